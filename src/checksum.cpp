@@ -0,0 +1,520 @@
+#include "checksum.hpp"
+#include "crc32.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define SCFT_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define SCFT_CRC32C_ARM 1
+#endif
+
+namespace scft
+{
+    namespace checksum
+    {
+        /**
+         * @brief Build the reflected CRC32C lookup table
+         * @return Table with 0x82F63B78 as polynomial
+        */
+        static constexpr std::array<std::uint32_t, 256> make_crc32c_table()
+        {
+            std::array<std::uint32_t, 256> table{};
+            for (std::uint32_t index = 0; index < 256; index++)
+            {
+                std::uint32_t crc = index;
+                for (int bit_index = 0; bit_index < 8; bit_index++)
+                    crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+                table[index] = crc;
+            }
+            return table;
+        }
+
+        /**
+         * @brief CRC32C lookup table, software fallback
+        */
+        static constexpr std::array<std::uint32_t, 256> crc32c_table = make_crc32c_table();
+
+        /**
+         * @brief Software CRC32C
+         * @param data Buffer
+         * @param size Buffer size
+         * @param crc Previous state
+         * @return State
+        */
+        static std::uint32_t crc32c_software(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+        {
+            while (size-- != 0)
+                crc = (crc >> 8) ^ crc32c_table[(crc ^ *data++) & 0xFF];
+            return crc;
+        }
+
+    #if defined(SCFT_CRC32C_SSE42)
+        /**
+         * @brief SSE4.2 CRC32C, 8 bytes per instruction
+         * @param data Buffer
+         * @param size Buffer size
+         * @param crc Previous state
+         * @return State
+        */
+        __attribute__((target("sse4.2")))
+        static std::uint32_t crc32c_hardware(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+        {
+        #if defined(__x86_64__)
+            std::uint64_t crc64 = crc;
+            for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t), data += sizeof(std::uint64_t))
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data, sizeof(word));
+                crc64 = _mm_crc32_u64(crc64, word);
+            }
+            crc = static_cast<std::uint32_t>(crc64);
+        #endif
+            for (; size >= sizeof(std::uint32_t); size -= sizeof(std::uint32_t), data += sizeof(std::uint32_t))
+            {
+                std::uint32_t word;
+                std::memcpy(&word, data, sizeof(word));
+                crc = _mm_crc32_u32(crc, word);
+            }
+            while (size-- != 0)
+                crc = _mm_crc32_u8(crc, *data++);
+            return crc;
+        }
+
+        bool has_hardware_crc32c()
+        {
+            static const bool supported = __builtin_cpu_supports("sse4.2");
+            return supported;
+        }
+    #elif defined(SCFT_CRC32C_ARM)
+        /**
+         * @brief ARMv8 CRC32C, 8 bytes per instruction
+         * @param data Buffer
+         * @param size Buffer size
+         * @param crc Previous state
+         * @return State
+        */
+        static std::uint32_t crc32c_hardware(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+        {
+            for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t), data += sizeof(std::uint64_t))
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data, sizeof(word));
+                crc = __crc32cd(crc, word);
+            }
+            while (size-- != 0)
+                crc = __crc32cb(crc, *data++);
+            return crc;
+        }
+
+        bool has_hardware_crc32c()
+        {
+            return true;
+        }
+    #else
+        bool has_hardware_crc32c()
+        {
+            return false;
+        }
+    #endif
+
+        std::uint32_t get_crc32c(const void* buffer, std::size_t size, std::uint32_t crc)
+        {
+            const std::uint8_t* data = static_cast<const std::uint8_t*>(buffer);
+        #if defined(SCFT_CRC32C_SSE42) || defined(SCFT_CRC32C_ARM)
+            if (has_hardware_crc32c())
+                return crc32c_hardware(data, size, crc);
+        #endif
+            return crc32c_software(data, size, crc);
+        }
+
+        const char* get_name(ALGORITHM algorithm)
+        {
+            switch (algorithm)
+            {
+                case CRC32: return "crc32";
+                case CRC32C: return "crc32c";
+                case XXH3_64: return "xxh3-64";
+                case NONE: return "none";
+            }
+            return "unknown";
+        }
+
+        bool parse_name(const std::string& name, ALGORITHM& algorithm)
+        {
+            for (std::uint8_t index = 0; index <= LAST_ALGORITHM; index++)
+            {
+                if (name == get_name(static_cast<ALGORITHM>(index)))
+                {
+                    algorithm = static_cast<ALGORITHM>(index);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::uint32_t parse_names(const std::string& names)
+        {
+            std::uint32_t algorithms = 0;
+            std::stringstream stream(names);
+            std::string name;
+            while (std::getline(stream, name, ','))
+            {
+                ALGORITHM algorithm;
+                if (!parse_name(name, algorithm))
+                    throw std::runtime_error("Unknown checksum " + name);
+                algorithms |= bit(algorithm);
+            }
+            return algorithms;
+        }
+
+        /* XXH3, scalar version of the reference implementation for seed 0 and the default secret */
+
+        constexpr std::uint64_t PRIME32_1 = 0x9E3779B1U;
+        constexpr std::uint64_t PRIME32_2 = 0x85EBCA77U;
+        constexpr std::uint64_t PRIME32_3 = 0xC2B2AE3DU;
+        constexpr std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+        constexpr std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr std::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+        constexpr std::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr std::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+        constexpr std::uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+        constexpr std::uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+        constexpr std::size_t STRIPE_LEN = 64;
+        constexpr std::size_t SECRET_CONSUME_RATE = 8;
+        constexpr std::size_t STRIPES_PER_BLOCK = (XXH3_SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE;
+        constexpr std::size_t BLOCK_LEN = STRIPE_LEN * STRIPES_PER_BLOCK;
+        constexpr std::size_t MIDSIZE_MAX = 240;
+
+        /**
+         * @brief Default secret
+        */
+        alignas(64) static const std::uint8_t xxh3_secret[XXH3_SECRET_SIZE] =
+        {
+            0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+            0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+            0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+            0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+            0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+            0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+            0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+            0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+            0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+            0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+            0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+            0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+        };
+
+        static inline std::uint32_t read32(const std::uint8_t* data)
+        {
+            std::uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        static inline std::uint64_t read64(const std::uint8_t* data)
+        {
+            std::uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        static inline std::uint64_t rotl64(std::uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static inline std::uint64_t mul128_fold64(std::uint64_t lhs, std::uint64_t rhs)
+        {
+        #if defined(__SIZEOF_INT128__)
+            unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+            return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+        #else
+            std::uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+            std::uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+            std::uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+            std::uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+            std::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+            std::uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+            std::uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+            return lower ^ upper;
+        #endif
+        }
+
+        static inline std::uint64_t xxh64_avalanche(std::uint64_t hash)
+        {
+            hash ^= hash >> 33;
+            hash *= PRIME64_2;
+            hash ^= hash >> 29;
+            hash *= PRIME64_3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        static inline std::uint64_t xxh3_avalanche(std::uint64_t hash)
+        {
+            hash ^= hash >> 37;
+            hash *= PRIME_MX1;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        static inline std::uint64_t rrmxmx(std::uint64_t hash, std::uint64_t length)
+        {
+            hash ^= rotl64(hash, 49) ^ rotl64(hash, 24);
+            hash *= PRIME_MX2;
+            hash ^= (hash >> 35) + length;
+            hash *= PRIME_MX2;
+            return hash ^ (hash >> 28);
+        }
+
+        static inline std::uint64_t mix16(const std::uint8_t* input, const std::uint8_t* secret)
+        {
+            return mul128_fold64(read64(input) ^ read64(secret), read64(input + 8) ^ read64(secret + 8));
+        }
+
+        static std::uint64_t xxh3_short(const std::uint8_t* input, std::size_t length)
+        {
+            const std::uint8_t* secret = xxh3_secret;
+            if (length > 128)
+            {
+                std::uint64_t acc = length * PRIME64_1;
+                std::size_t rounds = length / 16;
+                for (std::size_t index = 0; index < 8; index++)
+                    acc += mix16(input + 16 * index, secret + 16 * index);
+                acc = xxh3_avalanche(acc);
+                for (std::size_t index = 8; index < rounds; index++)
+                    acc += mix16(input + 16 * index, secret + 16 * (index - 8) + 3);
+                acc += mix16(input + length - 16, secret + 136 - 17);
+                return xxh3_avalanche(acc);
+            }
+            if (length > 16)
+            {
+                std::uint64_t acc = length * PRIME64_1;
+                if (length > 32)
+                {
+                    if (length > 64)
+                    {
+                        if (length > 96)
+                        {
+                            acc += mix16(input + 48, secret + 96);
+                            acc += mix16(input + length - 64, secret + 112);
+                        }
+                        acc += mix16(input + 32, secret + 64);
+                        acc += mix16(input + length - 48, secret + 80);
+                    }
+                    acc += mix16(input + 16, secret + 32);
+                    acc += mix16(input + length - 32, secret + 48);
+                }
+                acc += mix16(input, secret);
+                acc += mix16(input + length - 16, secret + 16);
+                return xxh3_avalanche(acc);
+            }
+            if (length > 8)
+            {
+                std::uint64_t input_lo = read64(input) ^ (read64(secret + 24) ^ read64(secret + 32));
+                std::uint64_t input_hi = read64(input + length - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+                std::uint64_t acc = length + __builtin_bswap64(input_lo) + input_hi + mul128_fold64(input_lo, input_hi);
+                return xxh3_avalanche(acc);
+            }
+            if (length >= 4)
+            {
+                std::uint64_t input64 = read32(input + length - 4) + (static_cast<std::uint64_t>(read32(input)) << 32);
+                return rrmxmx(input64 ^ (read64(secret + 8) ^ read64(secret + 16)), length);
+            }
+            if (length > 0)
+            {
+                std::uint32_t combined = (static_cast<std::uint32_t>(input[0]) << 16) | (static_cast<std::uint32_t>(input[length >> 1]) << 24)
+                    | input[length - 1] | (static_cast<std::uint32_t>(length) << 8);
+                return xxh64_avalanche(combined ^ static_cast<std::uint64_t>(read32(secret) ^ read32(secret + 4)));
+            }
+            return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+        }
+
+        static inline void accumulate_512(std::uint64_t* acc, const std::uint8_t* input, const std::uint8_t* secret)
+        {
+            for (std::size_t index = 0; index < 8; index++)
+            {
+                std::uint64_t data_val = read64(input + 8 * index);
+                std::uint64_t data_key = data_val ^ read64(secret + 8 * index);
+                acc[index ^ 1] += data_val;
+                acc[index] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+            }
+        }
+
+        static inline void accumulate(std::uint64_t* acc, const std::uint8_t* input, const std::uint8_t* secret, std::size_t stripes)
+        {
+            for (std::size_t index = 0; index < stripes; index++)
+                accumulate_512(acc, input + index * STRIPE_LEN, secret + index * SECRET_CONSUME_RATE);
+        }
+
+        static inline void scramble(std::uint64_t* acc, const std::uint8_t* secret)
+        {
+            for (std::size_t index = 0; index < 8; index++)
+            {
+                std::uint64_t acc64 = acc[index];
+                acc64 ^= acc64 >> 47;
+                acc64 ^= read64(secret + 8 * index);
+                acc[index] = acc64 * PRIME32_1;
+            }
+        }
+
+        static std::uint64_t merge(const std::uint64_t* acc, std::uint64_t length)
+        {
+            std::uint64_t result = length * PRIME64_1;
+            for (std::size_t index = 0; index < 4; index++)
+                result += mul128_fold64(acc[2 * index] ^ read64(xxh3_secret + 11 + 16 * index),
+                    acc[2 * index + 1] ^ read64(xxh3_secret + 11 + 16 * index + 8));
+            return xxh3_avalanche(result);
+        }
+
+        static const std::array<std::uint64_t, 8> xxh3_initial_acc =
+            {{PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1}};
+
+        std::uint64_t get_xxh3_64(const void* buffer, std::size_t size)
+        {
+            const std::uint8_t* input = static_cast<const std::uint8_t*>(buffer);
+            if (size <= MIDSIZE_MAX)
+                return xxh3_short(input, size);
+            std::array<std::uint64_t, 8> acc = xxh3_initial_acc;
+            std::size_t blocks = (size - 1) / BLOCK_LEN;
+            for (std::size_t index = 0; index < blocks; index++)
+            {
+                accumulate(acc.data(), input + index * BLOCK_LEN, xxh3_secret, STRIPES_PER_BLOCK);
+                scramble(acc.data(), xxh3_secret + XXH3_SECRET_SIZE - STRIPE_LEN);
+            }
+            std::size_t stripes = ((size - 1) - BLOCK_LEN * blocks) / STRIPE_LEN;
+            accumulate(acc.data(), input + blocks * BLOCK_LEN, xxh3_secret, stripes);
+            accumulate_512(acc.data(), input + size - STRIPE_LEN, xxh3_secret + XXH3_SECRET_SIZE - STRIPE_LEN - 7);
+            return merge(acc.data(), size);
+        }
+
+        hasher::hasher(ALGORITHM algorithm)
+        :
+        m_algorithm(algorithm),
+        m_crc(~0),
+        m_acc(xxh3_initial_acc),
+        m_buffered(0),
+        m_stripes(0),
+        m_total(0)
+        {
+        }
+
+        hasher::~hasher()
+        {
+        }
+
+        void hasher::xxh3_consume(const std::uint8_t* input, std::size_t stripes)
+        {
+            if (STRIPES_PER_BLOCK - m_stripes <= stripes)
+            {
+                std::size_t to_end = STRIPES_PER_BLOCK - m_stripes;
+                accumulate(m_acc.data(), input, xxh3_secret + m_stripes * SECRET_CONSUME_RATE, to_end);
+                scramble(m_acc.data(), xxh3_secret + XXH3_SECRET_SIZE - STRIPE_LEN);
+                accumulate(m_acc.data(), input + to_end * STRIPE_LEN, xxh3_secret, stripes - to_end);
+                m_stripes = stripes - to_end;
+            }
+            else
+            {
+                accumulate(m_acc.data(), input, xxh3_secret + m_stripes * SECRET_CONSUME_RATE, stripes);
+                m_stripes += stripes;
+            }
+        }
+
+        void hasher::update(const void* buffer, std::size_t size)
+        {
+            const std::uint8_t* input = static_cast<const std::uint8_t*>(buffer);
+            switch (m_algorithm)
+            {
+                case CRC32:
+                    m_crc = crc32::get_crc32(input, size, m_crc);
+                    return;
+                case CRC32C:
+                    m_crc = get_crc32c(input, size, m_crc);
+                    return;
+                case NONE:
+                    return;
+                case XXH3_64:
+                    break;
+            }
+
+            // Always keep some input buffered, digest() needs the last stripe
+            m_total += size;
+            if (size <= XXH3_BUFFER_SIZE - m_buffered)
+            {
+                std::memcpy(m_buffer.data() + m_buffered, input, size);
+                m_buffered += size;
+                return;
+            }
+            const std::uint8_t* end = input + size;
+            if (m_buffered != 0)
+            {
+                std::size_t load = XXH3_BUFFER_SIZE - m_buffered;
+                std::memcpy(m_buffer.data() + m_buffered, input, load);
+                input += load;
+                xxh3_consume(m_buffer.data(), XXH3_BUFFER_SIZE / STRIPE_LEN);
+                m_buffered = 0;
+            }
+            if (static_cast<std::size_t>(end - input) > XXH3_BUFFER_SIZE)
+            {
+                const std::uint8_t* limit = end - XXH3_BUFFER_SIZE;
+                do
+                {
+                    xxh3_consume(input, XXH3_BUFFER_SIZE / STRIPE_LEN);
+                    input += XXH3_BUFFER_SIZE;
+                } while (input < limit);
+                std::memcpy(m_buffer.data() + XXH3_BUFFER_SIZE - STRIPE_LEN, input - STRIPE_LEN, STRIPE_LEN);
+            }
+            m_buffered = end - input;
+            std::memcpy(m_buffer.data(), input, m_buffered);
+        }
+
+        std::uint64_t hasher::digest() const
+        {
+            switch (m_algorithm)
+            {
+                case CRC32:
+                    return m_crc;
+                case CRC32C:
+                    return ~m_crc;
+                case NONE:
+                    return 0;
+                case XXH3_64:
+                    break;
+            }
+
+            if (m_total <= MIDSIZE_MAX)
+                return xxh3_short(m_buffer.data(), static_cast<std::size_t>(m_total));
+            std::array<std::uint64_t, 8> acc = m_acc;
+            const std::uint8_t* last_secret = xxh3_secret + XXH3_SECRET_SIZE - STRIPE_LEN - 7;
+            if (m_buffered >= STRIPE_LEN)
+            {
+                std::size_t stripes = (m_buffered - 1) / STRIPE_LEN;
+                std::size_t consumed = m_stripes;
+                if (STRIPES_PER_BLOCK - consumed <= stripes)
+                {
+                    std::size_t to_end = STRIPES_PER_BLOCK - consumed;
+                    accumulate(acc.data(), m_buffer.data(), xxh3_secret + consumed * SECRET_CONSUME_RATE, to_end);
+                    scramble(acc.data(), xxh3_secret + XXH3_SECRET_SIZE - STRIPE_LEN);
+                    accumulate(acc.data(), m_buffer.data() + to_end * STRIPE_LEN, xxh3_secret, stripes - to_end);
+                }
+                else
+                    accumulate(acc.data(), m_buffer.data(), xxh3_secret + consumed * SECRET_CONSUME_RATE, stripes);
+                accumulate_512(acc.data(), m_buffer.data() + m_buffered - STRIPE_LEN, last_secret);
+            }
+            else
+            {
+                std::uint8_t last_stripe[STRIPE_LEN];
+                std::size_t catchup = STRIPE_LEN - m_buffered;
+                std::memcpy(last_stripe, m_buffer.data() + XXH3_BUFFER_SIZE - catchup, catchup);
+                std::memcpy(last_stripe + catchup, m_buffer.data(), m_buffered);
+                accumulate_512(acc.data(), last_stripe, last_secret);
+            }
+            return merge(acc.data(), m_total);
+        }
+    }
+}
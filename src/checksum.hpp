@@ -0,0 +1,179 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+/**
+ * @file src/checksum.hpp
+ * @brief Defines checksum namespace, frame checksum algorithms behind one incremental hasher
+*/
+
+#include <cstdint>
+
+#include <array>
+#include <string>
+
+namespace scft
+{
+    /**
+     * @brief Frame checksums
+    */
+    namespace checksum
+    {
+        /**
+         * @brief Algorithm identifier, carried by version 2 headers
+        */
+        typedef enum _ALGORITHM : std::uint8_t
+        {
+            CRC32 = 0,      //!< Software CRC32 (0xEDB88320), unfinalized, the only one version 1 headers carry
+            CRC32C = 1,     //!< CRC32C (0x82F63B78), SSE4.2 or ARMv8 instruction when available
+            XXH3_64 = 2,    //!< XXH3 64 bits, seed 0 and default secret
+            NONE = 3        //!< No checksum, for trusted links
+        }ALGORITHM;
+
+        /**
+         * @brief Highest known identifier
+        */
+        constexpr ALGORITHM LAST_ALGORITHM = NONE;
+
+        /**
+         * @brief Bit of an algorithm in a set of algorithms
+         * @param algorithm Algorithm
+         * @return Mask
+        */
+        constexpr std::uint32_t bit(ALGORITHM algorithm) { return std::uint32_t(1) << algorithm; }
+
+        /**
+         * @brief Get algorithm name
+         * @param algorithm Algorithm
+         * @return "crc32", "crc32c", "xxh3-64" or "none"
+        */
+        const char* get_name(ALGORITHM algorithm);
+
+        /**
+         * @brief Parse algorithm name
+         * @param name Name from get_name()
+         * @param algorithm Parsed algorithm
+         * @return False if unknown
+        */
+        bool parse_name(const std::string& name, ALGORITHM& algorithm);
+
+        /**
+         * @brief Parse comma separated algorithm names, throws std::runtime_error on unknown names
+         * @param names Names from get_name()
+         * @return Set of bit()
+        */
+        std::uint32_t parse_names(const std::string& names);
+
+        /**
+         * @brief Check for the CRC32C instruction
+         * @return True if CRC32C runs in hardware
+        */
+        bool has_hardware_crc32c();
+
+        /**
+         * @brief CRC32C of a buffer, unfinalized so calls can be chained
+         * @param buffer Buffer
+         * @param size Buffer size
+         * @param crc Previous state
+         * @return State
+        */
+        std::uint32_t get_crc32c(const void* buffer, std::size_t size, std::uint32_t crc = ~0);
+
+        /**
+         * @brief XXH3 64 bits of a whole buffer
+         * @param buffer Buffer
+         * @param size Buffer size
+         * @return Hash
+        */
+        std::uint64_t get_xxh3_64(const void* buffer, std::size_t size);
+
+        /**
+         * @brief Size of the XXH3 secret
+        */
+        constexpr std::size_t XXH3_SECRET_SIZE = 192;
+
+        /**
+         * @brief Input kept by the XXH3 streaming state
+        */
+        constexpr std::size_t XXH3_BUFFER_SIZE = 256;
+
+        /**
+         * @brief Incremental checksum, copyable
+        */
+        class hasher
+        {
+            /**
+             * @brief Start a checksum
+             * @param algorithm Algorithm
+            */
+            public: hasher(ALGORITHM algorithm = CRC32);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~hasher();
+
+            /**
+             * @brief Add data
+             * @param buffer Buffer
+             * @param size Buffer size
+            */
+            public: void update(const void* buffer, std::size_t size);
+
+            /**
+             * @brief Checksum of the data added so far, more data may be added after
+             * @return 32 bit algorithms use the low half, 0 for NONE
+            */
+            public: std::uint64_t digest() const;
+
+            /**
+             * @brief Get algorithm
+             * @return Algorithm
+            */
+            public: ALGORITHM get_algorithm() const { return m_algorithm; }
+
+            /**
+             * @brief Feed XXH3 stripes, switching to the next block when needed
+             * @param input Stripes
+             * @param stripes Stripe count
+            */
+            private: void xxh3_consume(const std::uint8_t* input, std::size_t stripes);
+
+            /**
+             * @brief Algorithm
+            */
+            private: ALGORITHM m_algorithm;
+
+            /**
+             * @brief CRC state
+            */
+            private: std::uint32_t m_crc;
+
+            /**
+             * @brief XXH3 accumulators
+            */
+            private: std::array<std::uint64_t, 8> m_acc;
+
+            /**
+             * @brief XXH3 pending input, its last stripe is kept once consumed
+            */
+            private: std::array<std::uint8_t, XXH3_BUFFER_SIZE> m_buffer;
+
+            /**
+             * @brief XXH3 pending input length
+            */
+            private: std::size_t m_buffered;
+
+            /**
+             * @brief XXH3 stripes consumed in the current block
+            */
+            private: std::size_t m_stripes;
+
+            /**
+             * @brief XXH3 input length
+            */
+            private: std::uint64_t m_total;
+        };
+    }
+}
+
+#endif /* CHECKSUM_HPP */
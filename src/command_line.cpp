@@ -0,0 +1,97 @@
+#include "command_line.hpp"
+
+#include <cctype>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace scft
+{
+    namespace command_line
+    {
+        arguments::arguments(int argc, char* argv[], const std::vector<std::string>& value_less)
+        {
+            for (int index = 1; index < argc; index++)
+            {
+                std::string arg = argv[index];
+                if (arg.size() < 3 || arg.compare(0, 2, "--") != 0)
+                    throw std::runtime_error("Unexpected argument: " + arg);
+                arg.erase(0, 2);
+
+                std::size_t equal_pos = arg.find('=');
+                if (equal_pos != std::string::npos)
+                {
+                    m_values[arg.substr(0, equal_pos)] = arg.substr(equal_pos + 1);
+                }
+                else if (std::find(value_less.begin(), value_less.end(), arg) != value_less.end())
+                {
+                    m_values[arg] = "";
+                }
+                else
+                {
+                    if (index + 1 >= argc)
+                        throw std::runtime_error("Missing value for --" + arg);
+                    m_values[arg] = argv[++index];
+                }
+            }
+        }
+
+        arguments::~arguments()
+        {
+        }
+
+        bool arguments::has(const std::string& name) const
+        {
+            return m_values.find(name) != m_values.end();
+        }
+
+        std::string arguments::get(const std::string& name, const std::string& fallback) const
+        {
+            std::unordered_map<std::string, std::string>::const_iterator value = m_values.find(name);
+            if (value == m_values.end())
+                return fallback;
+            return value->second;
+        }
+
+        std::uint64_t arguments::get_uint(const std::string& name, std::uint64_t fallback) const
+        {
+            std::unordered_map<std::string, std::string>::const_iterator value = m_values.find(name);
+            if (value == m_values.end())
+                return fallback;
+            if (value->second.empty() || !std::all_of(value->second.begin(), value->second.end(), ::isdigit))
+                throw std::runtime_error("--" + name + " expects a number");
+            return std::stoull(value->second);
+        }
+
+        double arguments::get_double(const std::string& name, double fallback) const
+        {
+            std::unordered_map<std::string, std::string>::const_iterator value = m_values.find(name);
+            if (value == m_values.end())
+                return fallback;
+            std::size_t parsed = 0;
+            double number = 0;
+            try
+            {
+                number = std::stod(value->second, &parsed);
+            }
+            catch (std::exception&)
+            {
+                parsed = 0;
+            }
+            if (parsed == 0 || parsed != value->second.size())
+                throw std::runtime_error("--" + name + " expects a number");
+            return number;
+        }
+
+        std::vector<std::string> arguments::unknown(const std::vector<std::string>& known) const
+        {
+            std::vector<std::string> unknown_flags;
+            for (const std::pair<const std::string, std::string>& value : m_values)
+            {
+                if (std::find(known.begin(), known.end(), value.first) == known.end())
+                    unknown_flags.push_back(value.first);
+            }
+            return unknown_flags;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef COMMAND_LINE_HPP
+#define COMMAND_LINE_HPP
+
+/**
+ * @file src/command_line.hpp
+ * @brief Defines command_line, to parse program flags
+*/
+
+#include <cstdint>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace scft
+{
+    /**
+     * @brief Program flags helper
+    */
+    namespace command_line
+    {
+        /**
+         * @brief Parsed --key value / --key=value / --flag arguments
+        */
+        class arguments
+        {
+            /**
+             * @brief Parse arguments, throws std::runtime_error on positional arguments
+             * @param argc Argument count from main
+             * @param argv Argument vector from main
+             * @param value_less Flags that never take a value (e.g. --headless)
+            */
+            public: arguments(int argc, char* argv[], const std::vector<std::string>& value_less);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~arguments();
+
+            /**
+             * @brief Check if flag was given
+             * @param name Flag name without leading dashes
+             * @return True if present
+            */
+            public: bool has(const std::string& name) const;
+
+            /**
+             * @brief Get flag value
+             * @param name Flag name without leading dashes
+             * @param fallback Returned if the flag is absent
+             * @return Flag value
+            */
+            public: std::string get(const std::string& name, const std::string& fallback = "") const;
+
+            /**
+             * @brief Get flag value as unsigned integer, throws std::runtime_error if not a number
+             * @param name Flag name without leading dashes
+             * @param fallback Returned if the flag is absent
+             * @return Flag value
+            */
+            public: std::uint64_t get_uint(const std::string& name, std::uint64_t fallback) const;
+
+            /**
+             * @brief Get flag value as floating point number, throws std::runtime_error if not a number
+             * @param name Flag name without leading dashes
+             * @param fallback Returned if the flag is absent
+             * @return Flag value
+            */
+            public: double get_double(const std::string& name, double fallback) const;
+
+            /**
+             * @brief Flags that were given but are not in known
+             * @param known Accepted flag names
+             * @return Unknown flag names
+            */
+            public: std::vector<std::string> unknown(const std::vector<std::string>& known) const;
+
+            /**
+             * @brief Flag name to value (empty for value-less flags)
+            */
+            private: std::unordered_map<std::string, std::string> m_values;
+        };
+    }
+}
+
+#endif /* COMMAND_LINE_HPP */
@@ -0,0 +1,493 @@
+#include "delta.hpp"
+#include "checksum.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <utility>
+
+namespace scft
+{
+    namespace delta
+    {
+        namespace
+        {
+            /**
+             * @brief Contents read at once by a thread 4M
+            */
+            constexpr std::size_t READ_SIZE = 4194304;
+
+            /**
+             * @brief Bytes moved at once within a file being rebuilt 1M
+            */
+            constexpr std::size_t MOVE_SIZE = 1048576;
+
+            /**
+             * @brief Threads for some contents
+             * @param length Contents length
+             * @return Between 1 and MAX_THREADS
+            */
+            unsigned thread_count(std::uint64_t length)
+            {
+                unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+                std::uint64_t spans = std::max<std::uint64_t>(1, length / MIN_THREAD_SPAN);
+                return static_cast<unsigned>(std::min<std::uint64_t>({MAX_THREADS, hardware, spans}));
+            }
+
+            /**
+             * @brief Run work for each part, the last one on the calling thread
+             * @param parts Parts
+             * @param work Called with the part index
+            */
+            template <typename Work>
+            void run_parallel(unsigned parts, Work work)
+            {
+                std::vector<std::thread> threads;
+                for (unsigned part = 0; part + 1 < parts; part++)
+                    threads.emplace_back(work, part);
+                work(parts - 1);
+                for (std::thread& thread : threads)
+                    thread.join();
+            }
+
+            /**
+             * @brief Tag of a weak checksum, rules most of them out before searching
+             * @param weak Weak checksum
+             * @return 16 bits
+            */
+            std::uint16_t get_tag(std::uint32_t weak)
+            {
+                return static_cast<std::uint16_t>(weak ^ (weak >> 16));
+            }
+
+            /**
+             * @brief Append an operation, merging it with the last one when they are contiguous
+             * @param ops Operations
+             * @param _op Operation
+            */
+            void append_op(std::vector<op>& ops, const op& _op)
+            {
+                if (!ops.empty() && ops.back().copy == _op.copy && ops.back().offset + ops.back().length == _op.offset)
+                    ops.back().length += _op.length;
+                else
+                    ops.push_back(_op);
+            }
+
+            /**
+             * @brief Blocks of the receiver's copy sorted by weak checksum
+            */
+            struct block_index
+            {
+                std::vector<std::pair<std::uint32_t, std::uint32_t>> blocks; //!< Weak checksum and block
+                std::vector<bool> tags;                                      //!< Tags of the weak checksums
+            };
+
+            /**
+             * @brief Encode part of the new contents
+             * @param _source New contents
+             * @param _signatures Signatures of the receiver's copy
+             * @param index Blocks by weak checksum
+             * @param begin First byte
+             * @param end Past the last byte
+             * @param ops Operations
+             * @return False if the source could not be read
+            */
+            bool encode_segment(const source& _source, const signatures& _signatures, const block_index& index,
+                std::uint64_t begin, std::uint64_t end, std::vector<op>& ops)
+            {
+                const std::uint64_t block_size = _signatures.block_size;
+                reader _reader(_source);
+                std::vector<std::uint8_t> buffer(std::max<std::size_t>(READ_SIZE, 2 * block_size));
+                std::uint64_t buffer_start = begin;
+                std::size_t buffer_len = 0;
+                // Keeps [from, to) in the buffer, from never goes back
+                auto ensure = [&](std::uint64_t from, std::uint64_t to)
+                {
+                    if (to <= buffer_start + buffer_len)
+                        return true;
+                    std::size_t keep = from < buffer_start + buffer_len ? static_cast<std::size_t>(buffer_start + buffer_len - from) : 0;
+                    std::memmove(buffer.data(), buffer.data() + (buffer_len - keep), keep);
+                    buffer_start = from;
+                    std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size() - keep, end - from - keep));
+                    if (!_reader.read(from + keep, buffer.data() + keep, want))
+                        return false;
+                    buffer_len = keep + want;
+                    return true;
+                };
+
+                std::uint64_t position = begin;
+                std::uint64_t literal = begin;
+                bool rolling = false;
+                std::uint32_t a = 0;
+                std::uint32_t b = 0;
+                while (position + block_size <= end)
+                {
+                    if (!ensure(position, position + block_size))
+                        return false;
+                    const std::uint8_t* window = buffer.data() + (position - buffer_start);
+                    std::uint32_t weak = rolling ? (a & 0xffff) | (b << 16) : weak_checksum(window, block_size, a, b);
+                    rolling = true;
+                    // Blocks before the position were already rebuilt over, the one at the position costs the receiver nothing
+                    std::uint64_t match = UINT64_MAX;
+                    if (index.tags[get_tag(weak)])
+                    {
+                        std::vector<std::pair<std::uint32_t, std::uint32_t>>::const_iterator candidate =
+                            std::lower_bound(index.blocks.begin(), index.blocks.end(), std::make_pair(weak, std::uint32_t(0)));
+                        bool hashed = false;
+                        std::uint64_t strong = 0;
+                        for (; candidate != index.blocks.end() && candidate->first == weak; ++candidate)
+                        {
+                            std::uint64_t offset = static_cast<std::uint64_t>(candidate->second) * block_size;
+                            if (offset < position || (match != UINT64_MAX && offset != position))
+                                continue;
+                            if (!hashed)
+                            {
+                                strong = checksum::get_xxh3_64(window, static_cast<std::size_t>(block_size));
+                                hashed = true;
+                            }
+                            if (_signatures.blocks[candidate->second].strong != strong)
+                                continue;
+                            match = offset;
+                            if (offset == position)
+                                break;
+                        }
+                    }
+                    if (match != UINT64_MAX)
+                    {
+                        if (position != literal)
+                            append_op(ops, op{false, literal, position - literal});
+                        append_op(ops, op{true, match, block_size});
+                        position += block_size;
+                        literal = position;
+                        rolling = false;
+                        continue;
+                    }
+                    if (position + block_size == end)
+                        break;
+                    if (!ensure(position, position + block_size + 1))
+                        return false;
+                    window = buffer.data() + (position - buffer_start);
+                    std::uint32_t out = window[0];
+                    a += window[block_size] - out;
+                    b += a - static_cast<std::uint32_t>(block_size) * out;
+                    position++;
+                }
+                if (end != literal)
+                    append_op(ops, op{false, literal, end - literal});
+                return true;
+            }
+        }
+
+        std::uint32_t choose_block_size(std::uint64_t length)
+        {
+            std::uint32_t block_size = MIN_BLOCK_SIZE;
+            while (block_size < MAX_BLOCK_SIZE && static_cast<std::uint64_t>(block_size) * block_size < length)
+                block_size <<= 1;
+            return block_size;
+        }
+
+        std::uint32_t weak_checksum(const std::uint8_t* data, std::size_t length, std::uint32_t& a, std::uint32_t& b)
+        {
+            a = 0;
+            b = 0;
+            for (std::size_t index = 0; index < length; index++)
+            {
+                a += data[index];
+                b += static_cast<std::uint32_t>(length - index) * data[index];
+            }
+            return (a & 0xffff) | (b << 16);
+        }
+
+        reader::reader(const source& _source)
+        :
+        m_source(_source)
+        {
+            if (!m_source.path.empty())
+                m_file.open(m_source.path, std::ios::in | std::ios::binary);
+        }
+
+        reader::~reader()
+        {
+        }
+
+        bool reader::read(std::uint64_t offset, std::uint8_t* out, std::size_t length)
+        {
+            if (offset > m_source.length || length > m_source.length - offset)
+                return false;
+            if (m_source.path.empty())
+            {
+                std::memcpy(out, m_source.data + offset, length);
+                return true;
+            }
+            m_file.seekg(static_cast<std::streamoff>(offset));
+            m_file.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(length));
+            return static_cast<bool>(m_file);
+        }
+
+        signatures compute_signatures(const std::string& path)
+        {
+            signatures _signatures;
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(path, ec))
+                return _signatures;
+            std::uint64_t length = std::filesystem::file_size(path, ec);
+            if (ec)
+                return _signatures;
+            std::uint32_t block_size = choose_block_size(length);
+            std::vector<block_signature> blocks(static_cast<std::size_t>(std::min<std::uint64_t>(length / block_size, MAX_BLOCKS)));
+
+            // Each thread streams through its own range of blocks
+            unsigned parts = thread_count(length);
+            std::size_t per_part = (blocks.size() + parts - 1) / parts;
+            std::size_t blocks_per_read = std::max<std::size_t>(1, READ_SIZE / block_size);
+            std::atomic<bool> failed(false);
+            source _source{path, nullptr, length};
+            run_parallel(parts,
+                [&](unsigned part)
+                {
+                    std::size_t first = std::min(blocks.size(), part * per_part);
+                    std::size_t last = std::min(blocks.size(), first + per_part);
+                    reader _reader(_source);
+                    std::vector<std::uint8_t> buffer(blocks_per_read * block_size);
+                    for (std::size_t block = first; block < last && !failed; block += blocks_per_read)
+                    {
+                        std::size_t count = std::min(blocks_per_read, last - block);
+                        if (!_reader.read(static_cast<std::uint64_t>(block) * block_size, buffer.data(), count * block_size))
+                        {
+                            failed = true;
+                            return;
+                        }
+                        for (std::size_t index = 0; index < count; index++)
+                        {
+                            const std::uint8_t* data = buffer.data() + index * block_size;
+                            std::uint32_t a;
+                            std::uint32_t b;
+                            blocks[block + index].weak = weak_checksum(data, block_size, a, b);
+                            blocks[block + index].strong = checksum::get_xxh3_64(data, block_size);
+                        }
+                    }
+                });
+            if (failed)
+                return _signatures;
+            _signatures.block_size = block_size;
+            _signatures.length = length;
+            _signatures.blocks = std::move(blocks);
+            return _signatures;
+        }
+
+        std::vector<std::uint8_t> write_signatures(const signatures& _signatures)
+        {
+            std::vector<std::uint8_t> data(SIGNATURES_HEADER_SIZE + _signatures.blocks.size() * SIGNATURE_SIZE);
+            std::memcpy(data.data(), &_signatures.block_size, 4);
+            std::memcpy(data.data() + 4, &_signatures.length, 8);
+            std::uint8_t* at = data.data() + SIGNATURES_HEADER_SIZE;
+            for (const block_signature& block : _signatures.blocks)
+            {
+                std::memcpy(at, &block.weak, 4);
+                std::memcpy(at + 4, &block.strong, 8);
+                at += SIGNATURE_SIZE;
+            }
+            return data;
+        }
+
+        bool read_signatures_header(const std::uint8_t* data, signatures& _signatures)
+        {
+            std::memcpy(&_signatures.block_size, data, 4);
+            std::memcpy(&_signatures.length, data + 4, 8);
+            std::uint32_t block_size = _signatures.block_size;
+            return block_size == 0 || (block_size >= MIN_BLOCK_SIZE && block_size <= MAX_BLOCK_SIZE && (block_size & (block_size - 1)) == 0);
+        }
+
+        std::uint64_t get_blocks_size(const signatures& _signatures)
+        {
+            if (_signatures.block_size == 0)
+                return 0;
+            return std::min<std::uint64_t>(_signatures.length / _signatures.block_size, MAX_BLOCKS) * SIGNATURE_SIZE;
+        }
+
+        void read_blocks(const std::uint8_t* data, signatures& _signatures)
+        {
+            _signatures.blocks.resize(static_cast<std::size_t>(get_blocks_size(_signatures) / SIGNATURE_SIZE));
+            for (block_signature& block : _signatures.blocks)
+            {
+                std::memcpy(&block.weak, data, 4);
+                std::memcpy(&block.strong, data + 4, 8);
+                data += SIGNATURE_SIZE;
+            }
+        }
+
+        bool encode(const source& _source, const signatures& _signatures, std::vector<op>& ops)
+        {
+            ops.clear();
+            if (_signatures.block_size == 0 || _signatures.blocks.empty())
+            {
+                if (_source.length != 0)
+                    ops.push_back(op{false, 0, _source.length});
+                return true;
+            }
+            block_index index;
+            index.blocks.reserve(_signatures.blocks.size());
+            index.tags.resize(65536);
+            for (std::size_t block = 0; block < _signatures.blocks.size(); block++)
+            {
+                index.blocks.emplace_back(_signatures.blocks[block].weak, static_cast<std::uint32_t>(block));
+                index.tags[get_tag(_signatures.blocks[block].weak)] = true;
+            }
+            std::sort(index.blocks.begin(), index.blocks.end());
+
+            // Segments start on block boundaries, an unchanged file matches every block in place
+            unsigned parts = thread_count(_source.length);
+            std::uint64_t span = (_source.length / parts + _signatures.block_size - 1) / _signatures.block_size * _signatures.block_size;
+            std::vector<std::vector<op>> segments(parts);
+            std::atomic<bool> failed(false);
+            run_parallel(parts,
+                [&](unsigned part)
+                {
+                    std::uint64_t begin = std::min(_source.length, part * span);
+                    std::uint64_t end = part + 1 == parts ? _source.length : std::min(_source.length, begin + span);
+                    if (begin != end && !encode_segment(_source, _signatures, index, begin, end, segments[part]))
+                        failed = true;
+                });
+            if (failed)
+                return false;
+            for (const std::vector<op>& segment : segments)
+            {
+                for (const op& _op : segment)
+                    append_op(ops, _op);
+            }
+            return true;
+        }
+
+        op_writer::op_writer(const source& _source, std::vector<op> ops)
+        :
+        m_reader(_source),
+        m_ops(std::move(ops)),
+        m_next(0),
+        m_done(0),
+        m_literal_bytes(0)
+        {
+        }
+
+        op_writer::~op_writer()
+        {
+        }
+
+        bool op_writer::next(std::vector<std::uint8_t>& out, std::size_t max)
+        {
+            out.clear();
+            while (m_next != m_ops.size())
+            {
+                const op& _op = m_ops[m_next];
+                std::size_t at = out.size();
+                if (_op.copy)
+                {
+                    if (at + COPY_OP_SIZE > max)
+                        break;
+                    out.resize(at + COPY_OP_SIZE);
+                    out[at] = OP_COPY;
+                    std::memcpy(out.data() + at + 1, &_op.offset, 8);
+                    std::memcpy(out.data() + at + 9, &_op.length, 8);
+                    m_next++;
+                    continue;
+                }
+                if (at + LITERAL_OP_HEADER_SIZE >= max)
+                    break;
+                std::uint32_t length = static_cast<std::uint32_t>(std::min<std::uint64_t>(max - at - LITERAL_OP_HEADER_SIZE, _op.length - m_done));
+                out.resize(at + LITERAL_OP_HEADER_SIZE + length);
+                out[at] = OP_LITERAL;
+                std::memcpy(out.data() + at + 1, &length, 4);
+                if (!m_reader.read(_op.offset + m_done, out.data() + at + LITERAL_OP_HEADER_SIZE, length))
+                    return false;
+                m_literal_bytes += length;
+                m_done += length;
+                if (m_done == _op.length)
+                {
+                    m_next++;
+                    m_done = 0;
+                }
+            }
+            return true;
+        }
+
+        patcher::patcher(const std::string& path, std::uint64_t copy_length, std::uint64_t length)
+        :
+        m_path(path),
+        m_copy_length(copy_length),
+        m_length(length),
+        m_position(0),
+        m_copied_bytes(0)
+        {
+            m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary);
+            if (!m_file.is_open())
+            {
+                std::ofstream(m_path, std::ios::out | std::ios::binary);
+                m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary);
+            }
+        }
+
+        patcher::~patcher()
+        {
+        }
+
+        bool patcher::apply(const std::uint8_t* data, std::size_t length)
+        {
+            const std::uint8_t* end = data + length;
+            while (data != end && m_file)
+            {
+                if (*data == OP_COPY && end - data >= static_cast<std::ptrdiff_t>(COPY_OP_SIZE))
+                {
+                    std::uint64_t offset;
+                    std::uint64_t count;
+                    std::memcpy(&offset, data + 1, 8);
+                    std::memcpy(&count, data + 9, 8);
+                    data += COPY_OP_SIZE;
+                    // Bytes before the position may have been rebuilt over already
+                    if (offset < m_position || count > m_copy_length || offset > m_copy_length - count || count > m_length - m_position)
+                        return false;
+                    for (std::uint64_t moved = 0; offset != m_position && moved < count;)
+                    {
+                        std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(MOVE_SIZE, count - moved));
+                        m_buffer.resize(chunk);
+                        m_file.seekg(static_cast<std::streamoff>(offset + moved));
+                        m_file.read(reinterpret_cast<char*>(m_buffer.data()), static_cast<std::streamsize>(chunk));
+                        m_file.seekp(static_cast<std::streamoff>(m_position + moved));
+                        m_file.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(chunk));
+                        if (!m_file)
+                            return false;
+                        moved += chunk;
+                    }
+                    m_position += count;
+                    m_copied_bytes += count;
+                }
+                else if (*data == OP_LITERAL && end - data >= static_cast<std::ptrdiff_t>(LITERAL_OP_HEADER_SIZE))
+                {
+                    std::uint32_t count;
+                    std::memcpy(&count, data + 1, 4);
+                    data += LITERAL_OP_HEADER_SIZE;
+                    if (count > static_cast<std::size_t>(end - data) || count > m_length - m_position)
+                        return false;
+                    m_file.seekp(static_cast<std::streamoff>(m_position));
+                    m_file.write(reinterpret_cast<const char*>(data), count);
+                    data += count;
+                    m_position += count;
+                }
+                else
+                    return false;
+            }
+            return static_cast<bool>(m_file);
+        }
+
+        bool patcher::finish()
+        {
+            m_file.close();
+            if (m_file.fail())
+                return false;
+            std::error_code ec;
+            if (std::filesystem::file_size(m_path, ec) != m_length && !ec)
+                std::filesystem::resize_file(m_path, m_length, ec);
+            return !ec;
+        }
+    }
+}
@@ -0,0 +1,380 @@
+#ifndef DELTA_HPP
+#define DELTA_HPP
+
+/**
+ * @file src/delta.hpp
+ * @brief Defines block signatures, delta encoding and in place patching of a file the receiver already has an older copy of
+*/
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace scft
+{
+    /**
+     * @brief Rsync style delta transfer
+     * @verbatim
+     * Signatures, every whole block of the receiver's copy, in order:
+     * [1111][22222222] then per block [3333][44444444]
+     * 1: Block size, 0 if the receiver has no copy 4 bytes
+     * 2: Length of the receiver's copy 8 bytes
+     * 3: Weak rolling checksum 4 bytes
+     * 4: XXH3 64 bits 8 bytes
+     * Operations, rebuilding the new contents from offset 0 on:
+     * [1][22222222][33333333] copy
+     * [1][4444][DATA...] literal
+     * 1: OP_COPY or OP_LITERAL 1 byte
+     * 2: Offset of the bytes in the receiver's copy, never before the offset they are copied to 8 bytes
+     * 3: Bytes copied 8 bytes
+     * 4: Data length 4 bytes
+     * Copies never read what earlier operations wrote, the receiver rebuilds its copy in place
+     * @endverbatim
+    */
+    namespace delta
+    {
+        /**
+         * @brief Smallest block size 2K
+        */
+        constexpr std::uint32_t MIN_BLOCK_SIZE = 2048;
+
+        /**
+         * @brief Largest block size 1M
+        */
+        constexpr std::uint32_t MAX_BLOCK_SIZE = 1048576;
+
+        /**
+         * @brief Most blocks signed, those after are sent as literals, 48M of signatures
+        */
+        constexpr std::uint64_t MAX_BLOCKS = 4194304;
+
+        /**
+         * @brief Size of the signatures header
+        */
+        constexpr std::size_t SIGNATURES_HEADER_SIZE = 12;
+
+        /**
+         * @brief Size of one block signature
+        */
+        constexpr std::size_t SIGNATURE_SIZE = 12;
+
+        /**
+         * @brief Most threads computing signatures or encoding
+        */
+        constexpr unsigned MAX_THREADS = 8;
+
+        /**
+         * @brief Least contents worth another thread 16M
+        */
+        constexpr std::uint64_t MIN_THREAD_SPAN = 16777216;
+
+        /**
+         * @brief Identifier of a copy operation
+        */
+        constexpr std::uint8_t OP_COPY = 1;
+
+        /**
+         * @brief Identifier of a literal operation
+        */
+        constexpr std::uint8_t OP_LITERAL = 2;
+
+        /**
+         * @brief Size of a copy operation
+        */
+        constexpr std::size_t COPY_OP_SIZE = 17;
+
+        /**
+         * @brief Size of a literal operation before its data
+        */
+        constexpr std::size_t LITERAL_OP_HEADER_SIZE = 5;
+
+        /**
+         * @brief Block size for a copy of some length, about its square root
+         * @param length Length of the copy
+         * @return Power of two between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+        */
+        std::uint32_t choose_block_size(std::uint64_t length);
+
+        /**
+         * @brief Weak checksum of a block, rolled one byte at a time
+         * @param data Block
+         * @param length Block length
+         * @param a Sum of the bytes
+         * @param b Sum of the bytes weighted by their distance to the end
+         * @return Checksum
+        */
+        std::uint32_t weak_checksum(const std::uint8_t* data, std::size_t length, std::uint32_t& a, std::uint32_t& b);
+
+        /**
+         * @brief Signature of one block
+        */
+        struct block_signature
+        {
+            std::uint32_t weak;                                 //!< Weak rolling checksum
+            std::uint64_t strong;                               //!< XXH3 64 bits
+        };
+
+        /**
+         * @brief Signatures of a copy
+        */
+        struct signatures
+        {
+            std::uint32_t block_size = 0;                       //!< Block size, 0 without a copy
+            std::uint64_t length = 0;                           //!< Length of the copy
+            std::vector<block_signature> blocks;                //!< Whole blocks, in order
+        };
+
+        /**
+         * @brief Contents to read, a file or a buffer
+        */
+        struct source
+        {
+            std::string path;                                   //!< File, empty for the buffer
+            const std::uint8_t* data = nullptr;                 //!< Buffer, must outlive every reader
+            std::uint64_t length = 0;                           //!< Contents length
+        };
+
+        /**
+         * @brief Reads a source, each thread uses its own
+        */
+        class reader
+        {
+            /**
+             * @brief Open the file of a source
+             * @param _source Source
+            */
+            public: reader(const source& _source);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~reader();
+
+            /**
+             * @brief Read contents
+             * @param offset Contents offset
+             * @param out Destination
+             * @param length Bytes to read, up to the end of the source
+             * @return False if the file could not be read
+            */
+            public: bool read(std::uint64_t offset, std::uint8_t* out, std::size_t length);
+
+            /**
+             * @brief Source read
+            */
+            private: source m_source;
+
+            /**
+             * @brief File of the source
+            */
+            private: std::ifstream m_file;
+        };
+
+        /**
+         * @brief Compute the signatures of a file, in parallel
+         * @param path File
+         * @return Signatures, no block size if it is not a regular file or could not be read
+        */
+        signatures compute_signatures(const std::string& path);
+
+        /**
+         * @brief Serialize signatures
+         * @param _signatures Signatures
+         * @return Header then blocks
+        */
+        std::vector<std::uint8_t> write_signatures(const signatures& _signatures);
+
+        /**
+         * @brief Parse the signatures header
+         * @param data SIGNATURES_HEADER_SIZE bytes
+         * @param _signatures Block size and length
+         * @return False if the block size is neither 0 nor a power of two between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+        */
+        bool read_signatures_header(const std::uint8_t* data, signatures& _signatures);
+
+        /**
+         * @brief Byte count of the blocks following a header
+         * @param _signatures Block size and length
+         * @return Bytes, signatures of at most MAX_BLOCKS blocks
+        */
+        std::uint64_t get_blocks_size(const signatures& _signatures);
+
+        /**
+         * @brief Parse blocks
+         * @param data Blocks, get_blocks_size() bytes
+         * @param _signatures Signatures whose header was read
+        */
+        void read_blocks(const std::uint8_t* data, signatures& _signatures);
+
+        /**
+         * @brief Operation rebuilding part of the new contents
+        */
+        struct op
+        {
+            bool copy;                                          //!< Copy from the receiver's copy, else literal
+            std::uint64_t offset;                               //!< Offset in the receiver's copy, or of the literal in the new contents
+            std::uint64_t length;                               //!< Bytes
+        };
+
+        /**
+         * @brief Encode new contents against signatures, segments in parallel
+         * @param _source New contents
+         * @param _signatures Signatures of the receiver's copy
+         * @param ops Operations, adjacent ones merged
+         * @return False if the source could not be read
+        */
+        bool encode(const source& _source, const signatures& _signatures, std::vector<op>& ops);
+
+        /**
+         * @brief Cuts operations into frames, reading literals from their source
+        */
+        class op_writer
+        {
+            /**
+             * @brief Describe writer
+             * @param _source New contents, literals are read from it
+             * @param ops Operations
+            */
+            public: op_writer(const source& _source, std::vector<op> ops);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~op_writer();
+
+            /**
+             * @brief Serialize the next operations
+             * @param out Operations, at most max bytes
+             * @param max Bytes, at least LITERAL_OP_HEADER_SIZE + 1 and COPY_OP_SIZE
+             * @return False if the source could not be read
+            */
+            public: bool next(std::vector<std::uint8_t>& out, std::size_t max);
+
+            /**
+             * @brief Check for more operations
+             * @return True once every operation was serialized
+            */
+            public: bool done() const { return m_next == m_ops.size(); }
+
+            /**
+             * @brief Bytes sent as literals
+             * @return Bytes
+            */
+            public: std::uint64_t get_literal_bytes() const { return m_literal_bytes; }
+
+            /**
+             * @brief Reads literals
+            */
+            private: reader m_reader;
+
+            /**
+             * @brief Operations
+            */
+            private: std::vector<op> m_ops;
+
+            /**
+             * @brief Next operation
+            */
+            private: std::size_t m_next;
+
+            /**
+             * @brief Bytes of m_ops[m_next] already serialized
+            */
+            private: std::uint64_t m_done;
+
+            /**
+             * @brief Literal bytes serialized
+            */
+            private: std::uint64_t m_literal_bytes;
+        };
+
+        /**
+         * @brief Rebuilds a file in place, not thread safe
+        */
+        class patcher
+        {
+            /**
+             * @brief Open the copy, created if missing
+             * @param path Copy
+             * @param copy_length Length of the copy the signatures were computed on
+             * @param length New length
+            */
+            public: patcher(const std::string& path, std::uint64_t copy_length, std::uint64_t length);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~patcher();
+
+            /**
+             * @brief Check if the copy could be opened
+             * @return True if it is open
+            */
+            public: bool is_open() const { return m_file.is_open(); }
+
+            /**
+             * @brief Apply serialized operations
+             * @param data Whole operations
+             * @param length Data length
+             * @return False if malformed, out of bounds, reading rebuilt bytes or on write errors
+            */
+            public: bool apply(const std::uint8_t* data, std::size_t length);
+
+            /**
+             * @brief Check if every byte was rebuilt
+             * @return True at the new length
+            */
+            public: bool complete() const { return m_position == m_length; }
+
+            /**
+             * @brief Close the copy and cut it to the new length
+             * @return False on errors
+            */
+            public: bool finish();
+
+            /**
+             * @brief Bytes copied within the file rather than received
+             * @return Bytes
+            */
+            public: std::uint64_t get_copied_bytes() const { return m_copied_bytes; }
+
+            /**
+             * @brief Copy
+            */
+            private: std::string m_path;
+
+            /**
+             * @brief Copy, read and written
+            */
+            private: std::fstream m_file;
+
+            /**
+             * @brief Length of the copy before rebuilding
+            */
+            private: std::uint64_t m_copy_length;
+
+            /**
+             * @brief New length
+            */
+            private: std::uint64_t m_length;
+
+            /**
+             * @brief Bytes rebuilt
+            */
+            private: std::uint64_t m_position;
+
+            /**
+             * @brief Bytes copied
+            */
+            private: std::uint64_t m_copied_bytes;
+
+            /**
+             * @brief Bytes moved within the file
+            */
+            private: std::vector<std::uint8_t> m_buffer;
+        };
+    }
+}
+
+#endif /* DELTA_HPP */
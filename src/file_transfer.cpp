@@ -0,0 +1,318 @@
+#include "file_transfer.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+#if defined(SCFT_SENDFILE)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
+namespace scft
+{
+    namespace transfer
+    {
+        std::string receive_path(std::string_view name)
+        {
+            bool nested = false;
+            bool safe = !name.empty() && name.find_first_of("\\:") == std::string_view::npos;
+            for (std::size_t begin = 0; safe;)
+            {
+                std::size_t end = name.find('/', begin);
+                std::string_view component = name.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+                safe = !component.empty() && component != "." && component != "..";
+                if (end == std::string_view::npos)
+                    break;
+                nested = true;
+                begin = end + 1;
+            }
+            if (!safe)
+            {
+                std::size_t separator = name.find_last_of("/\\");
+                return std::string(separator == std::string_view::npos ? name : name.substr(separator + 1));
+            }
+            // Opening the file reports directories that could not be created
+            if (nested)
+            {
+                std::error_code ec;
+                std::filesystem::create_directories(std::filesystem::path(std::string(name)).parent_path(), ec);
+            }
+            return std::string(name);
+        }
+
+        void write_file(
+            const boost::asio::any_io_executor& executor,
+            const std::string& path,
+            const void* data,
+            std::size_t length,
+            send_handler handler)
+        {
+            std::ofstream out_file{path, std::ios::out | std::ios::binary | std::ios::trunc};
+            out_file.write(static_cast<const char*>(data), length);
+            out_file.close();
+            boost::system::error_code ec;
+            if (!out_file)
+                ec = boost::system::errc::make_error_code(boost::system::errc::io_error);
+            boost::asio::post(executor, [handler, ec]() { handler(ec); });
+        }
+
+        file_sender::file_sender(transport::stream& _socket, std::shared_ptr<message::payload_file> _payload_file, send_handler handler)
+        :
+        m_socket(_socket),
+        m_payload_file(_payload_file),
+    #if defined(SCFT_SENDFILE)
+        m_fd(-1),
+        m_offset(0),
+    #endif
+        m_remaining(_payload_file->get_length()),
+        m_handler(std::move(handler))
+        {
+        }
+
+        file_sender::~file_sender()
+        {
+        #if defined(SCFT_SENDFILE)
+            if (m_fd >= 0)
+                ::close(m_fd);
+        #endif
+        }
+
+        void file_sender::start()
+        {
+        #if defined(SCFT_SENDFILE)
+            m_fd = ::open(m_payload_file->get_path().c_str(), O_RDONLY | O_CLOEXEC);
+            boost::system::error_code ec;
+            if (m_fd >= 0 && !m_socket.is_shm())
+                m_socket.get_socket().native_non_blocking(true, ec);
+            if (m_fd < 0 || ec)
+        #else
+            m_file.open(m_payload_file->get_path(), std::ios::in | std::ios::binary);
+            if (!m_file)
+        #endif
+            {
+                boost::asio::post(m_socket.get_executor(),
+                    [self = shared_from_this()]()
+                    {
+                        self->m_handler(boost::system::errc::make_error_code(boost::system::errc::no_such_file_or_directory));
+                    });
+                return;
+            }
+        #if !defined(SCFT_SENDFILE)
+            m_buffer.resize(static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, m_remaining)));
+        #endif
+            send_chunk();
+        }
+
+        void file_sender::send_chunk()
+        {
+        #if defined(SCFT_SENDFILE)
+            if (m_socket.is_shm())
+            {
+                // sendfile(2) needs a socket, the page cache is read straight into the ring instead
+                m_socket.get_shm()->async_produce(static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, m_remaining)),
+                    [this](std::uint8_t* data, std::size_t length) -> std::size_t
+                    {
+                        ssize_t done = ::pread(m_fd, data, length, m_offset);
+                        if (done <= 0)
+                            return 0;
+                        m_offset += done;
+                        return static_cast<std::size_t>(done);
+                    },
+                    [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
+                    {
+                        // io_error if the file shrank since the header was written
+                        if (ec)
+                            self->m_handler(ec);
+                        else
+                            self->chunk_sent(length);
+                    });
+                return;
+            }
+            // One chunk per readiness wait, a fast recipient does not hold the io thread for a whole file
+            m_socket.get_socket().async_wait(transport::socket::wait_write,
+                [self = shared_from_this()](boost::system::error_code ec)
+                {
+                    if (ec)
+                    {
+                        self->m_handler(ec);
+                        return;
+                    }
+                    std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, self->m_remaining));
+                    ssize_t length = ::sendfile(self->m_socket.get_socket().native_handle(), self->m_fd, &self->m_offset, chunk);
+                    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                    {
+                        self->send_chunk();
+                        return;
+                    }
+                    if (length <= 0)
+                    {
+                        // File shrank since the header was written, the frame can not be completed
+                        self->m_handler(length == 0 ? boost::system::errc::make_error_code(boost::system::errc::io_error)
+                            : boost::system::error_code(errno, boost::system::system_category()));
+                        return;
+                    }
+                    self->chunk_sent(static_cast<std::size_t>(length));
+                });
+        #else
+            std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(m_buffer.size(), m_remaining));
+            m_file.read(m_buffer.data(), chunk);
+            if (static_cast<std::size_t>(m_file.gcount()) != chunk)
+            {
+                // File shrank since the header was written, the frame can not be completed
+                boost::asio::post(m_socket.get_executor(),
+                    [self = shared_from_this()]()
+                    {
+                        self->m_handler(boost::system::errc::make_error_code(boost::system::errc::io_error));
+                    });
+                return;
+            }
+            write_chunk(chunk);
+        #endif
+        }
+
+        void file_sender::write_chunk(std::size_t chunk)
+        {
+            boost::asio::async_write(m_socket, boost::asio::buffer(m_buffer.data(), chunk),
+                [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
+                {
+                    if (ec)
+                    {
+                        self->m_handler(ec);
+                        return;
+                    }
+                    self->chunk_sent(length);
+                });
+        }
+
+        void file_sender::chunk_sent(std::size_t length)
+        {
+            m_remaining -= length;
+            if (m_progress_handler)
+                m_progress_handler(length);
+            if (m_pace_handler)
+                m_pace_handler(length, [self = shared_from_this()]() { self->chunk_paced(); });
+            else
+                chunk_paced();
+        }
+
+        void file_sender::chunk_paced()
+        {
+            if (m_remaining == 0)
+                m_handler(boost::system::error_code());
+            else
+                send_chunk();
+        }
+
+        file_receiver::file_receiver(
+            transport::stream& _socket,
+            const std::string& path,
+            std::uint64_t length,
+            bool verify,
+            const checksum::hasher& _hasher,
+            receive_handler handler)
+        :
+        m_socket(_socket),
+        m_path(path),
+        m_remaining(length),
+        m_resume_offset(0),
+        m_verify(verify),
+        m_hasher(_hasher),
+        m_write_failed(false),
+        m_handler(std::move(handler))
+        {
+        }
+
+        file_receiver::~file_receiver()
+        {
+        }
+
+        void file_receiver::start()
+        {
+            if (!m_path.empty())
+            {
+                if (m_resume_offset == 0)
+                    m_file.open(m_path, std::ios::out | std::ios::binary | std::ios::trunc);
+                else
+                {
+                    m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary);
+                    m_file.seekp(static_cast<std::streamoff>(m_resume_offset));
+                }
+                m_write_failed = !m_file;
+            }
+            if (!m_socket.is_shm())
+                m_buffer.resize(static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, m_remaining)));
+            receive_chunk();
+        }
+
+        void file_receiver::receive_chunk()
+        {
+            if (m_socket.is_shm())
+            {
+                // Contents go from the ring to the file, without the chunk buffer
+                m_socket.get_shm()->async_consume(static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, m_remaining)),
+                    [this](const std::uint8_t* data, std::size_t length)
+                    {
+                        if (m_verify)
+                            m_hasher.update(data, length);
+                        if (m_data_handler)
+                            m_data_handler(data, length);
+                        if (m_file.is_open() && !m_file.write(reinterpret_cast<const char*>(data), length))
+                            m_write_failed = true;
+                    },
+                    [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
+                    {
+                        if (ec)
+                            self->m_handler(ec, 0);
+                        else
+                            self->chunk_stored(length);
+                    });
+                return;
+            }
+            std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(m_buffer.size(), m_remaining));
+            boost::asio::async_read(m_socket, boost::asio::buffer(m_buffer.data(), chunk),
+                [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
+                {
+                    if (ec)
+                    {
+                        self->m_handler(ec, 0);
+                        return;
+                    }
+                    if (self->m_verify)
+                        self->m_hasher.update(self->m_buffer.data(), length);
+                    if (self->m_data_handler)
+                        self->m_data_handler(reinterpret_cast<const std::uint8_t*>(self->m_buffer.data()), length);
+                    // Keep reading after a failed write so the connection stays in sync, report it at the end
+                    if (self->m_file.is_open() && !self->m_file.write(self->m_buffer.data(), length))
+                        self->m_write_failed = true;
+                    self->chunk_stored(length);
+                });
+        }
+
+        void file_receiver::chunk_stored(std::size_t length)
+        {
+            m_remaining -= length;
+            if (m_progress_handler)
+                m_progress_handler(length);
+            if (m_pace_handler)
+                m_pace_handler(length, [self = shared_from_this()]() { self->chunk_paced(); });
+            else
+                chunk_paced();
+        }
+
+        void file_receiver::chunk_paced()
+        {
+            if (m_remaining == 0)
+            {
+                boost::system::error_code ec;
+                m_file.close();
+                if (m_write_failed)
+                    ec = boost::system::errc::make_error_code(boost::system::errc::io_error);
+                m_handler(ec, m_verify ? m_hasher.digest() : 0);
+            }
+            else
+                receive_chunk();
+        }
+    }
+}
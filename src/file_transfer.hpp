@@ -0,0 +1,346 @@
+#ifndef FILE_TRANSFER_HPP
+#define FILE_TRANSFER_HPP
+
+/**
+ * @file src/file_transfer.hpp
+ * @brief Defines file_sender and file_receiver, streaming message contents between disk and socket in chunks
+ * @note File reads and writes block the io thread for one chunk at a time, on Linux files are sent with sendfile(2)
+*/
+
+#include "scft_message.hpp"
+#include "transport.hpp"
+
+#include <boost/asio.hpp>
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__linux__)
+/**
+ * @brief file_sender moves contents from page cache to socket, without a chunk buffer unless the stream is shared memory
+*/
+#define SCFT_SENDFILE 1
+#endif
+
+namespace scft
+{
+    /**
+     * @brief Streamed file contents
+    */
+    namespace transfer
+    {
+        /**
+         * @brief Bytes moved per read or write 1M
+        */
+        constexpr std::size_t CHUNK_SIZE = 1048576;
+
+        /**
+         * @brief Called once the whole file was sent or on the first error
+         * @param ec Error, if any
+        */
+        typedef std::function<void(boost::system::error_code ec)> send_handler;
+
+        /**
+         * @brief Called once the whole file was received or on the first error
+         * @param ec Error, if any
+         * @param checksum Checksum of the frame data, 0 unless verifying
+        */
+        typedef std::function<void(boost::system::error_code ec, std::uint64_t checksum)> receive_handler;
+
+        /**
+         * @brief Called after every chunk, to notice stalled transfers
+         * @param length Chunk length
+        */
+        typedef std::function<void(std::size_t length)> progress_handler;
+
+        /**
+         * @brief Called with the bytes of every received chunk before they are written, to compute more checksums on the way
+         * @param data Chunk
+         * @param length Chunk length
+        */
+        typedef std::function<void(const std::uint8_t* data, std::size_t length)> data_handler;
+
+        /**
+         * @brief Called after every chunk, the next chunk or the completion waits until resume runs, to rate limit transfers
+         * @param length Chunk length
+         * @param resume Continues the transfer
+        */
+        typedef std::function<void(std::size_t length, std::function<void()> resume)> pace_handler;
+
+        /**
+         * @brief Local path of a received file, creating its directories
+         * @param name File name of the WRITE_FILE, a relative path with '/' separators for files sent with their directory
+         * @return name, or only its base name if it is absolute, has a backslash, a colon, or an empty, "." or ".." component
+        */
+        std::string receive_path(std::string_view name);
+
+        /**
+         * @brief Write a whole buffer to a file, then call handler on the executor
+         * @param executor Executor running handler
+         * @param path Destination file, truncated
+         * @param data Contents, kept alive by the caller until handler runs
+         * @param length Contents length
+         * @param handler Completion handler
+        */
+        void write_file(
+            const boost::asio::any_io_executor& executor,
+            const std::string& path,
+            const void* data,
+            std::size_t length,
+            send_handler handler);
+
+        /**
+         * @brief Writes a payload file to a socket, the caller keeps the socket alive until the handler runs
+        */
+        class file_sender : public std::enable_shared_from_this<file_sender>
+        {
+            /**
+             * @brief Describe transfer
+             * @param _socket Connected stream
+             * @param _payload_file File to send
+             * @param handler Completion handler
+            */
+            public: file_sender(transport::stream& _socket, std::shared_ptr<message::payload_file> _payload_file, send_handler handler);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~file_sender();
+
+            /**
+             * @brief Open file and send first chunk, call once owned by a shared_ptr
+            */
+            public: void start();
+
+            /**
+             * @brief Set chunk callback, call before start()
+             * @param handler Progress handler
+            */
+            public: void set_progress_handler(progress_handler handler) { m_progress_handler = std::move(handler); }
+
+            /**
+             * @brief Set pacing callback, call before start()
+             * @param handler Pace handler
+            */
+            public: void set_pace_handler(pace_handler handler) { m_pace_handler = std::move(handler); }
+
+            /**
+             * @brief Read and write next chunk
+            */
+            private: void send_chunk();
+
+            /**
+             * @brief Write a chunk read from the file
+             * @param chunk Chunk length
+            */
+            private: void write_chunk(std::size_t chunk);
+
+            /**
+             * @brief Account for a sent chunk, then send the next one or complete
+             * @param length Chunk length
+            */
+            private: void chunk_sent(std::size_t length);
+
+            /**
+             * @brief Send the next chunk or complete
+            */
+            private: void chunk_paced();
+
+            /**
+             * @brief Destination stream
+            */
+            private: transport::stream& m_socket;
+
+            /**
+             * @brief File to send, kept alive during the transfer
+            */
+            private: std::shared_ptr<message::payload_file> m_payload_file;
+
+#if defined(SCFT_SENDFILE)
+            /**
+             * @brief Source file descriptor, -1 until opened
+            */
+            private: int m_fd;
+
+            /**
+             * @brief Offset of the next chunk, advanced by sendfile(2)
+            */
+            private: off_t m_offset;
+#else
+            /**
+             * @brief Source stream
+            */
+            private: std::ifstream m_file;
+#endif
+
+            /**
+             * @brief Chunk buffer
+            */
+            private: std::vector<char> m_buffer;
+
+            /**
+             * @brief Bytes left to send
+            */
+            private: std::uint64_t m_remaining;
+
+            /**
+             * @brief Completion handler
+            */
+            private: send_handler m_handler;
+
+            /**
+             * @brief Chunk callback
+            */
+            private: progress_handler m_progress_handler;
+
+            /**
+             * @brief Pacing callback
+            */
+            private: pace_handler m_pace_handler;
+        };
+
+        /**
+         * @brief Reads contents from a socket into a file, the caller keeps the socket alive until the handler runs
+        */
+        class file_receiver : public std::enable_shared_from_this<file_receiver>
+        {
+            /**
+             * @brief Describe transfer
+             * @param _socket Connected stream
+             * @param path Destination file, empty to discard contents
+             * @param length Bytes to read
+             * @param verify Compute the checksum, relays forwarding it untouched can skip it
+             * @param _hasher Checksum state before the contents
+             * @param handler Completion handler
+            */
+            public: file_receiver(
+                transport::stream& _socket,
+                const std::string& path,
+                std::uint64_t length,
+                bool verify,
+                const checksum::hasher& _hasher,
+                receive_handler handler);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~file_receiver();
+
+            /**
+             * @brief Open file and read first chunk, call once owned by a shared_ptr
+            */
+            public: void start();
+
+            /**
+             * @brief Set chunk callback, call before start()
+             * @param handler Progress handler
+            */
+            public: void set_progress_handler(progress_handler handler) { m_progress_handler = std::move(handler); }
+
+            /**
+             * @brief Set pacing callback, call before start()
+             * @param handler Pace handler
+            */
+            public: void set_pace_handler(pace_handler handler) { m_pace_handler = std::move(handler); }
+
+            /**
+             * @brief Set received bytes callback, call before start()
+             * @param handler Data handler
+            */
+            public: void set_data_handler(data_handler handler) { m_data_handler = std::move(handler); }
+
+            /**
+             * @brief Keep the first bytes of an existing file and write after them, call before start()
+             * @param offset Bytes kept, not counted in length
+            */
+            public: void resume_at(std::uint64_t offset) { m_resume_offset = offset; }
+
+            /**
+             * @brief Read and write next chunk
+            */
+            private: void receive_chunk();
+
+            /**
+             * @brief Account for a stored chunk, then read the next one or complete
+             * @param length Chunk length
+            */
+            private: void chunk_stored(std::size_t length);
+
+            /**
+             * @brief Read the next chunk or complete
+            */
+            private: void chunk_paced();
+
+            /**
+             * @brief Source stream
+            */
+            private: transport::stream& m_socket;
+
+            /**
+             * @brief Destination file path
+            */
+            private: std::string m_path;
+
+            /**
+             * @brief Destination stream
+            */
+            private: std::ofstream m_file;
+
+            /**
+             * @brief Chunk buffer
+            */
+            private: std::vector<char> m_buffer;
+
+            /**
+             * @brief Bytes left to read
+            */
+            private: std::uint64_t m_remaining;
+
+            /**
+             * @brief Bytes of the file kept before the first chunk
+            */
+            private: std::uint64_t m_resume_offset;
+
+            /**
+             * @brief Compute checksum
+            */
+            private: bool m_verify;
+
+            /**
+             * @brief Running checksum
+            */
+            private: checksum::hasher m_hasher;
+
+            /**
+             * @brief Set once writing to the file failed
+            */
+            private: bool m_write_failed;
+
+            /**
+             * @brief Completion handler
+            */
+            private: receive_handler m_handler;
+
+            /**
+             * @brief Chunk callback
+            */
+            private: progress_handler m_progress_handler;
+
+            /**
+             * @brief Pacing callback
+            */
+            private: pace_handler m_pace_handler;
+
+            /**
+             * @brief Received bytes callback
+            */
+            private: data_handler m_data_handler;
+        };
+    }
+}
+
+#endif /* FILE_TRANSFER_HPP */
@@ -0,0 +1,167 @@
+#include "frame_scheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace scft
+{
+    namespace mux
+    {
+        LANE get_lane(message::MESSAGE_TYPE message_type)
+        {
+            if (message_type == message::MESSAGE_TYPE::TEXT)
+                return CHAT;
+            // A MULTICAST_END stays behind its announce
+            if (message_type == message::MESSAGE_TYPE::WRITE_FILE || message_type == message::MESSAGE_TYPE::CHUNK
+                || message_type == message::MESSAGE_TYPE::MULTICAST_END || message_type == message::MESSAGE_TYPE::REPAIR)
+                return BULK;
+            return CONTROL;
+        }
+
+        frame_scheduler::frame_scheduler()
+        :
+        m_chunking(false),
+        m_next_stream_id(1),
+        m_size(0)
+        {
+        }
+
+        frame_scheduler::~frame_scheduler()
+        {
+        }
+
+        void frame_scheduler::push(message::message _message)
+        {
+            entry _entry;
+            _entry.queued_at = std::chrono::steady_clock::now();
+            _entry.queued_len = _message.get_raw_message().size();
+            LANE lane = get_lane(_message.get_message_type());
+            if (lane == BULK && m_chunking && _message.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE && !_message.is_chunked()
+                && (_message.get_flags() & message::FLAG_DIRECT) == 0 && _message.get_file_buffer_len() > message::STREAM_CHUNK_SIZE)
+            {
+                // Same header and checksum, the contents are cut from the source as the stream gets its turns
+                _entry.chunked = true;
+                std::size_t prefix = _message.get_header_size() + _message.get_origin_len() + _message.get_string_len() + 1;
+                _entry.announce.get_raw_message().assign(_message.get_raw_message().begin(), _message.get_raw_message().begin() + prefix);
+                _entry.announce.set_flags(_entry.announce.get_flags() | message::FLAG_CHUNKED);
+                _entry.announce.set_stream_id(m_next_stream_id);
+                m_next_stream_id = m_next_stream_id == UINT32_MAX ? 1 : m_next_stream_id + 1;
+            }
+            _entry.source = std::move(_message);
+            if (lane == BULK)
+                m_waiting.push_back(std::move(_entry));
+            else
+                m_lanes[lane].push_back(std::move(_entry));
+            m_size++;
+        }
+
+        void frame_scheduler::activate()
+        {
+            while (m_active.size() < MAX_STREAMS && !m_waiting.empty())
+            {
+                m_active.push_back(std::move(m_waiting.front()));
+                m_waiting.pop_front();
+            }
+        }
+
+        std::size_t frame_scheduler::next_size()
+        {
+            for (std::deque<entry>& lane : m_lanes)
+            {
+                if (!lane.empty())
+                    return lane.front().source.get_raw_message().size();
+            }
+            activate();
+            entry& _entry = m_active.front();
+            if (!_entry.chunked)
+                return _entry.source.get_raw_message().size();
+            if (!_entry.announced)
+                return _entry.announce.get_raw_message().size();
+            std::uint64_t left = _entry.source.get_file_buffer_len() - _entry.sent;
+            return message::V2_STREAM_HEADER_SIZE + 2 + static_cast<std::size_t>(std::min<std::uint64_t>(left, message::STREAM_CHUNK_SIZE));
+        }
+
+        scheduled_frame frame_scheduler::take()
+        {
+            scheduled_frame next;
+            for (std::deque<entry>& lane : m_lanes)
+            {
+                if (lane.empty())
+                    continue;
+                next.frame = std::move(lane.front().source);
+                next.queued_at = lane.front().queued_at;
+                next.first = true;
+                next.last = true;
+                next.queued_len = lane.front().queued_len;
+                lane.pop_front();
+                m_size--;
+                return next;
+            }
+
+            // Bulk frames in turn, a stream with chunks left goes back to the end
+            activate();
+            entry _entry = std::move(m_active.front());
+            m_active.pop_front();
+            next.queued_at = _entry.queued_at;
+            if (!_entry.chunked)
+            {
+                next.frame = std::move(_entry.source);
+                next.first = true;
+                next.last = true;
+            }
+            else if (!_entry.announced)
+            {
+                next.frame = _entry.announce;
+                next.first = true;
+                _entry.announced = true;
+            }
+            else
+            {
+                next.frame = next_chunk(_entry);
+                next.last = _entry.sent == _entry.source.get_file_buffer_len();
+            }
+            if (!next.last)
+            {
+                m_active.push_back(std::move(_entry));
+                return next;
+            }
+            next.queued_len = _entry.queued_len;
+            m_size--;
+            return next;
+        }
+
+        void frame_scheduler::rewind()
+        {
+            for (entry& _entry : m_active)
+            {
+                _entry.announced = false;
+                _entry.sent = 0;
+                _entry.contents_file.reset();
+            }
+        }
+
+        message::message frame_scheduler::next_chunk(entry& _entry)
+        {
+            std::uint32_t stream_id = _entry.announce.get_stream_id();
+            std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(_entry.source.get_file_buffer_len() - _entry.sent, message::STREAM_CHUNK_SIZE));
+            std::shared_ptr<message::payload_file> contents = _entry.source.get_payload_file();
+            if (!contents)
+            {
+                message::message chunk{stream_id, _entry.source.get_file_buffer() + _entry.sent, length};
+                _entry.sent += length;
+                return chunk;
+            }
+            if (!_entry.contents_file)
+            {
+                _entry.contents_file = std::make_shared<std::ifstream>(contents->get_path(), std::ios::in | std::ios::binary);
+                if (!*_entry.contents_file)
+                    throw std::runtime_error("Could not open " + contents->get_path() + '\n');
+            }
+            std::vector<std::uint8_t> buffer(length);
+            if (!_entry.contents_file->read(reinterpret_cast<char*>(buffer.data()), length))
+                throw std::runtime_error("File shrank while reading\n");
+            _entry.sent += length;
+            return message::message{stream_id, buffer.data(), length};
+        }
+    }
+}
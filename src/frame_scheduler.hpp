@@ -0,0 +1,196 @@
+#ifndef FRAME_SCHEDULER_HPP
+#define FRAME_SCHEDULER_HPP
+
+/**
+ * @file src/frame_scheduler.hpp
+ * @brief Defines frame_scheduler, the send queue of a connection, with priority lanes and chunked files
+*/
+
+#include "scft_message.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+
+namespace scft
+{
+    /**
+     * @brief Stream multiplexing
+    */
+    namespace mux
+    {
+        /**
+         * @brief Send priority, lower lanes are always emptied first
+        */
+        typedef enum _LANE : std::uint8_t
+        {
+            CONTROL = 0,    //!< HEARTBEAT, PING, PONG, NEGOTIATE, HISTORY and NACK
+            CHAT = 1,       //!< TEXT
+            BULK = 2        //!< WRITE_FILE, MULTICAST_END and REPAIR, one chunk per stream in turn
+        }LANE;
+
+        /**
+         * @brief Chunked files sent or received at the same time on a connection, others wait for their turn
+        */
+        constexpr std::size_t MAX_STREAMS = 16;
+
+        /**
+         * @brief Lane of a message type
+         * @param message_type Message type
+         * @return Lane
+        */
+        LANE get_lane(message::MESSAGE_TYPE message_type);
+
+        /**
+         * @brief Next frame to write
+        */
+        struct scheduled_frame
+        {
+            message::message frame;                             //!< Queued message, or the announce or a chunk of a chunked one
+            std::chrono::steady_clock::time_point queued_at;    //!< Time its message was queued
+            bool first = false;                                 //!< First frame of its message
+            bool last = false;                                  //!< Last frame of its message
+            std::uint64_t queued_len = 0;                       //!< Buffer size of its message as queued, on the last frame only
+            std::uint64_t sequence = 0;                         //!< Sequence number once taken, 0 if not sequenced
+        };
+
+        /**
+         * @brief Send queue, not thread safe
+         * @note Files above STREAM_CHUNK_SIZE are cut into CHUNK frames when the peer reassembles them, so texts
+         * and control frames never wait behind a whole file and up to MAX_STREAMS files progress together
+        */
+        class frame_scheduler
+        {
+            /**
+             * @brief Empty queue, files are sent whole until chunking is enabled
+            */
+            public: frame_scheduler();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~frame_scheduler();
+
+            /**
+             * @brief Move constructor, a resumed session takes over the queue of its previous connection
+            */
+            public: frame_scheduler(frame_scheduler&&) = default;
+
+            /**
+             * @brief Move assignment
+            */
+            public: frame_scheduler& operator=(frame_scheduler&&) = default;
+
+            /**
+             * @brief Enable or disable chunking of files queued from now on
+             * @param chunking True once the peer negotiated streams
+            */
+            public: void set_chunking(bool chunking) { m_chunking = chunking; }
+
+            /**
+             * @brief Check if files are chunked
+             * @return True if enabled
+            */
+            public: bool get_chunking() const { return m_chunking; }
+
+            /**
+             * @brief Queue a message
+             * @param _message Message, streamed contents are read from its payload_file when chunked
+            */
+            public: void push(message::message _message);
+
+            /**
+             * @brief Check for frames to take
+             * @return True if nothing is queued
+            */
+            public: bool empty() const { return m_size == 0; }
+
+            /**
+             * @brief Queued messages with frames left to take
+             * @return Count
+            */
+            public: std::size_t size() const { return m_size; }
+
+            /**
+             * @brief Buffer size of the frame take() returns next, call when not empty
+             * @return Bytes, streamed contents excluded
+            */
+            public: std::size_t next_size();
+
+            /**
+             * @brief Take the next frame, by lane, then in turn between streams
+             * @return Frame, call when not empty
+             * @note A lane is never reordered, whatever their sizes the texts of a sender go out in the order it sent them
+             * @note Throws std::runtime_error if a chunked file can not be read
+            */
+            public: scheduled_frame take();
+
+            /**
+             * @brief Start chunked files over from their announce, for a peer that lost their streams
+            */
+            public: void rewind();
+
+            /**
+             * @brief Queued message
+            */
+            private: struct entry
+            {
+                message::message source;                            //!< Message as queued
+                message::message announce;                          //!< WRITE_FILE without contents, if chunked
+                std::chrono::steady_clock::time_point queued_at;    //!< Time queued
+                std::uint64_t queued_len = 0;                       //!< Buffer size as queued
+                std::shared_ptr<std::ifstream> contents_file;       //!< Streamed contents, open once the first chunk is read
+                std::uint64_t sent = 0;                             //!< Contents taken
+                bool chunked = false;                               //!< Sent as an announce and CHUNK frames
+                bool announced = false;                             //!< Announce taken
+            };
+
+            /**
+             * @brief Move waiting files to the active streams
+            */
+            private: void activate();
+
+            /**
+             * @brief Build the next chunk of a stream
+             * @param _entry Stream
+             * @return CHUNK frame
+            */
+            private: message::message next_chunk(entry& _entry);
+
+            /**
+             * @brief CONTROL and CHAT queues
+            */
+            private: std::array<std::deque<entry>, BULK> m_lanes;
+
+            /**
+             * @brief Files being sent, in turn
+            */
+            private: std::deque<entry> m_active;
+
+            /**
+             * @brief Files waiting for a stream
+            */
+            private: std::deque<entry> m_waiting;
+
+            /**
+             * @brief Chunk files
+            */
+            private: bool m_chunking;
+
+            /**
+             * @brief Identifier of the next stream
+            */
+            private: std::uint32_t m_next_stream_id;
+
+            /**
+             * @brief Queued messages
+            */
+            private: std::size_t m_size;
+        };
+    }
+}
+
+#endif /* FRAME_SCHEDULER_HPP */
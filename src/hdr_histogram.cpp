@@ -0,0 +1,140 @@
+#include "hdr_histogram.hpp"
+
+#include <limits>
+
+namespace scft
+{
+    namespace metrics
+    {
+        /**
+         * @brief Index of the highest set bit
+         * @param value Non zero value
+         * @return 0 to 63
+        */
+        static unsigned int highest_bit(std::uint64_t value)
+        {
+        #if defined(__GNUC__)
+            return 63 - __builtin_clzll(value);
+        #else
+            unsigned int bit = 0;
+            while (value >>= 1)
+                ++bit;
+            return bit;
+        #endif
+        }
+
+        hdr_histogram::hdr_histogram()
+        :
+        m_counts(new std::atomic<std::uint64_t>[BUCKET_COUNT]),
+        m_count(0),
+        m_sum(0),
+        m_min(std::numeric_limits<std::uint64_t>::max()),
+        m_max(0)
+        {
+            for (std::size_t index = 0; index < BUCKET_COUNT; index++)
+                m_counts[index].store(0, std::memory_order_relaxed);
+        }
+
+        hdr_histogram::~hdr_histogram()
+        {
+        }
+
+        std::size_t hdr_histogram::bucket_index(std::uint64_t value)
+        {
+            constexpr std::uint64_t half_count = std::uint64_t(1) << (PRECISION_BITS - 1);
+            if (value < 2 * half_count)
+                return static_cast<std::size_t>(value);
+            unsigned int bucket = highest_bit(value) - (PRECISION_BITS - 1);
+            return static_cast<std::size_t>(bucket * half_count + (value >> bucket));
+        }
+
+        std::uint64_t hdr_histogram::highest_equivalent_value(std::size_t index)
+        {
+            constexpr std::uint64_t half_count = std::uint64_t(1) << (PRECISION_BITS - 1);
+            if (index < 2 * half_count)
+                return index;
+            std::uint64_t bucket = index / half_count - 1;
+            std::uint64_t sub_bucket = index - bucket * half_count;
+            return ((sub_bucket + 1) << bucket) - 1;
+        }
+
+        void hdr_histogram::record(std::uint64_t value, std::uint64_t count)
+        {
+            m_counts[bucket_index(value)].fetch_add(count, std::memory_order_relaxed);
+            m_count.fetch_add(count, std::memory_order_relaxed);
+            m_sum.fetch_add(value * count, std::memory_order_relaxed);
+
+            std::uint64_t cur_min = m_min.load(std::memory_order_relaxed);
+            while (value < cur_min && !m_min.compare_exchange_weak(cur_min, value, std::memory_order_relaxed));
+            std::uint64_t cur_max = m_max.load(std::memory_order_relaxed);
+            while (value > cur_max && !m_max.compare_exchange_weak(cur_max, value, std::memory_order_relaxed));
+        }
+
+        void hdr_histogram::merge(const hdr_histogram& other)
+        {
+            for (std::size_t index = 0; index < BUCKET_COUNT; index++)
+            {
+                std::uint64_t count = other.m_counts[index].load(std::memory_order_relaxed);
+                if (count != 0)
+                    m_counts[index].fetch_add(count, std::memory_order_relaxed);
+            }
+            m_count.fetch_add(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            std::uint64_t other_min = other.m_min.load(std::memory_order_relaxed);
+            std::uint64_t cur_min = m_min.load(std::memory_order_relaxed);
+            while (other_min < cur_min && !m_min.compare_exchange_weak(cur_min, other_min, std::memory_order_relaxed));
+            std::uint64_t other_max = other.m_max.load(std::memory_order_relaxed);
+            std::uint64_t cur_max = m_max.load(std::memory_order_relaxed);
+            while (other_max > cur_max && !m_max.compare_exchange_weak(cur_max, other_max, std::memory_order_relaxed));
+        }
+
+        void hdr_histogram::reset()
+        {
+            for (std::size_t index = 0; index < BUCKET_COUNT; index++)
+                m_counts[index].store(0, std::memory_order_relaxed);
+            m_count.store(0, std::memory_order_relaxed);
+            m_sum.store(0, std::memory_order_relaxed);
+            m_min.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+            m_max.store(0, std::memory_order_relaxed);
+        }
+
+        std::uint64_t hdr_histogram::value_at_percentile(double percentile) const
+        {
+            std::uint64_t total = get_count();
+            if (total == 0)
+                return 0;
+            if (percentile > 100.0)
+                percentile = 100.0;
+            std::uint64_t wanted = static_cast<std::uint64_t>(percentile / 100.0 * total + 0.5);
+            if (wanted == 0)
+                wanted = 1;
+            std::uint64_t seen = 0;
+            for (std::size_t index = 0; index < BUCKET_COUNT; index++)
+            {
+                seen += m_counts[index].load(std::memory_order_relaxed);
+                if (seen >= wanted)
+                {
+                    std::uint64_t value = highest_equivalent_value(index);
+                    return value < get_max() ? value : get_max();
+                }
+            }
+            return get_max();
+        }
+
+        std::uint64_t hdr_histogram::get_min() const
+        {
+            if (get_count() == 0)
+                return 0;
+            return m_min.load(std::memory_order_relaxed);
+        }
+
+        double hdr_histogram::get_mean() const
+        {
+            std::uint64_t count = get_count();
+            if (count == 0)
+                return 0.0;
+            return static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count;
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef HDR_HISTOGRAM_HPP
+#define HDR_HISTOGRAM_HPP
+
+/**
+ * @file src/hdr_histogram.hpp
+ * @brief Defines hdr_histogram, to record latencies with bounded relative error
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace scft
+{
+    /**
+     * @brief Measurement helpers
+    */
+    namespace metrics
+    {
+        /**
+         * @brief Log-linear (HDR style) histogram of 64 bit values
+         * @verbatim
+         * Values below 2^PRECISION_BITS have their own bucket, above that every
+         * power of two is split in 2^(PRECISION_BITS - 1) linear sub-buckets,
+         * the relative error is therefore at most 1 / 2^(PRECISION_BITS - 1)
+         * @endverbatim
+         * record() and reads are lock free and may run concurrently
+        */
+        class hdr_histogram
+        {
+            /**
+             * @brief Bits of precision, 8 gives < 0.8% error over the whole 64 bit range
+            */
+            public: static constexpr unsigned int PRECISION_BITS = 8;
+
+            /**
+             * @brief Number of buckets
+            */
+            public: static constexpr std::size_t BUCKET_COUNT = (64 - PRECISION_BITS + 2) << (PRECISION_BITS - 1);
+
+            /**
+             * @brief Empty histogram
+            */
+            public: hdr_histogram();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~hdr_histogram();
+
+            /**
+             * @brief Record value
+             * @param value Value (e.g. nanoseconds)
+             * @param count Number of times it occured
+            */
+            public: void record(std::uint64_t value, std::uint64_t count = 1);
+
+            /**
+             * @brief Add every value of another histogram
+             * @param other Histogram to add
+            */
+            public: void merge(const hdr_histogram& other);
+
+            /**
+             * @brief Clear all values, concurrent record() may be lost
+            */
+            public: void reset();
+
+            /**
+             * @brief Value under which the given percentage of values are
+             * @param percentile 0 to 100
+             * @return Highest equivalent value of the matching bucket, 0 if empty
+            */
+            public: std::uint64_t value_at_percentile(double percentile) const;
+
+            /**
+             * @brief Number of recorded values
+             * @return Count
+            */
+            public: std::uint64_t get_count() const { return m_count.load(std::memory_order_relaxed); }
+
+            /**
+             * @brief Smallest recorded value
+             * @return 0 if empty
+            */
+            public: std::uint64_t get_min() const;
+
+            /**
+             * @brief Largest recorded value
+             * @return 0 if empty
+            */
+            public: std::uint64_t get_max() const { return m_max.load(std::memory_order_relaxed); }
+
+            /**
+             * @brief Mean of recorded values
+             * @return 0 if empty
+            */
+            public: double get_mean() const;
+
+            /**
+             * @brief Bucket of a value
+             * @param value Value
+             * @return Bucket index
+            */
+            private: static std::size_t bucket_index(std::uint64_t value);
+
+            /**
+             * @brief Highest value falling in a bucket
+             * @param index Bucket index
+             * @return Value
+            */
+            private: static std::uint64_t highest_equivalent_value(std::size_t index);
+
+            /**
+             * @brief Per bucket counts
+            */
+            private: std::unique_ptr<std::atomic<std::uint64_t>[]> m_counts;
+
+            /**
+             * @brief Total count
+            */
+            private: std::atomic<std::uint64_t> m_count;
+
+            /**
+             * @brief Sum of values, for the mean
+            */
+            private: std::atomic<std::uint64_t> m_sum;
+
+            /**
+             * @brief Smallest value
+            */
+            private: std::atomic<std::uint64_t> m_min;
+
+            /**
+             * @brief Largest value
+            */
+            private: std::atomic<std::uint64_t> m_max;
+        };
+    }
+}
+
+#endif /* HDR_HISTOGRAM_HPP */
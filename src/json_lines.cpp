@@ -0,0 +1,243 @@
+#include "json_lines.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+
+namespace scft
+{
+    namespace json_lines
+    {
+        std::string escape(const std::string& str)
+        {
+            std::string escaped;
+            escaped.reserve(str.size());
+            for (const char& ch : str)
+            {
+                switch (ch)
+                {
+                    case '\"': escaped.append("\\\""); break;
+                    case '\\': escaped.append("\\\\"); break;
+                    case '\n': escaped.append("\\n"); break;
+                    case '\r': escaped.append("\\r"); break;
+                    case '\t': escaped.append("\\t"); break;
+                    case '\b': escaped.append("\\b"); break;
+                    case '\f': escaped.append("\\f"); break;
+                    default:
+                        if (static_cast<unsigned char>(ch) < 0x20)
+                        {
+                            char code[7];
+                            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(ch));
+                            escaped.append(code);
+                        }
+                        else
+                            escaped.push_back(ch);
+                        break;
+                }
+            }
+            return escaped;
+        }
+
+        std::string quote(const std::string& str)
+        {
+            return '\"' + escape(str) + '\"';
+        }
+
+        std::string object(const std::vector<std::pair<std::string, std::string>>& fields)
+        {
+            std::string line = "{";
+            for (std::size_t index = 0; index < fields.size(); index++)
+            {
+                if (index != 0)
+                    line.push_back(',');
+                line.append(quote(fields[index].first));
+                line.push_back(':');
+                line.append(fields[index].second);
+            }
+            line.push_back('}');
+            return line;
+        }
+
+        /**
+         * @brief Append code point as UTF-8
+         * @param code_point Unicode code point
+         * @param out Destination
+        */
+        static void append_utf8(std::uint32_t code_point, std::string& out)
+        {
+            if (code_point < 0x80)
+                out.push_back(static_cast<char>(code_point));
+            else if (code_point < 0x800)
+            {
+                out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+                out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else if (code_point < 0x10000)
+            {
+                out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+        }
+
+        /**
+         * @brief Read four hex digits
+         * @param line JSON text
+         * @param index Position of first digit, moved past the last one
+         * @param value Parsed value
+         * @return False if malformed
+        */
+        static bool parse_hex4(const std::string& line, std::size_t& index, std::uint32_t& value)
+        {
+            if (index + 4 > line.size())
+                return false;
+            value = 0;
+            for (std::size_t end = index + 4; index < end; index++)
+            {
+                char ch = line[index];
+                value <<= 4;
+                if (ch >= '0' && ch <= '9') value |= ch - '0';
+                else if (ch >= 'a' && ch <= 'f') value |= ch - 'a' + 10;
+                else if (ch >= 'A' && ch <= 'F') value |= ch - 'A' + 10;
+                else return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Parse a quoted string
+         * @param line JSON text
+         * @param index Position of opening quote, moved past the closing one
+         * @param out Unescaped string
+         * @return False if malformed
+        */
+        static bool parse_string(const std::string& line, std::size_t& index, std::string& out)
+        {
+            if (index >= line.size() || line[index] != '\"')
+                return false;
+            ++index;
+            while (index < line.size())
+            {
+                char ch = line[index++];
+                if (ch == '\"')
+                    return true;
+                if (ch != '\\')
+                {
+                    out.push_back(ch);
+                    continue;
+                }
+                if (index >= line.size())
+                    return false;
+                switch (line[index++])
+                {
+                    case '\"': out.push_back('\"'); break;
+                    case '\\': out.push_back('\\'); break;
+                    case '/': out.push_back('/'); break;
+                    case 'n': out.push_back('\n'); break;
+                    case 'r': out.push_back('\r'); break;
+                    case 't': out.push_back('\t'); break;
+                    case 'b': out.push_back('\b'); break;
+                    case 'f': out.push_back('\f'); break;
+                    case 'u':
+                    {
+                        std::uint32_t code_point = 0;
+                        if (!parse_hex4(line, index, code_point))
+                            return false;
+                        if (code_point >= 0xD800 && code_point < 0xDC00)
+                        {
+                            std::uint32_t low = 0;
+                            if (line.compare(index, 2, "\\u") != 0)
+                                return false;
+                            index += 2;
+                            if (!parse_hex4(line, index, low) || low < 0xDC00 || low > 0xDFFF)
+                                return false;
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        append_utf8(code_point, out);
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief Skip whitespaces
+         * @param line JSON text
+         * @param index Moved to next non whitespace character
+        */
+        static void skip_spaces(const std::string& line, std::size_t& index)
+        {
+            while (index < line.size() && std::isspace(static_cast<unsigned char>(line[index])))
+                ++index;
+        }
+
+        bool parse(const std::string& line, std::unordered_map<std::string, std::string>& fields)
+        {
+            std::size_t index = 0;
+            skip_spaces(line, index);
+            if (index >= line.size() || line[index++] != '{')
+                return false;
+            skip_spaces(line, index);
+            if (index < line.size() && line[index] == '}')
+            {
+                ++index;
+                skip_spaces(line, index);
+                return index == line.size();
+            }
+            while (index < line.size())
+            {
+                std::string key;
+                std::string value;
+                skip_spaces(line, index);
+                if (!parse_string(line, index, key))
+                    return false;
+                skip_spaces(line, index);
+                if (index >= line.size() || line[index++] != ':')
+                    return false;
+                skip_spaces(line, index);
+                if (index >= line.size())
+                    return false;
+                if (line[index] == '\"')
+                {
+                    if (!parse_string(line, index, value))
+                        return false;
+                }
+                else
+                {
+                    while (index < line.size() && line[index] != ',' && line[index] != '}' &&
+                        !std::isspace(static_cast<unsigned char>(line[index])))
+                    {
+                        if (line[index] == '{' || line[index] == '[')
+                            return false;
+                        value.push_back(line[index++]);
+                    }
+                    if (value.empty())
+                        return false;
+                }
+                fields[key] = value;
+                skip_spaces(line, index);
+                if (index >= line.size())
+                    return false;
+                if (line[index] == '}')
+                {
+                    ++index;
+                    skip_spaces(line, index);
+                    return index == line.size();
+                }
+                if (line[index++] != ',')
+                    return false;
+            }
+            return false;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef JSON_LINES_HPP
+#define JSON_LINES_HPP
+
+/**
+ * @file src/json_lines.hpp
+ * @brief Defines json_lines namespace, to read and write one flat JSON object per line
+*/
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scft
+{
+    /**
+     * @brief Flat JSON object helper (string, number and boolean values only)
+    */
+    namespace json_lines
+    {
+        /**
+         * @brief Escape string to be placed between JSON quotes
+         * @param str Raw string, accepts u8
+         * @return Escaped string
+        */
+        std::string escape(const std::string& str);
+
+        /**
+         * @brief Serialize fields to a single JSON line (without trailing newline)
+         * @param fields Key and already serialized value pairs, see quote()
+         * @return JSON object
+        */
+        std::string object(const std::vector<std::pair<std::string, std::string>>& fields);
+
+        /**
+         * @brief Escape and quote a string value
+         * @param str Raw string
+         * @return Quoted JSON string
+        */
+        std::string quote(const std::string& str);
+
+        /**
+         * @brief Parse flat JSON object, nested objects and arrays are refused
+         * @param line JSON text
+         * @param fields Filled with key and unescaped value, numbers and booleans are kept as text
+         * @return False if malformed
+        */
+        bool parse(const std::string& line, std::unordered_map<std::string, std::string>& fields);
+    }
+}
+
+#endif /* JSON_LINES_HPP */
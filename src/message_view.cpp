@@ -0,0 +1,144 @@
+#include "message_view.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace scft
+{
+    namespace message
+    {
+        /**
+         * @brief Load a header field, fields of version 1 headers are not aligned
+         * @param at Field
+         * @return Value
+        */
+        template<typename T>
+        static T load(const std::uint8_t* at)
+        {
+            T value;
+            std::memcpy(&value, at, sizeof(T));
+            return value;
+        }
+
+        message_view::message_view()
+        :
+        m_valid(false),
+        m_message_type(RESERVED),
+        m_v2(false),
+        m_streamed(false),
+        m_chunked(false),
+        m_multicast(false),
+        m_traced(false),
+        m_checksum_algorithm(checksum::CRC32),
+        m_header_size(0),
+        m_origin_len(0),
+        m_flags(0),
+        m_checksum(0),
+        m_stringdata_len(0),
+        m_file_buffer_len(0),
+        m_send_time(0),
+        m_trace_id(0),
+        m_stream_id(0)
+        {
+        }
+
+        message_view::~message_view()
+        {
+        }
+
+        bool message_view::parse(const std::uint8_t* frame, std::size_t size, bool detached)
+        {
+            *this = message_view();
+            if (size < HEADER_SIZE)
+                return false;
+
+            // Header fields, the same checks as message::bad_header()
+            std::uint64_t string_len = 0;
+            m_v2 = (frame[MESSAGE_TYPE_OFFSET] & V2_TYPE_FLAG) != 0;
+            m_message_type = static_cast<MESSAGE_TYPE>(frame[MESSAGE_TYPE_OFFSET] & ~V2_TYPE_FLAG);
+            if (m_v2)
+            {
+                m_header_size = load<std::uint16_t>(frame + V2_HEADER_SIZE_OFFSET);
+                if (frame[V2_VERSION_OFFSET] != V2_VERSION || m_header_size < V2_HEADER_SIZE || m_header_size > MAX_HEADER_SIZE || size < m_header_size)
+                    return false;
+                m_flags = load<std::uint32_t>(frame + V2_FLAGS_OFFSET);
+                m_stringdata_len = load<std::uint64_t>(frame + V2_STRINGDATA_LEN_OFFSET);
+                string_len = load<std::uint32_t>(frame + V2_STRING_LEN_OFFSET);
+                m_checksum = load<std::uint32_t>(frame + V2_CHECKSUM_OFFSET)
+                    | static_cast<std::uint64_t>(load<std::uint32_t>(frame + V2_CHECKSUM_HIGH_OFFSET)) << 32;
+                m_origin_len = load<std::uint16_t>(frame + V2_ORIGIN_LEN_OFFSET);
+                m_checksum_algorithm = static_cast<checksum::ALGORITHM>(frame[V2_CHECKSUM_ALGORITHM_OFFSET]);
+                if (string_len == 0 || string_len > m_stringdata_len || m_checksum_algorithm > checksum::LAST_ALGORITHM)
+                    return false;
+                if (m_header_size >= V2_STREAM_HEADER_SIZE)
+                    m_stream_id = load<std::uint32_t>(frame + V2_STREAM_ID_OFFSET);
+            }
+            else
+            {
+                m_header_size = HEADER_SIZE;
+                m_origin_len = frame[ORIGIN_LEN_OFFSET];
+                m_stringdata_len = load<std::uint32_t>(frame + STRINGDATA_LEN_OFFSET);
+                m_checksum = load<std::uint32_t>(frame + CHECKSUM_OFFSET);
+            }
+            if (m_message_type == RESERVED || m_message_type > LAST_MESSAGE_TYPE || m_origin_len == 0)
+                return false;
+            if (m_message_type == CHUNK && (!m_v2 || m_stream_id == 0 || m_stringdata_len > MAX_CHUNK_LENGTH + 1))
+                return false;
+            if (m_message_type == REPAIR && (!m_v2 || m_stream_id == 0 || m_stringdata_len > MAX_REPAIR_LENGTH))
+                return false;
+            m_chunked = m_message_type == WRITE_FILE && (m_flags & (FLAG_CHUNKED | FLAG_MULTICAST)) != 0;
+            m_multicast = m_message_type == WRITE_FILE && (m_flags & FLAG_MULTICAST) != 0;
+            if (m_chunked && m_stream_id == 0)
+                return false;
+            bool streamed = m_v2 && m_message_type == WRITE_FILE && m_stringdata_len - string_len > STREAM_THRESHOLD;
+            if (streamed || m_chunked ? (m_stringdata_len > MAX_STREAM_LENGTH || string_len > MAX_DATA_LENGTH) : m_stringdata_len > MAX_DATA_LENGTH)
+                return false;
+            m_streamed = m_message_type == WRITE_FILE && !m_chunked && (streamed || detached);
+
+            // Segments, each string is looked for once, a detached version 1 file name ends somewhere in the buffer
+            std::size_t available = size - m_header_size;
+            std::size_t buffered_stringdata_len = static_cast<std::size_t>(m_streamed || m_chunked ? string_len : m_stringdata_len);
+            if (m_streamed && !m_v2)
+                buffered_stringdata_len = available < m_origin_len ? 0 : static_cast<std::size_t>(std::min<std::uint64_t>(m_stringdata_len, available - m_origin_len));
+            if (available < m_origin_len + buffered_stringdata_len)
+                return false;
+            const std::uint8_t* origin = frame + m_header_size;
+            const std::uint8_t* stringdata = origin + m_origin_len;
+
+            const std::uint8_t* origin_end = static_cast<const std::uint8_t*>(std::memchr(origin, '\0', m_origin_len));
+            if (origin_end == nullptr)
+                return false;
+            m_origin = std::string_view(reinterpret_cast<const char*>(origin), origin_end - origin);
+            m_traced = m_origin_len == m_origin.size() + 1 + TRACE_SIZE;
+            if (m_traced)
+            {
+                m_send_time = load<std::uint64_t>(origin_end + 1);
+                m_trace_id = load<std::uint64_t>(origin_end + 1 + sizeof(std::uint64_t));
+            }
+
+            // Version 2 carries the string length, version 1 texts fill the stringdata, only file names need a scan
+            if (!m_v2 && m_message_type == WRITE_FILE)
+            {
+                const std::uint8_t* string_end = static_cast<const std::uint8_t*>(std::memchr(stringdata, '\0', buffered_stringdata_len));
+                if (string_end == nullptr)
+                    return false;
+                string_len = string_end - stringdata + 1;
+            }
+            else if (!m_v2)
+                string_len = m_stringdata_len;
+            if (string_len == 0 || stringdata[string_len - 1] != '\0')
+                return false;
+            m_string = std::string_view(reinterpret_cast<const char*>(stringdata), static_cast<std::size_t>(string_len - 1));
+            m_buffered_data = byte_span{origin, m_origin_len + static_cast<std::size_t>(m_streamed ? string_len : buffered_stringdata_len)};
+
+            if (m_message_type == WRITE_FILE || m_message_type == CHUNK || m_message_type == REPAIR)
+            {
+                m_file_buffer_len = m_stringdata_len - string_len;
+                if (!m_streamed && !m_chunked)
+                    m_file_buffer = byte_span{stringdata + string_len, static_cast<std::size_t>(m_file_buffer_len)};
+            }
+            m_valid = true;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,286 @@
+#ifndef MESSAGE_VIEW_HPP
+#define MESSAGE_VIEW_HPP
+
+/**
+ * @file src/message_view.hpp
+ * @brief Defines class message_view, a parsed read only view over a received frame
+*/
+
+#include "scft_message.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+namespace scft
+{
+    namespace message
+    {
+        /**
+         * @brief Read only bytes, std::span is C++20
+        */
+        struct byte_span
+        {
+            const std::uint8_t* data = nullptr;     //!< First byte, nullptr if empty
+            std::size_t size = 0;                   //!< Byte count
+        };
+
+        /**
+         * @brief Frame validated once, segments are then returned without scanning or header loads
+         * @note Points into the parsed buffer, parse again after it is resized or refilled
+        */
+        class message_view
+        {
+            /**
+             * @brief Empty, invalid view
+            */
+            public: message_view();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~message_view();
+
+            /**
+             * @brief Validate a frame and compute its segments
+             * @param frame Header followed by the buffered data, streamed contents excluded
+             * @param size Bytes available at frame
+             * @param detached File contents are not in the buffer whatever their size, they were spilled to a payload_file
+             * @return False if the header is bad, data is missing or a string is not terminated, the view is then invalid
+            */
+            public: bool parse(const std::uint8_t* frame, std::size_t size, bool detached = false);
+
+            /**
+             * @brief Check last parse()
+             * @return True if it succeeded
+            */
+            public: bool is_valid() const { return m_valid; }
+
+            /**
+             * @brief Get message type
+             * @return Message type
+            */
+            public: MESSAGE_TYPE get_message_type() const { return m_message_type; }
+
+            /**
+             * @brief Check header version
+             * @return True if version 2
+            */
+            public: bool is_v2() const { return m_v2; }
+
+            /**
+             * @brief Get header size
+             * @return Bytes before the origin
+            */
+            public: std::size_t get_header_size() const { return m_header_size; }
+
+            /**
+             * @brief Get flags
+             * @return 0 for version 1
+            */
+            public: std::uint32_t get_flags() const { return m_flags; }
+
+            /**
+             * @brief Get checksum
+             * @return Checksum, 32 bit algorithms use the low half
+            */
+            public: std::uint64_t get_checksum() const { return m_checksum; }
+
+            /**
+             * @brief Get checksum algorithm
+             * @return CRC32 for version 1
+            */
+            public: checksum::ALGORITHM get_checksum_algorithm() const { return m_checksum_algorithm; }
+
+            /**
+             * @brief Get origin, without terminator nor trace
+             * @return Origin
+            */
+            public: std::string_view get_origin() const { return m_origin; }
+
+            /**
+             * @brief Get text or file name, without terminator
+             * @return String
+            */
+            public: std::string_view get_string() const { return m_string; }
+
+            /**
+             * @brief Get buffered file contents, or the contents of a CHUNK or REPAIR
+             * @return Empty unless an unstreamed, unchunked WRITE_FILE, a CHUNK or a REPAIR
+            */
+            public: byte_span get_file_buffer() const { return m_file_buffer; }
+
+            /**
+             * @brief Get file contents length
+             * @return Length, streamed or chunked contents included, 0 unless WRITE_FILE, CHUNK or REPAIR
+            */
+            public: std::uint64_t get_file_buffer_len() const { return m_file_buffer_len; }
+
+            /**
+             * @brief Get origin and stringdata as buffered, what the checksum covers before streamed contents
+             * @return Data
+            */
+            public: byte_span get_buffered_data() const { return m_buffered_data; }
+
+            /**
+             * @brief Get stringdata length
+             * @return Length, streamed contents included
+            */
+            public: std::uint64_t get_stringdata_len() const { return m_stringdata_len; }
+
+            /**
+             * @brief Get frame length
+             * @return Header and data length, streamed contents included
+            */
+            public: std::uint64_t get_frame_len() const { return m_header_size + m_origin_len + m_stringdata_len; }
+
+            /**
+             * @brief Check for contents left on the socket after the buffered data, or kept in a payload_file
+             * @return True for a version 2 WRITE_FILE above STREAM_THRESHOLD or a WRITE_FILE parsed as detached
+            */
+            public: bool has_streamed_body() const { return m_streamed; }
+
+            /**
+             * @brief Check for contents following in other frames
+             * @return True for a WRITE_FILE flagged FLAG_CHUNKED or FLAG_MULTICAST, it is never streamed
+            */
+            public: bool is_chunked() const { return m_chunked; }
+
+            /**
+             * @brief Check for contents following in multicast datagrams
+             * @return True for a WRITE_FILE flagged FLAG_MULTICAST
+            */
+            public: bool is_multicast() const { return m_multicast; }
+
+            /**
+             * @brief Get stream identifier
+             * @return 0 if the header does not carry one
+            */
+            public: std::uint32_t get_stream_id() const { return m_stream_id; }
+
+            /**
+             * @brief Check for a trace after the origin
+             * @return True if traced
+            */
+            public: bool has_trace() const { return m_traced; }
+
+            /**
+             * @brief Get trace send time
+             * @return Monotonic nanoseconds, 0 without trace
+            */
+            public: std::uint64_t get_send_time() const { return m_send_time; }
+
+            /**
+             * @brief Get trace identifier
+             * @return Identifier, 0 without trace
+            */
+            public: std::uint64_t get_trace_id() const { return m_trace_id; }
+
+            /**
+             * @brief Parse succeeded
+            */
+            private: bool m_valid;
+
+            /**
+             * @brief Message type
+            */
+            private: MESSAGE_TYPE m_message_type;
+
+            /**
+             * @brief Version 2 header
+            */
+            private: bool m_v2;
+
+            /**
+             * @brief Contents are not buffered
+            */
+            private: bool m_streamed;
+
+            /**
+             * @brief Contents follow in other frames
+            */
+            private: bool m_chunked;
+
+            /**
+             * @brief Contents follow in multicast datagrams
+            */
+            private: bool m_multicast;
+
+            /**
+             * @brief Trace after the origin
+            */
+            private: bool m_traced;
+
+            /**
+             * @brief Checksum algorithm
+            */
+            private: checksum::ALGORITHM m_checksum_algorithm;
+
+            /**
+             * @brief Header size
+            */
+            private: std::size_t m_header_size;
+
+            /**
+             * @brief Origin segment length, trace included
+            */
+            private: std::size_t m_origin_len;
+
+            /**
+             * @brief Flags
+            */
+            private: std::uint32_t m_flags;
+
+            /**
+             * @brief Checksum
+            */
+            private: std::uint64_t m_checksum;
+
+            /**
+             * @brief Stringdata length
+            */
+            private: std::uint64_t m_stringdata_len;
+
+            /**
+             * @brief File contents length
+            */
+            private: std::uint64_t m_file_buffer_len;
+
+            /**
+             * @brief Trace send time
+            */
+            private: std::uint64_t m_send_time;
+
+            /**
+             * @brief Trace identifier
+            */
+            private: std::uint64_t m_trace_id;
+
+            /**
+             * @brief Stream identifier
+            */
+            private: std::uint32_t m_stream_id;
+
+            /**
+             * @brief Origin
+            */
+            private: std::string_view m_origin;
+
+            /**
+             * @brief Text or file name
+            */
+            private: std::string_view m_string;
+
+            /**
+             * @brief Buffered file contents
+            */
+            private: byte_span m_file_buffer;
+
+            /**
+             * @brief Buffered data
+            */
+            private: byte_span m_buffered_data;
+        };
+    }
+}
+
+#endif /* MESSAGE_VIEW_HPP */
@@ -0,0 +1,287 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+namespace scft
+{
+    namespace metrics
+    {
+        std::size_t shard_index()
+        {
+            static std::atomic<std::size_t> next_index{0};
+            thread_local std::size_t index = next_index.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+            return index;
+        }
+
+        std::string label(const std::string& name, const std::string& value)
+        {
+            std::string escaped;
+            for (const char& ch : value)
+            {
+                if (ch == '\\' || ch == '\"')
+                    escaped.push_back('\\');
+                if (ch == '\n')
+                    escaped.append("\\n");
+                else
+                    escaped.push_back(ch);
+            }
+            return name + "=\"" + escaped + '\"';
+        }
+
+        /**
+         * @brief Nanoseconds to seconds as Prometheus float
+         * @param value_ns Nanoseconds
+         * @return Seconds
+        */
+        static std::string seconds(std::uint64_t value_ns)
+        {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.9g", value_ns / 1e9);
+            return text;
+        }
+
+        /**
+         * @brief Nanoseconds to a short human readable duration
+         * @param value_ns Nanoseconds
+         * @return Text with unit
+        */
+        static std::string duration_text(std::uint64_t value_ns)
+        {
+            char text[32];
+            if (value_ns < 1000000)
+                std::snprintf(text, sizeof(text), "%.1fus", value_ns / 1e3);
+            else if (value_ns < 1000000000)
+                std::snprintf(text, sizeof(text), "%.1fms", value_ns / 1e6);
+            else
+                std::snprintf(text, sizeof(text), "%.2fs", value_ns / 1e9);
+            return text;
+        }
+
+        void gauge::write_prometheus(const std::string& name, const std::string& labels, std::string& out) const
+        {
+            out.append(name + (labels.empty() ? "" : '{' + labels + '}') + ' ' + std::to_string(get()) + '\n');
+        }
+
+        void gauge::write_text(std::string& out) const
+        {
+            out.append(std::to_string(get()));
+        }
+
+        histogram::histogram(const std::vector<std::uint64_t>& bounds)
+        :
+        m_bounds(bounds),
+        m_shards(new shard[SHARD_COUNT])
+        {
+            if (m_bounds.size() > MAX_BUCKETS)
+                throw std::logic_error("Too many histogram buckets");
+        }
+
+        histogram::~histogram()
+        {
+        }
+
+        void histogram::record(std::uint64_t value_ns)
+        {
+            std::size_t bucket = 0;
+            while (bucket < m_bounds.size() && value_ns > m_bounds[bucket])
+                ++bucket;
+            shard& cur_shard = m_shards[shard_index()];
+            cur_shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            cur_shard.sum.fetch_add(value_ns, std::memory_order_relaxed);
+        }
+
+        std::vector<std::uint64_t> histogram::collect(std::uint64_t& sum) const
+        {
+            std::vector<std::uint64_t> counts(m_bounds.size() + 1, 0);
+            sum = 0;
+            for (std::size_t shard_index = 0; shard_index < SHARD_COUNT; shard_index++)
+            {
+                for (std::size_t bucket = 0; bucket < counts.size(); bucket++)
+                    counts[bucket] += m_shards[shard_index].counts[bucket].load(std::memory_order_relaxed);
+                sum += m_shards[shard_index].sum.load(std::memory_order_relaxed);
+            }
+            return counts;
+        }
+
+        std::uint64_t histogram::get_count() const
+        {
+            std::uint64_t sum = 0;
+            std::uint64_t total = 0;
+            for (const std::uint64_t& count : collect(sum))
+                total += count;
+            return total;
+        }
+
+        std::uint64_t histogram::bound_at_percentile(double percentile) const
+        {
+            std::uint64_t sum = 0;
+            std::vector<std::uint64_t> counts = collect(sum);
+            std::uint64_t total = 0;
+            for (const std::uint64_t& count : counts)
+                total += count;
+            std::uint64_t wanted = static_cast<std::uint64_t>(percentile / 100.0 * total + 0.5);
+            std::uint64_t seen = 0;
+            for (std::size_t bucket = 0; bucket < m_bounds.size(); bucket++)
+            {
+                seen += counts[bucket];
+                if (seen >= wanted && seen != 0)
+                    return m_bounds[bucket];
+            }
+            return std::numeric_limits<std::uint64_t>::max();
+        }
+
+        void histogram::write_prometheus(const std::string& name, const std::string& labels, std::string& out) const
+        {
+            std::uint64_t sum = 0;
+            std::vector<std::uint64_t> counts = collect(sum);
+            std::string prefix = labels.empty() ? "" : labels + ',';
+            std::uint64_t cumulative = 0;
+            for (std::size_t bucket = 0; bucket < m_bounds.size(); bucket++)
+            {
+                cumulative += counts[bucket];
+                out.append(name + "_bucket{" + prefix + "le=\"" + seconds(m_bounds[bucket]) + "\"} " + std::to_string(cumulative) + '\n');
+            }
+            cumulative += counts.back();
+            out.append(name + "_bucket{" + prefix + "le=\"+Inf\"} " + std::to_string(cumulative) + '\n');
+            std::string braced = labels.empty() ? "" : '{' + labels + '}';
+            out.append(name + "_sum" + braced + ' ' + seconds(sum) + '\n');
+            out.append(name + "_count" + braced + ' ' + std::to_string(cumulative) + '\n');
+        }
+
+        void histogram::write_text(std::string& out) const
+        {
+            std::uint64_t sum = 0;
+            std::uint64_t total = 0;
+            for (const std::uint64_t& count : collect(sum))
+                total += count;
+            out.append("n=" + std::to_string(total));
+            if (total == 0)
+                return;
+            out.append(" avg=" + duration_text(sum / total));
+            std::uint64_t p99 = bound_at_percentile(99);
+            out.append(" p99<=" + (p99 == std::numeric_limits<std::uint64_t>::max() ? std::string("inf") : duration_text(p99)));
+        }
+
+        std::vector<std::uint64_t> latency_bounds()
+        {
+            std::vector<std::uint64_t> bounds;
+            for (std::uint64_t bound = 1000; bounds.size() < MAX_BUCKETS; bound *= 2)
+                bounds.push_back(bound);
+            return bounds;
+        }
+
+        registry::registry()
+        {
+        }
+
+        registry::~registry()
+        {
+        }
+
+        void registry::add(const std::string& name, const std::string& help, const std::string& labels, std::shared_ptr<metric> value)
+        {
+            std::lock_guard<std::mutex> lock(m_families_mutex);
+            family& cur_family = m_families[name];
+            if (cur_family.type.empty())
+            {
+                cur_family.help = help;
+                cur_family.type = value->type_name();
+            }
+            else if (cur_family.type != value->type_name())
+                throw std::logic_error("Metric " + name + " registered with two types");
+            cur_family.entries.push_back(entry{labels, value});
+        }
+
+        std::shared_ptr<counter> registry::make_counter(const std::string& name, const std::string& help, const std::string& labels)
+        {
+            std::shared_ptr<counter> value = std::make_shared<counter>();
+            add(name, help, labels, value);
+            return value;
+        }
+
+        std::shared_ptr<local_counter> registry::make_local_counter(const std::string& name, const std::string& help, const std::string& labels)
+        {
+            std::shared_ptr<local_counter> value = std::make_shared<local_counter>();
+            add(name, help, labels, value);
+            return value;
+        }
+
+        std::shared_ptr<gauge> registry::make_gauge(const std::string& name, const std::string& help, const std::string& labels)
+        {
+            std::shared_ptr<gauge> value = std::make_shared<gauge>();
+            add(name, help, labels, value);
+            return value;
+        }
+
+        std::shared_ptr<histogram> registry::make_histogram(
+            const std::string& name, const std::string& help, const std::vector<std::uint64_t>& bounds, const std::string& labels)
+        {
+            std::shared_ptr<histogram> value = std::make_shared<histogram>(bounds);
+            add(name, help, labels, value);
+            return value;
+        }
+
+        void registry::prune()
+        {
+            for (std::map<std::string, family>::iterator cur_family = m_families.begin(); cur_family != m_families.end(); ++cur_family)
+            {
+                std::vector<entry>& entries = cur_family->second.entries;
+                std::size_t kept = 0;
+                for (std::size_t index = 0; index < entries.size(); index++)
+                {
+                    if (entries[index].value.expired())
+                        continue;
+                    if (kept != index)
+                        entries[kept] = std::move(entries[index]);
+                    ++kept;
+                }
+                entries.resize(kept);
+            }
+        }
+
+        std::string registry::render_prometheus()
+        {
+            std::string out;
+            std::lock_guard<std::mutex> lock(m_families_mutex);
+            prune();
+            for (const std::pair<const std::string, family>& cur_family : m_families)
+            {
+                if (cur_family.second.entries.empty())
+                    continue;
+                out.append("# HELP " + cur_family.first + ' ' + cur_family.second.help + '\n');
+                out.append("# TYPE " + cur_family.first + ' ' + cur_family.second.type + '\n');
+                for (const entry& cur_entry : cur_family.second.entries)
+                {
+                    std::shared_ptr<metric> value = cur_entry.value.lock();
+                    if (value)
+                        value->write_prometheus(cur_family.first, cur_entry.labels, out);
+                }
+            }
+            return out;
+        }
+
+        std::string registry::render_text(bool labeled)
+        {
+            std::string out;
+            std::lock_guard<std::mutex> lock(m_families_mutex);
+            prune();
+            for (const std::pair<const std::string, family>& cur_family : m_families)
+            {
+                for (const entry& cur_entry : cur_family.second.entries)
+                {
+                    if (cur_entry.labels.empty() == labeled)
+                        continue;
+                    std::shared_ptr<metric> value = cur_entry.value.lock();
+                    if (!value)
+                        continue;
+                    out.append(cur_family.first + (cur_entry.labels.empty() ? "" : '{' + cur_entry.labels + '}') + ' ');
+                    value->write_text(out);
+                    out.push_back('\n');
+                }
+            }
+            return out;
+        }
+    }
+}
@@ -0,0 +1,367 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+/**
+ * @file src/metrics.hpp
+ * @brief Defines counters, gauges, histograms and the registry exporting them
+*/
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace scft
+{
+    namespace metrics
+    {
+        /**
+         * @brief Assumed cache line size, shards are aligned on it to avoid false sharing
+        */
+        constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+        /**
+         * @brief Number of shards of shared counters and histograms
+        */
+        constexpr std::size_t SHARD_COUNT = 16;
+
+        /**
+         * @brief Maximum number of histogram buckets (without +Inf)
+        */
+        constexpr std::size_t MAX_BUCKETS = 24;
+
+        /**
+         * @brief Shard used by the calling thread, assigned round-robin on first use
+         * @return 0 to SHARD_COUNT - 1
+        */
+        std::size_t shard_index();
+
+        /**
+         * @brief Format a Prometheus label
+         * @param name Label name
+         * @param value Label value, escaped
+         * @return name="value"
+        */
+        std::string label(const std::string& name, const std::string& value);
+
+        /**
+         * @brief Base of every registered metric
+        */
+        class metric
+        {
+            /**
+             * @brief Default destructor
+            */
+            public: virtual ~metric() {}
+
+            /**
+             * @brief Prometheus TYPE
+             * @return counter, gauge or histogram
+            */
+            public: virtual const char* type_name() const = 0;
+
+            /**
+             * @brief Append Prometheus text exposition samples
+             * @param name Metric name
+             * @param labels Formatted labels, may be empty
+             * @param out Destination
+            */
+            public: virtual void write_prometheus(const std::string& name, const std::string& labels, std::string& out) const = 0;
+
+            /**
+             * @brief Append a short human readable value
+             * @param out Destination
+            */
+            public: virtual void write_text(std::string& out) const = 0;
+        };
+
+        /**
+         * @brief Monotonic counter, increments go to the calling thread's shard
+         * @tparam SHARDS 1 for values only updated from one strand (per connection)
+        */
+        template <std::size_t SHARDS>
+        class basic_counter : public metric
+        {
+            /**
+             * @brief Cache line sized shard
+            */
+            private: struct alignas(CACHE_LINE_SIZE) shard
+            {
+                std::atomic<std::uint64_t> value{0};
+            };
+
+            /**
+             * @brief Add to counter
+             * @param value Increment
+            */
+            public: void add(std::uint64_t value = 1)
+            {
+                m_shards[SHARDS == 1 ? 0 : shard_index() % SHARDS].value.fetch_add(value, std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief Sum of shards
+             * @return Counter value
+            */
+            public: std::uint64_t get() const
+            {
+                std::uint64_t total = 0;
+                for (const shard& cur_shard : m_shards)
+                    total += cur_shard.value.load(std::memory_order_relaxed);
+                return total;
+            }
+
+            public: const char* type_name() const override { return "counter"; }
+
+            public: void write_prometheus(const std::string& name, const std::string& labels, std::string& out) const override
+            {
+                out.append(name + (labels.empty() ? "" : '{' + labels + '}') + ' ' + std::to_string(get()) + '\n');
+            }
+
+            public: void write_text(std::string& out) const override
+            {
+                out.append(std::to_string(get()));
+            }
+
+            /**
+             * @brief Shards
+            */
+            private: std::array<shard, SHARDS> m_shards;
+        };
+
+        /**
+         * @brief Counter updated from many threads
+        */
+        typedef basic_counter<SHARD_COUNT> counter;
+
+        /**
+         * @brief Counter updated from a single strand
+        */
+        typedef basic_counter<1> local_counter;
+
+        /**
+         * @brief Value that goes up and down
+        */
+        class gauge : public metric
+        {
+            /**
+             * @brief Add (or subtract) to gauge
+             * @param value Signed increment
+            */
+            public: void add(std::int64_t value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+
+            /**
+             * @brief Set gauge
+             * @param value New value
+            */
+            public: void set(std::int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+
+            /**
+             * @brief Get value
+             * @return Current value
+            */
+            public: std::int64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+            public: const char* type_name() const override { return "gauge"; }
+
+            public: void write_prometheus(const std::string& name, const std::string& labels, std::string& out) const override;
+
+            public: void write_text(std::string& out) const override;
+
+            /**
+             * @brief Value
+            */
+            private: alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> m_value{0};
+        };
+
+        /**
+         * @brief Fixed buckets histogram of nanosecond durations, exported in seconds
+        */
+        class histogram : public metric
+        {
+            /**
+             * @brief Per thread bucket counts
+            */
+            private: struct alignas(CACHE_LINE_SIZE) shard
+            {
+                std::atomic<std::uint64_t> counts[MAX_BUCKETS + 1] = {};
+                std::atomic<std::uint64_t> sum{0};
+            };
+
+            /**
+             * @brief Create histogram, throws std::logic_error if more than MAX_BUCKETS bounds
+             * @param bounds Ascending inclusive upper bounds in nanoseconds
+            */
+            public: histogram(const std::vector<std::uint64_t>& bounds);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~histogram();
+
+            /**
+             * @brief Record duration
+             * @param value_ns Nanoseconds
+            */
+            public: void record(std::uint64_t value_ns);
+
+            /**
+             * @brief Number of recorded values
+             * @return Count
+            */
+            public: std::uint64_t get_count() const;
+
+            /**
+             * @brief Upper bound of the bucket containing the percentile
+             * @param percentile 0 to 100
+             * @return Nanoseconds, UINT64_MAX if in the +Inf bucket
+            */
+            public: std::uint64_t bound_at_percentile(double percentile) const;
+
+            public: const char* type_name() const override { return "histogram"; }
+
+            public: void write_prometheus(const std::string& name, const std::string& labels, std::string& out) const override;
+
+            public: void write_text(std::string& out) const override;
+
+            /**
+             * @brief Counts summed over shards
+             * @param sum Sum of values
+             * @return Per bucket counts, last one is +Inf
+            */
+            private: std::vector<std::uint64_t> collect(std::uint64_t& sum) const;
+
+            /**
+             * @brief Bucket upper bounds
+            */
+            private: std::vector<std::uint64_t> m_bounds;
+
+            /**
+             * @brief Shards
+            */
+            private: std::unique_ptr<shard[]> m_shards;
+        };
+
+        /**
+         * @brief Exponential latency bounds from 1us to ~8s
+         * @return Bounds in nanoseconds
+        */
+        std::vector<std::uint64_t> latency_bounds();
+
+        /**
+         * @brief Named metrics, metrics are unregistered when their last owner releases them
+        */
+        class registry
+        {
+            /**
+             * @brief Empty registry
+            */
+            public: registry();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~registry();
+
+            /**
+             * @brief Create and register a sharded counter
+             * @param name Metric name
+             * @param help Description
+             * @param labels Formatted labels, see label()
+             * @return Counter, unregistered once released
+            */
+            public: std::shared_ptr<counter> make_counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+            /**
+             * @brief Create and register a single strand counter
+             * @param name Metric name
+             * @param help Description
+             * @param labels Formatted labels, see label()
+             * @return Counter, unregistered once released
+            */
+            public: std::shared_ptr<local_counter> make_local_counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+            /**
+             * @brief Create and register a gauge
+             * @param name Metric name
+             * @param help Description
+             * @param labels Formatted labels, see label()
+             * @return Gauge, unregistered once released
+            */
+            public: std::shared_ptr<gauge> make_gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+            /**
+             * @brief Create and register a histogram
+             * @param name Metric name
+             * @param help Description
+             * @param bounds Bucket upper bounds in nanoseconds
+             * @param labels Formatted labels, see label()
+             * @return Histogram, unregistered once released
+            */
+            public: std::shared_ptr<histogram> make_histogram(
+                const std::string& name, const std::string& help, const std::vector<std::uint64_t>& bounds, const std::string& labels = "");
+
+            /**
+             * @brief Prometheus text exposition format (version 0.0.4)
+             * @return Every live metric
+            */
+            public: std::string render_prometheus();
+
+            /**
+             * @brief One "name{labels} value" line per metric
+             * @param labeled Include labeled (per member) metrics, otherwise only unlabeled ones
+             * @return Text
+            */
+            public: std::string render_text(bool labeled);
+
+            /**
+             * @brief Registered metric
+            */
+            private: struct entry
+            {
+                std::string labels;             //!< Formatted labels
+                std::weak_ptr<metric> value;    //!< Metric, expired once released
+            };
+
+            /**
+             * @brief Metrics sharing a name
+            */
+            private: struct family
+            {
+                std::string help;               //!< Description
+                std::string type;               //!< Prometheus type
+                std::vector<entry> entries;     //!< Members of the family
+            };
+
+            /**
+             * @brief Register metric
+             * @param name Metric name
+             * @param help Description
+             * @param labels Formatted labels
+             * @param value Metric
+            */
+            private: void add(const std::string& name, const std::string& help, const std::string& labels, std::shared_ptr<metric> value);
+
+            /**
+             * @brief Drop expired entries, call with m_families_mutex held
+            */
+            private: void prune();
+
+            /**
+             * @brief Families by name, sorted for stable output
+            */
+            private: std::map<std::string, family> m_families;
+
+            /**
+             * @brief Registration and rendering sync, never taken by updates
+            */
+            private: std::mutex m_families_mutex;
+        };
+    }
+}
+
+#endif /* METRICS_HPP */
@@ -0,0 +1,153 @@
+#include "multicast.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace scft
+{
+    namespace multicast
+    {
+        std::uint64_t packet_count(std::uint64_t length)
+        {
+            return (length + DATAGRAM_PAYLOAD - 1) / DATAGRAM_PAYLOAD;
+        }
+
+        void write_header(std::uint8_t* at, std::uint32_t transfer_id, std::uint64_t offset)
+        {
+            std::uint32_t magic = DATAGRAM_MAGIC;
+            std::memcpy(at, &magic, sizeof(magic));
+            std::memcpy(at + 4, &transfer_id, sizeof(transfer_id));
+            std::memcpy(at + 8, &offset, sizeof(offset));
+        }
+
+        bool read_header(const std::uint8_t* at, std::size_t size, std::uint32_t& transfer_id, std::uint64_t& offset)
+        {
+            if (size < DATAGRAM_HEADER_SIZE || size > DATAGRAM_HEADER_SIZE + DATAGRAM_PAYLOAD)
+                return false;
+            std::uint32_t magic;
+            std::memcpy(&magic, at, sizeof(magic));
+            std::memcpy(&transfer_id, at + 4, sizeof(transfer_id));
+            std::memcpy(&offset, at + 8, sizeof(offset));
+            return magic == DATAGRAM_MAGIC && offset % DATAGRAM_PAYLOAD == 0;
+        }
+
+        std::string format_nack(std::uint32_t transfer_id, const std::vector<range>& ranges)
+        {
+            std::string nack = std::to_string(transfer_id);
+            for (const range& _range : ranges)
+                nack += ' ' + std::to_string(_range.first) + '-' + std::to_string(_range.last);
+            return nack;
+        }
+
+        bool parse_nack(std::string_view nack, std::uint32_t& transfer_id, std::vector<range>& ranges)
+        {
+            ranges.clear();
+            try
+            {
+                std::size_t end = std::min(nack.find(' '), nack.size());
+                unsigned long long id = std::stoull(std::string(nack.substr(0, end)));
+                if (id == 0 || id > UINT32_MAX)
+                    return false;
+                transfer_id = static_cast<std::uint32_t>(id);
+                while (end < nack.size() && ranges.size() < MAX_NACK_RANGES)
+                {
+                    std::size_t begin = end + 1;
+                    end = std::min(nack.find(' ', begin), nack.size());
+                    std::string_view token = nack.substr(begin, end - begin);
+                    std::size_t dash = token.find('-');
+                    if (dash == std::string_view::npos)
+                        return false;
+                    range _range{std::stoull(std::string(token.substr(0, dash))), std::stoull(std::string(token.substr(dash + 1)))};
+                    if (_range.last < _range.first)
+                        return false;
+                    ranges.push_back(_range);
+                }
+                return end >= nack.size();
+            }
+            catch (std::exception&)
+            {
+                return false;
+            }
+        }
+
+        bool parse_group(const std::string& text, boost::asio::ip::udp::endpoint& endpoint)
+        {
+            std::size_t colon = text.rfind(':');
+            if (colon == std::string::npos)
+                return false;
+            boost::system::error_code ec;
+            boost::asio::ip::address_v4 address = boost::asio::ip::make_address_v4(text.substr(0, colon), ec);
+            if (ec || !address.is_multicast())
+                return false;
+            try
+            {
+                unsigned long port = std::stoul(text.substr(colon + 1));
+                if (port == 0 || port > UINT16_MAX)
+                    return false;
+                endpoint = boost::asio::ip::udp::endpoint(address, static_cast<std::uint16_t>(port));
+            }
+            catch (std::exception&)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        packet_map::packet_map(std::uint64_t length)
+        :
+        m_bits(static_cast<std::size_t>((packet_count(length) + 63) / 64), 0),
+        m_packets(packet_count(length)),
+        m_missing(m_packets)
+        {
+        }
+
+        packet_map::~packet_map()
+        {
+        }
+
+        bool packet_map::test(std::uint64_t index) const
+        {
+            if (index >= m_packets)
+                return true;
+            return (m_bits[static_cast<std::size_t>(index / 64)] >> (index % 64) & 1) != 0;
+        }
+
+        void packet_map::set(std::uint64_t offset, std::uint64_t length)
+        {
+            std::uint64_t end = std::min(packet_count(offset + length), m_packets);
+            for (std::uint64_t index = offset / DATAGRAM_PAYLOAD; index < end; index++)
+            {
+                if (test(index))
+                    continue;
+                m_bits[static_cast<std::size_t>(index / 64)] |= std::uint64_t(1) << (index % 64);
+                m_missing--;
+            }
+        }
+
+        std::vector<range> packet_map::missing() const
+        {
+            std::vector<range> ranges;
+            for (std::uint64_t index = 0; index < m_packets && m_missing != 0; index++)
+            {
+                // Whole words at once, losses are usually sparse
+                if (index % 64 == 0 && m_bits[static_cast<std::size_t>(index / 64)] == UINT64_MAX)
+                {
+                    index += 63;
+                    continue;
+                }
+                if (test(index))
+                    continue;
+                if (!ranges.empty() && ranges.back().last + 1 == index)
+                    ranges.back().last = index;
+                else if (ranges.size() < MAX_NACK_RANGES)
+                    ranges.push_back(range{index, index});
+                else
+                {
+                    ranges.back().last = m_packets - 1;
+                    break;
+                }
+            }
+            return ranges;
+        }
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef MULTICAST_HPP
+#define MULTICAST_HPP
+
+/**
+ * @file src/multicast.hpp
+ * @brief Defines the multicast datagram format, NACK ranges and packet_map, shared by server and client
+*/
+
+#include <boost/asio.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace scft
+{
+    /**
+     * @brief Multicast file distribution
+     * @verbatim
+     * Datagram:
+     * [1111][2222][33333333][CONTENTS...]
+     * 1: DATAGRAM_MAGIC 4 bytes
+     * 2: Transfer identifier, the stream identifier of the WRITE_FILE flagged FLAG_MULTICAST 4 bytes
+     * 3: Offset of the contents in the file, a multiple of DATAGRAM_PAYLOAD 8 bytes
+     * Packet N carries the contents at N * DATAGRAM_PAYLOAD, NACK ranges count packets
+     * @endverbatim
+    */
+    namespace multicast
+    {
+        /**
+         * @brief First bytes of every datagram
+        */
+        constexpr std::uint32_t DATAGRAM_MAGIC = 0x4d544353;
+
+        /**
+         * @brief Datagram header size
+        */
+        constexpr std::size_t DATAGRAM_HEADER_SIZE = 16;
+
+        /**
+         * @brief Contents per datagram, an unfragmented IPv4 UDP datagram on a 1500 bytes MTU
+        */
+        constexpr std::size_t DATAGRAM_PAYLOAD = 1456;
+
+        /**
+         * @brief Contents per REPAIR frame, whole packets up to STREAM_CHUNK_SIZE
+        */
+        constexpr std::size_t REPAIR_PIECE = DATAGRAM_PAYLOAD * 45;
+
+        /**
+         * @brief Ranges per NACK, the last one is widened to cover the rest so the frame stays a control frame
+        */
+        constexpr std::size_t MAX_NACK_RANGES = 128;
+
+        /**
+         * @brief Packets from first to last, inclusive
+        */
+        struct range
+        {
+            std::uint64_t first;    //!< First packet
+            std::uint64_t last;     //!< Last packet
+        };
+
+        /**
+         * @brief Packets of a file
+         * @param length File length
+         * @return Packet count
+        */
+        std::uint64_t packet_count(std::uint64_t length);
+
+        /**
+         * @brief Write a datagram header
+         * @param at DATAGRAM_HEADER_SIZE bytes
+         * @param transfer_id Transfer identifier
+         * @param offset Contents offset
+        */
+        void write_header(std::uint8_t* at, std::uint32_t transfer_id, std::uint64_t offset);
+
+        /**
+         * @brief Read a datagram header
+         * @param at Datagram
+         * @param size Datagram size
+         * @param transfer_id Transfer identifier
+         * @param offset Contents offset
+         * @return False if it is not a datagram of this protocol
+        */
+        bool read_header(const std::uint8_t* at, std::size_t size, std::uint32_t& transfer_id, std::uint64_t& offset);
+
+        /**
+         * @brief Format a NACK string
+         * @param transfer_id Transfer identifier
+         * @param ranges Missing packets, at most MAX_NACK_RANGES
+         * @return "ID FIRST-LAST FIRST-LAST...", just "ID" once complete
+        */
+        std::string format_nack(std::uint32_t transfer_id, const std::vector<range>& ranges);
+
+        /**
+         * @brief Parse a NACK string
+         * @param nack String
+         * @param transfer_id Transfer identifier
+         * @param ranges Missing packets
+         * @return False if malformed
+        */
+        bool parse_nack(std::string_view nack, std::uint32_t& transfer_id, std::vector<range>& ranges);
+
+        /**
+         * @brief Parse a group
+         * @param text "IPV4:PORT"
+         * @param endpoint Group endpoint
+         * @return False if malformed or not a multicast address
+        */
+        bool parse_group(const std::string& text, boost::asio::ip::udp::endpoint& endpoint);
+
+        /**
+         * @brief Packets of a file received so far
+        */
+        class packet_map
+        {
+            /**
+             * @brief Nothing received
+             * @param length File length
+            */
+            public: packet_map(std::uint64_t length = 0);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~packet_map();
+
+            /**
+             * @brief Check for a packet
+             * @param index Packet
+             * @return True if received, or beyond the file
+            */
+            public: bool test(std::uint64_t index) const;
+
+            /**
+             * @brief Mark the packets of received contents
+             * @param offset Contents offset, a multiple of DATAGRAM_PAYLOAD
+             * @param length Contents length, whole packets or up to the end of the file
+            */
+            public: void set(std::uint64_t offset, std::uint64_t length);
+
+            /**
+             * @brief Check if every packet was received
+             * @return True if complete
+            */
+            public: bool complete() const { return m_missing == 0; }
+
+            /**
+             * @brief Missing packets
+             * @return Up to MAX_NACK_RANGES ranges, the last one covering every missing packet after it
+            */
+            public: std::vector<range> missing() const;
+
+            /**
+             * @brief One bit per packet
+            */
+            private: std::vector<std::uint64_t> m_bits;
+
+            /**
+             * @brief Packet count
+            */
+            private: std::uint64_t m_packets;
+
+            /**
+             * @brief Packets not received
+            */
+            private: std::uint64_t m_missing;
+        };
+    }
+}
+
+#endif /* MULTICAST_HPP */
@@ -0,0 +1,289 @@
+#include "bench_client.hpp"
+#include "file_transfer.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace scft
+{
+    namespace bench
+    {
+    std::uint64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Parse timestamp following a tag
+     * @param str String starting with the tag
+     * @param tag Tag
+     * @param sent_ns Parsed timestamp
+     * @return False if str doesn't start with tag
+    */
+    static bool parse_tag(const char* str, const char* tag, std::uint64_t& sent_ns)
+    {
+        std::size_t tag_len = std::strlen(tag);
+        if (std::strncmp(str, tag, tag_len) != 0)
+            return false;
+        sent_ns = std::strtoull(str + tag_len, nullptr, 10);
+        return sent_ns != 0;
+    }
+
+    bench_client::bench_client(boost::asio::io_context& io_ctx, const transport::endpoint& endpoint, bool shared_memory, statistics& stats)
+    :
+    m_strand(boost::asio::make_strand(io_ctx)),
+    m_socket(m_strand),
+    m_shared_memory(shared_memory),
+    m_endpoint(endpoint),
+    m_stats(stats),
+    m_message(),
+    m_text_timer(m_strand),
+    m_file_timer(m_strand),
+    m_heartbeat_timer(m_strand),
+    m_text_rate(0),
+    m_text_size(0),
+    m_file_rate(0),
+    m_port(0),
+    m_random(std::random_device{}()),
+    m_connected(false)
+    {
+    }
+
+    bench_client::~bench_client()
+    {
+    }
+
+    void bench_client::start()
+    {
+        m_socket.get_socket().async_connect(m_endpoint,
+            [self = shared_from_this()](boost::system::error_code ec)
+            {
+                if (!ec && self->m_shared_memory)
+                {
+                    try
+                    {
+                        self->m_socket.attach(transport::shm_channel::offer(self->m_socket.get_socket(), transport::SHM_RING_SIZE));
+                    }
+                    catch (std::exception&)
+                    {
+                        ec = boost::asio::error::connection_refused;
+                    }
+                }
+                if (!ec)
+                {
+                    self->m_address = transport::get_address(self->m_socket.get_socket().local_endpoint());
+                    self->m_port = transport::get_port(self->m_socket.get_socket().local_endpoint());
+                    self->m_connected = true;
+                    self->m_stats.connected++;
+                    self->schedule_heartbeat();
+                    self->header_reader();
+                }
+                else
+                    self->m_stats.failed++;
+            });
+    }
+
+    void bench_client::start_sending(double text_rate, std::size_t text_size, double file_rate, const std::string& file_path)
+    {
+        boost::asio::post(m_strand,
+            [self = shared_from_this(), text_rate, text_size, file_rate, file_path]()
+            {
+                if (!self->m_connected)
+                    return;
+                self->m_text_rate = text_rate;
+                self->m_text_size = text_size;
+                self->m_file_rate = file_rate;
+                if (file_rate > 0)
+                    self->m_file_template = message::message(message::MESSAGE_TYPE::WRITE_FILE, self->m_address, self->m_port, file_path);
+                if (text_rate > 0)
+                    self->schedule_text();
+                if (file_rate > 0)
+                    self->schedule_file();
+            });
+    }
+
+    void bench_client::stop()
+    {
+        boost::asio::post(m_strand,
+            [self = shared_from_this()]()
+            {
+                self->m_text_timer.cancel();
+                self->m_file_timer.cancel();
+                self->m_heartbeat_timer.cancel();
+                boost::system::error_code ec;
+                self->m_socket.close(ec);
+            });
+    }
+
+    std::chrono::nanoseconds bench_client::next_interval(double rate)
+    {
+        std::uniform_real_distribution<double> jitter(0.5, 1.5);
+        return std::chrono::nanoseconds(static_cast<std::int64_t>(1e9 / rate * jitter(m_random)));
+    }
+
+    void bench_client::schedule_text()
+    {
+        m_text_timer.expires_after(next_interval(m_text_rate));
+        m_text_timer.async_wait(
+            [self = shared_from_this()](boost::system::error_code ec)
+            {
+                if (ec || !self->m_socket.is_open())
+                    return;
+                std::string text = TEXT_TAG + std::to_string(now_ns()) + ':';
+                if (text.size() < self->m_text_size)
+                    text.resize(self->m_text_size, 'x');
+                self->send_message(message::message(message::MESSAGE_TYPE::TEXT, self->m_address, self->m_port, text));
+                self->schedule_text();
+            });
+    }
+
+    void bench_client::schedule_file()
+    {
+        m_file_timer.expires_after(next_interval(m_file_rate));
+        m_file_timer.async_wait(
+            [self = shared_from_this()](boost::system::error_code ec)
+            {
+                if (ec || !self->m_socket.is_open())
+                    return;
+                message::message file_message = self->m_file_template;
+                char digits[FILE_TAG_DIGITS + 1];
+                std::snprintf(digits, sizeof(digits), "%020llu", static_cast<unsigned long long>(now_ns()));
+                std::memcpy(file_message.get_string() + std::strlen(FILE_TAG), digits, FILE_TAG_DIGITS);
+                self->send_message(std::move(file_message));
+                self->schedule_file();
+            });
+    }
+
+    void bench_client::schedule_heartbeat()
+    {
+        m_heartbeat_timer.expires_after(HEARTBEAT_INTERVAL);
+        m_heartbeat_timer.async_wait(
+            [self = shared_from_this()](boost::system::error_code ec)
+            {
+                if (ec || !self->m_socket.is_open())
+                    return;
+                self->send_message(message::message(message::MESSAGE_TYPE::HEARTBEAT, self->m_address, self->m_port, ""));
+                self->schedule_heartbeat();
+            });
+    }
+
+    void bench_client::send_message(message::message _message)
+    {
+        if (m_messages.size() >= MAX_QUEUED_MESSAGES)
+        {
+            m_stats.skipped_messages++;
+            return;
+        }
+        bool write_in_progress = !m_messages.empty();
+        m_messages.push_back(std::move(_message));
+        if (!write_in_progress)
+            flush_messages();
+    }
+
+    void bench_client::flush_messages()
+    {
+        boost::asio::async_write(m_socket,
+            boost::asio::buffer(m_messages.front().get_raw_message(), m_messages.front().get_raw_message().size()),
+            [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
+            {
+                if (!ec)
+                {
+                    self->m_stats.sent_messages++;
+                    self->m_stats.sent_bytes += length;
+                    self->m_messages.pop_front();
+                    if (!self->m_messages.empty())
+                        self->flush_messages();
+                }
+                else
+                    self->m_messages.clear();
+            });
+    }
+
+    void bench_client::header_reader()
+    {
+        boost::asio::async_read(m_socket,
+            boost::asio::buffer(m_message.get_raw_message(), message::HEADER_SIZE),
+            [self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec)
+                    self->header_extension_reader();
+                else
+                    self->disconnected();
+            });
+    }
+
+    void bench_client::header_extension_reader()
+    {
+        std::size_t missing = m_message.extend_header();
+        boost::asio::async_read(m_socket,
+            boost::asio::buffer(m_message.get_raw_message().data() + message::HEADER_SIZE, missing),
+            [self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec && !self->m_message.bad_header())
+                {
+                    self->m_message.adjust();
+                    self->data_buffer_reader();
+                }
+                else
+                    self->disconnected();
+            });
+    }
+
+    void bench_client::data_buffer_reader()
+    {
+        boost::asio::async_read(m_socket,
+            boost::asio::buffer(m_message.get_data(), m_message.get_buffered_data_len()),
+            [self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (ec)
+                    self->disconnected();
+                else if (self->m_message.has_streamed_body())
+                {
+                    // Large files from other members are only counted
+                    std::make_shared<transfer::file_receiver>(self->m_socket, "", self->m_message.get_file_buffer_len(), false, checksum::hasher(),
+                        [self](boost::system::error_code ec, std::uint64_t)
+                        {
+                            if (!ec)
+                                self->record_message();
+                            else
+                                self->disconnected();
+                        })->start();
+                }
+                else
+                    self->record_message();
+            });
+    }
+
+    void bench_client::record_message()
+    {
+        std::uint64_t received_ns = now_ns();
+        std::uint64_t sent_ns = 0;
+        bool tagged = false;
+        if (m_message.get_message_type() == message::MESSAGE_TYPE::TEXT)
+            tagged = parse_tag(m_message.get_string(), TEXT_TAG, sent_ns);
+        else if (m_message.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE)
+            tagged = parse_tag(m_message.get_string(), FILE_TAG, sent_ns);
+
+        m_stats.received_bytes += m_message.get_frame_len();
+        if (tagged)
+        {
+            m_stats.received_messages++;
+            std::uint64_t latency = received_ns > sent_ns ? received_ns - sent_ns : 0;
+            m_stats.interval_latency.record(latency);
+            m_stats.total_latency.record(latency);
+        }
+        else
+            m_stats.other_messages++;
+        header_reader();
+    }
+
+    void bench_client::disconnected()
+    {
+        if (m_connected.exchange(false))
+            m_stats.disconnected++;
+        boost::system::error_code close_ec;
+        m_socket.close(close_ec);
+    }
+    }
+}
@@ -0,0 +1,274 @@
+#ifndef BENCH_CLIENT_HPP
+#define BENCH_CLIENT_HPP
+
+/**
+ * @file src/scft-bench/bench_client.hpp
+ * @brief Defines bench_client, a simulated member driving load against scft-srv
+*/
+
+#include "hdr_histogram.hpp"
+#include "scft_message.hpp"
+#include "transport.hpp"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace scft
+{
+    /**
+     * @brief Load generator
+    */
+    namespace bench
+    {
+        /**
+         * @brief Prefix of timestamped bench text, followed by steady_clock nanoseconds
+        */
+        constexpr const char* TEXT_TAG = "SCFTBENCH:";
+
+        /**
+         * @brief Prefix of timestamped bench file names, followed by 20 digits of steady_clock nanoseconds
+        */
+        constexpr const char* FILE_TAG = "scftbench_";
+
+        /**
+         * @brief Number of digits reserved for the timestamp in file names
+        */
+        constexpr std::size_t FILE_TAG_DIGITS = 20;
+
+        /**
+         * @brief Sends are skipped while this many messages are still queued on a client
+        */
+        constexpr std::size_t MAX_QUEUED_MESSAGES = 256;
+
+        /**
+         * @brief Period of HEARTBEAT frames keeping idle clients from being reaped by the server
+        */
+        constexpr std::chrono::seconds HEARTBEAT_INTERVAL{15};
+
+        /**
+         * @brief Counters shared by every simulated client
+        */
+        struct statistics
+        {
+            std::atomic<std::uint64_t> connected{0};            //!< Established connections
+            std::atomic<std::uint64_t> failed{0};               //!< Connections that could not be established
+            std::atomic<std::uint64_t> disconnected{0};         //!< Connections lost after being established
+            std::atomic<std::uint64_t> sent_messages{0};        //!< Frames fully written
+            std::atomic<std::uint64_t> sent_bytes{0};           //!< Bytes fully written
+            std::atomic<std::uint64_t> skipped_messages{0};     //!< Sends skipped because the queue was full
+            std::atomic<std::uint64_t> received_messages{0};    //!< Bench frames received (fan-out)
+            std::atomic<std::uint64_t> received_bytes{0};       //!< Bytes received, any frame
+            std::atomic<std::uint64_t> other_messages{0};       //!< Non bench frames (joins, leaves...)
+            metrics::hdr_histogram interval_latency;            //!< Fan-out latency since last report (ns)
+            metrics::hdr_histogram total_latency;               //!< Fan-out latency since start (ns)
+        };
+
+        /**
+         * @brief Current steady_clock time
+         * @return Nanoseconds, comparable between clients of the same process
+        */
+        std::uint64_t now_ns();
+
+        /**
+         * @brief Simulated member
+        */
+        class bench_client : public std::enable_shared_from_this<bench_client>
+        {
+            /**
+             * @brief Prepare socket on its own strand
+             * @param io_ctx boost io context, may be run by several threads
+             * @param endpoint Server endpoint
+             * @param shared_memory Hand the server a shared memory segment once connected, endpoint is its shared memory socket
+             * @param stats Shared counters
+            */
+            public: bench_client(boost::asio::io_context& io_ctx, const transport::endpoint& endpoint, bool shared_memory, statistics& stats);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~bench_client();
+
+            /**
+             * @brief Connect and start reading
+            */
+            public: void start();
+
+            /**
+             * @brief Start periodic sends, call once connected
+             * @param text_rate TEXT frames per second, 0 for none
+             * @param text_size Bytes of text per frame
+             * @param file_rate WRITE_FILE frames per second, 0 for none
+             * @param file_path Template file, its name must start with FILE_TAG and FILE_TAG_DIGITS zeros
+            */
+            public: void start_sending(double text_rate, std::size_t text_size, double file_rate, const std::string& file_path);
+
+            /**
+             * @brief Cancel timers and close socket
+            */
+            public: void stop();
+
+            /**
+             * @brief Check connection state
+             * @return True once connected
+            */
+            public: bool is_connected() const { return m_connected; }
+
+            /**
+             * @brief Read message header
+            */
+            private: void header_reader();
+
+            /**
+             * @brief Read the rest of a version 2 header
+            */
+            private: void header_extension_reader();
+
+            /**
+             * @brief Read message data, discarding streamed file contents
+            */
+            private: void data_buffer_reader();
+
+            /**
+             * @brief Record latency of a completely read message and read the next one
+            */
+            private: void record_message();
+
+            /**
+             * @brief Count disconnection once and close socket
+            */
+            private: void disconnected();
+
+            /**
+             * @brief Queue message and write it
+             * @param _message Message to send
+            */
+            private: void send_message(message::message _message);
+
+            /**
+             * @brief Write queued messages
+            */
+            private: void flush_messages();
+
+            /**
+             * @brief Arm text timer
+            */
+            private: void schedule_text();
+
+            /**
+             * @brief Arm file timer
+            */
+            private: void schedule_file();
+
+            /**
+             * @brief Arm heartbeat timer
+            */
+            private: void schedule_heartbeat();
+
+            /**
+             * @brief Randomized interval, so clients don't fire in lockstep
+             * @param rate Events per second
+             * @return Interval
+            */
+            private: std::chrono::nanoseconds next_interval(double rate);
+
+            /**
+             * @brief Serializes handlers of this client
+            */
+            private: boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
+
+            /**
+             * @brief Connection, a socket or shared memory rings
+            */
+            private: transport::stream m_socket;
+
+            /**
+             * @brief Exchange frames through shared memory once connected
+            */
+            private: bool m_shared_memory;
+
+            /**
+             * @brief Server endpoint
+            */
+            private: transport::endpoint m_endpoint;
+
+            /**
+             * @brief Shared counters
+            */
+            private: statistics& m_stats;
+
+            /**
+             * @brief Current reading message
+            */
+            private: message::message m_message;
+
+            /**
+             * @brief Output message queue
+            */
+            private: std::deque<message::message> m_messages;
+
+            /**
+             * @brief File message built once, copied and timestamped on each send
+            */
+            private: message::message m_file_template;
+
+            /**
+             * @brief Text send timer
+            */
+            private: boost::asio::steady_timer m_text_timer;
+
+            /**
+             * @brief File send timer
+            */
+            private: boost::asio::steady_timer m_file_timer;
+
+            /**
+             * @brief Heartbeat timer
+            */
+            private: boost::asio::steady_timer m_heartbeat_timer;
+
+            /**
+             * @brief Text frames per second
+            */
+            private: double m_text_rate;
+
+            /**
+             * @brief Text frame size
+            */
+            private: std::size_t m_text_size;
+
+            /**
+             * @brief File frames per second
+            */
+            private: double m_file_rate;
+
+            /**
+             * @brief Local address, used as origin
+            */
+            private: std::string m_address;
+
+            /**
+             * @brief Local port, used as origin
+            */
+            private: std::uint16_t m_port;
+
+            /**
+             * @brief Jitter source
+            */
+            private: std::mt19937_64 m_random;
+
+            /**
+             * @brief Connected flag
+            */
+            private: std::atomic<bool> m_connected;
+        };
+    }
+}
+
+#endif /* BENCH_CLIENT_HPP */
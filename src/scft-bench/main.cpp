@@ -0,0 +1,363 @@
+#include "bench_client.hpp"
+#include "command_line.hpp"
+#include "json_lines.hpp"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __ANDROID__
+    #include <boost/filesystem.hpp>
+    namespace bench_fs = boost::filesystem;
+#else
+    #include <filesystem>
+    namespace bench_fs = std::filesystem;
+#endif
+
+/**
+ * @brief Load parameters, filled from a scenario then overridden by flags
+*/
+struct bench_config
+{
+    std::string address = "127.0.0.1";     //!< Server address
+    std::uint16_t port = 0;                 //!< Server port
+    std::string local_path;                 //!< Server Unix domain socket, used instead of address and port if set
+    bool shared_memory = false;             //!< local_path is the server's shared memory socket, frames go through shared memory
+    std::size_t clients = 10;               //!< Simulated members
+    std::size_t threads = 1;                //!< io_context threads
+    std::size_t senders = 10;               //!< Members sending text
+    double text_rate = 10;                  //!< TEXT frames per second per sender
+    std::size_t text_size = 64;             //!< TEXT payload size
+    std::size_t file_senders = 0;           //!< Members sending files
+    double file_rate = 0;                   //!< WRITE_FILE frames per second per file sender
+    std::size_t file_size = 0;              //!< WRITE_FILE payload size
+    double duration = 10;                   //!< Measured seconds
+    double warmup = 2;                      //!< Seconds between last connection and first send
+    double interval = 1;                    //!< Seconds between reports
+    long server_pid = 0;                    //!< scft-srv pid for RSS sampling, 0 to disable
+    bool json = false;                      //!< JSON lines report
+};
+
+/**
+ * @brief Apply scenario defaults
+ * @param name idle, chat-storm, files-chat or custom
+ * @param config Config to fill
+ * @return False if unknown scenario
+*/
+static bool apply_scenario(const std::string& name, bench_config& config)
+{
+    if (name == "idle")
+    {
+        config.clients = 1000;
+        config.senders = 0;
+        config.file_senders = 0;
+    }
+    else if (name == "chat-storm")
+    {
+        config.clients = 100;
+        config.senders = 100;
+        config.text_rate = 50;
+        config.text_size = 128;
+        config.file_senders = 0;
+    }
+    else if (name == "files-chat")
+    {
+        config.clients = 20;
+        config.senders = 20;
+        config.text_rate = 5;
+        config.file_senders = 1;
+        config.file_rate = 0.5;
+        config.file_size = 16 * 1024 * 1024;
+    }
+    else if (name != "custom")
+        return false;
+    return true;
+}
+
+/**
+ * @brief Resident set size of a process
+ * @param pid Process id
+ * @return RSS in bytes, 0 if unavailable
+*/
+static std::uint64_t read_rss(long pid)
+{
+#ifdef __linux__
+    std::ifstream status{"/proc/" + std::to_string(pid) + "/status"};
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return std::stoull(line.substr(6)) * 1024;
+    }
+#else
+    (void)pid;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Runs one benchmark and prints reports
+*/
+class bench_runner
+{
+    public: bench_runner(const bench_config& config)
+    :
+    m_config(config),
+    m_work(boost::asio::make_work_guard(m_io_ctx))
+    {
+    }
+
+    public: ~bench_runner() {}
+
+    private: static double ms(std::uint64_t ns) { return ns / 1e6; }
+
+    private: void report(const std::string& type, double elapsed, double period, std::uint64_t rss)
+    {
+        std::uint64_t sent_messages = m_stats.sent_messages.load();
+        std::uint64_t sent_bytes = m_stats.sent_bytes.load();
+        std::uint64_t received_messages = m_stats.received_messages.load();
+        std::uint64_t received_bytes = m_stats.received_bytes.load();
+        const scft::metrics::hdr_histogram& latency = (type == "summary") ? m_stats.total_latency : m_stats.interval_latency;
+
+        double sent_rate = (sent_messages - m_last_sent_messages) / period;
+        double sent_byte_rate = (sent_bytes - m_last_sent_bytes) / period;
+        double received_rate = (received_messages - m_last_received_messages) / period;
+        double received_byte_rate = (received_bytes - m_last_received_bytes) / period;
+        if (type != "summary")
+        {
+            m_last_sent_messages = sent_messages;
+            m_last_sent_bytes = sent_bytes;
+            m_last_received_messages = received_messages;
+            m_last_received_bytes = received_bytes;
+        }
+
+        if (m_config.json)
+        {
+            std::cout << scft::json_lines::object({
+                {"type", scft::json_lines::quote(type)},
+                {"elapsed_s", std::to_string(elapsed)},
+                {"connected", std::to_string(m_stats.connected.load() - m_stats.disconnected.load())},
+                {"sent_msgs_per_s", std::to_string(sent_rate)},
+                {"sent_bytes_per_s", std::to_string(sent_byte_rate)},
+                {"recv_msgs_per_s", std::to_string(received_rate)},
+                {"recv_bytes_per_s", std::to_string(received_byte_rate)},
+                {"latency_count", std::to_string(latency.get_count())},
+                {"latency_p50_ms", std::to_string(ms(latency.value_at_percentile(50)))},
+                {"latency_p90_ms", std::to_string(ms(latency.value_at_percentile(90)))},
+                {"latency_p99_ms", std::to_string(ms(latency.value_at_percentile(99)))},
+                {"latency_p999_ms", std::to_string(ms(latency.value_at_percentile(99.9)))},
+                {"latency_max_ms", std::to_string(ms(latency.get_max()))},
+                {"skipped", std::to_string(m_stats.skipped_messages.load())},
+                {"server_rss_bytes", std::to_string(rss)}}) << '\n';
+        }
+        else
+        {
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                "%-8s %7.1f %6llu %10.0f %9.2f %10.0f %9.2f %9.3f %9.3f %9.3f %9.3f %8llu %9.1f\n",
+                type.c_str(), elapsed,
+                static_cast<unsigned long long>(m_stats.connected.load() - m_stats.disconnected.load()),
+                sent_rate, sent_byte_rate / 1048576.0, received_rate, received_byte_rate / 1048576.0,
+                ms(latency.value_at_percentile(50)), ms(latency.value_at_percentile(99)),
+                ms(latency.value_at_percentile(99.9)), ms(latency.get_max()),
+                static_cast<unsigned long long>(m_stats.skipped_messages.load()), rss / 1048576.0);
+            std::cout << line;
+        }
+        std::cout.flush();
+        if (type != "summary")
+            m_stats.interval_latency.reset();
+    }
+
+    private: std::string make_file_template()
+    {
+        bench_fs::path path = bench_fs::temp_directory_path() /
+            (std::string(scft::bench::FILE_TAG) + std::string(scft::bench::FILE_TAG_DIGITS, '0') + ".bin");
+        std::ofstream out_file{path.string(), std::ios::out | std::ios::binary | std::ios::trunc};
+        std::mt19937_64 random(42);
+        std::vector<std::uint64_t> block(8192);
+        for (std::size_t written = 0; written < m_config.file_size;)
+        {
+            for (std::uint64_t& word : block)
+                word = random();
+            std::size_t len = std::min(m_config.file_size - written, block.size() * sizeof(std::uint64_t));
+            out_file.write(reinterpret_cast<const char*>(block.data()), len);
+            written += len;
+        }
+        return path.string();
+    }
+
+    public: int run()
+    {
+        scft::transport::endpoint endpoint = m_config.local_path.empty()
+            ? scft::transport::endpoint(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(m_config.address), m_config.port))
+            : scft::transport::make_local_endpoint(m_config.local_path);
+        std::vector<std::thread> pool;
+        for (std::size_t index = 0; index < m_config.threads; index++)
+            pool.emplace_back([this](){ m_io_ctx.run(); });
+
+        std::cerr << "Connecting " << m_config.clients << " clients to " << scft::transport::describe(endpoint) << '\n';
+        for (std::size_t index = 0; index < m_config.clients; index++)
+        {
+            m_clients.push_back(std::make_shared<scft::bench::bench_client>(m_io_ctx, endpoint, m_config.shared_memory, m_stats));
+            m_clients.back()->start();
+        }
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (m_stats.connected + m_stats.failed < m_config.clients && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::cerr << m_stats.connected << " connected, " << m_stats.failed << " failed\n";
+
+        std::string file_path;
+        if (m_config.file_senders > 0 && m_config.file_size > 0 && m_config.file_rate > 0)
+            file_path = make_file_template();
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(m_config.warmup));
+        m_stats.interval_latency.reset();
+        m_stats.total_latency.reset();
+        m_last_sent_messages = m_stats.sent_messages;
+        m_last_sent_bytes = m_stats.sent_bytes;
+        m_last_received_messages = m_stats.received_messages;
+        m_last_received_bytes = m_stats.received_bytes;
+        std::uint64_t start_sent_messages = m_last_sent_messages;
+        std::uint64_t start_sent_bytes = m_last_sent_bytes;
+        std::uint64_t start_received_messages = m_last_received_messages;
+        std::uint64_t start_received_bytes = m_last_received_bytes;
+
+        for (std::size_t index = 0; index < m_clients.size(); index++)
+        {
+            double text_rate = index < m_config.senders ? m_config.text_rate : 0;
+            double file_rate = (index < m_config.file_senders && !file_path.empty()) ? m_config.file_rate : 0;
+            if (text_rate > 0 || file_rate > 0)
+                m_clients[index]->start_sending(text_rate, m_config.text_size, file_rate, file_path);
+        }
+
+        if (!m_config.json)
+            std::cout << "type     elapsed  conns   sent/s     sMiB/s     recv/s    rMiB/s   p50(ms)   p99(ms)  p999(ms)   max(ms)  skipped  rss(MiB)\n";
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point last = start;
+        std::uint64_t peak_rss = 0;
+        while (std::chrono::duration<double>(last - start).count() < m_config.duration)
+        {
+            std::this_thread::sleep_until(last + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(m_config.interval)));
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            std::uint64_t rss = m_config.server_pid ? read_rss(m_config.server_pid) : 0;
+            peak_rss = std::max(peak_rss, rss);
+            report("interval", std::chrono::duration<double>(now - start).count(), std::chrono::duration<double>(now - last).count(), rss);
+            last = now;
+        }
+
+        for (std::shared_ptr<scft::bench::bench_client>& _client : m_clients)
+            _client->stop();
+        m_last_sent_messages = start_sent_messages;
+        m_last_sent_bytes = start_sent_bytes;
+        m_last_received_messages = start_received_messages;
+        m_last_received_bytes = start_received_bytes;
+        report("summary", std::chrono::duration<double>(last - start).count(), std::chrono::duration<double>(last - start).count(), peak_rss);
+
+        m_work.reset();
+        m_io_ctx.stop();
+        for (std::thread& thread : pool)
+            thread.join();
+        m_clients.clear();
+        if (!file_path.empty())
+            bench_fs::remove(file_path);
+        return m_stats.connected == 0 ? 1 : 0;
+    }
+
+    private: bench_config m_config;
+    private: boost::asio::io_context m_io_ctx;
+    private: boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work;
+    private: scft::bench::statistics m_stats;
+    private: std::vector<std::shared_ptr<scft::bench::bench_client>> m_clients;
+    private: std::uint64_t m_last_sent_messages = 0;
+    private: std::uint64_t m_last_sent_bytes = 0;
+    private: std::uint64_t m_last_received_messages = 0;
+    private: std::uint64_t m_last_received_bytes = 0;
+};
+
+static void print_usage()
+{
+    std::cout <<
+        "Usage: scft-bench --port PORT | --unix PATH | --shm PATH [OPTIONS]\n"
+        "Drives simulated members against a running scft-srv\n"
+        "\t--address IP: Server address (default 127.0.0.1)\n"
+        "\t--port PORT: Server port\n"
+        "\t--unix PATH: Server Unix domain socket, instead of address and port\n"
+        "\t--shm PATH: Server shared memory socket, members exchange frames through shared memory\n"
+        "\t--scenario NAME: idle (1000 idle members), chat-storm, files-chat or custom (default)\n"
+        "\t--clients N: Simulated members\n"
+        "\t--threads N: io threads (default 1)\n"
+        "\t--senders N: Members sending text\n"
+        "\t--text-rate R: Text frames per second per sender\n"
+        "\t--text-size BYTES: Text frame payload size\n"
+        "\t--file-senders N: Members sending files\n"
+        "\t--file-rate R: File frames per second per file sender\n"
+        "\t--file-size BYTES: File payload size\n"
+        "\t--duration S: Measured seconds (default 10)\n"
+        "\t--warmup S: Seconds to wait after connecting (default 2)\n"
+        "\t--interval S: Seconds between reports (default 1)\n"
+        "\t--server-pid PID: Sample scft-srv resident memory\n"
+        "\t--json: One JSON object per report line\n"
+        "\t--help: Prints this\n";
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        scft::command_line::arguments args(argc, argv, {"json", "help"});
+        std::vector<std::string> unknown = args.unknown({
+            "json", "help", "address", "port", "unix", "shm", "scenario", "clients", "threads", "senders", "text-rate", "text-size",
+            "file-senders", "file-rate", "file-size", "duration", "warmup", "interval", "server-pid"});
+        if (!unknown.empty())
+            throw std::runtime_error("Unknown flag --" + unknown.front());
+        if (args.has("help") || (!args.has("port") && !args.has("unix") && !args.has("shm")))
+        {
+            print_usage();
+            return args.has("help") ? 0 : 1;
+        }
+
+        bench_config config;
+        if (!apply_scenario(args.get("scenario", "custom"), config))
+            throw std::runtime_error("Unknown scenario " + args.get("scenario"));
+        config.address = args.get("address", config.address);
+        config.port = static_cast<std::uint16_t>(args.get_uint("port", 0));
+        config.local_path = args.get("unix", config.local_path);
+        if (args.has("shm"))
+        {
+            config.local_path = args.get("shm");
+            config.shared_memory = true;
+        }
+        config.clients = args.get_uint("clients", config.clients);
+        config.threads = std::max<std::uint64_t>(1, args.get_uint("threads", config.threads));
+        config.senders = args.get_uint("senders", config.senders);
+        config.text_rate = args.get_double("text-rate", config.text_rate);
+        config.text_size = args.get_uint("text-size", config.text_size);
+        config.file_senders = args.get_uint("file-senders", config.file_senders);
+        config.file_rate = args.get_double("file-rate", config.file_rate);
+        config.file_size = args.get_uint("file-size", config.file_size);
+        config.duration = args.get_double("duration", config.duration);
+        config.warmup = args.get_double("warmup", config.warmup);
+        config.interval = std::max(0.1, args.get_double("interval", config.interval));
+        config.server_pid = static_cast<long>(args.get_uint("server-pid", 0));
+        config.json = args.has("json");
+
+        bench_runner runner(config);
+        return runner.run();
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        print_usage();
+        return 1;
+    }
+}
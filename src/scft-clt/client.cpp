@@ -1,5 +1,11 @@
 #include "client.hpp"
+#include "file_transfer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <random>
 
 using boost::asio::ip::tcp;
 
@@ -7,81 +13,1066 @@ namespace scft
 {
     namespace client
     {
+    /**
+     * @brief Resolve a server address
+     * @param io_ctx boost io context
+     * @param address Host name or IP
+     * @param port Port
+     * @return Endpoints, throws if none
+    */
+    static std::vector<transport::endpoint> resolve(boost::asio::io_context& io_ctx, const std::string& address, std::uint16_t port)
+    {
+        std::vector<transport::endpoint> endpoints;
+        tcp::resolver resolver(io_ctx);
+        for (const tcp::resolver::results_type::value_type& entry : resolver.resolve(address, std::to_string(port)))
+            endpoints.push_back(entry.endpoint());
+        return endpoints;
+    }
+
     client::client(boost::asio::io_context& io_ctx, const std::string& address, std::uint16_t port, basic_shell::scrolling_log& _log)
     :
+    client(io_ctx, resolve(io_ctx, address, port), false, _log)
+    {
+    }
+
+    client::client(boost::asio::io_context& io_ctx, const std::string& path, bool shared_memory, basic_shell::scrolling_log& _log)
+    :
+    client(io_ctx, std::vector<transport::endpoint>{transport::make_local_endpoint(path)}, shared_memory, _log)
+    {
+    }
+
+    client::client(boost::asio::io_context& io_ctx, const std::vector<transport::endpoint>& endpoints, bool shared_memory, basic_shell::scrolling_log& _log)
+    :
     m_io_ctx(io_ctx),
-    m_socket(io_ctx),
-    m_log(_log)
+    m_socket(io_ctx.get_executor()),
+    m_endpoints(endpoints),
+    m_reconnect(true),
+    m_reconnecting(false),
+    m_attempts(0),
+    m_reconnect_timer(io_ctx),
+    m_link(0),
+    m_reading(false),
+    m_resuming(false),
+    m_retaining(false),
+    m_received(0),
+    m_acknowledged(0),
+    m_received_bytes(0),
+    m_acknowledged_bytes(0),
+    m_window(message::DEFAULT_RECEIVE_WINDOW),
+    m_window_negotiated(false),
+    m_sequence(0),
+    m_acked(0),
+    m_resend(1),
+    m_port(0),
+    m_shared_memory(shared_memory),
+    m_heartbeat_timer(io_ctx),
+    m_multicast_socket(io_ctx),
+    m_datagram(multicast::DATAGRAM_HEADER_SIZE + multicast::DATAGRAM_PAYLOAD),
+    m_multicast_timer(io_ctx),
+    m_queued_bytes(0),
+    m_writing(false),
+    m_low_latency(false),
+    m_coalesce_window(DEFAULT_COALESCE_WINDOW),
+    m_coalesce_bytes(DEFAULT_COALESCE_BYTES),
+    m_coalesce_timer(io_ctx),
+    m_coalescing(false),
+    m_frames_written(0),
+    m_write_calls(0),
+    m_log(_log),
+    m_connected(false),
+    m_closed(false),
+    m_tracing(true),
+    m_trace_prefix(static_cast<std::uint64_t>(std::random_device{}()) << 32),
+    m_trace_sequence(0),
+    m_streams(true),
+    m_multicast(false),
+    m_delta(true),
+    m_offered_bytes(0),
+    m_direct_negotiated(false),
+    m_direct_port(0),
+    m_next_offer_id(1),
+    m_preferred_checksum(checksum::CRC32),
+    m_checksum_algorithm(checksum::CRC32),
+    m_stopping(false),
+    m_preparation_pool(PREPARATION_THREADS)
     {
-        tcp::resolver resolver(io_ctx);
-        auto endpoints = resolver.resolve(address, std::to_string(port));
-        boost::asio::async_connect(m_socket, endpoints,
-            [this](boost::system::error_code ec, tcp::endpoint)
+        connect();
+    }
+
+    void client::connect()
+    {
+        std::uint64_t link = ++m_link;
+        m_socket.reset();
+        boost::asio::async_connect(m_socket.get_socket(), m_endpoints,
+            [this, link](boost::system::error_code ec, const transport::endpoint&)
             {
-                if (!ec)
+                if (link != m_link || m_closed)
+                    return;
+                std::string error;
+                if (ec)
+                    error = "Connection failed: " + ec.message() + '\n';
+                else if (m_shared_memory)
                 {
-                    m_log.append_log(
-                        "Connected to " + m_socket.remote_endpoint().address().to_string() + ':'
-                        + std::to_string(m_socket.remote_endpoint().port()) +'\n');
-                    header_reader();
+                    try
+                    {
+                        m_socket.attach(transport::shm_channel::offer(m_socket.get_socket(), transport::SHM_RING_SIZE));
+                    }
+                    catch (std::exception& e)
+                    {
+                        error = "Shared memory failed: " + std::string(e.what()) + '\n';
+                    }
+                }
+                if (error.empty())
+                    connected(m_reconnecting && !m_session.empty());
+                else if (m_reconnecting)
+                    reconnect_waiter();
+                else
+                {
+                    m_log.append_log(error);
+                    close();
                 }
             });
     }
 
+    void client::connected(bool resuming)
+    {
+        m_reconnecting = false;
+        m_attempts = 0;
+        if (!resuming)
+            restart();
+        m_log.append_log(std::string(resuming ? "Reconnected to " : "Connected to ")
+            + transport::describe(m_socket.get_socket().remote_endpoint())
+            + (m_shared_memory ? " through shared memory\n" : "\n"));
+        m_connected = true;
+        if (m_low_latency)
+            transport::set_no_delay(m_socket.get_socket(), true);
+        m_last_read = std::chrono::steady_clock::now();
+        m_last_write = m_last_read;
+        heartbeat_waiter();
+        if (!m_reading)
+            header_reader();
+        if (resuming)
+            resume();
+        // Servers predating NEGOTIATE drop it, only send it when asked for something
+        else if (m_preferred_checksum != checksum::CRC32 || m_streams || m_multicast || m_direct_server || m_reconnect)
+            negotiate();
+        else if (!m_scheduler.empty())
+            flush_messages();
+    }
+
+    void client::disconnected()
+    {
+        if (m_closed || !m_connected)
+            return;
+        if (!m_reconnect)
+        {
+            close();
+            return;
+        }
+        m_connected = false;
+        m_reconnecting = true;
+        m_resuming = false;
+        // Handlers of this connection still to run see a new link and leave its state alone
+        ++m_link;
+        m_socket.reset();
+        m_heartbeat_timer.cancel();
+        m_coalesce_timer.cancel();
+        m_coalescing = false;
+        // Frames being written may or may not have arrived, the session sends them again if not
+        for (mux::scheduled_frame& frame : m_in_flight)
+        {
+            m_queued_bytes -= frame.queued_len;
+            retain(std::move(frame));
+        }
+        m_in_flight.clear();
+        m_gather.clear();
+        m_writing = false;
+        m_log.append_log("Connection lost, reconnecting\n");
+        reconnect_waiter();
+    }
+
+    void client::reconnect_waiter()
+    {
+        if (m_attempts >= RECONNECT_ATTEMPTS)
+        {
+            m_log.append_log("Could not reconnect\n");
+            close();
+            return;
+        }
+        std::chrono::milliseconds delay = std::min<std::chrono::milliseconds>(RECONNECT_MAX_DELAY,
+            RECONNECT_DELAY * (1U << std::min(m_attempts, 16U)));
+        // Jitter keeps clients dropped together from reconnecting together
+        static thread_local std::minstd_rand generator(std::random_device{}());
+        delay = delay / 2 + std::chrono::milliseconds(std::uniform_int_distribution<std::int64_t>(0, delay.count() / 2)(generator));
+        m_attempts++;
+        m_reconnect_timer.expires_after(delay);
+        m_reconnect_timer.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                if (ec || m_closed)
+                    return;
+                connect();
+            });
+    }
+
+    void client::restart()
+    {
+        m_session.clear();
+        m_retaining = m_reconnect;
+        m_received = 0;
+        m_acknowledged = 0;
+        m_received_bytes = 0;
+        m_acknowledged_bytes = 0;
+        m_window_negotiated = false;
+        m_sequence = 0;
+        m_acked = 0;
+        m_resend = 1;
+        m_unacked.clear();
+        // Chunked files and streams the server has no trace of begin again
+        m_scheduler.rewind();
+        m_incoming.clear();
+        boost::system::error_code ec;
+        transport::endpoint local = m_socket.get_socket().local_endpoint(ec);
+        std::lock_guard<std::mutex> lock(m_origin_mutex);
+        m_address = ec ? std::string() : transport::get_address(local);
+        m_port = ec ? 0 : transport::get_port(local);
+    }
+
+    void client::resume()
+    {
+        m_resuming = true;
+        std::shared_ptr<message::message> request = std::make_shared<message::message>(message::MESSAGE_TYPE::SESSION,
+            get_address(), get_port(), m_session + ' ' + std::to_string(m_received));
+        m_writing = true;
+        boost::asio::async_write(m_socket, boost::asio::buffer(request->get_raw_message()),
+            [this, request, link = m_link](boost::system::error_code ec, std::size_t)
+            {
+                if (link != m_link)
+                    return;
+                m_writing = false;
+                if (ec)
+                {
+                    disconnected();
+                    return;
+                }
+                m_last_write = std::chrono::steady_clock::now();
+                if (!m_resuming && (!m_scheduler.empty() || m_resend <= m_sequence))
+                    flush_messages();
+            });
+    }
+
+    void client::on_session()
+    {
+        if (!m_resuming)
+            return;
+        m_resuming = false;
+        std::string_view answer = m_view.get_string();
+        std::size_t space = answer.find(' ');
+        if (space != std::string_view::npos && answer.substr(0, space) == m_session)
+        {
+            try
+            {
+                std::uint64_t received = std::stoull(std::string(answer.substr(space + 1)));
+                if (received >= m_acked && received <= m_sequence)
+                {
+                    acknowledge(received);
+                    m_resend = received + 1;
+                    m_log.append_log("Resumed session, " + std::to_string(m_sequence - received) + " frames to send again\n");
+                    if (!m_writing && (!m_scheduler.empty() || m_resend <= m_sequence))
+                        flush_messages();
+                    return;
+                }
+            }
+            catch (std::exception&)
+            {
+            }
+        }
+        m_log.append_log("Session lost, " + std::to_string(m_unacked.size()) + " unacknowledged frames dropped\n");
+        restart();
+        negotiate();
+        if (!m_writing && !m_scheduler.empty())
+            flush_messages();
+    }
+
+    void client::adopt_origin()
+    {
+        // "local:N", frames then need no stamping by the server, which would read large contents once more
+        std::string_view origin = m_view.get_origin();
+        std::size_t colon = origin.rfind(':');
+        if (get_address() != transport::LOCAL_ADDRESS || colon == std::string_view::npos || origin.substr(0, colon) != transport::LOCAL_ADDRESS)
+            return;
+        unsigned long port;
+        try
+        {
+            port = std::stoul(std::string(origin.substr(colon + 1)));
+        }
+        catch (std::exception&)
+        {
+            return;
+        }
+        if (port > UINT16_MAX)
+            return;
+        std::lock_guard<std::mutex> lock(m_origin_mutex);
+        m_port = static_cast<std::uint16_t>(port);
+    }
+
+    void client::frame_received()
+    {
+        if (!message::is_sequenced(m_view.get_message_type(), m_view.get_flags()))
+            return;
+        m_received++;
+        m_received_bytes += m_view.get_frame_len();
+        // Half the window leaves the server room to write while the ACK travels
+        if ((!m_session.empty() && m_received - m_acknowledged >= message::ACK_INTERVAL)
+            || (m_window_negotiated && m_received_bytes - m_acknowledged_bytes >= m_window / 2))
+            send_ack();
+    }
+
+    void client::send_ack()
+    {
+        m_acknowledged = m_received;
+        m_acknowledged_bytes = m_received_bytes;
+        message::message ack(message::MESSAGE_TYPE::ACK, get_address(), get_port(), std::to_string(m_received));
+        m_queued_bytes += ack.get_raw_message().size();
+        m_scheduler.push(std::move(ack));
+        if (!m_writing)
+            flush_messages();
+    }
+
+    void client::acknowledge(std::uint64_t received)
+    {
+        received = std::min(received, m_sequence);
+        while (!m_unacked.empty() && m_unacked.front().sequence <= received)
+            m_unacked.pop_front();
+        m_acked = std::max(m_acked, received);
+    }
+
+    void client::retain(mux::scheduled_frame frame)
+    {
+        if (!m_retaining || frame.sequence == 0 || frame.sequence <= m_acked
+            || (!m_unacked.empty() && frame.sequence <= m_unacked.back().sequence))
+            return;
+        m_unacked.push_back(std::move(frame));
+    }
+
     client::~client()
     {
+        m_stopping = true;
+        m_preparation_pool.join();
         m_socket.close();
+        boost::system::error_code ec;
+        m_multicast_socket.close(ec);
+    }
+
+    void client::send_file(const std::string& path)
+    {
+        std::shared_ptr<file_send> _file_send = std::make_shared<file_send>();
+        _file_send->path = path;
+        {
+            std::lock_guard<std::mutex> lock(m_file_sends_mutex);
+            m_file_sends.push_back(_file_send);
+        }
+        std::string address = get_address();
+        std::uint16_t port = get_port();
+        boost::asio::post(m_preparation_pool,
+            [this, _file_send, address, port]()
+            {
+                std::string error;
+                try
+                {
+                    message::message _message{message::MESSAGE_TYPE::WRITE_FILE, address, port, _file_send->path, m_checksum_algorithm,
+                        [this, _file_send](std::uint64_t done, std::uint64_t total)
+                        {
+                            _file_send->total = total;
+                            _file_send->done = done;
+                            return !m_stopping;
+                        }};
+                    // Queued before the preparation is removed below, drain() can't miss it
+                    send_message(_message);
+                }
+                catch (std::exception& e)
+                {
+                    error = e.what();
+                }
+                boost::asio::post(m_io_ctx,
+                    [this, _file_send, address, port, error]()
+                    {
+                        if (error.empty())
+                            m_log.append_log('[' + address + ':' + std::to_string(port) + "]: [FILE]: " + _file_send->path + '\n');
+                        else
+                            m_log.append_log("Could not send " + _file_send->path + ": " + error);
+                        {
+                            std::lock_guard<std::mutex> lock(m_file_sends_mutex);
+                            m_file_sends.remove(_file_send);
+                        }
+                        check_drained();
+                    });
+            });
+    }
+
+    void client::send_directory(const std::string& path)
+    {
+        std::shared_ptr<directory_send> _directory_send = std::make_shared<directory_send>();
+        _directory_send->progress = std::make_shared<file_send>();
+        _directory_send->progress->path = path;
+        {
+            std::lock_guard<std::mutex> lock(m_file_sends_mutex);
+            m_file_sends.push_back(_directory_send->progress);
+        }
+        boost::asio::post(m_preparation_pool,
+            [this, _directory_send, path]()
+            {
+                std::string error;
+                try
+                {
+                    // Names start with the directory's own name, "." sends the current directory under its name
+                    std::filesystem::path root = std::filesystem::absolute(path).lexically_normal();
+                    if (!root.has_filename())
+                        root = root.parent_path();
+                    std::string base = root.filename().generic_string();
+                    std::uint64_t total = 0;
+                    for (std::filesystem::recursive_directory_iterator entry(root, std::filesystem::directory_options::skip_permission_denied);
+                        entry != std::filesystem::recursive_directory_iterator(); ++entry)
+                    {
+                        if (!entry->is_regular_file())
+                            continue;
+                        std::string relative = entry->path().lexically_relative(root).generic_string();
+                        _directory_send->files.push_back(directory_entry{entry->path().string(),
+                            base.empty() ? relative : base + '/' + relative, entry->file_size()});
+                        total += _directory_send->files.back().length;
+                    }
+                    std::sort(_directory_send->files.begin(), _directory_send->files.end(),
+                        [](const directory_entry& left, const directory_entry& right) { return left.name < right.name; });
+                    _directory_send->progress->total = total;
+                }
+                catch (std::exception& e)
+                {
+                    error = e.what();
+                }
+                boost::asio::post(m_io_ctx,
+                    [this, _directory_send, error]()
+                    {
+                        if (!error.empty())
+                        {
+                            m_log.append_log("Could not send " + _directory_send->progress->path + ": " + error + '\n');
+                            _directory_send->files.clear();
+                        }
+                        m_directory_sends.push_back(_directory_send);
+                        read_ahead();
+                    });
+            });
+    }
+
+    void client::read_ahead()
+    {
+        std::string address = get_address();
+        std::uint16_t port = get_port();
+        std::list<std::shared_ptr<directory_send>>::iterator _directory_send = m_directory_sends.begin();
+        while (_directory_send != m_directory_sends.end())
+        {
+            std::shared_ptr<directory_send> send = *_directory_send;
+            if (m_closed)
+                send->next = send->files.size();
+            while (send->next < send->files.size() && send->reading < DIRECTORY_READ_AHEAD_FILES)
+            {
+                // Contents above STREAM_THRESHOLD stay on disk until written, queued ones count until then
+                const directory_entry& entry = send->files[send->next];
+                std::uint64_t buffered = entry.length > message::STREAM_THRESHOLD ? 0 : entry.length;
+                if (m_queued_bytes + send->reading_bytes + buffered > DIRECTORY_READ_AHEAD_BYTES && (m_queued_bytes != 0 || send->reading != 0))
+                    break;
+                send->next++;
+                send->reading++;
+                send->reading_bytes += buffered;
+                boost::asio::post(m_preparation_pool,
+                    [this, send, entry, buffered, address, port]()
+                    {
+                        bool sent = true;
+                        try
+                        {
+                            send_message(message::message{message::MESSAGE_TYPE::WRITE_FILE, address, port, entry.path, m_checksum_algorithm,
+                                [this](std::uint64_t, std::uint64_t) { return !m_stopping; }, entry.name});
+                        }
+                        catch (std::exception& e)
+                        {
+                            m_log.append_log("Could not send " + entry.path + ": " + e.what());
+                            sent = false;
+                        }
+                        // Posted after the frame, the queued bytes already count it
+                        boost::asio::post(m_io_ctx,
+                            [this, send, entry, buffered, sent]()
+                            {
+                                send->reading--;
+                                send->reading_bytes -= buffered;
+                                send->progress->done += entry.length;
+                                if (!sent)
+                                    send->failed++;
+                                read_ahead();
+                            });
+                    });
+            }
+            if (send->next < send->files.size() || send->reading != 0)
+            {
+                ++_directory_send;
+                continue;
+            }
+            if (send->failed == 0)
+                m_log.append_log('[' + address + ':' + std::to_string(port) + "]: [DIRECTORY]: " + send->progress->path + " ("
+                    + std::to_string(send->files.size()) + " files)\n");
+            else
+                m_log.append_log("Could not send " + std::to_string(send->failed) + " of " + std::to_string(send->files.size())
+                    + " files of " + send->progress->path + '\n');
+            {
+                std::lock_guard<std::mutex> lock(m_file_sends_mutex);
+                m_file_sends.remove(send->progress);
+            }
+            _directory_send = m_directory_sends.erase(_directory_send);
+            check_drained();
+        }
+    }
+
+    std::vector<std::shared_ptr<const file_send>> client::get_file_sends() const
+    {
+        std::lock_guard<std::mutex> lock(m_file_sends_mutex);
+        return std::vector<std::shared_ptr<const file_send>>(m_file_sends.begin(), m_file_sends.end());
     }
 
     void client::send_message(message::message _message)
+    {
+        // Streamed contents were checksummed while reading them, rereading is not worth it
+        if (_message.get_checksum_algorithm() != m_checksum_algorithm && !_message.has_streamed_body())
+            _message.set_checksum_algorithm(m_checksum_algorithm);
+        if (_message.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE && m_direct_negotiated && m_direct_port != 0
+            && _message.get_file_buffer_len() >= DIRECT_THRESHOLD)
+        {
+            // Kept here, members fetch it straight from this client, the server only sees the OFFER
+            std::uint32_t offer_id = m_next_offer_id.fetch_add(1);
+            std::shared_ptr<message::message> offer = std::make_shared<message::message>(std::move(_message));
+            boost::asio::post(m_io_ctx, [this, offer_id, offer]() { store_offer(offer_id, offer); });
+            queue_message(message::message{message::MESSAGE_TYPE::OFFER, get_address(), get_port(),
+                std::to_string(offer_id) + ' ' + std::to_string(m_direct_port)});
+            return;
+        }
+        if (m_tracing && !_message.has_streamed_body())
+            _message.set_trace(message::get_monotonic_ns(), next_trace_id());
+        queue_message(_message);
+    }
+
+    void client::ping()
+    {
+        message::message _message{message::MESSAGE_TYPE::PING, get_address(), get_port(), ""};
+        _message.set_trace(message::get_monotonic_ns(), next_trace_id());
+        queue_message(_message);
+    }
+
+    void client::request_history(const std::string& query)
+    {
+        queue_message(message::message{message::MESSAGE_TYPE::HISTORY, get_address(), get_port(), query});
+    }
+
+    void client::set_checksum(checksum::ALGORITHM preferred)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, preferred]()
+            {
+                m_preferred_checksum = preferred;
+                if (m_connected && !m_closed)
+                    negotiate();
+            });
+    }
+
+    void client::set_streams(bool streams)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, streams]()
+            {
+                m_streams = streams;
+                if (!streams)
+                    m_scheduler.set_chunking(false);
+                if (m_connected && !m_closed)
+                    negotiate();
+            });
+    }
+
+    void client::negotiate()
+    {
+        std::string names = checksum::get_name(m_preferred_checksum);
+        for (std::uint8_t index = 0; index <= checksum::LAST_ALGORITHM; index++)
+        {
+            checksum::ALGORITHM algorithm = static_cast<checksum::ALGORITHM>(index);
+            if (algorithm != m_preferred_checksum && algorithm != checksum::NONE)
+                names += std::string(",") + checksum::get_name(algorithm);
+        }
+        if (m_streams)
+            names += ",streams";
+        if (m_multicast)
+            names += ",multicast";
+        if (m_direct_server)
+            names += ",direct";
+        if (m_reconnect)
+            names += ",session";
+        if (m_window != 0)
+            names += ",window=" + std::to_string(m_window);
+        queue_message(message::message{message::MESSAGE_TYPE::NEGOTIATE, get_address(), get_port(), names});
+    }
+
+    void client::set_multicast(bool multicast, const std::string& interface_address)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, multicast, interface_address]()
+            {
+                m_multicast = multicast;
+                m_multicast_interface = interface_address;
+                if (m_connected && !m_closed)
+                    negotiate();
+            });
+    }
+
+    void client::set_direct(bool direct, std::uint16_t port)
     {
         boost::asio::post(m_io_ctx,
-            [this, _message]()
+            [this, direct, port]()
             {
-                bool write_in_progress = !m_messages.empty();
-                m_messages.push_back(_message);
-                if (!write_in_progress)
+                m_direct_port = 0;
+                m_direct_server.reset();
+                if (direct)
                 {
-                    flush_messages();
+                    try
+                    {
+                        m_direct_server = std::make_unique<direct_server>(m_io_ctx, port,
+                            [this](std::uint32_t offer_id)
+                            {
+                                std::map<std::uint32_t, std::shared_ptr<message::message>>::iterator found = m_offers.find(offer_id);
+                                return found != m_offers.end() ? found->second : nullptr;
+                            }, m_preparation_pool, m_log);
+                        m_direct_port = m_direct_server->get_port();
+                    }
+                    catch (std::exception& e)
+                    {
+                        m_log.append_log(std::string("Could not serve offered files: ") + e.what() + '\n');
+                    }
                 }
+                if (!m_direct_server)
+                    m_direct_negotiated = false;
+                if (m_connected && !m_closed)
+                    negotiate();
             });
     }
 
-    void client::flush_messages()
+    void client::set_delta(bool delta)
     {
-        boost::asio::async_write(m_socket,
-            boost::asio::buffer(m_messages.front().get_raw_message(), m_messages.front().get_raw_message().size()),
-            [this](boost::system::error_code ec, std::size_t)
+        boost::asio::post(m_io_ctx, [this, delta]() { m_delta = delta; });
+    }
+
+    void client::set_reconnect(bool reconnect)
+    {
+        boost::asio::post(m_io_ctx, [this, reconnect]() { m_reconnect = reconnect; });
+    }
+
+    void client::set_window(std::uint64_t window)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, window]()
             {
-                if (!ec)
+                m_window = window;
+                if (m_connected && !m_closed)
+                    negotiate();
+            });
+    }
+
+    void client::join_group(const std::string& group)
+    {
+        if (m_multicast_socket.is_open())
+            return;
+        boost::asio::ip::udp::endpoint endpoint;
+        if (!multicast::parse_group(group, endpoint))
+        {
+            m_log.append_log("Bad multicast group " + group + '\n');
+            return;
+        }
+        // Files announced from now on are still received, every datagram is then repaired over TCP
+        try
+        {
+            m_multicast_socket.open(boost::asio::ip::udp::v4());
+            m_multicast_socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+            boost::system::error_code option_ec;
+            m_multicast_socket.set_option(boost::asio::socket_base::receive_buffer_size(MULTICAST_RECEIVE_BUFFER), option_ec);
+            m_multicast_socket.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), endpoint.port()));
+            if (m_multicast_interface.empty())
+                m_multicast_socket.set_option(boost::asio::ip::multicast::join_group(endpoint.address()));
+            else
+                m_multicast_socket.set_option(boost::asio::ip::multicast::join_group(endpoint.address().to_v4(),
+                    boost::asio::ip::make_address_v4(m_multicast_interface)));
+        }
+        catch (std::exception& e)
+        {
+            m_log.append_log("Could not join multicast group " + group + ": " + e.what() + '\n');
+            boost::system::error_code ec;
+            m_multicast_socket.close(ec);
+            return;
+        }
+        m_log.append_log("Joined multicast group " + group + '\n');
+        datagram_reader();
+    }
+
+    void client::datagram_reader()
+    {
+        m_multicast_socket.async_receive(boost::asio::buffer(m_datagram),
+            [this](boost::system::error_code ec, std::size_t length)
+            {
+                if (ec == boost::asio::error::operation_aborted || !m_multicast_socket.is_open())
+                    return;
+                std::uint32_t transfer_id;
+                std::uint64_t offset;
+                // Datagrams of unknown transfers, or already received, are dropped
+                if (!ec && multicast::read_header(m_datagram.data(), length, transfer_id, offset))
                 {
-                    m_messages.pop_front();
-                    if (!m_messages.empty())
+                    std::map<std::uint32_t, incoming_multicast>::iterator found = m_multicasts.find(transfer_id);
+                    std::size_t size = length - multicast::DATAGRAM_HEADER_SIZE;
+                    if (found != m_multicasts.end() && !found->second.received.test(offset / multicast::DATAGRAM_PAYLOAD)
+                        && offset + size <= found->second.announce.get_file_buffer_len())
                     {
-                        flush_messages();
+                        incoming_multicast& transfer = found->second;
+                        transfer.out.seekp(static_cast<std::streamoff>(offset));
+                        transfer.out.write(reinterpret_cast<const char*>(m_datagram.data() + multicast::DATAGRAM_HEADER_SIZE), size);
+                        if (transfer.out)
+                            transfer.received.set(offset, size);
                     }
                 }
+                datagram_reader();
+            });
+    }
+
+    void client::set_low_latency(bool enabled, std::chrono::microseconds window, std::size_t max_bytes)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, enabled, window, max_bytes]()
+            {
+                m_low_latency = enabled;
+                m_coalesce_window = window;
+                m_coalesce_bytes = max_bytes;
+                if (m_connected)
+                    transport::set_no_delay(m_socket.get_socket(), enabled);
+            });
+    }
+
+    void client::queue_message(message::message _message)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, _message]() mutable
+            {
+                bool text = _message.get_message_type() == message::MESSAGE_TYPE::TEXT;
+                m_queued_bytes += _message.get_raw_message().size();
+                m_scheduler.push(_message);
+                if (m_writing || !m_connected || m_resuming)
+                    return;
+                // Typed lines get a short grace period to share a segment, anything else goes now
+                if (m_low_latency && text && m_queued_bytes < m_coalesce_bytes)
+                {
+                    if (!m_coalescing)
+                    {
+                        m_coalescing = true;
+                        coalesce_waiter();
+                    }
+                    return;
+                }
+                flush_messages();
+            });
+    }
+
+    void client::coalesce_waiter()
+    {
+        m_coalesce_timer.expires_after(m_coalesce_window);
+        m_coalesce_timer.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                if (ec || m_closed)
+                    return;
+                m_coalescing = false;
+                if (!m_writing && m_connected && !m_resuming && !m_scheduler.empty())
+                    flush_messages();
+            });
+    }
+
+    std::uint64_t client::next_trace_id()
+    {
+        return m_trace_prefix | m_trace_sequence.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void client::flush_messages()
+    {
+        if (m_coalescing)
+        {
+            m_coalescing = false;
+            m_coalesce_timer.cancel();
+        }
+        if (!m_connected || m_resuming)
+            return;
+        m_writing = true;
+        m_gather.clear();
+        m_in_flight.clear();
+        std::size_t gathered = 0;
+        // Frames received since the last ACK are acknowledged in the same write
+        if (acknowledging() && m_received != m_acknowledged)
+        {
+            m_acknowledged = m_received;
+            m_acknowledged_bytes = m_received_bytes;
+            mux::scheduled_frame ack;
+            ack.frame = message::message{message::MESSAGE_TYPE::ACK, get_address(), get_port(), std::to_string(m_received)};
+            gathered += ack.frame.get_raw_message().size();
+            m_in_flight.push_back(std::move(ack));
+        }
+        std::size_t piggybacked = m_in_flight.size();
+        try
+        {
+            // Frames the server missed go again first, then chat ahead of files, a chunk only ever waits for one other chunk
+            while (true)
+            {
+                bool resend = m_resend <= m_sequence && m_resend - m_acked - 1 < m_unacked.size();
+                if (!resend && m_scheduler.empty())
+                    break;
+                std::size_t length = resend ? m_unacked[m_resend - m_acked - 1].frame.get_raw_message().size() : m_scheduler.next_size();
+                if (m_in_flight.size() > piggybacked && gathered + length > m_coalesce_bytes)
+                    break;
+                if (resend)
+                {
+                    mux::scheduled_frame frame = m_unacked[m_resend - m_acked - 1];
+                    frame.queued_len = 0;
+                    m_in_flight.push_back(std::move(frame));
+                    m_resend++;
+                }
                 else
                 {
-                    m_socket.close();
+                    m_in_flight.push_back(m_scheduler.take());
+                    if (message::is_sequenced(m_in_flight.back().frame.get_message_type(), m_in_flight.back().frame.get_flags()))
+                        m_in_flight.back().sequence = ++m_sequence;
+                    m_resend = m_sequence + 1;
+                }
+                gathered += length;
+                if (m_in_flight.back().frame.get_payload_file())
+                    break;
+            }
+        }
+        catch (std::exception& e)
+        {
+            m_log.append_log(std::string("Send failed: ") + e.what());
+            close();
+            return;
+        }
+        if (m_in_flight.empty())
+        {
+            m_writing = false;
+            check_drained();
+            return;
+        }
+        for (mux::scheduled_frame& frame : m_in_flight)
+            m_gather.push_back(boost::asio::buffer(frame.frame.get_raw_message()));
+        ++m_write_calls;
+        boost::asio::async_write(m_socket, m_gather,
+            [this, link = m_link](boost::system::error_code ec, std::size_t)
+            {
+                if (link != m_link)
+                    return;
+                if (ec)
+                {
+                    disconnected();
+                }
+                else if (m_in_flight.back().frame.get_payload_file())
+                {
+                    std::shared_ptr<transfer::file_sender> sender = std::make_shared<transfer::file_sender>(
+                        m_socket, m_in_flight.back().frame.get_payload_file(),
+                        [this, link](boost::system::error_code ec)
+                        {
+                            if (link != m_link)
+                                return;
+                            if (!ec)
+                                message_flushed();
+                            else
+                                disconnected();
+                        });
+                    sender->set_progress_handler([this](std::size_t) { m_last_write = std::chrono::steady_clock::now(); });
+                    sender->start();
                 }
+                else
+                {
+                    message_flushed();
+                }
+            });
+    }
+
+    void client::message_flushed()
+    {
+        m_last_write = std::chrono::steady_clock::now();
+        m_frames_written += m_in_flight.size();
+        for (mux::scheduled_frame& frame : m_in_flight)
+        {
+            m_queued_bytes -= frame.queued_len;
+            retain(std::move(frame));
+        }
+        m_in_flight.clear();
+        m_writing = false;
+        if (!m_directory_sends.empty())
+            read_ahead();
+        // Whatever queued up meanwhile already waited a whole write, send it without a window
+        if (!m_scheduler.empty() || m_resend <= m_sequence)
+        {
+            flush_messages();
+        }
+        else
+        {
+            check_drained();
+        }
+    }
+
+    void client::set_message_handler(message_handler handler)
+    {
+        m_message_handler = std::move(handler);
+    }
+
+    void client::drain(std::function<void()> on_drained)
+    {
+        boost::asio::post(m_io_ctx,
+            [this, on_drained]()
+            {
+                m_on_drained = on_drained;
+                check_drained();
             });
     }
 
+    void client::leave(std::function<void()> on_left)
+    {
+        drain(
+            [this, on_left]()
+            {
+                if (m_closed || m_session.empty())
+                {
+                    close();
+                    on_left();
+                    return;
+                }
+                // An empty SESSION ends it, a deliberate disconnect is not held for a resume
+                message::message end(message::MESSAGE_TYPE::SESSION, get_address(), get_port(), "");
+                m_queued_bytes += end.get_raw_message().size();
+                m_scheduler.push(std::move(end));
+                m_on_drained = [this, on_left]()
+                {
+                    close();
+                    on_left();
+                };
+                flush_messages();
+            });
+    }
+
+    void client::check_drained()
+    {
+        if (!m_on_drained)
+            return;
+        if (!m_closed)
+        {
+            if (!m_connected || m_resuming || m_writing || !m_scheduler.empty() || m_resend <= m_sequence)
+                return;
+            std::lock_guard<std::mutex> lock(m_file_sends_mutex);
+            if (!m_file_sends.empty())
+                return;
+        }
+        std::function<void()> on_drained = std::move(m_on_drained);
+        m_on_drained = nullptr;
+        on_drained();
+    }
+
+    void client::close()
+    {
+        m_closed = true;
+        m_reconnecting = false;
+        boost::system::error_code ec;
+        m_reconnect_timer.cancel();
+        m_heartbeat_timer.cancel();
+        m_coalesce_timer.cancel();
+        m_multicast_timer.cancel();
+        m_socket.close(ec);
+        m_multicast_socket.close(ec);
+        if (m_direct_server)
+            m_direct_server->close();
+        if (m_on_drained)
+        {
+            std::function<void()> on_drained = std::move(m_on_drained);
+            m_on_drained = nullptr;
+            on_drained();
+        }
+    }
+
+    void client::heartbeat_waiter()
+    {
+        m_heartbeat_timer.expires_after(HEARTBEAT_INTERVAL);
+        m_heartbeat_timer.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                if (!ec && !m_closed)
+                    heartbeat();
+            });
+    }
+
+    void client::heartbeat()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - m_last_read >= SERVER_TIMEOUT)
+        {
+            m_log.append_log("Server timed out\n");
+            disconnected();
+            return;
+        }
+        if (acknowledging() && m_received != m_acknowledged && !m_resuming)
+            send_ack();
+        // A long write in progress counts as activity, the server sees its bytes
+        if (!m_writing && !m_resuming && m_scheduler.empty() && now - m_last_write >= HEARTBEAT_INTERVAL)
+        {
+            message::message heartbeat{message::MESSAGE_TYPE::HEARTBEAT, get_address(), get_port(), ""};
+            m_queued_bytes += heartbeat.get_raw_message().size();
+            m_scheduler.push(heartbeat);
+            flush_messages();
+        }
+        heartbeat_waiter();
+    }
+
     void client::header_reader()
     {
+        m_reading = true;
         boost::asio::async_read(m_socket,
             boost::asio::buffer(m_message.get_raw_message(), message::HEADER_SIZE),
-            [this](boost::system::error_code ec, std::size_t length)
+            [this](boost::system::error_code ec, std::size_t /*length*/)
+            {
+                if (!ec)
+                {
+                    m_last_read = std::chrono::steady_clock::now();
+                    header_extension_reader();
+                }
+                else
+                {
+                    m_reading = false;
+                    disconnected();
+                }
+            });
+    }
+
+    void client::header_extension_reader()
+    {
+        std::size_t missing = m_message.extend_header();
+        boost::asio::async_read(m_socket,
+            boost::asio::buffer(m_message.get_raw_message().data() + message::HEADER_SIZE, missing),
+            [this](boost::system::error_code ec, std::size_t)
             {
                 if (!ec && !m_message.bad_header())
                 {
                     m_message.adjust();
                     data_buffer_reader();
                 }
+                else if (ec)
+                {
+                    m_reading = false;
+                    disconnected();
+                }
                 else
                 {
-                    m_socket.close();
+                    close();
                 }
             });
     }
@@ -89,49 +1080,476 @@ namespace scft
     void client::data_buffer_reader()
     {
         boost::asio::async_read(m_socket,
-            boost::asio::buffer(m_message.get_data(), m_message.get_data_len()),
+            boost::asio::buffer(m_message.get_data(), m_message.get_buffered_data_len()),
             [this](boost::system::error_code ec, std::size_t)
             {
-                if (!ec)
+                if (ec)
                 {
-                    std::uint32_t checksum = scft::crc32::get_crc32(reinterpret_cast<std::uint8_t*>(m_message.get_data()), m_message.get_data_len());
-                    if (checksum == m_message.get_checksum())
-                        m_log.append_log("[CRC32 OK!]: ");
-                    else
-                        m_log.append_log("[CRC32 BAD]: ");
-                    m_log.append_log('[' + std::string(m_message.get_origin()) + "]: ");
+                    m_reading = false;
+                    disconnected();
+                    return;
+                }
 
-                    if (m_message.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE)
-                    {
-                        std::ofstream out_file{m_message.get_string(), std::ios::out | std::ios::binary};
-                        out_file.write(reinterpret_cast<const char*>(m_message.get_file_buffer()), m_message.get_file_buffer_len());
-                        out_file.close();
-                        m_log.append_log("[FILE] " +
-                            std::string(m_message.get_string()) + ' ' +
-                            std::to_string(m_message.get_file_buffer_len()) + " (bytes)" + '\n');
-                    }
-                    else if (m_message.get_message_type() == message::MESSAGE_TYPE::TEXT)
-                    {
-                        m_log.append_log(std::string(m_message.get_string()) + '\n');
-                    }
-                    header_reader();
+                m_last_read = std::chrono::steady_clock::now();
+                if (!m_view.parse(m_message.get_raw_message().data(), m_message.get_raw_message().size()))
+                {
+                    m_log.append_log("Malformed frame\n");
+                    close();
+                    return;
                 }
-                else
+                if (!m_view.has_streamed_body())
+                    frame_received();
+                if (m_view.get_message_type() == message::MESSAGE_TYPE::MULTICAST_END)
+                {
+                    end_multicast();
+                    return;
+                }
+                if (m_view.is_multicast() || m_view.get_message_type() == message::MESSAGE_TYPE::REPAIR)
+                {
+                    if (!receive_multicast())
+                        header_reader();
+                    return;
+                }
+                if (m_view.is_chunked() || m_view.get_message_type() == message::MESSAGE_TYPE::CHUNK)
+                {
+                    if (!receive_stream())
+                        header_reader();
+                    return;
+                }
+                checksum::hasher _hasher(m_view.get_checksum_algorithm());
+                _hasher.update(m_view.get_buffered_data().data, m_view.get_buffered_data().size);
+                if (m_view.has_streamed_body())
+                {
+                    // Contents go straight to disk, the checksum is finished while receiving them
+                    std::shared_ptr<transfer::file_receiver> receiver = std::make_shared<transfer::file_receiver>(
+                        m_socket, transfer::receive_path(m_view.get_string()), m_view.get_file_buffer_len(), true, _hasher,
+                        [this](boost::system::error_code ec, std::uint64_t checksum)
+                        {
+                            if (!ec || ec == boost::system::errc::io_error)
+                                frame_received();
+                            if (!ec)
+                                dispatch_message(checksum == m_view.get_checksum());
+                            else if (ec == boost::system::errc::io_error)
+                            {
+                                m_log.append_log("Could not write " + std::string(m_view.get_string()) + '\n');
+                                header_reader();
+                            }
+                            else
+                            {
+                                m_reading = false;
+                                disconnected();
+                            }
+                        });
+                    receiver->set_progress_handler([this](std::size_t) { m_last_read = std::chrono::steady_clock::now(); });
+                    receiver->start();
+                    return;
+                }
+
+                if (m_view.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE)
                 {
-                    m_socket.close();
+                    transfer::write_file(m_socket.get_executor(), transfer::receive_path(m_view.get_string()),
+                        m_view.get_file_buffer().data, m_view.get_file_buffer().size,
+                        [this, checksum = _hasher.digest()](boost::system::error_code ec)
+                        {
+                            if (ec)
+                                m_log.append_log("Could not write " + std::string(m_view.get_string()) + '\n');
+                            dispatch_message(checksum == m_view.get_checksum());
+                        });
+                    return;
                 }
+                dispatch_message(_hasher.digest() == m_view.get_checksum());
+            });
+    }
+
+    bool client::receive_stream()
+    {
+        std::uint32_t stream_id = m_view.get_stream_id();
+        if (m_view.is_chunked())
+        {
+            incoming_stream& stream = m_incoming[stream_id];
+            stream = incoming_stream();
+            stream.announce = m_message;
+            stream.out.open(transfer::receive_path(m_view.get_string()), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!stream.out)
+                m_log.append_log("Could not write " + std::string(m_view.get_string()) + '\n');
+            stream.hasher = checksum::hasher(m_view.get_checksum_algorithm());
+            stream.hasher.update(m_view.get_buffered_data().data, m_view.get_buffered_data().size);
+            return false;
+        }
+        // Chunks of a stream opened before a reconnect or refused by the server are dropped
+        std::map<std::uint32_t, incoming_stream>::iterator found = m_incoming.find(stream_id);
+        if (found == m_incoming.end())
+            return false;
+        incoming_stream& stream = found->second;
+        message::byte_span contents = m_view.get_file_buffer();
+        if (stream.out.is_open())
+            stream.out.write(reinterpret_cast<const char*>(contents.data), contents.size);
+        stream.hasher.update(contents.data, contents.size);
+        stream.received += contents.size;
+        if (stream.received < stream.announce.get_file_buffer_len())
+            return false;
+
+        // Delivered like a streamed file, its contents are on disk
+        stream.out.close();
+        bool checksum_ok = stream.hasher.digest() == stream.announce.get_checksum();
+        m_message = stream.announce;
+        m_message.set_flags(m_message.get_flags() & ~message::FLAG_CHUNKED);
+        m_message.set_stream_id(0);
+        m_message.set_payload_file(std::make_shared<message::payload_file>(m_message.get_string(), m_message.get_file_buffer_len(), false));
+        m_incoming.erase(found);
+        m_view.parse(m_message.get_raw_message().data(), m_message.get_raw_message().size(), true);
+        dispatch_message(checksum_ok);
+        return true;
+    }
+
+    bool client::receive_multicast()
+    {
+        if (m_view.is_multicast())
+        {
+            // At its final length, datagrams and repairs come in any order
+            std::string name = transfer::receive_path(m_view.get_string());
+            incoming_multicast& transfer = m_multicasts[m_view.get_stream_id()];
+            transfer = incoming_multicast();
+            transfer.announce = m_message;
+            transfer.received = multicast::packet_map(m_view.get_file_buffer_len());
+            transfer.hasher = checksum::hasher(m_view.get_checksum_algorithm());
+            transfer.hasher.update(m_view.get_buffered_data().data, m_view.get_buffered_data().size);
+            transfer.out.open(name, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            std::error_code ec;
+            if (transfer.out)
+                std::filesystem::resize_file(name, m_view.get_file_buffer_len(), ec);
+            if (!transfer.out || ec)
+            {
+                m_log.append_log("Could not write " + name + '\n');
+                transfer.out.close();
+            }
+            return false;
+        }
+        std::map<std::uint32_t, incoming_multicast>::iterator found = m_multicasts.find(m_view.get_stream_id());
+        if (found == m_multicasts.end())
+            return false;
+        incoming_multicast& transfer = found->second;
+        std::uint64_t offset;
+        try
+        {
+            offset = std::stoull(std::string(m_view.get_string()));
+        }
+        catch (std::exception&)
+        {
+            return false;
+        }
+        message::byte_span contents = m_view.get_file_buffer();
+        if (offset % multicast::DATAGRAM_PAYLOAD != 0 || offset + contents.size > transfer.announce.get_file_buffer_len())
+            return false;
+        if (transfer.out.is_open())
+        {
+            transfer.out.seekp(static_cast<std::streamoff>(offset));
+            transfer.out.write(reinterpret_cast<const char*>(contents.data), contents.size);
+        }
+        transfer.received.set(offset, contents.size);
+        if (!transfer.received.complete())
+            return false;
+        deliver_multicast(found);
+        return true;
+    }
+
+    void client::end_multicast()
+    {
+        std::uint32_t transfer_id = 0;
+        try
+        {
+            transfer_id = static_cast<std::uint32_t>(std::stoul(std::string(m_view.get_string())));
+        }
+        catch (std::exception&)
+        {
+            header_reader();
+            return;
+        }
+        m_multicast_timer.expires_after(MULTICAST_GRACE);
+        m_multicast_timer.async_wait(
+            [this, transfer_id](boost::system::error_code ec)
+            {
+                if (ec || m_closed)
+                    return;
+                // Unknown transfers are acknowledged too, the server then lets go of their contents
+                std::map<std::uint32_t, incoming_multicast>::iterator found = m_multicasts.find(transfer_id);
+                std::vector<multicast::range> missing;
+                if (found != m_multicasts.end())
+                    missing = found->second.out.is_open() ? found->second.received.missing() : std::vector<multicast::range>();
+                queue_message(message::message{message::MESSAGE_TYPE::NACK, get_address(), get_port(), multicast::format_nack(transfer_id, missing)});
+                if (found != m_multicasts.end() && (found->second.received.complete() || !found->second.out.is_open()))
+                    deliver_multicast(found);
+                else
+                    header_reader();
             });
     }
 
+    void client::deliver_multicast(std::map<std::uint32_t, incoming_multicast>::iterator found)
+    {
+        // Verified by reading the contents back, they arrived out of order
+        incoming_multicast& transfer = found->second;
+        bool checksum_ok = transfer.out.is_open();
+        if (checksum_ok)
+        {
+            transfer.out.flush();
+            transfer.out.seekg(0);
+            std::vector<std::uint8_t> buffer(message::FILE_READ_CHUNK);
+            std::uint64_t left = transfer.announce.get_file_buffer_len();
+            while (left != 0 && transfer.out)
+            {
+                std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), left));
+                transfer.out.read(reinterpret_cast<char*>(buffer.data()), length);
+                transfer.hasher.update(buffer.data(), length);
+                left -= length;
+            }
+            checksum_ok = transfer.out && transfer.hasher.digest() == transfer.announce.get_checksum();
+            transfer.out.close();
+        }
+        m_message = transfer.announce;
+        m_message.set_flags(m_message.get_flags() & ~message::FLAG_MULTICAST);
+        m_message.set_stream_id(0);
+        m_message.set_payload_file(std::make_shared<message::payload_file>(m_message.get_string(), m_message.get_file_buffer_len(), false));
+        m_multicasts.erase(found);
+        m_view.parse(m_message.get_raw_message().data(), m_message.get_raw_message().size(), true);
+        dispatch_message(checksum_ok);
+    }
+
+    void client::store_offer(std::uint32_t offer_id, std::shared_ptr<message::message> _message)
+    {
+        if (!_message->get_payload_file())
+            m_offered_bytes += _message->get_file_buffer_len();
+        m_offers[offer_id] = _message;
+        while (m_offers.size() > 1 && (m_offers.size() > MAX_OFFERS || m_offered_bytes > DIRECT_OFFER_BYTES))
+        {
+            if (!m_offers.begin()->second->get_payload_file())
+                m_offered_bytes -= m_offers.begin()->second->get_file_buffer_len();
+            m_offers.erase(m_offers.begin());
+        }
+    }
+
+    void client::fetch_offer()
+    {
+        // "ID IP:PORT" of the sender, as the server sees it
+        std::string offer(m_view.get_string());
+        std::string origin(m_view.get_origin());
+        std::size_t space = offer.find(' ');
+        std::size_t colon = offer.rfind(':');
+        std::uint32_t offer_id;
+        tcp::endpoint sender;
+        try
+        {
+            if (space == std::string::npos || colon == std::string::npos || colon < space)
+                throw std::invalid_argument("offer");
+            offer_id = static_cast<std::uint32_t>(std::stoul(offer.substr(0, space)));
+            sender = tcp::endpoint(boost::asio::ip::make_address(offer.substr(space + 1, colon - space - 1)),
+                static_cast<std::uint16_t>(std::stoul(offer.substr(colon + 1))));
+        }
+        catch (std::exception&)
+        {
+            m_log.append_log("Bad offer from " + origin + '\n');
+            return;
+        }
+        std::make_shared<direct_fetch>(m_io_ctx, sender, offer_id, get_address(), get_port(), m_delta, m_preparation_pool,
+            [this, offer_id, origin](bool reached, message::message& _message, message::message_view& _view, bool checksum_ok)
+            {
+                if (m_closed)
+                    return;
+                if (reached)
+                {
+                    deliver(_message, _view, checksum_ok);
+                    return;
+                }
+                m_log.append_log("Could not reach " + origin + ", fetching through the server\n");
+                queue_message(message::message{message::MESSAGE_TYPE::FETCH, get_address(), get_port(), std::to_string(offer_id) + ' ' + origin});
+            }, m_log)->start();
+    }
+
+    void client::serve_fetch()
+    {
+        std::map<std::uint32_t, std::shared_ptr<message::message>>::iterator found = m_offers.end();
+        try
+        {
+            found = m_offers.find(static_cast<std::uint32_t>(std::stoul(std::string(m_view.get_string()))));
+        }
+        catch (std::exception&)
+        {
+        }
+        if (found == m_offers.end())
+        {
+            m_log.append_log("Asked for unknown offer " + std::string(m_view.get_string()) + '\n');
+            return;
+        }
+        // Whole, the server relays it to every member waiting for this offer
+        message::message _message = *found->second;
+        _message.set_flags(_message.get_flags() | message::FLAG_DIRECT);
+        _message.set_stream_id(found->first);
+        queue_message(_message);
+    }
+
+    void client::dispatch_message(bool checksum_ok)
+    {
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::HEARTBEAT)
+        {
+            header_reader();
+            return;
+        }
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::SESSION)
+        {
+            if (checksum_ok)
+                on_session();
+            else
+                close();
+            header_reader();
+            return;
+        }
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::ACK)
+        {
+            try
+            {
+                if (checksum_ok)
+                    acknowledge(std::stoull(std::string(m_view.get_string())));
+            }
+            catch (std::exception&)
+            {
+            }
+            header_reader();
+            return;
+        }
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::NEGOTIATE)
+        {
+            // The algorithm, then ",streams" if the server takes chunked files, ",multicast=GROUP" if it multicasts them, ",direct" if it brokers offers,
+            // ",session=TOKEN" if it keeps the session of a dropped connection
+            std::string_view answer = m_view.get_string();
+            std::string_view name = answer.substr(0, answer.find(','));
+            checksum::ALGORITHM algorithm;
+            if (checksum_ok && checksum::parse_name(std::string(name), algorithm))
+            {
+                adopt_origin();
+                m_checksum_algorithm = algorithm;
+                bool streams = false;
+                bool direct = false;
+                std::string group;
+                std::string session;
+                bool window = false;
+                std::size_t begin = name.size() + 1;
+                while (begin < answer.size())
+                {
+                    std::size_t end = std::min(answer.find(',', begin), answer.size());
+                    std::string_view token = answer.substr(begin, end - begin);
+                    if (token == "streams")
+                        streams = m_streams;
+                    else if (token.substr(0, 10) == "multicast=")
+                        group = token.substr(10);
+                    else if (token == "direct")
+                        direct = m_direct_server != nullptr;
+                    else if (token.substr(0, 8) == "session=" && m_reconnect)
+                        session = token.substr(8);
+                    else if (token == "window")
+                        window = m_window != 0;
+                    begin = end + 1;
+                }
+                m_scheduler.set_chunking(streams);
+                m_direct_negotiated = direct;
+                m_window_negotiated = window;
+                // Without a session nothing is ever sent again, written frames need not be kept
+                m_session = session;
+                m_retaining = !session.empty();
+                if (session.empty())
+                    m_unacked.clear();
+                m_log.append_log(std::string("Checksum: ") + checksum::get_name(algorithm) + (streams ? ", streams" : "")
+                    + (direct ? ", direct" : "") + (session.empty() ? "" : ", session") + (window ? ", window" : "")
+                    + (group.empty() ? "\n" : ", multicast " + group + '\n'));
+                if (m_multicast && !group.empty())
+                    join_group(group);
+            }
+            header_reader();
+            return;
+        }
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::PONG)
+        {
+            if (m_view.has_trace())
+            {
+                std::uint64_t round_trip = message::get_monotonic_ns() - m_view.get_send_time();
+                m_round_trip_latency.record(round_trip);
+                if (m_message_handler)
+                {
+                    m_message_handler(m_message, checksum_ok);
+                    header_reader();
+                    return;
+                }
+                char text[96];
+                std::snprintf(text, sizeof(text), "[PONG] trace %016llx: %.3f ms\n",
+                    static_cast<unsigned long long>(m_view.get_trace_id()), round_trip / 1e6);
+                m_log.append_log(text);
+            }
+            header_reader();
+            return;
+        }
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::OFFER)
+        {
+            if (checksum_ok)
+                fetch_offer();
+            header_reader();
+            return;
+        }
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::FETCH)
+        {
+            if (checksum_ok)
+                serve_fetch();
+            header_reader();
+            return;
+        }
+        deliver(m_message, m_view, checksum_ok);
+        header_reader();
+    }
+
+    void client::deliver(message::message& _message, message::message_view& _view, bool checksum_ok)
+    {
+        // Send times of other hosts are not comparable, replays are not deliveries
+        bool replayed = (_view.get_flags() & message::FLAG_REPLAYED) != 0;
+        if (!replayed && _view.has_trace() && message::get_monotonic_ns() >= _view.get_send_time())
+            m_delivery_latency.record(message::get_monotonic_ns() - _view.get_send_time());
+
+        if (m_message_handler)
+        {
+            m_message_handler(_message, checksum_ok);
+            return;
+        }
+
+        std::string label = checksum::get_name(_view.get_checksum_algorithm());
+        std::transform(label.begin(), label.end(), label.begin(), ::toupper);
+        if (replayed)
+            m_log.append_log("[HISTORY] ");
+        if (_view.get_checksum_algorithm() == checksum::NONE)
+            m_log.append_log("[UNCHECKED]: ");
+        else if (checksum_ok)
+            m_log.append_log('[' + label + " OK!]: ");
+        else
+            m_log.append_log('[' + label + " BAD]: ");
+        m_log.append_log('[' + std::string(_view.get_origin()) + "]: ");
+
+        if (_view.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE)
+        {
+            m_log.append_log("[FILE] " +
+                std::string(_view.get_string()) + ' ' +
+                std::to_string(_view.get_file_buffer_len()) + " (bytes)" + '\n');
+        }
+        else if (_view.get_message_type() == message::MESSAGE_TYPE::TEXT)
+        {
+            m_log.append_log(std::string(_view.get_string()) + '\n');
+        }
+    }
 
     std::string client::get_address()
     {
-        return m_socket.local_endpoint().address().to_string();
+        std::lock_guard<std::mutex> lock(m_origin_mutex);
+        return m_address;
     }
 
     std::uint16_t client::get_port()
     {
-        return m_socket.local_endpoint().port();
+        std::lock_guard<std::mutex> lock(m_origin_mutex);
+        return m_port;
     }
     }
 }
\ No newline at end of file
@@ -7,11 +7,25 @@
 */
 
 #include "scft-clt_version.hpp"
+#include "direct.hpp"
+#include "frame_scheduler.hpp"
+#include "hdr_histogram.hpp"
+#include "message_view.hpp"
+#include "multicast.hpp"
 #include "scft_message.hpp"
 #include "scrolling_log.hpp"
+#include "transport.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
 #include <boost/asio.hpp>
 
 namespace scft
@@ -21,6 +35,138 @@ namespace scft
     */
     namespace client
     {
+        /**
+         * @brief Send a HEARTBEAT if nothing else was written for this long, well under the server's read timeout
+        */
+        constexpr std::chrono::seconds HEARTBEAT_INTERVAL{15};
+
+        /**
+         * @brief Close if nothing, not even a HEARTBEAT echo, was read for this long
+        */
+        constexpr std::chrono::seconds SERVER_TIMEOUT{45};
+
+        /**
+         * @brief Wait before the first reconnection attempt, doubled after each failed one
+        */
+        constexpr std::chrono::milliseconds RECONNECT_DELAY{250};
+
+        /**
+         * @brief Longest wait between reconnection attempts
+        */
+        constexpr std::chrono::milliseconds RECONNECT_MAX_DELAY{30000};
+
+        /**
+         * @brief Failed reconnection attempts before giving up
+        */
+        constexpr unsigned int RECONNECT_ATTEMPTS = 12;
+
+        /**
+         * @brief Low latency mode holds TEXT frames this long to write them together
+        */
+        constexpr std::chrono::microseconds DEFAULT_COALESCE_WINDOW{200};
+
+        /**
+         * @brief Most bytes of queued frames written by one gathered write
+        */
+        constexpr std::size_t DEFAULT_COALESCE_BYTES = 16 * 1024;
+
+        /**
+         * @brief Files read and checksummed at the same time
+        */
+        constexpr std::size_t PREPARATION_THREADS = 2;
+
+        /**
+         * @brief Wait after a MULTICAST_END for datagrams still in flight before answering with a NACK
+        */
+        constexpr std::chrono::milliseconds MULTICAST_GRACE{50};
+
+        /**
+         * @brief Receive buffer asked for on the multicast socket, the system may cap it
+        */
+        constexpr int MULTICAST_RECEIVE_BUFFER = 4 << 20;
+
+        /**
+         * @brief Most contents of a directory send read ahead of what was written 64M, a larger file still goes alone
+        */
+        constexpr std::uint64_t DIRECTORY_READ_AHEAD_BYTES = 67108864;
+
+        /**
+         * @brief Most files of a directory send read ahead at once
+        */
+        constexpr std::size_t DIRECTORY_READ_AHEAD_FILES = 8;
+
+        /**
+         * @brief Most files kept offered, older offers are fetched through the server or not at all
+        */
+        constexpr std::size_t MAX_OFFERS = 64;
+
+        /**
+         * @brief Most buffered contents kept offered 256M, streamed contents stay on disk and do not count
+        */
+        constexpr std::uint64_t DIRECT_OFFER_BYTES = 268435456;
+
+        /**
+         * @brief File send still being read and checksummed
+        */
+        struct file_send
+        {
+            std::string path;                       //!< File path
+            std::atomic<std::uint64_t> done{0};     //!< Bytes read and checksummed
+            std::atomic<std::uint64_t> total{0};    //!< File length, 0 until the first chunk
+        };
+
+        /**
+         * @brief File of a directory send
+        */
+        struct directory_entry
+        {
+            std::string path;                       //!< Local path
+            std::string name;                       //!< Name sent, the directory's own name then the path below it
+            std::uint64_t length;                   //!< File length when listed
+        };
+
+        /**
+         * @brief Directory send whose files are read ahead and queued one after another
+        */
+        struct directory_send
+        {
+            std::shared_ptr<file_send> progress;    //!< Listed with the file sends, done counts contents queued
+            std::vector<directory_entry> files;     //!< Regular files of the tree, by name
+            std::size_t next = 0;                   //!< Next file to read
+            std::size_t reading = 0;                //!< Files being read
+            std::uint64_t reading_bytes = 0;        //!< Contents of the files being read that stay buffered
+            std::size_t failed = 0;                 //!< Files that could not be sent
+        };
+
+        /**
+         * @brief Chunked file being received
+        */
+        struct incoming_stream
+        {
+            message::message announce;          //!< WRITE_FILE flagged FLAG_CHUNKED
+            std::ofstream out;                  //!< File being written
+            checksum::hasher hasher;            //!< Checksum of the data so far
+            std::uint64_t received = 0;         //!< Contents received
+        };
+
+        /**
+         * @brief Multicast file being received
+        */
+        struct incoming_multicast
+        {
+            message::message announce;          //!< WRITE_FILE flagged FLAG_MULTICAST
+            std::fstream out;                   //!< File being written, at its final length
+            multicast::packet_map received;     //!< Packets written
+            checksum::hasher hasher;            //!< Checksum of the origin and file name, the contents are read back
+        };
+
+        /**
+         * @brief Called on the io thread for every received message
+         * @param _message Received message, files are already written to disk
+         * @param checksum_ok True if the checksum matched, always true for unchecked messages
+        */
+        typedef std::function<void(message::message& _message, bool checksum_ok)> message_handler;
+
         /**
          * @brief SCFT Client
         */
@@ -39,32 +185,400 @@ namespace scft
                 std::uint16_t port,
                 basic_shell::scrolling_log& _log);
 
+            /**
+             * @brief Tries to connect to a server on this host over its Unix domain socket, show message
+             * @param io_ctx boost io context
+             * @param path Socket path, the server's shared memory one for shared_memory
+             * @param shared_memory Hand the server a shared memory segment and exchange frames through it
+             * @param _log Log
+             * @note Throws std::runtime_error if the platform has no Unix domain sockets
+            */
+            public: client(
+                boost::asio::io_context& io_ctx,
+                const std::string& path,
+                bool shared_memory,
+                basic_shell::scrolling_log& _log);
+
+            /**
+             * @brief Tries each endpoint in turn
+             * @param io_ctx boost io context
+             * @param endpoints Server endpoints
+             * @param shared_memory Hand the server a shared memory segment once connected
+             * @param _log Log
+            */
+            private: client(
+                boost::asio::io_context& io_ctx,
+                const std::vector<transport::endpoint>& endpoints,
+                bool shared_memory,
+                basic_shell::scrolling_log& _log);
+
             /**
              * @brief Default constructor
             */
             public: ~client();
 
             /**
-             * @brief Send message
+             * @brief Send message, stamped with a trace when tracing is on and contents are not streamed, files above DIRECT_THRESHOLD are offered once direct is negotiated
              * @param _message Message to send
             */
             public: void send_message(message::message _message);
 
             /**
-             * @brief Flush queued message
+             * @brief Read and checksum a file on a preparation thread, then send it, returns immediately
+             * @param path File path, errors are logged
+            */
+            public: void send_file(const std::string& path);
+
+            /**
+             * @brief List the regular files of a directory tree on a preparation thread, then read ahead and send them, returns immediately
+             * @note Each file is its own WRITE_FILE rather than part of one archive, so it keeps its checksum, chunking, delta and offer paths
+             * @param path Directory path, receivers recreate the tree under its name, errors are logged
+            */
+            public: void send_directory(const std::string& path);
+
+            /**
+             * @brief Files still being prepared
+             * @return Snapshot in submission order
+            */
+            public: std::vector<std::shared_ptr<const file_send>> get_file_sends() const;
+
+            /**
+             * @brief Send a PING, the server answers with a PONG whose round trip is recorded
+            */
+            public: void ping();
+
+            /**
+             * @brief Ask the server to replay broadcasts sent before joining, they arrive flagged FLAG_REPLAYED
+             * @param query "last N" frames or "since UNIX_MS"
+            */
+            public: void request_history(const std::string& query);
+
+            /**
+             * @brief Enable or disable traces on sent messages, on by default
+             * @param tracing True to stamp messages
+            */
+            public: void set_tracing(bool tracing) { m_tracing = tracing; }
+
+            /**
+             * @brief Ask the server to checksum with another algorithm, CRC32 is used until it answers
+             * @param preferred Algorithm, sent again after connecting
+            */
+            public: void set_checksum(checksum::ALGORITHM preferred);
+
+            /**
+             * @brief Offer to send and receive files as chunks interleaved with other frames, on by default
+             * @param streams False for servers predating NEGOTIATE, which drop the connection when offered
+            */
+            public: void set_streams(bool streams);
+
+            /**
+             * @brief Offer to receive files over the server's multicast group, off by default
+             * @param multicast True to offer it
+             * @param interface_address IPV4 of the interface to join the group on, empty for the system's choice
+            */
+            public: void set_multicast(bool multicast, const std::string& interface_address = "");
+
+            /**
+             * @brief Offer files above DIRECT_THRESHOLD for members to fetch from here, and fetch offered files from their senders, off by default
+             * @param direct True to offer it
+             * @param port Port to serve offered files on, 0 for any, members must be able to reach it
+            */
+            public: void set_direct(bool direct, std::uint16_t port = 0);
+
+            /**
+             * @brief Fetch only what changed of offered files a copy of the same name is already here of, on by default
+             * @param delta False to always fetch whole files
+            */
+            public: void set_delta(bool delta);
+
+            /**
+             * @brief Reconnect when the connection drops, resuming the session if the server kept it, on by default
+             * @param reconnect False to close instead
+            */
+            public: void set_reconnect(bool reconnect);
+
+            /**
+             * @brief Advertise a receive window, the server then writes no more than this ahead of the ACKs
+             * @param window Bytes, 0 to leave flow control to TCP
+            */
+            public: void set_window(std::uint64_t window);
+
+            /**
+             * @brief Algorithm agreed with the server
+             * @return CRC32 unless negotiated
+            */
+            public: checksum::ALGORITHM get_checksum_algorithm() const { return m_checksum_algorithm; }
+
+            /**
+             * @brief Set TCP_NODELAY and batch TEXT frames sent within a window, or Nagle's algorithm and no window
+             * @param enabled True for low latency mode
+             * @param window TEXT frames are written once this has elapsed since the first one was queued
+             * @param max_bytes Written at once when this many bytes are queued, also bounds every gathered write
+            */
+            public: void set_low_latency(bool enabled,
+                std::chrono::microseconds window = DEFAULT_COALESCE_WINDOW,
+                std::size_t max_bytes = DEFAULT_COALESCE_BYTES);
+
+            /**
+             * @brief Frames fully written
+             * @return Count
+            */
+            public: std::uint64_t get_frames_written() const { return m_frames_written; }
+
+            /**
+             * @brief Gathered writes started, each one carries one or more frame headers
+             * @return Count
+            */
+            public: std::uint64_t get_write_calls() const { return m_write_calls; }
+
+            /**
+             * @brief Delivery latency of received traced messages, in nanoseconds
+             * @return Histogram, only meaningful if sender runs on the same host
+            */
+            public: const metrics::hdr_histogram& get_delivery_latency() const { return m_delivery_latency; }
+
+            /**
+             * @brief PING to PONG round trip latency, in nanoseconds
+             * @return Histogram
+            */
+            public: const metrics::hdr_histogram& get_round_trip_latency() const { return m_round_trip_latency; }
+
+            /**
+             * @brief Make a trace identifier unique to this client
+             * @return Random prefix and sequence number
+            */
+            private: std::uint64_t next_trace_id();
+
+            /**
+             * @brief Queue message on the io thread
+             * @param _message Message to send
+            */
+            private: void queue_message(message::message _message);
+
+            /**
+             * @brief Connect to the first reachable endpoint
+            */
+            private: void connect();
+
+            /**
+             * @brief Start reading and writing on a new connection, resuming the session if there is one
+             * @param resuming True if reconnected with a session
+            */
+            private: void connected(bool resuming);
+
+            /**
+             * @brief Reconnect after an error, or close if reconnecting is off
+            */
+            private: void disconnected();
+
+            /**
+             * @brief Wait before the next reconnection attempt, close once out of attempts
+            */
+            private: void reconnect_waiter();
+
+            /**
+             * @brief Forget the session, frames are numbered from 1 again and chunked files start over
+            */
+            private: void restart();
+
+            /**
+             * @brief Write a SESSION, frames wait for the server's answer
+            */
+            private: void resume();
+
+            /**
+             * @brief Handle the server's SESSION answer, send unacknowledged frames again or start anew
+            */
+            private: void on_session();
+
+            /**
+             * @brief Take the name the server answered with, Unix domain and shared memory connections can't see theirs
+            */
+            private: void adopt_origin();
+
+            /**
+             * @brief Count a completely received frame, acknowledge every ACK_INTERVAL sequenced ones
+            */
+            private: void frame_received();
+
+            /**
+             * @brief Queue an ACK for the frames received so far
+            */
+            private: void send_ack();
+
+            /**
+             * @brief Check if the server counts on ACKs, for a session or the receive window
+             * @return True if frames are acknowledged
+            */
+            private: bool acknowledging() const { return !m_session.empty() || m_window_negotiated; }
+
+            /**
+             * @brief Forget frames the server acknowledged
+             * @param received Sequence number of the last frame the server got
+            */
+            private: void acknowledge(std::uint64_t received);
+
+            /**
+             * @brief Keep a written frame until the server acknowledges it
+             * @param frame Frame, ignored unless sequenced and new
+            */
+            private: void retain(mux::scheduled_frame frame);
+
+            /**
+             * @brief Flush queued frames with one gathered write, by lane, a streamed frame always ends it
             */
             private: void flush_messages();
 
+            /**
+             * @brief Send a NEGOTIATE listing the preferred algorithm first, then every other one verified here, then streams and multicast
+            */
+            private: void negotiate();
+
+            /**
+             * @brief Join the multicast group the server answered with, once
+             * @param group "IPV4:PORT"
+            */
+            private: void join_group(const std::string& group);
+
+            /**
+             * @brief Write received datagrams to their files
+            */
+            private: void datagram_reader();
+
+            /**
+             * @brief Open the file of a multicast WRITE_FILE, or write a REPAIR and dispatch the file once complete
+             * @return True if the file was dispatched, which reads the next frame
+            */
+            private: bool receive_multicast();
+
+            /**
+             * @brief Answer a MULTICAST_END with a NACK once datagrams in flight arrived, dispatch the file if complete
+            */
+            private: void end_multicast();
+
+            /**
+             * @brief Verify and dispatch a complete multicast file, which reads the next frame
+             * @param found Its entry in m_multicasts
+            */
+            private: void deliver_multicast(std::map<std::uint32_t, incoming_multicast>::iterator found);
+
+            /**
+             * @brief Flush once the coalescing window is over
+            */
+            private: void coalesce_waiter();
+
+            /**
+             * @brief Account for the written frames and flush the next ones
+            */
+            private: void message_flushed();
+
+            /**
+             * @brief Replace logging of received messages by a handler, call before running the io context
+             * @param handler Handler, empty to log again
+            */
+            public: void set_message_handler(message_handler handler);
+
+            /**
+             * @brief Call back once every queued message has been written
+             * @param on_drained Called on the io thread, immediately if nothing is queued
+            */
+            public: void drain(std::function<void()> on_drained);
+
+            /**
+             * @brief Write every queued message, end the session then close, the server announces the client left at once
+             * @param on_left Called on the io thread once closed
+            */
+            public: void leave(std::function<void()> on_left);
+
+            /**
+             * @brief Check if connection succeeded
+             * @return True once connected
+            */
+            public: bool is_connected() const { return m_connected; }
+
+            /**
+             * @brief Check if connection failed or was closed
+             * @return True if it will never deliver messages again
+            */
+            public: bool is_closed() const { return m_closed; }
+
+            /**
+             * @brief Call the drain callback once nothing is queued or being prepared
+            */
+            private: void check_drained();
+
+            /**
+             * @brief Close socket and flag client as closed
+            */
+            private: void close();
+
+            /**
+             * @brief Wait for the next heartbeat tick
+            */
+            private: void heartbeat_waiter();
+
+            /**
+             * @brief Send a HEARTBEAT if idle, close if the server went silent
+            */
+            private: void heartbeat();
+
             /**
              * @brief Get message header
             */
             private: void header_reader();
 
             /**
-             * @brief Get message data
+             * @brief Get the rest of a version 2 header
+            */
+            private: void header_extension_reader();
+
+            /**
+             * @brief Get message data, streamed file contents go straight to disk
             */
             private: void data_buffer_reader();
 
+            /**
+             * @brief Spool a chunked WRITE_FILE or CHUNK, dispatch the file once complete
+             * @return True if the file was dispatched, which reads the next frame
+            */
+            private: bool receive_stream();
+
+            /**
+             * @brief Record, hand over or log a completely received message, then read the next one
+             * @param checksum_ok True if the checksum matched
+            */
+            private: void dispatch_message(bool checksum_ok);
+
+            /**
+             * @brief Record, hand over or log a received TEXT or WRITE_FILE
+             * @param _message Received message
+             * @param _view Segments of _message
+             * @param checksum_ok True if the checksum matched
+            */
+            private: void deliver(message::message& _message, message::message_view& _view, bool checksum_ok);
+
+            /**
+             * @brief Keep a file for members to fetch, evicting the oldest offers beyond MAX_OFFERS or DIRECT_OFFER_BYTES
+             * @param offer_id Offer identifier
+             * @param _message WRITE_FILE
+            */
+            private: void store_offer(std::uint32_t offer_id, std::shared_ptr<message::message> _message);
+
+            /**
+             * @brief Read the next files of directory sends while DIRECTORY_READ_AHEAD_BYTES and DIRECTORY_READ_AHEAD_FILES allow
+            */
+            private: void read_ahead();
+
+            /**
+             * @brief Fetch a file the server told about from its sender, or through the server if unreachable
+            */
+            private: void fetch_offer();
+
+            /**
+             * @brief Send a file a member asked the server for
+            */
+            private: void serve_fetch();
+
             /**
              * @brief Get local address
              * @return Local address
@@ -83,9 +597,144 @@ namespace scft
             private: boost::asio::io_context& m_io_ctx;
 
             /**
-             * @brief TCP Socket
+             * @brief Connection, a socket or shared memory rings
+            */
+            private: transport::stream m_socket;
+
+            /**
+             * @brief Server endpoints, tried in turn when connecting again
+            */
+            private: std::vector<transport::endpoint> m_endpoints;
+
+            /**
+             * @brief Reconnect on errors, only used on the io thread
+            */
+            private: bool m_reconnect;
+
+            /**
+             * @brief Waiting to connect again
+            */
+            private: bool m_reconnecting;
+
+            /**
+             * @brief Failed reconnection attempts in a row
+            */
+            private: unsigned int m_attempts;
+
+            /**
+             * @brief Reconnection backoff timer
+            */
+            private: boost::asio::steady_timer m_reconnect_timer;
+
+            /**
+             * @brief Connection number, handlers of a dropped connection are ignored
+            */
+            private: std::uint64_t m_link;
+
+            /**
+             * @brief A read is pending or a received frame is being handled, reconnecting does not start another
+            */
+            private: bool m_reading;
+
+            /**
+             * @brief SESSION written, frames wait for the answer
+            */
+            private: bool m_resuming;
+
+            /**
+             * @brief Keep written frames, until the server answers whether it keeps a session
+            */
+            private: bool m_retaining;
+
+            /**
+             * @brief Session token, empty without a session
+            */
+            private: std::string m_session;
+
+            /**
+             * @brief Sequence number of the last frame received
             */
-            private: boost::asio::ip::tcp::socket m_socket;
+            private: std::uint64_t m_received;
+
+            /**
+             * @brief Sequence number in the last ACK sent
+            */
+            private: std::uint64_t m_acknowledged;
+
+            /**
+             * @brief Bytes of sequenced frames received, contents included
+            */
+            private: std::uint64_t m_received_bytes;
+
+            /**
+             * @brief m_received_bytes when the last ACK was sent
+            */
+            private: std::uint64_t m_acknowledged_bytes;
+
+            /**
+             * @brief Receive window to advertise, 0 for none
+            */
+            private: std::uint64_t m_window;
+
+            /**
+             * @brief The server answered the receive window
+            */
+            private: bool m_window_negotiated;
+
+            /**
+             * @brief Sequence number of the last frame taken from the queue
+            */
+            private: std::uint64_t m_sequence;
+
+            /**
+             * @brief Sequence number the server last acknowledged
+            */
+            private: std::uint64_t m_acked;
+
+            /**
+             * @brief Sequence number of the next frame to send again, past m_sequence when caught up
+            */
+            private: std::uint64_t m_resend;
+
+            /**
+             * @brief Written frames not acknowledged yet, in sequence
+            */
+            private: std::deque<mux::scheduled_frame> m_unacked;
+
+            /**
+             * @brief Origin address of sent frames, kept across resumed connections
+            */
+            private: std::string m_address;
+
+            /**
+             * @brief Origin port of sent frames
+            */
+            private: std::uint16_t m_port;
+
+            /**
+             * @brief Protects m_address and m_port
+            */
+            private: mutable std::mutex m_origin_mutex;
+
+            /**
+             * @brief Exchange frames through shared memory once connected
+            */
+            private: bool m_shared_memory;
+
+            /**
+             * @brief Heartbeat and server timeout timer
+            */
+            private: boost::asio::steady_timer m_heartbeat_timer;
+
+            /**
+             * @brief Last time bytes were read
+            */
+            private: std::chrono::steady_clock::time_point m_last_read;
+
+            /**
+             * @brief Last time a message was written
+            */
+            private: std::chrono::steady_clock::time_point m_last_write;
 
             /**
              * @brief Current reading message
@@ -93,14 +742,229 @@ namespace scft
             private: message::message m_message;
 
             /**
-             * @brief Output message queue
+             * @brief Segments of m_message, parsed once its buffered data is read
+            */
+            private: message::message_view m_view;
+
+            /**
+             * @brief Output message queue, files are chunked once the server negotiated streams
+            */
+            private: mux::frame_scheduler m_scheduler;
+
+            /**
+             * @brief Chunked files being received, by stream identifier
+            */
+            private: std::map<std::uint32_t, incoming_stream> m_incoming;
+
+            /**
+             * @brief Multicast socket, open once the group is joined
+            */
+            private: boost::asio::ip::udp::socket m_multicast_socket;
+
+            /**
+             * @brief Datagram being received
+            */
+            private: std::vector<std::uint8_t> m_datagram;
+
+            /**
+             * @brief Grace timer between a MULTICAST_END and its NACK
+            */
+            private: boost::asio::steady_timer m_multicast_timer;
+
+            /**
+             * @brief Multicast files being received, by transfer identifier
+            */
+            private: std::map<std::uint32_t, incoming_multicast> m_multicasts;
+
+            /**
+             * @brief Bytes of queued frame headers and buffered data
+            */
+            private: std::size_t m_queued_bytes;
+
+            /**
+             * @brief Frames being written
+            */
+            private: std::vector<mux::scheduled_frame> m_in_flight;
+
+            /**
+             * @brief Buffers of the frames being written
+            */
+            private: std::vector<boost::asio::const_buffer> m_gather;
+
+            /**
+             * @brief A gathered write is in progress
             */
-            private: std::deque<message::message> m_messages;
+            private: bool m_writing;
+
+            /**
+             * @brief TCP_NODELAY and TEXT coalescing
+            */
+            private: bool m_low_latency;
+
+            /**
+             * @brief Coalescing window
+            */
+            private: std::chrono::microseconds m_coalesce_window;
+
+            /**
+             * @brief Gathered write budget
+            */
+            private: std::size_t m_coalesce_bytes;
+
+            /**
+             * @brief Coalescing window timer
+            */
+            private: boost::asio::steady_timer m_coalesce_timer;
+
+            /**
+             * @brief Coalescing window timer is armed
+            */
+            private: bool m_coalescing;
+
+            /**
+             * @brief Frames fully written
+            */
+            private: std::atomic<std::uint64_t> m_frames_written;
+
+            /**
+             * @brief Gathered writes started
+            */
+            private: std::atomic<std::uint64_t> m_write_calls;
 
             /**
              * @brief Log to write to
             */
             private: basic_shell::scrolling_log& m_log;
+
+            /**
+             * @brief Received message handler
+            */
+            private: message_handler m_message_handler;
+
+            /**
+             * @brief Drain callback
+            */
+            private: std::function<void()> m_on_drained;
+
+            /**
+             * @brief Connected flag
+            */
+            private: std::atomic<bool> m_connected;
+
+            /**
+             * @brief Closed flag
+            */
+            private: std::atomic<bool> m_closed;
+
+            /**
+             * @brief Stamp sent messages
+            */
+            private: std::atomic<bool> m_tracing;
+
+            /**
+             * @brief Random high half of trace identifiers
+            */
+            private: std::uint64_t m_trace_prefix;
+
+            /**
+             * @brief Low half of trace identifiers
+            */
+            private: std::atomic<std::uint32_t> m_trace_sequence;
+
+            /**
+             * @brief Offer streams, only used on the io thread
+            */
+            private: bool m_streams;
+
+            /**
+             * @brief Offer multicast, only used on the io thread
+            */
+            private: bool m_multicast;
+
+            /**
+             * @brief Interface to join the multicast group on, only used on the io thread
+            */
+            private: std::string m_multicast_interface;
+
+            /**
+             * @brief Serves offered files, null unless direct was asked for, only used on the io thread
+            */
+            private: std::unique_ptr<direct_server> m_direct_server;
+
+            /**
+             * @brief Ask senders for deltas against local copies, only used on the io thread
+            */
+            private: bool m_delta;
+
+            /**
+             * @brief Offered files by identifier, only used on the io thread
+            */
+            private: std::map<std::uint32_t, std::shared_ptr<message::message>> m_offers;
+
+            /**
+             * @brief Buffered contents of m_offers, only used on the io thread
+            */
+            private: std::uint64_t m_offered_bytes;
+
+            /**
+             * @brief The server answered direct, files above DIRECT_THRESHOLD are offered
+            */
+            private: std::atomic<bool> m_direct_negotiated;
+
+            /**
+             * @brief Port offered files are served on, 0 if not serving
+            */
+            private: std::atomic<std::uint16_t> m_direct_port;
+
+            /**
+             * @brief Identifier of the next offer
+            */
+            private: std::atomic<std::uint32_t> m_next_offer_id;
+
+            /**
+             * @brief Algorithm asked for, only used on the io thread
+            */
+            private: checksum::ALGORITHM m_preferred_checksum;
+
+            /**
+             * @brief Algorithm agreed with the server
+            */
+            private: std::atomic<checksum::ALGORITHM> m_checksum_algorithm;
+
+            /**
+             * @brief Delivery latency of received traced messages
+            */
+            private: metrics::hdr_histogram m_delivery_latency;
+
+            /**
+             * @brief PING round trip latency
+            */
+            private: metrics::hdr_histogram m_round_trip_latency;
+
+            /**
+             * @brief Files being prepared
+            */
+            private: std::list<std::shared_ptr<file_send>> m_file_sends;
+
+            /**
+             * @brief Protects m_file_sends
+            */
+            private: mutable std::mutex m_file_sends_mutex;
+
+            /**
+             * @brief Directory sends with files left to read, only used on the io thread
+            */
+            private: std::list<std::shared_ptr<directory_send>> m_directory_sends;
+
+            /**
+             * @brief Set by the destructor, stops preparations at their next chunk
+            */
+            private: std::atomic<bool> m_stopping;
+
+            /**
+             * @brief Preparation threads
+            */
+            private: boost::asio::thread_pool m_preparation_pool;
         };
     }
 }
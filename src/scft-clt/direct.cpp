@@ -0,0 +1,489 @@
+#include "direct.hpp"
+#include "file_transfer.hpp"
+
+using boost::asio::ip::tcp;
+
+namespace scft
+{
+    namespace client
+    {
+    void read_frame(transport::stream& _socket, message::message& frame, std::size_t max, std::function<void(bool ok)> handler)
+    {
+        boost::asio::async_read(_socket,
+            boost::asio::buffer(frame.get_raw_message(), message::HEADER_SIZE),
+            [&_socket, &frame, max, handler](boost::system::error_code ec, std::size_t)
+            {
+                if (ec)
+                {
+                    handler(false);
+                    return;
+                }
+                std::size_t missing = frame.extend_header();
+                boost::asio::async_read(_socket,
+                    boost::asio::buffer(frame.get_raw_message().data() + message::HEADER_SIZE, missing),
+                    [&_socket, &frame, max, handler](boost::system::error_code ec, std::size_t)
+                    {
+                        if (ec || frame.bad_header())
+                        {
+                            handler(false);
+                            return;
+                        }
+                        frame.adjust();
+                        if (frame.get_buffered_data_len() > max)
+                        {
+                            handler(false);
+                            return;
+                        }
+                        boost::asio::async_read(_socket,
+                            boost::asio::buffer(frame.get_data(), frame.get_buffered_data_len()),
+                            [handler](boost::system::error_code ec, std::size_t) { handler(!ec); });
+                    });
+            });
+    }
+
+    direct_server::direct_server(boost::asio::io_context& io_ctx, std::uint16_t port, offer_lookup lookup,
+        boost::asio::thread_pool& pool, basic_shell::scrolling_log& _log)
+    :
+    m_acceptor(io_ctx, transport::endpoint(tcp::endpoint(tcp::v4(), port))),
+    m_port(transport::get_port(m_acceptor.local_endpoint())),
+    m_lookup(std::move(lookup)),
+    m_pool(pool),
+    m_log(_log)
+    {
+        m_log.append_log("Serving offered files on port " + std::to_string(m_port) + '\n');
+        accepter();
+    }
+
+    direct_server::~direct_server()
+    {
+        close();
+    }
+
+    void direct_server::close()
+    {
+        boost::system::error_code ec;
+        m_acceptor.close(ec);
+    }
+
+    void direct_server::accepter()
+    {
+        m_acceptor.async_accept(
+            [this](boost::system::error_code ec, transport::socket _socket)
+            {
+                if (ec == boost::asio::error::operation_aborted || !m_acceptor.is_open())
+                    return;
+                if (!ec)
+                    upload(std::make_shared<transport::stream>(std::move(_socket)));
+                accepter();
+            });
+    }
+
+    void direct_server::upload(std::shared_ptr<transport::stream> _socket)
+    {
+        std::shared_ptr<message::message> fetch = std::make_shared<message::message>();
+        read_frame(*_socket, *fetch, MAX_FETCH_FRAME,
+            [this, _socket, fetch](bool ok)
+            {
+                message::message_view view;
+                if (!ok || fetch->get_message_type() != message::MESSAGE_TYPE::FETCH
+                    || !view.parse(fetch->get_raw_message().data(), fetch->get_raw_message().size()))
+                    return;
+                // "ID", or "ID delta" from clients that have a copy to patch
+                std::string text(view.get_string());
+                std::size_t space = text.find(' ');
+                std::uint32_t offer_id = 0;
+                std::shared_ptr<message::message> offer;
+                try
+                {
+                    unsigned long parsed = std::stoul(text.substr(0, space));
+                    if (parsed <= UINT32_MAX)
+                    {
+                        offer_id = static_cast<std::uint32_t>(parsed);
+                        offer = m_lookup(offer_id);
+                    }
+                }
+                catch (std::exception&)
+                {
+                }
+                // Closing tells the fetching client to ask the server instead
+                if (!offer)
+                    return;
+                m_log.append_log("Uploading " + text.substr(0, space) + " to " + std::string(view.get_origin()) + '\n');
+                if (space != std::string::npos && text.substr(space + 1) == "delta")
+                {
+                    upload_delta(_socket, offer, offer_id, std::string(view.get_origin()));
+                    return;
+                }
+                boost::asio::async_write(*_socket, boost::asio::buffer(offer->get_raw_message()),
+                    [_socket, offer](boost::system::error_code ec, std::size_t)
+                    {
+                        if (ec || !offer->get_payload_file())
+                            return;
+                        std::shared_ptr<transfer::file_sender> sender = std::make_shared<transfer::file_sender>(
+                            *_socket, offer->get_payload_file(),
+                            [_socket](boost::system::error_code) {});
+                        sender->start();
+                    });
+            });
+    }
+
+    void direct_server::upload_delta(std::shared_ptr<transport::stream> _socket, std::shared_ptr<message::message> offer,
+        std::uint32_t offer_id, const std::string& origin)
+    {
+        // Same header and checksum as the offer, the contents follow as operations on the client's copy
+        std::shared_ptr<message::message> announce = std::make_shared<message::message>();
+        std::size_t prefix = offer->get_header_size() + offer->get_origin_len() + offer->get_string_len() + 1;
+        announce->get_raw_message().assign(offer->get_raw_message().begin(), offer->get_raw_message().begin() + prefix);
+        announce->set_flags(announce->get_flags() | message::FLAG_CHUNKED | message::FLAG_DELTA);
+        announce->set_stream_id(offer_id);
+        boost::asio::async_write(*_socket, boost::asio::buffer(announce->get_raw_message()),
+            [this, _socket, offer, offer_id, origin, announce](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec)
+                    signature_reader(_socket, offer, offer_id, origin, std::make_shared<std::vector<std::uint8_t>>());
+            });
+    }
+
+    void direct_server::signature_reader(std::shared_ptr<transport::stream> _socket, std::shared_ptr<message::message> offer,
+        std::uint32_t offer_id, const std::string& origin, std::shared_ptr<std::vector<std::uint8_t>> data)
+    {
+        std::shared_ptr<message::message> frame = std::make_shared<message::message>();
+        read_frame(*_socket, *frame, MAX_DELTA_FRAME,
+            [this, _socket, offer, offer_id, origin, data, frame](bool ok)
+            {
+                message::message_view view;
+                if (!ok || !view.parse(frame->get_raw_message().data(), frame->get_raw_message().size())
+                    || view.get_message_type() != message::MESSAGE_TYPE::CHUNK || view.get_stream_id() != offer_id)
+                    return;
+                data->insert(data->end(), view.get_file_buffer().data, view.get_file_buffer().data + view.get_file_buffer().size);
+                if (data->size() < delta::SIGNATURES_HEADER_SIZE)
+                {
+                    signature_reader(_socket, offer, offer_id, origin, data);
+                    return;
+                }
+                std::shared_ptr<delta::signatures> _signatures = std::make_shared<delta::signatures>();
+                if (!delta::read_signatures_header(data->data(), *_signatures))
+                    return;
+                std::uint64_t expected = delta::SIGNATURES_HEADER_SIZE + delta::get_blocks_size(*_signatures);
+                if (data->size() > expected)
+                    return;
+                if (data->size() < expected)
+                {
+                    signature_reader(_socket, offer, offer_id, origin, data);
+                    return;
+                }
+                delta::read_blocks(data->data() + delta::SIGNATURES_HEADER_SIZE, *_signatures);
+                data->clear();
+                data->shrink_to_fit();
+
+                delta::source _source{offer->get_payload_file() ? offer->get_payload_file()->get_path() : std::string(),
+                    offer->get_payload_file() ? nullptr : offer->get_file_buffer(), offer->get_file_buffer_len()};
+                basic_shell::scrolling_log& _log = m_log;
+                boost::asio::post(m_pool,
+                    [_socket, offer, offer_id, origin, _signatures, _source, &_log]()
+                    {
+                        std::vector<delta::op> ops;
+                        if (!delta::encode(_source, *_signatures, ops))
+                        {
+                            _log.append_log("Could not read offer " + std::to_string(offer_id) + '\n');
+                            boost::asio::post(_socket->get_executor(), [_socket]() { _socket->close(); });
+                            return;
+                        }
+                        std::uint64_t literal = 0;
+                        for (const delta::op& _op : ops)
+                            literal += _op.copy ? 0 : _op.length;
+                        _log.append_log("Delta of " + std::to_string(offer_id) + " to " + origin + ": " + std::to_string(literal)
+                            + " of " + std::to_string(_source.length) + " bytes literal\n");
+                        std::shared_ptr<delta::op_writer> writer = std::make_shared<delta::op_writer>(_source, std::move(ops));
+                        boost::asio::post(_socket->get_executor(), [_socket, writer, offer_id, offer]() { op_sender(_socket, writer, offer_id, offer); });
+                    });
+            });
+    }
+
+    void direct_server::op_sender(std::shared_ptr<transport::stream> _socket, std::shared_ptr<delta::op_writer> writer,
+        std::uint32_t offer_id, std::shared_ptr<message::message> offer)
+    {
+        if (writer->done())
+            return;
+        std::vector<std::uint8_t> ops;
+        boost::system::error_code ec;
+        if (!writer->next(ops, message::STREAM_CHUNK_SIZE))
+        {
+            _socket->close(ec);
+            return;
+        }
+        std::shared_ptr<message::message> frame = std::make_shared<message::message>(offer_id, ops.data(), ops.size());
+        boost::asio::async_write(*_socket, boost::asio::buffer(frame->get_raw_message()),
+            [_socket, writer, offer_id, offer, frame](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec)
+                    op_sender(_socket, writer, offer_id, offer);
+            });
+    }
+
+    direct_fetch::direct_fetch(
+        boost::asio::io_context& io_ctx,
+        const tcp::endpoint& sender,
+        std::uint32_t offer_id,
+        const std::string& address,
+        std::uint16_t port,
+        bool delta,
+        boost::asio::thread_pool& pool,
+        fetch_handler handler,
+        basic_shell::scrolling_log& _log)
+    :
+    m_socket(io_ctx.get_executor()),
+    m_timer(io_ctx),
+    m_sender(sender),
+    m_offer_id(offer_id),
+    m_pool(pool),
+    m_fetch(message::MESSAGE_TYPE::FETCH, address, port, std::to_string(offer_id) + (delta ? " delta" : "")),
+    m_handler(std::move(handler)),
+    m_log(_log)
+    {
+    }
+
+    direct_fetch::~direct_fetch()
+    {
+    }
+
+    void direct_fetch::start()
+    {
+        std::shared_ptr<direct_fetch> self = shared_from_this();
+        m_timer.expires_after(DIRECT_CONNECT_TIMEOUT);
+        m_timer.async_wait(
+            [self](boost::system::error_code ec)
+            {
+                if (!ec)
+                    self->finish(false, false);
+            });
+        m_socket.get_socket().async_connect(m_sender,
+            [self](boost::system::error_code ec)
+            {
+                if (ec)
+                {
+                    self->finish(false, false);
+                    return;
+                }
+                self->m_timer.cancel();
+                boost::asio::async_write(self->m_socket, boost::asio::buffer(self->m_fetch.get_raw_message()),
+                    [self](boost::system::error_code ec, std::size_t)
+                    {
+                        if (!ec)
+                            self->header_reader();
+                        else
+                            self->finish(false, false);
+                    });
+            });
+    }
+
+    void direct_fetch::header_reader()
+    {
+        std::shared_ptr<direct_fetch> self = shared_from_this();
+        boost::asio::async_read(m_socket,
+            boost::asio::buffer(m_message.get_raw_message(), message::HEADER_SIZE),
+            [self](boost::system::error_code ec, std::size_t)
+            {
+                if (ec)
+                {
+                    self->finish(false, false);
+                    return;
+                }
+                std::size_t missing = self->m_message.extend_header();
+                boost::asio::async_read(self->m_socket,
+                    boost::asio::buffer(self->m_message.get_raw_message().data() + message::HEADER_SIZE, missing),
+                    [self](boost::system::error_code ec, std::size_t)
+                    {
+                        if (ec || self->m_message.bad_header() || self->m_message.get_message_type() != message::MESSAGE_TYPE::WRITE_FILE)
+                        {
+                            self->finish(false, false);
+                            return;
+                        }
+                        self->m_message.adjust();
+                        self->data_buffer_reader();
+                    });
+            });
+    }
+
+    void direct_fetch::data_buffer_reader()
+    {
+        std::shared_ptr<direct_fetch> self = shared_from_this();
+        boost::asio::async_read(m_socket,
+            boost::asio::buffer(m_message.get_data(), m_message.get_buffered_data_len()),
+            [self](boost::system::error_code ec, std::size_t)
+            {
+                if (ec || !self->m_view.parse(self->m_message.get_raw_message().data(), self->m_message.get_raw_message().size()))
+                {
+                    self->finish(false, false);
+                    return;
+                }
+                checksum::hasher _hasher(self->m_view.get_checksum_algorithm());
+                _hasher.update(self->m_view.get_buffered_data().data, self->m_view.get_buffered_data().size);
+                if (self->m_view.is_chunked())
+                {
+                    // Only a sender asked for a delta announces its file instead of sending it
+                    if ((self->m_view.get_flags() & message::FLAG_DELTA) == 0 || self->m_view.get_stream_id() != self->m_offer_id)
+                        self->finish(false, false);
+                    else
+                        self->signature_writer(_hasher);
+                    return;
+                }
+                if (self->m_view.has_streamed_body())
+                {
+                    // A sender gone halfway is asked again through the server, which rewrites the file
+                    std::shared_ptr<transfer::file_receiver> receiver = std::make_shared<transfer::file_receiver>(
+                        self->m_socket, transfer::receive_path(self->m_view.get_string()), self->m_view.get_file_buffer_len(), true, _hasher,
+                        [self](boost::system::error_code ec, std::uint64_t checksum)
+                        {
+                            if (!ec)
+                            {
+                                self->m_message.set_payload_file(std::make_shared<message::payload_file>(
+                                    std::string(self->m_view.get_string()), self->m_view.get_file_buffer_len(), false));
+                                self->finish(true, checksum == self->m_view.get_checksum());
+                            }
+                            else if (ec == boost::system::errc::io_error)
+                            {
+                                self->m_log.append_log("Could not write " + std::string(self->m_view.get_string()) + '\n');
+                                self->finish(true, false);
+                            }
+                            else
+                                self->finish(false, false);
+                        });
+                    receiver->start();
+                    return;
+                }
+                transfer::write_file(self->m_socket.get_executor(), transfer::receive_path(self->m_view.get_string()),
+                    self->m_view.get_file_buffer().data, self->m_view.get_file_buffer().size,
+                    [self, checksum = _hasher.digest()](boost::system::error_code ec)
+                    {
+                        if (ec)
+                            self->m_log.append_log("Could not write " + std::string(self->m_view.get_string()) + '\n');
+                        self->finish(true, checksum == self->m_view.get_checksum());
+                    });
+            });
+    }
+
+    void direct_fetch::signature_writer(checksum::hasher _hasher)
+    {
+        std::shared_ptr<direct_fetch> self = shared_from_this();
+        m_name = transfer::receive_path(m_view.get_string());
+        boost::asio::post(m_pool,
+            [self, _hasher]()
+            {
+                // A missing copy has no block size, the sender then sends every byte as a literal
+                delta::signatures _signatures = delta::compute_signatures(self->m_name);
+                std::vector<std::uint8_t> data = delta::write_signatures(_signatures);
+                std::shared_ptr<std::vector<message::message>> frames = std::make_shared<std::vector<message::message>>();
+                for (std::size_t offset = 0; offset < data.size(); offset += message::STREAM_CHUNK_SIZE)
+                    frames->emplace_back(self->m_offer_id, data.data() + offset, std::min(message::STREAM_CHUNK_SIZE, data.size() - offset));
+                std::shared_ptr<delta::patcher> _patcher = std::make_shared<delta::patcher>(self->m_name, _signatures.length, self->m_view.get_file_buffer_len());
+                boost::asio::post(self->m_socket.get_executor(),
+                    [self, _hasher, frames, _patcher]()
+                    {
+                        if (!_patcher->is_open())
+                        {
+                            self->m_log.append_log("Could not write " + self->m_name + '\n');
+                            self->finish(true, false);
+                            return;
+                        }
+                        self->m_patcher = _patcher;
+                        std::vector<boost::asio::const_buffer> buffers;
+                        for (message::message& frame : *frames)
+                            buffers.push_back(boost::asio::buffer(frame.get_raw_message()));
+                        boost::asio::async_write(self->m_socket, buffers,
+                            [self, _hasher, frames](boost::system::error_code ec, std::size_t)
+                            {
+                                if (ec)
+                                    self->finish(false, false);
+                                else
+                                    self->delta_reader(_hasher);
+                            });
+                    });
+            });
+    }
+
+    void direct_fetch::delta_reader(checksum::hasher _hasher)
+    {
+        std::shared_ptr<direct_fetch> self = shared_from_this();
+        if (!m_patcher->complete())
+        {
+            m_frame = message::message();
+            read_frame(m_socket, m_frame, MAX_DELTA_FRAME,
+                [self, _hasher](bool ok)
+                {
+                    message::message_view view;
+                    if (!ok || !view.parse(self->m_frame.get_raw_message().data(), self->m_frame.get_raw_message().size())
+                        || view.get_message_type() != message::MESSAGE_TYPE::CHUNK || view.get_stream_id() != self->m_offer_id)
+                    {
+                        self->finish(false, false);
+                        return;
+                    }
+                    boost::asio::post(self->m_pool,
+                        [self, _hasher, contents = view.get_file_buffer()]()
+                        {
+                            bool applied = self->m_patcher->apply(contents.data, contents.size);
+                            boost::asio::post(self->m_socket.get_executor(),
+                                [self, _hasher, applied]()
+                                {
+                                    if (applied)
+                                        self->delta_reader(_hasher);
+                                    else
+                                    {
+                                        self->m_log.append_log("Bad delta for " + self->m_name + ", fetching it whole\n");
+                                        self->finish(false, false);
+                                    }
+                                });
+                        });
+                });
+            return;
+        }
+        // Verified by reading the copy back, most of it was never sent
+        boost::asio::post(m_pool,
+            [self, _hasher]() mutable
+            {
+                std::uint64_t length = self->m_view.get_file_buffer_len();
+                bool checksum_ok = self->m_patcher->finish();
+                delta::reader _reader(delta::source{self->m_name, nullptr, length});
+                std::vector<std::uint8_t> buffer(message::FILE_READ_CHUNK);
+                for (std::uint64_t offset = 0; checksum_ok && offset < length; offset += buffer.size())
+                {
+                    std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), length - offset));
+                    checksum_ok = _reader.read(offset, buffer.data(), chunk);
+                    _hasher.update(buffer.data(), chunk);
+                }
+                checksum_ok = checksum_ok && _hasher.digest() == self->m_view.get_checksum();
+                boost::asio::post(self->m_socket.get_executor(),
+                    [self, checksum_ok]()
+                    {
+                        if (!checksum_ok)
+                        {
+                            self->m_log.append_log(self->m_name + " does not match once patched, fetching it whole\n");
+                            self->finish(false, false);
+                            return;
+                        }
+                        self->m_log.append_log("Patched " + self->m_name + ", " + std::to_string(self->m_patcher->get_copied_bytes())
+                            + " of " + std::to_string(self->m_view.get_file_buffer_len()) + " bytes from the local copy\n");
+                        // Delivered like a streamed file, its contents are on disk
+                        self->m_message.set_flags(self->m_message.get_flags() & ~(message::FLAG_CHUNKED | message::FLAG_DELTA));
+                        self->m_message.set_stream_id(0);
+                        self->m_message.set_payload_file(std::make_shared<message::payload_file>(
+                            self->m_name, self->m_view.get_file_buffer_len(), false));
+                        self->m_view.parse(self->m_message.get_raw_message().data(), self->m_message.get_raw_message().size(), true);
+                        self->finish(true, true);
+                    });
+            });
+    }
+
+    void direct_fetch::finish(bool reached, bool checksum_ok)
+    {
+        if (!m_handler)
+            return;
+        boost::system::error_code ec;
+        m_timer.cancel();
+        m_socket.close(ec);
+        fetch_handler handler = std::move(m_handler);
+        m_handler = nullptr;
+        handler(reached, m_message, m_view, checksum_ok);
+    }
+    }
+}
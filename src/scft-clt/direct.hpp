@@ -0,0 +1,306 @@
+#ifndef DIRECT_HPP
+#define DIRECT_HPP
+
+/**
+ * @file src/scft-clt/direct.hpp
+ * @brief Defines direct_server and direct_fetch, moving offered files between clients without the server
+*/
+
+#include "delta.hpp"
+#include "message_view.hpp"
+#include "scft_message.hpp"
+#include "scrolling_log.hpp"
+#include "transport.hpp"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace scft
+{
+    namespace client
+    {
+        /**
+         * @brief Files with at least this much contents are offered rather than sent once the server negotiated direct 1M
+        */
+        constexpr std::uint64_t DIRECT_THRESHOLD = 1048576;
+
+        /**
+         * @brief Give up reaching a sender after this long and fetch through the server
+        */
+        constexpr std::chrono::seconds DIRECT_CONNECT_TIMEOUT{3};
+
+        /**
+         * @brief Largest FETCH frame a direct_server reads
+        */
+        constexpr std::size_t MAX_FETCH_FRAME = 4096;
+
+        /**
+         * @brief Largest CHUNK frame of a delta exchange, STREAM_CHUNK_SIZE of contents
+        */
+        constexpr std::size_t MAX_DELTA_FRAME = message::STREAM_CHUNK_SIZE + 2;
+
+        /**
+         * @brief Read one whole frame
+         * @param _socket Connection, must outlive the read
+         * @param frame Frame read, must outlive the read
+         * @param max Largest buffered data accepted
+         * @param handler Called with false on errors, bad headers and larger frames
+        */
+        void read_frame(transport::stream& _socket, message::message& frame, std::size_t max, std::function<void(bool ok)> handler);
+
+        /**
+         * @brief Finds an offered file
+         * @param offer_id Offer identifier
+         * @return Offered WRITE_FILE, null if not offered, or not anymore
+        */
+        typedef std::function<std::shared_ptr<message::message>(std::uint32_t offer_id)> offer_lookup;
+
+        /**
+         * @brief Called on the io thread once a fetch is over
+         * @param reached False if the sender could not be reached or did not have the offer, nothing was written
+         * @param _message Received WRITE_FILE, contents on disk in its payload_file or in its buffer
+         * @param _view Segments of _message
+         * @param checksum_ok True if the checksum matched
+        */
+        typedef std::function<void(bool reached, message::message& _message, message::message_view& _view, bool checksum_ok)> fetch_handler;
+
+        /**
+         * @brief Serves offered files, one FETCH per connection, not thread safe, use it from the io thread
+        */
+        class direct_server
+        {
+            /**
+             * @brief Listen
+             * @param io_ctx boost io context
+             * @param port Port to listen on, 0 for any
+             * @param lookup Finds offered files
+             * @param pool Threads encoding deltas
+             * @param _log Log
+             * @note Throws boost::system::system_error if it can not listen
+            */
+            public: direct_server(boost::asio::io_context& io_ctx, std::uint16_t port, offer_lookup lookup,
+                boost::asio::thread_pool& pool, basic_shell::scrolling_log& _log);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~direct_server();
+
+            /**
+             * @brief Port offers are served on
+             * @return Port
+            */
+            public: std::uint16_t get_port() const { return m_port; }
+
+            /**
+             * @brief Stop accepting, uploads in progress complete
+            */
+            public: void close();
+
+            /**
+             * @brief Accept the next fetch
+            */
+            private: void accepter();
+
+            /**
+             * @brief Read a FETCH and write its file
+             * @param _socket Connection of the fetching client
+            */
+            private: void upload(std::shared_ptr<transport::stream> _socket);
+
+            /**
+             * @brief Announce an offered file, read the signatures of the fetching client's copy and write a delta against it
+             * @param _socket Connection of the fetching client
+             * @param offer Offered WRITE_FILE
+             * @param offer_id Offer identifier
+             * @param origin Fetching client
+            */
+            private: void upload_delta(std::shared_ptr<transport::stream> _socket, std::shared_ptr<message::message> offer,
+                std::uint32_t offer_id, const std::string& origin);
+
+            /**
+             * @brief Read CHUNK frames until the signatures are complete, then encode the delta
+             * @param _socket Connection of the fetching client
+             * @param offer Offered WRITE_FILE
+             * @param offer_id Offer identifier
+             * @param origin Fetching client
+             * @param data Signatures read so far
+            */
+            private: void signature_reader(std::shared_ptr<transport::stream> _socket, std::shared_ptr<message::message> offer,
+                std::uint32_t offer_id, const std::string& origin, std::shared_ptr<std::vector<std::uint8_t>> data);
+
+            /**
+             * @brief Write the next CHUNK frame of a delta
+             * @param _socket Connection of the fetching client
+             * @param writer Operations left
+             * @param offer_id Offer identifier
+             * @param offer Offered WRITE_FILE, literals are read from it
+            */
+            private: static void op_sender(std::shared_ptr<transport::stream> _socket, std::shared_ptr<delta::op_writer> writer,
+                std::uint32_t offer_id, std::shared_ptr<message::message> offer);
+
+            /**
+             * @brief TCP Accept socket
+            */
+            private: transport::acceptor m_acceptor;
+
+            /**
+             * @brief Listening port
+            */
+            private: std::uint16_t m_port;
+
+            /**
+             * @brief Finds offered files
+            */
+            private: offer_lookup m_lookup;
+
+            /**
+             * @brief Threads encoding deltas
+            */
+            private: boost::asio::thread_pool& m_pool;
+
+            /**
+             * @brief Log
+            */
+            private: basic_shell::scrolling_log& m_log;
+        };
+
+        /**
+         * @brief Fetches one offered file from its sender
+        */
+        class direct_fetch : public std::enable_shared_from_this<direct_fetch>
+        {
+            /**
+             * @brief Describe fetch
+             * @param io_ctx boost io context
+             * @param sender Sender endpoint, from the OFFER
+             * @param offer_id Offer identifier
+             * @param address Own address, origin of the FETCH frame
+             * @param port Own port, origin of the FETCH frame
+             * @param delta Ask for a delta against a local copy of the same name
+             * @param pool Threads computing signatures and rebuilding the copy
+             * @param handler Completion handler
+             * @param _log Log
+            */
+            public: direct_fetch(
+                boost::asio::io_context& io_ctx,
+                const boost::asio::ip::tcp::endpoint& sender,
+                std::uint32_t offer_id,
+                const std::string& address,
+                std::uint16_t port,
+                bool delta,
+                boost::asio::thread_pool& pool,
+                fetch_handler handler,
+                basic_shell::scrolling_log& _log);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~direct_fetch();
+
+            /**
+             * @brief Connect, call once owned by a shared_ptr
+            */
+            public: void start();
+
+            /**
+             * @brief Read the WRITE_FILE header and its extension
+            */
+            private: void header_reader();
+
+            /**
+             * @brief Read the origin, file name and buffered contents, then write the contents to disk
+            */
+            private: void data_buffer_reader();
+
+            /**
+             * @brief Write the signatures of the local copy of a file announced for a delta
+             * @param _hasher Checksum of the announce's origin and file name
+            */
+            private: void signature_writer(checksum::hasher _hasher);
+
+            /**
+             * @brief Read the next CHUNK frame of operations and apply it, then verify the rebuilt copy
+             * @param _hasher Checksum of the announce's origin and file name
+            */
+            private: void delta_reader(checksum::hasher _hasher);
+
+            /**
+             * @brief Close the connection and call the handler, once
+             * @param reached False to fetch through the server
+             * @param checksum_ok True if the checksum matched
+            */
+            private: void finish(bool reached, bool checksum_ok);
+
+            /**
+             * @brief TCP Socket
+            */
+            private: transport::stream m_socket;
+
+            /**
+             * @brief Connect timeout
+            */
+            private: boost::asio::steady_timer m_timer;
+
+            /**
+             * @brief Sender endpoint
+            */
+            private: transport::endpoint m_sender;
+
+            /**
+             * @brief Offer identifier
+            */
+            private: std::uint32_t m_offer_id;
+
+            /**
+             * @brief Threads computing signatures and rebuilding the copy
+            */
+            private: boost::asio::thread_pool& m_pool;
+
+            /**
+             * @brief FETCH frame
+            */
+            private: message::message m_fetch;
+
+            /**
+             * @brief WRITE_FILE being read
+            */
+            private: message::message m_message;
+
+            /**
+             * @brief Segments of m_message
+            */
+            private: message::message_view m_view;
+
+            /**
+             * @brief File name of a delta
+            */
+            private: std::string m_name;
+
+            /**
+             * @brief CHUNK frame of operations being read
+            */
+            private: message::message m_frame;
+
+            /**
+             * @brief Rebuilds the local copy, null unless fetching a delta
+            */
+            private: std::shared_ptr<delta::patcher> m_patcher;
+
+            /**
+             * @brief Completion handler, empty once called
+            */
+            private: fetch_handler m_handler;
+
+            /**
+             * @brief Log
+            */
+            private: basic_shell::scrolling_log& m_log;
+        };
+    }
+}
+
+#endif /* DIRECT_HPP */
@@ -1,5 +1,7 @@
 #include "client.hpp"
 #include "basic_shell.hpp"
+#include "command_line.hpp"
+#include "json_lines.hpp"
 
 #include <cctype>
 
@@ -7,6 +9,8 @@
 #include <boost/lexical_cast.hpp>
 
 #include <chrono>
+#include <csignal>
+#include <cstdio>
 #include <deque>
 
 #ifdef __ANDROID__
@@ -15,10 +19,46 @@
     #include <filesystem>
 #endif
 
+#include <future>
 #include <iostream>
 #include <mutex>
 #include <thread>
 
+/**
+ * @brief Check if path can be sent with sendfile
+ * @param path File path
+ * @return True if regular file under the message size limit
+*/
+static bool is_sendable_file(const std::string& path)
+{
+#ifdef __ANDROID__
+    if(!boost::filesystem::is_regular_file(path))
+        return false;
+    if (boost::filesystem::file_size(path) > scft::message::MAX_STREAM_LENGTH - path.size() - 1)
+        return false;
+#else
+    if(!std::filesystem::is_regular_file(path))
+        return false;
+    if (std::filesystem::file_size(path) > scft::message::MAX_STREAM_LENGTH - path.size() - 1)
+        return false;
+#endif
+    return true;
+}
+
+/**
+ * @brief Check if path can be sent with senddir
+ * @param path Directory path
+ * @return True if directory
+*/
+static bool is_sendable_directory(const std::string& path)
+{
+#ifdef __ANDROID__
+    return boost::filesystem::is_directory(path);
+#else
+    return std::filesystem::is_directory(path);
+#endif
+}
+
 class client_shell : scft::basic_shell::basic_shell
 {
     public: client_shell()
@@ -30,6 +70,14 @@ class client_shell : scft::basic_shell::basic_shell
         m_commands.insert(std::make_pair("sendfile", std::bind(&client_shell::cmd_sendfile, this, std::placeholders::_1)));
         m_commands.insert(std::make_pair("st", std::bind(&client_shell::cmd_sendtext, this, std::placeholders::_1)));
         m_commands.insert(std::make_pair("sf", std::bind(&client_shell::cmd_sendfile, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("senddir", std::bind(&client_shell::cmd_senddir, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("sd", std::bind(&client_shell::cmd_senddir, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("ping", std::bind(&client_shell::cmd_ping, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("pending", std::bind(&client_shell::cmd_pending, this)));
+        m_commands.insert(std::make_pair("latency", std::bind(&client_shell::cmd_latency, this)));
+        m_commands.insert(std::make_pair("lowlatency", std::bind(&client_shell::cmd_lowlatency, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("checksum", std::bind(&client_shell::cmd_checksum, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("history", std::bind(&client_shell::cmd_history, this, std::placeholders::_1)));
     }
 
     public: ~client_shell() {}
@@ -43,18 +91,43 @@ class client_shell : scft::basic_shell::basic_shell
             std::to_string(SCFT_CLT_VERSION_PATCH) + '\n');
         m_log.append_log("Available commands: \n");
         m_log.append_log("\thelp: Prints this: \n");
-        m_log.append_log("\tconnect [IP] [PORT]: Connect to server\n");
+        m_log.append_log("\tconnect [IP] [PORT] | connect [PATH]: Connect to server, over its Unix domain socket with PATH\n");
         m_log.append_log("\tdisconnect: Disconnect\n");
         m_log.append_log("\tsendtext [MESSAGE...]: Send message\n");
         m_log.append_log("\tsendfile [FILEPATH]: Send file\n");
         m_log.append_log("\tst: Alias of sendtext\n");
         m_log.append_log("\tsf: Alias of sendfile\n");
+        m_log.append_log("\tsenddir [DIRPATH]: Send every file of a directory tree, recreated under its name\n");
+        m_log.append_log("\tsd: Alias of senddir\n");
+        m_log.append_log("\tpending: Show progress of files still being read before sending\n");
+        m_log.append_log("\tping [COUNT]: Measure round trip to server COUNT times\n");
+        m_log.append_log("\tlatency: Show round trip and delivery latency percentiles\n");
+        m_log.append_log("\tlowlatency [on|off] [WINDOW_US] [BYTES]: TCP_NODELAY and batching of texts sent within WINDOW_US\n");
+        m_log.append_log("\tchecksum [crc32|crc32c|xxh3-64|none]: Ask the server for another checksum algorithm\n");
+        m_log.append_log("\thistory [last COUNT|since MINUTES]: Replay messages broadcast before joining\n");
         m_log.append_log("\tquit: Exits\n");
         return true;
     }
 
     private: bool cmd_connect(const std::vector<std::string>& args)
     {
+        if (args.size() == 2)
+        {
+            if (m_client)
+                return false;
+            try
+            {
+                m_client = std::make_unique<scft::client::client>(m_io_ctx, args.at(1), false, m_log);
+            }
+            catch (std::exception& e)
+            {
+                m_log.append_log(std::string("Cannot start client: ") + e.what() + '\n');
+                return true;
+            }
+            io_ctx_run_thread = std::thread([&](){ m_io_ctx.run(); });
+            m_log.append_log("Started client\n");
+            return true;
+        }
         if (args.size() < 3)
             return false;
         if (!is_ipv4(args.at(1)) || !is_int(args.at(2)))
@@ -73,6 +146,13 @@ class client_shell : scft::basic_shell::basic_shell
     {
         if (m_client)
         {
+            // A client still connected ends its session, the server then announces it left at once
+            if (!m_client->is_closed())
+            {
+                std::promise<void> left;
+                m_client->leave([&left](){ left.set_value(); });
+                left.get_future().wait();
+            }
             m_io_ctx.stop();
             io_ctx_run_thread.join();
             m_client.reset();
@@ -109,29 +189,143 @@ class client_shell : scft::basic_shell::basic_shell
     {
         if (args.size() != 2)
             return false;
-    #ifdef __ANDROID__
-        if(!boost::filesystem::is_regular_file(args.at(1)))
-            return false;
-        if (boost::filesystem::file_size(args.at(1)) > scft::message::MAX_DATA_LENGTH - scft::message::HEADER_SIZE)
+        if (!is_sendable_file(args.at(1)))
             return false;
-    #else
-        if(!std::filesystem::is_regular_file(args.at(1)))
+        if (m_client)
+        {
+            // Read and checksummed in the background, logged once queued
+            m_client->send_file(args.at(1));
+            return true;
+        }
+        return false;
+    }
+
+    private: bool cmd_senddir(const std::vector<std::string>& args)
+    {
+        if (args.size() != 2)
             return false;
-        if (std::filesystem::file_size(args.at(1)) > scft::message::MAX_DATA_LENGTH - scft::message::HEADER_SIZE)
+        if (!is_sendable_directory(args.at(1)))
             return false;
-    #endif
         if (m_client)
         {
-            scft::message::message _message{scft::message::MESSAGE_TYPE::WRITE_FILE, m_client->get_address(), m_client->get_port(), args.at(1)};
-            m_client->send_message(_message);
-            m_log.append_log(
-                '[' + m_client->get_address() + ':' + std::to_string(m_client->get_port()) + "]: " +
-                "[FILE]: " + args.at(1) + '\n');
+            // Walked and read ahead in the background, logged once every file is queued
+            m_client->send_directory(args.at(1));
             return true;
         }
         return false;
     }
 
+    private: bool cmd_pending()
+    {
+        if (!m_client)
+            return false;
+        std::vector<std::shared_ptr<const scft::client::file_send>> file_sends = m_client->get_file_sends();
+        if (file_sends.empty())
+            m_log.append_log("No file being prepared\n");
+        for (const std::shared_ptr<const scft::client::file_send>& _file_send : file_sends)
+        {
+            std::uint64_t total = _file_send->total;
+            std::uint64_t done = _file_send->done;
+            m_log.append_log(_file_send->path + ": " + std::to_string(total == 0 ? 0 : done * 100 / total) + "% of " +
+                std::to_string(total) + " (bytes)\n");
+        }
+        return true;
+    }
+
+    private: bool cmd_ping(const std::vector<std::string>& args)
+    {
+        if (args.size() > 2)
+            return false;
+        if (args.size() == 2 && !is_int(args.at(1)))
+            return false;
+        if (!m_client)
+            return false;
+        std::size_t count = args.size() == 2 ? boost::lexical_cast<std::size_t>(args.at(1)) : 1;
+        for (std::size_t index = 0; index < count; index++)
+            m_client->ping();
+        return true;
+    }
+
+    private: bool cmd_latency()
+    {
+        if (!m_client)
+            return false;
+        m_log.append_log(latency_line("round trip", m_client->get_round_trip_latency()));
+        m_log.append_log(latency_line("delivery", m_client->get_delivery_latency()));
+        m_log.append_log("writes: " + std::to_string(m_client->get_write_calls()) + " for " +
+            std::to_string(m_client->get_frames_written()) + " frames\n");
+        return true;
+    }
+
+    private: bool cmd_lowlatency(const std::vector<std::string>& args)
+    {
+        if (args.size() < 2 || args.size() > 4)
+            return false;
+        if (args.at(1) != "on" && args.at(1) != "off")
+            return false;
+        if ((args.size() > 2 && !is_int(args.at(2))) || (args.size() > 3 && !is_int(args.at(3))))
+            return false;
+        if (!m_client)
+            return false;
+        std::chrono::microseconds window = args.size() > 2 ?
+            std::chrono::microseconds(boost::lexical_cast<std::uint64_t>(args.at(2))) : scft::client::DEFAULT_COALESCE_WINDOW;
+        std::size_t max_bytes = args.size() > 3 ? boost::lexical_cast<std::size_t>(args.at(3)) : scft::client::DEFAULT_COALESCE_BYTES;
+        m_client->set_low_latency(args.at(1) == "on", window, max_bytes);
+        return true;
+    }
+
+    private: bool cmd_checksum(const std::vector<std::string>& args)
+    {
+        if (args.size() != 2)
+            return false;
+        scft::checksum::ALGORITHM algorithm;
+        if (!scft::checksum::parse_name(args.at(1), algorithm))
+            return false;
+        if (!m_client)
+            return false;
+        m_client->set_checksum(algorithm);
+        return true;
+    }
+
+    private: bool cmd_history(const std::vector<std::string>& args)
+    {
+        if (args.size() != 3 || !is_int(args.at(2)))
+            return false;
+        if (args.at(1) != "last" && args.at(1) != "since")
+            return false;
+        if (!m_client)
+            return false;
+        std::uint64_t value = boost::lexical_cast<std::uint64_t>(args.at(2));
+        if (args.at(1) == "since")
+        {
+            std::chrono::milliseconds now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch());
+            value = (now - std::chrono::minutes(value)).count();
+        }
+        m_client->request_history(args.at(1) + ' ' + std::to_string(value));
+        return true;
+    }
+
+    /**
+     * @brief Format histogram percentiles
+     * @param name Histogram name
+     * @param histogram Nanosecond histogram
+     * @return One log line
+    */
+    private: static std::string latency_line(const std::string& name, const scft::metrics::hdr_histogram& histogram)
+    {
+        if (histogram.get_count() == 0)
+            return name + ": no samples\n";
+        char text[160];
+        std::snprintf(text, sizeof(text), ": n=%llu p50=%.3fms p99=%.3fms p99.9=%.3fms max=%.3fms\n",
+            static_cast<unsigned long long>(histogram.get_count()),
+            histogram.value_at_percentile(50) / 1e6,
+            histogram.value_at_percentile(99) / 1e6,
+            histogram.value_at_percentile(99.9) / 1e6,
+            histogram.get_max() / 1e6);
+        return name + text;
+    }
+
     private: void update_log(const std::size_t& cursor_y)
     {
         std::size_t rec_line_count = m_log.get_recorded_lines_count();
@@ -233,8 +427,318 @@ class client_shell : scft::basic_shell::basic_shell
 };
 
 
+/**
+ * @brief Non-interactive client, reads stdin and writes received messages to stdout
+ * @verbatim
+ * Plain mode: every stdin line is sent as text
+ * JSON mode (--json), one object per line:
+ *  in:  {"type":"text","text":"..."} {"type":"file","path":"..."} {"type":"directory","path":"..."} {"type":"ping"}
+ *  out: {"type":"text","origin":"...","text":"...","checksum_ok":true,"replayed":false}
+ *       {"type":"file","origin":"...","name":"...","size":N,"checksum_ok":true,"replayed":false}
+ *       {"type":"pong","trace":N,"rtt_ns":N}
+ *       {"type":"error","line":N,"error":"..."}
+ * @endverbatim
+*/
+class client_daemon
+{
+    public: client_daemon(const scft::command_line::arguments& args)
+    :
+    m_args(args),
+    m_log(scft::basic_shell::SCROLL_LOG_WIDTH, scft::basic_shell::SCROLL_LOG_HEIGHT),
+    m_json(args.has("json"))
+    {
+    }
+
+    public: ~client_daemon() {}
+
+    private: void write_line(const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(m_stdout_mutex);
+        std::cout << line << '\n';
+        std::cout.flush();
+    }
+
+    private: void write_error(std::size_t line_number, const std::string& error)
+    {
+        if (m_json)
+        {
+            write_line(scft::json_lines::object({
+                {"type", scft::json_lines::quote("error")},
+                {"line", std::to_string(line_number)},
+                {"error", scft::json_lines::quote(error)}}));
+        }
+        else
+            m_log.append_log("Line " + std::to_string(line_number) + ": " + error + '\n');
+    }
+
+    private: void on_message(scft::message::message& _message, bool checksum_ok)
+    {
+        bool replayed = (_message.get_flags() & scft::message::FLAG_REPLAYED) != 0;
+        if (_message.get_message_type() == scft::message::MESSAGE_TYPE::WRITE_FILE)
+        {
+            write_line(scft::json_lines::object({
+                {"type", scft::json_lines::quote("file")},
+                {"origin", scft::json_lines::quote(_message.get_origin())},
+                {"name", scft::json_lines::quote(_message.get_string())},
+                {"size", std::to_string(_message.get_file_buffer_len())},
+                {"checksum_ok", checksum_ok ? "true" : "false"},
+                {"replayed", replayed ? "true" : "false"}}));
+        }
+        else if (_message.get_message_type() == scft::message::MESSAGE_TYPE::TEXT)
+        {
+            write_line(scft::json_lines::object({
+                {"type", scft::json_lines::quote("text")},
+                {"origin", scft::json_lines::quote(_message.get_origin())},
+                {"text", scft::json_lines::quote(_message.get_string())},
+                {"checksum_ok", checksum_ok ? "true" : "false"},
+                {"replayed", replayed ? "true" : "false"}}));
+        }
+        else if (_message.get_message_type() == scft::message::MESSAGE_TYPE::PONG)
+        {
+            write_line(scft::json_lines::object({
+                {"type", scft::json_lines::quote("pong")},
+                {"trace", std::to_string(_message.get_trace_id())},
+                {"rtt_ns", std::to_string(scft::message::get_monotonic_ns() - _message.get_send_time())}}));
+        }
+    }
+
+    private: bool send_line(const std::string& line, std::size_t line_number)
+    {
+        if (!m_json)
+        {
+            m_client->send_message(scft::message::message{
+                scft::message::MESSAGE_TYPE::TEXT, m_client->get_address(), m_client->get_port(), line});
+            return true;
+        }
+
+        std::unordered_map<std::string, std::string> fields;
+        if (!scft::json_lines::parse(line, fields))
+        {
+            write_error(line_number, "Malformed JSON");
+            return false;
+        }
+        const std::string& type = fields["type"];
+        if (type == "text")
+        {
+            m_client->send_message(scft::message::message{
+                scft::message::MESSAGE_TYPE::TEXT, m_client->get_address(), m_client->get_port(), fields["text"]});
+            return true;
+        }
+        if (type == "file")
+        {
+            if (!is_sendable_file(fields["path"]))
+            {
+                write_error(line_number, "Not a regular file or too large: " + fields["path"]);
+                return false;
+            }
+            m_client->send_message(scft::message::message{
+                scft::message::MESSAGE_TYPE::WRITE_FILE, m_client->get_address(), m_client->get_port(), fields["path"],
+                m_client->get_checksum_algorithm()});
+            return true;
+        }
+        if (type == "directory")
+        {
+            if (!is_sendable_directory(fields["path"]))
+            {
+                write_error(line_number, "Not a directory: " + fields["path"]);
+                return false;
+            }
+            m_client->send_directory(fields["path"]);
+            return true;
+        }
+        if (type == "ping")
+        {
+            m_client->ping();
+            return true;
+        }
+        write_error(line_number, "Unknown type: " + type);
+        return false;
+    }
+
+    public: int run()
+    {
+        std::ofstream log_file;
+        if (m_args.has("log-file"))
+        {
+            log_file.open(m_args.get("log-file"), std::ios::out | std::ios::app);
+            if (!log_file)
+            {
+                std::cerr << "Cannot open log file " << m_args.get("log-file") << '\n';
+                return 1;
+            }
+            m_log.set_sink(&log_file);
+        }
+        else
+            m_log.set_sink(m_json ? &std::cerr : &std::cout);
+
+        std::uint64_t connect_timeout_ms = m_args.get_uint("connect-timeout", 5000);
+        std::uint64_t linger_ms = m_args.get_uint("linger", 0);
+        std::uint16_t port = static_cast<std::uint16_t>(m_args.get_uint("port", 0));
+        try
+        {
+            if (m_args.has("shm"))
+                m_client = std::make_unique<scft::client::client>(m_io_ctx, m_args.get("shm"), true, m_log);
+            else if (m_args.has("unix"))
+                m_client = std::make_unique<scft::client::client>(m_io_ctx, m_args.get("unix"), false, m_log);
+            else
+                m_client = std::make_unique<scft::client::client>(m_io_ctx, m_args.get("address", "127.0.0.1"), port, m_log);
+        }
+        catch (std::exception& e)
+        {
+            m_log.append_log(std::string("Cannot start client: ") + e.what() + '\n');
+            return 1;
+        }
+        if (m_args.has("low-latency"))
+            m_client->set_low_latency(true,
+                std::chrono::microseconds(m_args.get_uint("coalesce-us", scft::client::DEFAULT_COALESCE_WINDOW.count())),
+                m_args.get_uint("coalesce-bytes", scft::client::DEFAULT_COALESCE_BYTES));
+        if (m_args.has("no-streams"))
+            m_client->set_streams(false);
+        if (m_args.has("no-reconnect"))
+            m_client->set_reconnect(false);
+        if (m_args.has("window"))
+            m_client->set_window(m_args.get_uint("window", scft::message::DEFAULT_RECEIVE_WINDOW));
+        if (m_args.has("multicast"))
+            m_client->set_multicast(true, m_args.get("multicast-interface", ""));
+        if (m_args.has("direct"))
+            m_client->set_direct(true, static_cast<std::uint16_t>(m_args.get_uint("direct-port", 0)));
+        if (m_args.has("no-delta"))
+            m_client->set_delta(false);
+        if (m_args.has("checksum"))
+        {
+            scft::checksum::ALGORITHM algorithm;
+            if (!scft::checksum::parse_name(m_args.get("checksum"), algorithm))
+            {
+                m_log.append_log("Unknown checksum " + m_args.get("checksum") + '\n');
+                return 1;
+            }
+            m_client->set_checksum(algorithm);
+        }
+        if (m_json)
+            m_client->set_message_handler(std::bind(&client_daemon::on_message, this, std::placeholders::_1, std::placeholders::_2));
+        // A closed client has no pending operations left, drain() still needs the context running
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work = boost::asio::make_work_guard(m_io_ctx);
+        std::thread io_ctx_run_thread([&](){ m_io_ctx.run(); });
+
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(connect_timeout_ms);
+        while (!m_client->is_connected() && !m_client->is_closed() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        int exit_code = 0;
+        if (!m_client->is_connected())
+        {
+            m_log.append_log("Could not connect\n");
+            exit_code = 1;
+        }
+        else
+        {
+            if (m_args.has("history-last"))
+                m_client->request_history("last " + std::to_string(m_args.get_uint("history-last", 0)));
+            std::string line;
+            std::size_t line_number = 0;
+            while (!m_client->is_closed() && std::getline(std::cin, line))
+            {
+                ++line_number;
+                if (line.empty())
+                    continue;
+                if (!send_line(line, line_number))
+                    exit_code = 2;
+            }
+
+            std::promise<void> drained;
+            m_client->drain([&drained](){ drained.set_value(); });
+            drained.get_future().wait();
+            std::this_thread::sleep_for(std::chrono::milliseconds(linger_ms));
+            if (m_client->is_closed())
+            {
+                m_log.append_log("Connection closed\n");
+                exit_code = 1;
+            }
+            if (m_args.has("low-latency"))
+                m_log.append_log("Wrote " + std::to_string(m_client->get_frames_written()) + " frames in " +
+                    std::to_string(m_client->get_write_calls()) + " writes\n");
+            std::promise<void> left;
+            m_client->leave([&left](){ left.set_value(); });
+            left.get_future().wait();
+        }
+
+        m_io_ctx.stop();
+        io_ctx_run_thread.join();
+        m_client.reset();
+        m_log.set_sink(nullptr);
+        return exit_code;
+    }
+
+    private: const scft::command_line::arguments& m_args;
+    private: scft::basic_shell::scrolling_log m_log;
+    private: bool m_json;
+    private: std::mutex m_stdout_mutex;
+    private: std::unique_ptr<scft::client::client> m_client;
+    private: boost::asio::io_context m_io_ctx;
+};
+
+static void print_usage()
+{
+    std::cout <<
+        "Usage: scft-clt [--headless --port PORT | --unix PATH | --shm PATH [OPTIONS]]\n"
+        "Without --headless, starts the interactive shell\n"
+        "\t--headless: Connect, send stdin lines, exit on end of input\n"
+        "\t--address IP: Server address (default 127.0.0.1)\n"
+        "\t--port PORT: Server port\n"
+        "\t--unix PATH: Connect to the server's Unix domain socket instead, on the same host\n"
+        "\t--shm PATH: Exchange frames with a server on the same host through shared memory, PATH is its --shm socket\n"
+        "\t--json: JSON lines on stdin and stdout, log goes to stderr\n"
+        "\t--log-file PATH: Append log to file instead of stdout/stderr\n"
+        "\t--connect-timeout MS: Give up connecting after MS (default 5000)\n"
+        "\t--linger MS: Keep receiving for MS after end of input (default 0)\n"
+        "\t--low-latency: Set TCP_NODELAY and write texts sent within a window together\n"
+        "\t--coalesce-us US: Low latency batching window (default 200)\n"
+        "\t--coalesce-bytes N: Low latency batch size limit (default 16384)\n"
+        "\t--checksum ALG: crc32 (default), crc32c, xxh3-64 or none, if the server allows it\n"
+        "\t--history-last N: Replay the last N messages broadcast before joining, if the server keeps history\n"
+        "\t--no-streams: Send and receive files whole, for servers that do not negotiate\n"
+        "\t--no-reconnect: Exit when the connection drops instead of reconnecting and resuming the session\n"
+        "\t--window BYTES: Receive window, the server writes no more than BYTES ahead of what was acknowledged, 0 leaves it to TCP (default 4194304)\n"
+        "\t--multicast: Receive large files over the server's multicast group, if it has one\n"
+        "\t--multicast-interface IP: Interface to join the multicast group on (default the system's choice)\n"
+        "\t--direct: Offer files of 1M and more for members to fetch from here, and fetch offered files from their senders\n"
+        "\t--direct-port PORT: Port to serve offered files on, members must reach it (default any)\n"
+        "\t--no-delta: Fetch offered files whole, even when a file of the same name is already here\n"
+        "\t--help: Prints this\n";
+}
+
 int main(int argc, char* argv[])
 {
+#if defined(SIGPIPE)
+    // sendfile() to a peer that reset the connection raises it, the returned error is enough
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    if (argc > 1)
+    {
+        try
+        {
+            scft::command_line::arguments args(argc, argv, {"headless", "json", "help", "low-latency", "no-streams", "no-reconnect", "multicast", "direct", "no-delta"});
+            std::vector<std::string> unknown = args.unknown(
+                {"headless", "json", "help", "low-latency", "no-streams", "no-reconnect", "multicast", "address", "port", "unix", "shm", "log-file", "connect-timeout",
+                 "linger", "coalesce-us", "coalesce-bytes", "checksum", "history-last", "multicast-interface",
+                 "direct", "direct-port", "window", "no-delta"});
+            if (!unknown.empty())
+                throw std::runtime_error("Unknown flag --" + unknown.front());
+            if (args.has("help") || !args.has("headless") || (!args.has("port") && !args.has("unix") && !args.has("shm")))
+            {
+                print_usage();
+                return args.has("help") ? 0 : 1;
+            }
+            client_daemon daemon(args);
+            return daemon.run();
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            print_usage();
+            return 1;
+        }
+    }
     client_shell _shell;
     _shell.run();
     return 0;
@@ -0,0 +1,292 @@
+#include "basic_shell.hpp"
+#include "checksum.hpp"
+#include "crc32.hpp"
+#include "message_view.hpp"
+#include "scft_message.hpp"
+#include "scrolling_log.hpp"
+
+#include <benchmark/benchmark.h>
+#include <boost/asio.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Fixed seed for every generated input, so runs of different builds are comparable
+*/
+constexpr std::uint64_t SEED = 0x5CF7;
+
+/**
+ * @brief Deterministic pseudo random bytes
+ * @param size Number of bytes
+ * @return Buffer
+*/
+static std::vector<std::uint8_t> make_buffer(std::size_t size)
+{
+    std::mt19937_64 random(SEED);
+    std::vector<std::uint8_t> buffer(size);
+    for (std::uint8_t& byte : buffer)
+        byte = static_cast<std::uint8_t>(random());
+    return buffer;
+}
+
+/**
+ * @brief Deterministic printable text
+ * @param size Number of characters
+ * @return Text
+*/
+static std::string make_text(std::size_t size)
+{
+    std::mt19937_64 random(SEED);
+    std::string text(size, ' ');
+    for (char& ch : text)
+        ch = static_cast<char>('a' + random() % 26);
+    return text;
+}
+
+/**
+ * @brief Reactor asio runs sockets on, labels the loopback benchmarks so a build with -DSCFT_IO_URING=ON, if one is made, can be told apart
+*/
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+constexpr const char* BACKEND = "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+constexpr const char* BACKEND = "epoll";
+#else
+constexpr const char* BACKEND = "default";
+#endif
+
+/**
+ * @brief Temporary file removed at exit
+*/
+class temp_file
+{
+    public: temp_file(std::size_t size)
+    :
+    m_path("scft-microbench-" + std::to_string(size) + ".bin")
+    {
+        std::vector<std::uint8_t> content = make_buffer(size);
+        std::ofstream out_file{m_path, std::ios::out | std::ios::binary | std::ios::trunc};
+        out_file.write(reinterpret_cast<const char*>(content.data()), content.size());
+    }
+
+    public: ~temp_file() { std::remove(m_path.c_str()); }
+
+    public: const std::string& get_path() const { return m_path; }
+
+    private: std::string m_path;
+};
+
+/**
+ * @brief Connected loopback TCP pair on one io_context, the server side echoes what it reads
+*/
+class loopback
+{
+    public: loopback(std::size_t size)
+    :
+    m_client(m_io_ctx),
+    m_server(m_io_ctx),
+    m_sent(make_buffer(size)),
+    m_echoed(size),
+    m_received(size)
+    {
+        boost::asio::ip::tcp::acceptor acceptor(m_io_ctx, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        m_client.connect(acceptor.local_endpoint());
+        acceptor.accept(m_server);
+        m_client.set_option(boost::asio::ip::tcp::no_delay(true));
+        m_server.set_option(boost::asio::ip::tcp::no_delay(true));
+    }
+
+    public: void round_trip()
+    {
+        boost::asio::async_write(m_client, boost::asio::buffer(m_sent), [](boost::system::error_code, std::size_t) {});
+        boost::asio::async_read(m_server, boost::asio::buffer(m_echoed),
+            [this](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec)
+                    boost::asio::async_write(m_server, boost::asio::buffer(m_echoed), [](boost::system::error_code, std::size_t) {});
+            });
+        boost::asio::async_read(m_client, boost::asio::buffer(m_received), [](boost::system::error_code, std::size_t) {});
+        m_io_ctx.restart();
+        m_io_ctx.run();
+    }
+
+    private: boost::asio::io_context m_io_ctx;
+    private: boost::asio::ip::tcp::socket m_client;
+    private: boost::asio::ip::tcp::socket m_server;
+    private: std::vector<std::uint8_t> m_sent;
+    private: std::vector<std::uint8_t> m_echoed;
+    private: std::vector<std::uint8_t> m_received;
+};
+
+/**
+ * @brief Exposes basic_shell::split_args
+*/
+class shell_probe : public scft::basic_shell::basic_shell
+{
+    public: using scft::basic_shell::basic_shell::split_args;
+};
+
+static void BM_crc32(benchmark::State& state)
+{
+    std::vector<std::uint8_t> buffer = make_buffer(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(scft::crc32::get_crc32(buffer.data(), buffer.size()));
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_crc32)->Arg(64)->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+
+static void BM_crc32c(benchmark::State& state)
+{
+    std::vector<std::uint8_t> buffer = make_buffer(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(scft::checksum::get_crc32c(buffer.data(), buffer.size()));
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+    state.SetLabel(scft::checksum::has_hardware_crc32c() ? "hardware" : "software");
+}
+BENCHMARK(BM_crc32c)->Arg(64)->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+
+static void BM_xxh3_64(benchmark::State& state)
+{
+    std::vector<std::uint8_t> buffer = make_buffer(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(scft::checksum::get_xxh3_64(buffer.data(), buffer.size()));
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_xxh3_64)->Arg(64)->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+
+static void BM_init_as_text(benchmark::State& state)
+{
+    std::string text = make_text(state.range(0));
+    for (auto _ : state)
+    {
+        scft::message::message _message{scft::message::MESSAGE_TYPE::TEXT, "127.0.0.1", 50000, text};
+        benchmark::DoNotOptimize(_message.get_raw_message().data());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_init_as_text)->Arg(16)->Arg(256)->Arg(4 << 10)->Arg(64 << 10);
+
+static void BM_init_as_file(benchmark::State& state)
+{
+    temp_file file(state.range(0));
+    for (auto _ : state)
+    {
+        scft::message::message _message{scft::message::MESSAGE_TYPE::WRITE_FILE, "127.0.0.1", 50000, file.get_path()};
+        benchmark::DoNotOptimize(_message.get_raw_message().data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_init_as_file)->Arg(4 << 10)->Arg(1 << 20)->Arg(16 << 20)->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief Header check and resize as done by the readers, with a reused message like member::m_message
+*/
+static void BM_header_parse(benchmark::State& state)
+{
+    scft::message::message sent{scft::message::MESSAGE_TYPE::TEXT, "127.0.0.1", 50000, make_text(state.range(0))};
+    scft::message::message received;
+    for (auto _ : state)
+    {
+        std::memcpy(received.get_raw_message().data(), sent.get_raw_message().data(), scft::message::HEADER_SIZE);
+        if (!received.bad_header())
+            received.adjust();
+        benchmark::DoNotOptimize(received.get_data_len());
+    }
+}
+BENCHMARK(BM_header_parse)->Arg(16)->Arg(4 << 10);
+
+/**
+ * @brief Accessors used after a frame body is read (client::data_buffer_reader)
+*/
+static void BM_message_accessors(benchmark::State& state)
+{
+    scft::message::message _message{scft::message::MESSAGE_TYPE::TEXT, "127.0.0.1", 50000, make_text(state.range(0))};
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(_message.get_origin());
+        benchmark::DoNotOptimize(_message.get_string_len());
+        benchmark::DoNotOptimize(_message.get_file_buffer_len());
+        benchmark::DoNotOptimize(_message.get_data_len());
+    }
+}
+BENCHMARK(BM_message_accessors)->Arg(16)->Arg(4 << 10)->Arg(64 << 10);
+
+/**
+ * @brief Same segments through a message_view, parsed once per frame as the readers do
+*/
+static void BM_message_view(benchmark::State& state)
+{
+    scft::message::message _message{scft::message::MESSAGE_TYPE::TEXT, "127.0.0.1", 50000, make_text(state.range(0))};
+    scft::message::message_view view;
+    for (auto _ : state)
+    {
+        view.parse(_message.get_raw_message().data(), _message.get_raw_message().size());
+        benchmark::DoNotOptimize(view.get_origin());
+        benchmark::DoNotOptimize(view.get_string());
+        benchmark::DoNotOptimize(view.get_file_buffer_len());
+        benchmark::DoNotOptimize(view.get_frame_len());
+    }
+}
+BENCHMARK(BM_message_view)->Arg(16)->Arg(4 << 10)->Arg(64 << 10);
+
+static void BM_append_log(benchmark::State& state)
+{
+    static scft::basic_shell::scrolling_log log(scft::basic_shell::SCROLL_LOG_WIDTH, scft::basic_shell::SCROLL_LOG_HEIGHT);
+    std::string entry = "Broadcasting: " + make_text(state.range(0)) + '\n';
+    for (auto _ : state)
+        log.append_log(entry);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_append_log)->Arg(16)->Arg(200)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_split_args(benchmark::State& state)
+{
+    shell_probe shell;
+    std::string command = "sendtext";
+    for (std::int64_t index = 0; index < state.range(0); index++)
+        command.append(index % 4 == 0 ? " \"quoted words here\"" : " word");
+    for (auto _ : state)
+        benchmark::DoNotOptimize(shell.split_args(command));
+    state.SetBytesProcessed(state.iterations() * command.size());
+}
+BENCHMARK(BM_split_args)->Arg(2)->Arg(16)->Arg(256);
+
+// Socket reactor cost, labelled with the backend; no -DSCFT_IO_URING=ON numbers exist yet
+static void BM_loopback_round_trip(benchmark::State& state)
+{
+    loopback pair(state.range(0));
+    for (auto _ : state)
+        pair.round_trip();
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+    state.SetLabel(BACKEND);
+}
+BENCHMARK(BM_loopback_round_trip)->Arg(64)->Arg(64 << 10)->Arg(1 << 20)->UseRealTime();
+
+/**
+ * @brief Same as BENCHMARK_MAIN(), but writes JSON to scft-microbench.json unless --benchmark_out is given
+*/
+int main(int argc, char* argv[])
+{
+    std::vector<char*> args(argv, argv + argc);
+    std::string out_arg = "--benchmark_out=scft-microbench.json";
+    std::string format_arg = "--benchmark_out_format=json";
+    bool has_out = false;
+    for (int index = 1; index < argc; index++)
+        has_out = has_out || std::strncmp(argv[index], "--benchmark_out=", 16) == 0;
+    if (!has_out)
+    {
+        args.push_back(&out_arg[0]);
+        args.push_back(&format_arg[0]);
+    }
+    int args_count = static_cast<int>(args.size());
+    benchmark::Initialize(&args_count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(args_count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include "bandwidth.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace scft
+{
+    namespace server
+    {
+    token_bucket::token_bucket(std::uint64_t rate, std::uint64_t burst)
+    :
+    m_rate(rate),
+    m_burst(burst != 0 ? static_cast<double>(burst) : std::max<double>(static_cast<double>(rate) * std::chrono::duration<double>(BURST_TIME).count(), MIN_BURST)),
+    m_tokens(m_burst),
+    m_refilled(std::chrono::steady_clock::now())
+    {
+    }
+
+    token_bucket::~token_bucket()
+    {
+    }
+
+    void token_bucket::consume(std::uint64_t bytes)
+    {
+        if (m_rate == 0)
+            return;
+        refill();
+        m_tokens -= static_cast<double>(bytes);
+    }
+
+    std::chrono::steady_clock::duration token_bucket::get_delay()
+    {
+        if (m_rate == 0)
+            return std::chrono::steady_clock::duration::zero();
+        refill();
+        if (m_tokens >= 0)
+            return std::chrono::steady_clock::duration::zero();
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(-m_tokens / static_cast<double>(m_rate)));
+    }
+
+    void token_bucket::refill()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        m_tokens = std::min(m_burst, m_tokens + std::chrono::duration<double>(now - m_refilled).count() * static_cast<double>(m_rate));
+        m_refilled = now;
+    }
+
+    bandwidth::bandwidth(
+        std::uint64_t member_ingress,
+        std::uint64_t member_egress,
+        std::uint64_t room_ingress,
+        std::uint64_t room_egress,
+        std::uint64_t quantum,
+        boost::asio::io_context& io_ctx,
+        server_metrics& _metrics)
+    :
+    m_member_ingress(member_ingress),
+    m_member_egress(member_egress),
+    m_ingress(room_ingress),
+    m_egress(room_egress),
+    m_quantum(std::max<std::uint64_t>(quantum, 1)),
+    m_scheduled(false),
+    m_timer(io_ctx),
+    m_metrics(_metrics)
+    {
+    }
+
+    bandwidth::~bandwidth()
+    {
+        m_metrics.egress_waiting->add(-static_cast<std::int64_t>(m_pending.size()));
+    }
+
+    std::chrono::steady_clock::duration bandwidth::read(std::uint64_t bytes)
+    {
+        m_ingress.consume(bytes);
+        return m_ingress.get_delay();
+    }
+
+    void bandwidth::write(const void* flow, std::uint64_t bytes, grant allow)
+    {
+        if (!m_egress.is_limited() || (m_pending.empty() && m_egress.get_delay() == std::chrono::steady_clock::duration::zero()))
+        {
+            if (allow())
+                m_egress.consume(bytes);
+            return;
+        }
+        m_metrics.throttled_writes->add();
+        m_metrics.egress_waiting->add(1);
+        m_pending.push_back(pending{flow, bytes, std::move(allow), std::chrono::steady_clock::now()});
+        service();
+    }
+
+    void bandwidth::forget(const void* flow)
+    {
+        std::size_t before = m_pending.size();
+        m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [flow](const pending& _pending) { return _pending.flow == flow; }), m_pending.end());
+        m_metrics.egress_waiting->add(-static_cast<std::int64_t>(before - m_pending.size()));
+        m_deficits.erase(flow);
+    }
+
+    void bandwidth::service()
+    {
+        while (!m_pending.empty())
+        {
+            std::chrono::steady_clock::duration delay = m_egress.get_delay();
+            if (delay > std::chrono::steady_clock::duration::zero())
+            {
+                if (!m_scheduled)
+                {
+                    m_scheduled = true;
+                    m_timer.expires_after(delay);
+                    m_timer.async_wait(
+                        [this](boost::system::error_code ec)
+                        {
+                            if (ec)
+                                return;
+                            m_scheduled = false;
+                            service();
+                        });
+                }
+                return;
+            }
+
+            // Skip the rounds in which no writer has enough deficit, every waiting writer earns them
+            std::uint64_t rounds = std::numeric_limits<std::uint64_t>::max();
+            for (const pending& _pending : m_pending)
+            {
+                std::uint64_t deficit = m_deficits[_pending.flow];
+                std::uint64_t missing = _pending.bytes > deficit ? _pending.bytes - deficit : 0;
+                rounds = std::min(rounds, (missing + m_quantum - 1) / m_quantum);
+            }
+            if (rounds != 0)
+            {
+                for (const pending& _pending : m_pending)
+                    m_deficits[_pending.flow] += rounds * m_quantum;
+            }
+            while (m_deficits[m_pending.front().flow] < m_pending.front().bytes)
+            {
+                m_pending.push_back(std::move(m_pending.front()));
+                m_pending.pop_front();
+            }
+
+            // Granted writers ask again after writing, behind those that waited
+            pending next = std::move(m_pending.front());
+            m_pending.pop_front();
+            m_metrics.egress_waiting->add(-1);
+            m_deficits[next.flow] -= next.bytes;
+            m_metrics.throttle_delay->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - next.since).count());
+            if (next.allow())
+                m_egress.consume(next.bytes);
+            else
+                m_deficits.erase(next.flow);
+        }
+    }
+
+    pacer::pacer(const boost::asio::any_io_executor& executor, bandwidth& _bandwidth, server_metrics& _metrics)
+    :
+    m_bandwidth(_bandwidth),
+    m_metrics(_metrics),
+    m_ingress(_bandwidth.get_member_ingress()),
+    m_egress(_bandwidth.get_member_egress()),
+    m_read_timer(executor),
+    m_write_timer(executor),
+    m_throttled(false)
+    {
+    }
+
+    pacer::~pacer()
+    {
+        m_bandwidth.forget(this);
+    }
+
+    void pacer::read(std::uint64_t bytes, std::function<void()> resume)
+    {
+        m_ingress.consume(bytes);
+        std::chrono::steady_clock::duration delay = std::max(m_ingress.get_delay(), m_bandwidth.read(bytes));
+        if (delay == std::chrono::steady_clock::duration::zero())
+        {
+            resume();
+            return;
+        }
+        // Like a deferred frame, the unread data fills the socket buffers and TCP slows the sender down
+        m_metrics.throttled_reads->add();
+        m_throttled = true;
+        // A timer of its own rather than the wheel, whose ticks would let the bytes through in bursts
+        m_read_timer.expires_after(delay);
+        m_read_timer.async_wait(
+            [this, resume = std::move(resume), since = std::chrono::steady_clock::now()](boost::system::error_code ec)
+            {
+                if (ec)
+                    return;
+                m_throttled = false;
+                m_metrics.throttle_delay->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+                resume();
+            });
+    }
+
+    void pacer::write(std::uint64_t bytes, bandwidth::grant allow)
+    {
+        m_egress.consume(bytes);
+        std::chrono::steady_clock::duration delay = m_egress.get_delay();
+        if (delay == std::chrono::steady_clock::duration::zero())
+        {
+            m_bandwidth.write(this, bytes, std::move(allow));
+            return;
+        }
+        m_metrics.throttled_writes->add();
+        m_write_timer.expires_after(delay);
+        m_write_timer.async_wait(
+            [this, bytes, allow = std::move(allow), since = std::chrono::steady_clock::now()](boost::system::error_code ec) mutable
+            {
+                if (ec)
+                    return;
+                m_metrics.throttle_delay->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+                m_bandwidth.write(this, bytes, std::move(allow));
+            });
+    }
+    }
+}
@@ -0,0 +1,311 @@
+#ifndef BANDWIDTH_HPP
+#define BANDWIDTH_HPP
+
+/**
+ * @file src/scft-srv/bandwidth.hpp
+ * @brief Defines token_bucket, bandwidth and pacer classes, rate limiting what members send and receive
+*/
+
+#include "server_metrics.hpp"
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Time a bucket can save up, so a late wakeup does not lower the rate
+        */
+        constexpr std::chrono::milliseconds BURST_TIME{250};
+
+        /**
+         * @brief Smallest bucket depth, a chunk of a slow bucket still goes out whole
+        */
+        constexpr std::uint64_t MIN_BURST = 65536;
+
+        /**
+         * @brief Default bytes each member may write per round when the room egress is contended
+        */
+        constexpr std::uint64_t DEFAULT_QUANTUM = 65536;
+
+        /**
+         * @brief Token bucket in bytes per second, bytes are paid after the fact and the debt is waited off
+        */
+        class token_bucket
+        {
+            /**
+             * @brief Full bucket
+             * @param rate Bytes per second, 0 for unlimited
+             * @param burst Bucket depth, 0 for BURST_TIME at the rate and at least MIN_BURST
+            */
+            public: token_bucket(std::uint64_t rate, std::uint64_t burst = 0);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~token_bucket();
+
+            /**
+             * @brief Check if the bucket limits anything
+             * @return False if unlimited
+            */
+            public: bool is_limited() const { return m_rate != 0; }
+
+            /**
+             * @brief Take bytes out, the bucket may go into debt
+             * @param bytes Bytes read or written
+            */
+            public: void consume(std::uint64_t bytes);
+
+            /**
+             * @brief Time until the debt is paid off
+             * @return Zero if not in debt
+            */
+            public: std::chrono::steady_clock::duration get_delay();
+
+            /**
+             * @brief Add the tokens earned since the last refill
+            */
+            private: void refill();
+
+            /**
+             * @brief Bytes per second
+            */
+            private: std::uint64_t m_rate;
+
+            /**
+             * @brief Bucket depth
+            */
+            private: double m_burst;
+
+            /**
+             * @brief Available bytes, negative in debt
+            */
+            private: double m_tokens;
+
+            /**
+             * @brief Last refill
+            */
+            private: std::chrono::steady_clock::time_point m_refilled;
+        };
+
+        /**
+         * @brief Room wide rates, and the per member ones each member applies to itself, not thread safe, use it from the io thread
+         * @note When the room egress is contended, members take turns by deficit round robin with equal quanta,
+         * so a member with many large files gets the same share as one sending small ones
+        */
+        class bandwidth
+        {
+            /**
+             * @brief Allows a write once the room egress has room for it
+             * @return False if nobody wants it anymore, its bytes are then not charged
+            */
+            public: typedef std::function<bool()> grant;
+
+            /**
+             * @brief Set rates, in bytes per second, 0 for unlimited
+             * @param member_ingress Each member's ingress
+             * @param member_egress Each member's egress
+             * @param room_ingress Ingress of every member together
+             * @param room_egress Egress of every member together
+             * @param quantum Bytes a member may write per round when the room egress is contended
+             * @param io_ctx Context of the io thread
+             * @param _metrics Server wide metrics
+            */
+            public: bandwidth(
+                std::uint64_t member_ingress,
+                std::uint64_t member_egress,
+                std::uint64_t room_ingress,
+                std::uint64_t room_egress,
+                std::uint64_t quantum,
+                boost::asio::io_context& io_ctx,
+                server_metrics& _metrics);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~bandwidth();
+
+            /**
+             * @brief Each member's ingress
+             * @return Bytes per second, 0 for unlimited
+            */
+            public: std::uint64_t get_member_ingress() const { return m_member_ingress; }
+
+            /**
+             * @brief Each member's egress
+             * @return Bytes per second, 0 for unlimited
+            */
+            public: std::uint64_t get_member_egress() const { return m_member_egress; }
+
+            /**
+             * @brief Charge read bytes to the room ingress
+             * @param bytes Bytes read
+             * @return Time to wait before reading more
+            */
+            public: std::chrono::steady_clock::duration read(std::uint64_t bytes);
+
+            /**
+             * @brief Queue a write for the room egress, granted at once when nobody waits and the egress is not in debt
+             * @param flow Writer, each one gets its turn
+             * @param bytes Bytes about to be written
+             * @param allow Called when the write may start
+            */
+            public: void write(const void* flow, std::uint64_t bytes, grant allow);
+
+            /**
+             * @brief Drop a writer's pending write and deficit
+             * @param flow Writer
+            */
+            public: void forget(const void* flow);
+
+            /**
+             * @brief Grant writes in turn while the room egress has room, otherwise wait for it
+            */
+            private: void service();
+
+            /**
+             * @brief Write waiting for its turn
+            */
+            private: struct pending
+            {
+                const void* flow;                               //!< Writer
+                std::uint64_t bytes;                            //!< Bytes about to be written
+                grant allow;                                    //!< Start the write
+                std::chrono::steady_clock::time_point since;    //!< Time queued
+            };
+
+            /**
+             * @brief Each member's ingress
+            */
+            private: std::uint64_t m_member_ingress;
+
+            /**
+             * @brief Each member's egress
+            */
+            private: std::uint64_t m_member_egress;
+
+            /**
+             * @brief Ingress of every member together
+            */
+            private: token_bucket m_ingress;
+
+            /**
+             * @brief Egress of every member together
+            */
+            private: token_bucket m_egress;
+
+            /**
+             * @brief Bytes added to each deficit per round
+            */
+            private: std::uint64_t m_quantum;
+
+            /**
+             * @brief Writes waiting, one per writer, in turn order
+            */
+            private: std::deque<pending> m_pending;
+
+            /**
+             * @brief Bytes each writer may still write before passing its turn
+            */
+            private: std::map<const void*, std::uint64_t> m_deficits;
+
+            /**
+             * @brief service() waits for m_timer
+            */
+            private: bool m_scheduled;
+
+            /**
+             * @brief Wakes service() once the room egress is out of debt
+            */
+            private: boost::asio::steady_timer m_timer;
+
+            /**
+             * @brief Server wide metrics
+            */
+            private: server_metrics& m_metrics;
+        };
+
+        /**
+         * @brief Paces one member's reads and writes, its own rates first, then the room's, use it from the io thread
+        */
+        class pacer
+        {
+            /**
+             * @brief Full buckets at the member rates of the room
+             * @param executor Executor of the member's connection
+             * @param _bandwidth Room wide rates
+             * @param _metrics Server wide metrics
+            */
+            public: pacer(const boost::asio::any_io_executor& executor, bandwidth& _bandwidth, server_metrics& _metrics);
+
+            /**
+             * @brief Withdraw a write waiting for its turn, pending wakeups are cancelled
+            */
+            public: ~pacer();
+
+            /**
+             * @brief Charge read bytes to the member and room ingress, then continue reading once their debt is paid
+             * @param bytes Bytes read or about to be read
+             * @param resume Continues reading, never called once the pacer is destroyed
+            */
+            public: void read(std::uint64_t bytes, std::function<void()> resume);
+
+            /**
+             * @brief Charge bytes about to be written to the member egress, then wait for a turn at the room egress
+             * @param bytes Bytes written or about to be written
+             * @param allow Continues writing, never called once the pacer is destroyed
+            */
+            public: void write(std::uint64_t bytes, bandwidth::grant allow);
+
+            /**
+             * @brief Check if reading waits for an ingress rate
+             * @return True while waiting
+            */
+            public: bool is_throttled() const { return m_throttled; }
+
+            /**
+             * @brief Room wide rates
+            */
+            private: bandwidth& m_bandwidth;
+
+            /**
+             * @brief Server wide metrics
+            */
+            private: server_metrics& m_metrics;
+
+            /**
+             * @brief Bytes read from the member per second
+            */
+            private: token_bucket m_ingress;
+
+            /**
+             * @brief Bytes written to the member per second
+            */
+            private: token_bucket m_egress;
+
+            /**
+             * @brief Wakes reading once the ingress rates allow it
+            */
+            private: boost::asio::steady_timer m_read_timer;
+
+            /**
+             * @brief Wakes writing once the member egress allows it
+            */
+            private: boost::asio::steady_timer m_write_timer;
+
+            /**
+             * @brief Reading waits for an ingress rate
+            */
+            private: bool m_throttled;
+        };
+    }
+}
+
+#endif /* BANDWIDTH_HPP */
@@ -0,0 +1,340 @@
+#include "history.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace scft
+{
+    namespace server
+    {
+    /**
+     * @brief Size of a record, padded to 8 bytes
+     * @param length Frame length
+     * @return Record size
+    */
+    static std::size_t record_size(std::size_t length)
+    {
+        return (HISTORY_RECORD_HEADER_SIZE + length + 7) & ~std::size_t(7);
+    }
+
+    history_segment::history_segment(const std::string& path, std::uint64_t first_sequence, std::size_t capacity)
+    :
+    m_path(path),
+    m_first_sequence(first_sequence),
+    m_capacity(capacity),
+    m_used(0),
+    m_count(0),
+    m_last_time(0),
+    m_removed(false)
+    {
+        bool exists = std::filesystem::exists(path) && std::filesystem::file_size(path) != 0;
+        if (!exists)
+        {
+            // Zero filled, recovery stops at the first header without magic
+            std::ofstream{path, std::ios::out | std::ios::binary};
+            std::filesystem::resize_file(path, capacity);
+        }
+        else
+            m_capacity = static_cast<std::size_t>(std::filesystem::file_size(path));
+        m_mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_write);
+        m_region = boost::interprocess::mapped_region(m_mapping, boost::interprocess::read_write);
+        if (!exists)
+            return;
+
+        const std::uint8_t* base = static_cast<const std::uint8_t*>(m_region.get_address());
+        while (m_used + HISTORY_RECORD_HEADER_SIZE <= m_capacity)
+        {
+            std::uint64_t time_ns;
+            std::uint32_t length;
+            std::uint32_t magic;
+            std::memcpy(&time_ns, base + m_used, sizeof(time_ns));
+            std::memcpy(&length, base + m_used + 8, sizeof(length));
+            std::memcpy(&magic, base + m_used + 12, sizeof(magic));
+            if (magic != HISTORY_RECORD_MAGIC || length == 0 || m_used + record_size(length) > m_capacity)
+                break;
+            add_record(time_ns, m_used, length);
+        }
+    }
+
+    history_segment::~history_segment()
+    {
+        m_region = boost::interprocess::mapped_region();
+        m_mapping = boost::interprocess::file_mapping();
+        if (m_removed)
+        {
+            std::error_code ec;
+            std::filesystem::remove(m_path, ec);
+        }
+    }
+
+    void history_segment::add_record(std::uint64_t time_ns, std::size_t offset, std::size_t length)
+    {
+        if (m_count % HISTORY_INDEX_INTERVAL == 0)
+            m_index.push_back(index_entry{m_first_sequence + m_count, time_ns, offset});
+        m_count++;
+        m_last_time = time_ns;
+        m_used = offset + record_size(length);
+    }
+
+    bool history_segment::append(const std::uint8_t* frame, std::size_t length, std::uint64_t time_ns)
+    {
+        if (m_used + record_size(length) > m_capacity)
+            return false;
+        std::uint8_t* record = static_cast<std::uint8_t*>(m_region.get_address()) + m_used;
+        std::uint32_t record_length = static_cast<std::uint32_t>(length);
+        std::memcpy(record, &time_ns, sizeof(time_ns));
+        std::memcpy(record + 8, &record_length, sizeof(record_length));
+        std::memcpy(record + HISTORY_RECORD_HEADER_SIZE, frame, length);
+        // Magic last, a crash mid record leaves it unrecovered
+        std::memcpy(record + 12, &HISTORY_RECORD_MAGIC, sizeof(HISTORY_RECORD_MAGIC));
+        add_record(time_ns, m_used, length);
+        return true;
+    }
+
+    std::size_t history_segment::find_sequence(std::uint64_t sequence) const
+    {
+        std::vector<index_entry>::const_iterator entry = std::upper_bound(m_index.begin(), m_index.end(), sequence,
+            [](std::uint64_t value, const index_entry& _entry) { return value < _entry.sequence; });
+        if (entry == m_index.begin())
+            return m_used;
+        --entry;
+        std::size_t offset = entry->offset;
+        for (std::uint64_t current = entry->sequence; current < sequence && offset < m_used; current++)
+            offset = next_offset(offset);
+        return offset;
+    }
+
+    std::size_t history_segment::find_time(std::uint64_t time_ns, std::uint64_t& sequence) const
+    {
+        // Start from the last entry before the time, the records between two entries are walked
+        std::vector<index_entry>::const_iterator entry = std::lower_bound(m_index.begin(), m_index.end(), time_ns,
+            [](const index_entry& _entry, std::uint64_t value) { return _entry.time_ns < value; });
+        if (entry != m_index.begin())
+            --entry;
+        if (entry == m_index.end())
+        {
+            sequence = get_end_sequence();
+            return m_used;
+        }
+        const std::uint8_t* base = static_cast<const std::uint8_t*>(m_region.get_address());
+        std::size_t offset = entry->offset;
+        sequence = entry->sequence;
+        while (offset < m_used)
+        {
+            std::uint64_t record_time;
+            std::memcpy(&record_time, base + offset, sizeof(record_time));
+            if (record_time >= time_ns)
+                break;
+            offset = next_offset(offset);
+            sequence++;
+        }
+        return offset;
+    }
+
+    const std::uint8_t* history_segment::get_frame(std::size_t offset, std::size_t& length) const
+    {
+        const std::uint8_t* record = static_cast<const std::uint8_t*>(m_region.get_address()) + offset;
+        std::uint32_t record_length;
+        std::memcpy(&record_length, record + 8, sizeof(record_length));
+        length = record_length;
+        return record + HISTORY_RECORD_HEADER_SIZE;
+    }
+
+    std::size_t history_segment::next_offset(std::size_t offset) const
+    {
+        std::size_t length;
+        get_frame(offset, length);
+        return offset + record_size(length);
+    }
+
+    history::history(
+        const std::string& directory,
+        std::size_t segment_bytes,
+        std::uint64_t max_bytes,
+        std::chrono::seconds max_age,
+        basic_shell::scrolling_log& _log)
+    :
+    m_directory(directory),
+    m_segment_bytes(segment_bytes),
+    m_max_bytes(max_bytes),
+    m_max_age(max_age),
+    m_log(_log),
+    m_bytes(0),
+    m_next_sequence(0),
+    m_last_time(0)
+    {
+        std::filesystem::create_directories(directory);
+        std::vector<std::uint64_t> first_sequences;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+        {
+            std::string name = entry.path().filename().string();
+            if (entry.is_regular_file() && name.size() == 24 && name.compare(20, 4, ".log") == 0
+                && std::all_of(name.begin(), name.begin() + 20, ::isdigit))
+                first_sequences.push_back(std::stoull(name.substr(0, 20)));
+        }
+        std::sort(first_sequences.begin(), first_sequences.end());
+        for (std::uint64_t first_sequence : first_sequences)
+        {
+            std::shared_ptr<history_segment> segment = std::make_shared<history_segment>(segment_path(first_sequence), first_sequence, m_segment_bytes);
+            m_bytes += segment->get_capacity();
+            m_next_sequence = segment->get_end_sequence();
+            m_last_time = std::max(m_last_time, segment->get_last_time());
+            m_segments.push_back(segment);
+        }
+        if (!m_segments.empty())
+            m_log.append_log("History: " + std::to_string(m_segments.size()) + " segments, frames " +
+                std::to_string(m_segments.front()->get_first_sequence()) + " to " + std::to_string(m_next_sequence) + '\n');
+        enforce_retention();
+    }
+
+    history::~history()
+    {
+    }
+
+    std::uint64_t history::append(const std::uint8_t* frame, std::size_t length)
+    {
+        std::uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        m_last_time = std::max(m_last_time, static_cast<std::uint64_t>(now));
+        if (m_segments.empty() || !m_segments.back()->append(frame, length, m_last_time))
+        {
+            std::size_t capacity = std::max(m_segment_bytes, record_size(length));
+            std::shared_ptr<history_segment> segment = std::make_shared<history_segment>(segment_path(m_next_sequence), m_next_sequence, capacity);
+            m_bytes += segment->get_capacity();
+            m_segments.push_back(segment);
+            segment->append(frame, length, m_last_time);
+        }
+        enforce_retention();
+        return m_next_sequence++;
+    }
+
+    void history::get_last(std::uint64_t count, std::uint64_t end_sequence, history_replay& replay)
+    {
+        end_sequence = std::min(end_sequence, m_next_sequence);
+        collect(end_sequence > count ? end_sequence - count : 0, end_sequence, replay);
+    }
+
+    void history::get_since(std::uint64_t since_ns, std::uint64_t end_sequence, history_replay& replay)
+    {
+        for (const std::shared_ptr<history_segment>& segment : m_segments)
+        {
+            if (segment->get_last_time() < since_ns)
+                continue;
+            std::uint64_t begin_sequence;
+            segment->find_time(since_ns, begin_sequence);
+            collect(begin_sequence, std::min(end_sequence, m_next_sequence), replay);
+            return;
+        }
+    }
+
+    void history::collect(std::uint64_t begin_sequence, std::uint64_t end_sequence, history_replay& replay)
+    {
+        for (const std::shared_ptr<history_segment>& segment : m_segments)
+        {
+            if (segment->get_end_sequence() <= begin_sequence || segment->get_first_sequence() >= end_sequence)
+                continue;
+            std::uint64_t sequence = std::max(begin_sequence, segment->get_first_sequence());
+            std::size_t offset = segment->find_sequence(sequence);
+            bool used = false;
+            for (; sequence < end_sequence && offset < segment->get_used(); sequence++)
+            {
+                std::size_t length;
+                const std::uint8_t* frame = segment->get_frame(offset, length);
+                replay.frames.push_back(boost::asio::buffer(frame, length));
+                replay.bytes += length;
+                offset = segment->next_offset(offset);
+                used = true;
+            }
+            if (used)
+                replay.segments.push_back(segment);
+        }
+    }
+
+    void history::enforce_retention()
+    {
+        std::uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        std::uint64_t max_age_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(m_max_age).count();
+        while (m_segments.size() > 1)
+        {
+            const std::shared_ptr<history_segment>& oldest = m_segments.front();
+            bool too_old = max_age_ns != 0 && oldest->get_last_time() + max_age_ns < now;
+            if (m_bytes <= m_max_bytes && !too_old)
+                break;
+            // Replays still reading it keep the mapping, the file goes with the last of them
+            oldest->remove();
+            m_bytes -= oldest->get_capacity();
+            m_segments.pop_front();
+        }
+    }
+
+    std::string history::segment_path(std::uint64_t first_sequence) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu.log", static_cast<unsigned long long>(first_sequence));
+        return (std::filesystem::path(m_directory) / name).string();
+    }
+
+    history_cursor::history_cursor()
+    :
+    m_joined_sequence(0),
+    m_next(0),
+    m_active(false)
+    {
+    }
+
+    history_cursor::~history_cursor()
+    {
+    }
+
+    std::size_t history_cursor::request(history& _history, std::string_view query)
+    {
+        if (m_active)
+            return 0;
+        std::size_t space = query.find(' ');
+        if (space == std::string_view::npos)
+            return 0;
+        std::string_view kind = query.substr(0, space);
+        std::uint64_t value;
+        try
+        {
+            value = std::stoull(std::string(query.substr(space + 1)));
+        }
+        catch (std::exception&)
+        {
+            return 0;
+        }
+        if (kind == "last")
+            _history.get_last(value, m_joined_sequence, m_replay);
+        else if (kind == "since")
+            _history.get_since(value * 1000000, m_joined_sequence, m_replay);
+        else
+            return 0;
+        if (m_replay.frames.empty())
+        {
+            m_replay = history_replay();
+            return 0;
+        }
+        m_next = 0;
+        m_active = true;
+        return m_replay.frames.size();
+    }
+
+    std::vector<boost::asio::const_buffer> history_cursor::take_batch()
+    {
+        std::size_t count = std::min(REPLAY_BATCH, m_replay.frames.size() - m_next);
+        std::vector<boost::asio::const_buffer> batch(m_replay.frames.begin() + m_next, m_replay.frames.begin() + m_next + count);
+        m_next += count;
+        return batch;
+    }
+
+    void history_cursor::finish()
+    {
+        m_replay = history_replay();
+        m_next = 0;
+        m_active = false;
+    }
+    }
+}
@@ -0,0 +1,427 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+/**
+ * @file src/scft-srv/history.hpp
+ * @brief Defines history class, broadcast frames appended to memory mapped segment files
+*/
+
+#include "scrolling_log.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Size of the record header before every frame in a segment
+         * @verbatim
+         * [11111111][2222][3333][FRAME...][PADDING]
+         * 1: Append time, wall clock nanoseconds 8 bytes
+         * 2: Frame length 4 bytes
+         * 3: HISTORY_RECORD_MAGIC 4 bytes
+         * Records are padded to 8 bytes, the first header without the magic ends the segment
+         * @endverbatim
+        */
+        constexpr std::size_t HISTORY_RECORD_HEADER_SIZE = 16;
+
+        /**
+         * @brief Marks a written record, segments are zero filled when created
+        */
+        constexpr std::uint32_t HISTORY_RECORD_MAGIC = 0x48544653;
+
+        /**
+         * @brief Records between two entries of a segment's sparse index
+        */
+        constexpr std::size_t HISTORY_INDEX_INTERVAL = 64;
+
+        /**
+         * @brief Replayed frames written at once
+        */
+        constexpr std::size_t REPLAY_BATCH = 64;
+
+        /**
+         * @brief One memory mapped segment file, named after the sequence number of its first record
+        */
+        class history_segment
+        {
+            /**
+             * @brief Map a segment, recovering its records if it exists
+             * @param path File path
+             * @param first_sequence Sequence number of the first record
+             * @param capacity Size of a new file, existing files keep theirs
+            */
+            public: history_segment(const std::string& path, std::uint64_t first_sequence, std::size_t capacity);
+
+            /**
+             * @brief Unmap, and delete the file if removed
+            */
+            public: ~history_segment();
+
+            /**
+             * @brief Append a record
+             * @param frame Frame
+             * @param length Frame length
+             * @param time_ns Append time
+             * @return False if it does not fit
+            */
+            public: bool append(const std::uint8_t* frame, std::size_t length, std::uint64_t time_ns);
+
+            /**
+             * @brief Offset of a record, walking from the closest index entry
+             * @param sequence Sequence number within this segment
+             * @return Offset
+            */
+            public: std::size_t find_sequence(std::uint64_t sequence) const;
+
+            /**
+             * @brief First record appended at or after a time
+             * @param time_ns Wall clock nanoseconds
+             * @param sequence Its sequence number, get_end_sequence() if none
+             * @return Its offset, get_used() if none
+            */
+            public: std::size_t find_time(std::uint64_t time_ns, std::uint64_t& sequence) const;
+
+            /**
+             * @brief Record at an offset
+             * @param offset Offset of a record
+             * @param length Frame length
+             * @return Frame
+            */
+            public: const std::uint8_t* get_frame(std::size_t offset, std::size_t& length) const;
+
+            /**
+             * @brief Offset of the record after one
+             * @param offset Offset of a record
+             * @return Offset
+            */
+            public: std::size_t next_offset(std::size_t offset) const;
+
+            /**
+             * @brief Delete the file once the last replay using it is done
+            */
+            public: void remove() { m_removed = true; }
+
+            /**
+             * @brief Sequence number of the first record
+             * @return Sequence number
+            */
+            public: std::uint64_t get_first_sequence() const { return m_first_sequence; }
+
+            /**
+             * @brief Sequence number after the last record
+             * @return Sequence number
+            */
+            public: std::uint64_t get_end_sequence() const { return m_first_sequence + m_count; }
+
+            /**
+             * @brief Append time of the last record
+             * @return Wall clock nanoseconds, 0 if empty
+            */
+            public: std::uint64_t get_last_time() const { return m_last_time; }
+
+            /**
+             * @brief Bytes used by records
+             * @return Bytes
+            */
+            public: std::size_t get_used() const { return m_used; }
+
+            /**
+             * @brief File size
+             * @return Bytes
+            */
+            public: std::size_t get_capacity() const { return m_capacity; }
+
+            /**
+             * @brief Sparse index entry
+            */
+            private: struct index_entry
+            {
+                std::uint64_t sequence;     //!< Sequence number
+                std::uint64_t time_ns;      //!< Append time
+                std::size_t offset;         //!< Record offset
+            };
+
+            /**
+             * @brief Add an appended or recovered record to the count and index
+             * @param time_ns Append time
+             * @param offset Record offset
+             * @param length Frame length
+            */
+            private: void add_record(std::uint64_t time_ns, std::size_t offset, std::size_t length);
+
+            /**
+             * @brief File path
+            */
+            private: std::string m_path;
+
+            /**
+             * @brief Sequence number of the first record
+            */
+            private: std::uint64_t m_first_sequence;
+
+            /**
+             * @brief File size
+            */
+            private: std::size_t m_capacity;
+
+            /**
+             * @brief File mapping
+            */
+            private: boost::interprocess::file_mapping m_mapping;
+
+            /**
+             * @brief Mapped file
+            */
+            private: boost::interprocess::mapped_region m_region;
+
+            /**
+             * @brief Bytes used by records
+            */
+            private: std::size_t m_used;
+
+            /**
+             * @brief Record count
+            */
+            private: std::uint64_t m_count;
+
+            /**
+             * @brief Append time of the last record
+            */
+            private: std::uint64_t m_last_time;
+
+            /**
+             * @brief One entry every HISTORY_INDEX_INTERVAL records
+            */
+            private: std::vector<index_entry> m_index;
+
+            /**
+             * @brief Delete file when destroyed
+            */
+            private: bool m_removed;
+        };
+
+        /**
+         * @brief Frames to replay, written straight from the mapped segments
+        */
+        struct history_replay
+        {
+            std::vector<std::shared_ptr<history_segment>> segments;     //!< Keep the mappings alive until written
+            std::vector<boost::asio::const_buffer> frames;              //!< One buffer per frame
+            std::uint64_t bytes = 0;                                    //!< Total length
+        };
+
+        /**
+         * @brief Append only log of broadcast frames, not thread safe, use it from the io thread
+        */
+        class history
+        {
+            /**
+             * @brief Open or create the log
+             * @param directory Directory of the segment files
+             * @param segment_bytes Size of new segments, larger frames get a segment of their own size
+             * @param max_bytes Oldest segments are deleted while the others take more than this
+             * @param max_age Oldest segments are deleted once their last record is older, 0 to disable
+             * @param _log Log
+            */
+            public: history(
+                const std::string& directory,
+                std::size_t segment_bytes,
+                std::uint64_t max_bytes,
+                std::chrono::seconds max_age,
+                basic_shell::scrolling_log& _log);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~history();
+
+            /**
+             * @brief Append a frame, rolling to a new segment when full
+             * @param frame Frame
+             * @param length Frame length
+             * @return Its sequence number
+            */
+            public: std::uint64_t append(const std::uint8_t* frame, std::size_t length);
+
+            /**
+             * @brief Sequence number the next frame gets
+             * @return Sequence number
+            */
+            public: std::uint64_t get_next_sequence() const { return m_next_sequence; }
+
+            /**
+             * @brief Collect the last frames before a sequence number
+             * @param count Frame count
+             * @param end_sequence First frame not to collect
+             * @param replay Filled
+            */
+            public: void get_last(std::uint64_t count, std::uint64_t end_sequence, history_replay& replay);
+
+            /**
+             * @brief Collect the frames appended since a time, before a sequence number
+             * @param since_ns Wall clock nanoseconds
+             * @param end_sequence First frame not to collect
+             * @param replay Filled
+            */
+            public: void get_since(std::uint64_t since_ns, std::uint64_t end_sequence, history_replay& replay);
+
+            /**
+             * @brief Collect frames from a sequence number on
+             * @param begin_sequence First frame
+             * @param end_sequence First frame not to collect
+             * @param replay Filled
+            */
+            private: void collect(std::uint64_t begin_sequence, std::uint64_t end_sequence, history_replay& replay);
+
+            /**
+             * @brief Delete oldest segments beyond the size or age limit, the active one is kept
+            */
+            private: void enforce_retention();
+
+            /**
+             * @brief Path of a segment
+             * @param first_sequence Sequence number of its first record
+             * @return Path
+            */
+            private: std::string segment_path(std::uint64_t first_sequence) const;
+
+            /**
+             * @brief Segment directory
+            */
+            private: std::string m_directory;
+
+            /**
+             * @brief Size of new segments
+            */
+            private: std::size_t m_segment_bytes;
+
+            /**
+             * @brief Size limit
+            */
+            private: std::uint64_t m_max_bytes;
+
+            /**
+             * @brief Age limit
+            */
+            private: std::chrono::seconds m_max_age;
+
+            /**
+             * @brief Log
+            */
+            private: basic_shell::scrolling_log& m_log;
+
+            /**
+             * @brief Segments, oldest first, the last one is appended to
+            */
+            private: std::deque<std::shared_ptr<history_segment>> m_segments;
+
+            /**
+             * @brief Sum of segment sizes
+            */
+            private: std::uint64_t m_bytes;
+
+            /**
+             * @brief Sequence number of the next frame
+            */
+            private: std::uint64_t m_next_sequence;
+
+            /**
+             * @brief Append time of the last frame, times never go backwards
+            */
+            private: std::uint64_t m_last_time;
+        };
+
+        /**
+         * @brief Frames of the history one member asked for, handed out in batches
+        */
+        class history_cursor
+        {
+            /**
+             * @brief Nothing to replay
+            */
+            public: history_cursor();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~history_cursor();
+
+            /**
+             * @brief Remember where the history stood when the member joined, replays stop there
+             * @param sequence Sequence number of the first frame broadcast after joining
+            */
+            public: void set_joined_sequence(std::uint64_t sequence) { m_joined_sequence = sequence; }
+
+            /**
+             * @brief Where the history stood when the member joined
+             * @return Sequence number
+            */
+            public: std::uint64_t get_joined_sequence() const { return m_joined_sequence; }
+
+            /**
+             * @brief Collect the frames of a HISTORY query, "last N" or "since UNIX_MS", unless a replay is active
+             * @param _history History
+             * @param query Query
+             * @return Frames collected, 0 if none or the query is unknown
+            */
+            public: std::size_t request(history& _history, std::string_view query);
+
+            /**
+             * @brief Check if frames are being replayed
+             * @return True from a request() that collected frames until finish()
+            */
+            public: bool is_active() const { return m_active; }
+
+            /**
+             * @brief Check if every frame was handed out
+             * @return True once the last batch was taken
+            */
+            public: bool is_done() const { return m_next == m_replay.frames.size(); }
+
+            /**
+             * @brief Take the next frames to write
+             * @return Up to REPLAY_BATCH buffers
+            */
+            public: std::vector<boost::asio::const_buffer> take_batch();
+
+            /**
+             * @brief Release the frames once written
+            */
+            public: void finish();
+
+            /**
+             * @brief History sequence number when the member joined
+            */
+            private: std::uint64_t m_joined_sequence;
+
+            /**
+             * @brief Frames being replayed
+            */
+            private: history_replay m_replay;
+
+            /**
+             * @brief Frames of m_replay already handed out
+            */
+            private: std::size_t m_next;
+
+            /**
+             * @brief A replay is in progress
+            */
+            private: bool m_active;
+        };
+    }
+}
+
+#endif /* HISTORY_HPP */
@@ -1,5 +1,6 @@
 #include "server.hpp"
 #include "basic_shell.hpp"
+#include "command_line.hpp"
 
 #include <cctype>
 
@@ -7,7 +8,10 @@
 #include <boost/lexical_cast.hpp>
 
 #include <chrono>
+#include <csignal>
+#include <cstdio>
 #include <deque>
+#include <fstream>
 #include <iostream>
 #include <mutex>
 #include <thread>
@@ -19,6 +23,7 @@ class server_shell : scft::basic_shell::basic_shell
         m_commands.insert(std::make_pair("help", std::bind(&server_shell::cmd_help, this)));
         m_commands.insert(std::make_pair("start", std::bind(&server_shell::cmd_start, this, std::placeholders::_1)));
         m_commands.insert(std::make_pair("stop", std::bind(&server_shell::cmd_stop, this, std::placeholders::_1)));
+        m_commands.insert(std::make_pair("stats", std::bind(&server_shell::cmd_stats, this, std::placeholders::_1)));
     }
 
     public: ~server_shell() {}
@@ -32,8 +37,9 @@ class server_shell : scft::basic_shell::basic_shell
             std::to_string(SCFT_SRV_VERSION_PATCH) + '\n');
         m_log.append_log("Available commands: \n");
         m_log.append_log("\thelp: Prints this: \n");
-        m_log.append_log("\tstart [IP] [PORT]: Start server\n");
+        m_log.append_log("\tstart [IP] [PORT] [METRICS_PORT]: Start server, Prometheus metrics on 127.0.0.1:METRICS_PORT\n");
         m_log.append_log("\tstop: Stops server\n");
+        m_log.append_log("\tstats [members]: Show metrics, per member with members\n");
         m_log.append_log("\tquit: Exits\n");
         return true;
     }
@@ -44,9 +50,18 @@ class server_shell : scft::basic_shell::basic_shell
             return false;
         if (!is_ipv4(args.at(1)) || !is_int(args.at(2)))
             return false;
+        if (args.size() > 3 && !is_int(args.at(3)))
+            return false;
         if (!m_server)
         {
-            m_server = std::make_unique<scft::server::server>(m_io_ctx, args.at(1), boost::lexical_cast<std::uint16_t>(args.at(2)), m_log);
+            scft::server::server_options options;
+            options.address = args.at(1);
+            options.port = boost::lexical_cast<std::uint16_t>(args.at(2));
+            if (args.size() > 3)
+                options.metrics_port = boost::lexical_cast<std::uint16_t>(args.at(3));
+            m_server = std::make_unique<scft::server::server>(m_io_ctx, options, m_log);
+            m_last_stats = std::chrono::steady_clock::now();
+            m_last_accepts = 0;
             io_ctx_run_thread = std::thread([&](){ m_io_ctx.run(); });
             m_log.append_log("Started server\n");
             return true;
@@ -58,7 +73,7 @@ class server_shell : scft::basic_shell::basic_shell
     {
         if (m_server)
         {
-            m_io_ctx.stop();
+            m_server->stop();
             io_ctx_run_thread.join();
             m_server.reset();
             m_io_ctx.restart();
@@ -68,6 +83,26 @@ class server_shell : scft::basic_shell::basic_shell
         return false;
     }
 
+    private: bool cmd_stats(const std::vector<std::string>& args)
+    {
+        if (!m_server)
+            return false;
+        bool labeled = args.size() > 1 && args.at(1) == "members";
+        m_log.append_log(m_server->get_registry().render_text(labeled));
+        if (!labeled)
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            std::uint64_t accepts = m_server->get_metrics().accepts->get();
+            double elapsed = std::chrono::duration<double>(now - m_last_stats).count();
+            char rate[64];
+            std::snprintf(rate, sizeof(rate), "accept rate %.2f/s\n", elapsed > 0 ? (accepts - m_last_accepts) / elapsed : 0.0);
+            m_log.append_log(rate);
+            m_last_stats = now;
+            m_last_accepts = accepts;
+        }
+        return true;
+    }
+
     private: void update_log(const std::size_t& cursor_y)
     {
         std::size_t rec_line_count = m_log.get_recorded_lines_count();
@@ -166,11 +201,179 @@ class server_shell : scft::basic_shell::basic_shell
     private: std::unique_ptr<scft::server::server> m_server;
     private: boost::asio::io_context m_io_ctx;
     private: std::thread io_ctx_run_thread;
+    private: std::chrono::steady_clock::time_point m_last_stats;
+    private: std::uint64_t m_last_accepts = 0;
 };
 
 
+/**
+ * @brief Non-interactive server, for service managers and containers
+*/
+class server_daemon
+{
+    public: server_daemon(const scft::command_line::arguments& args)
+    :
+    m_args(args),
+    m_log(scft::basic_shell::SCROLL_LOG_WIDTH, scft::basic_shell::SCROLL_LOG_HEIGHT)
+    {
+    }
+
+    public: ~server_daemon() {}
+
+    public: int run()
+    {
+        std::ofstream log_file;
+        if (m_args.has("log-file"))
+        {
+            log_file.open(m_args.get("log-file"), std::ios::out | std::ios::app);
+            if (!log_file)
+            {
+                std::cerr << "Cannot open log file " << m_args.get("log-file") << '\n';
+                return 1;
+            }
+            m_log.set_sink(&log_file);
+        }
+        else
+            m_log.set_sink(&std::cout);
+
+        scft::server::server_options options;
+        options.address = m_args.get("address", options.address);
+        options.port = static_cast<std::uint16_t>(m_args.get_uint("port", 0));
+        options.local_path = m_args.get("unix", options.local_path);
+        options.shm_path = m_args.get("shm", options.shm_path);
+        options.metrics_address = m_args.get("metrics-address", options.metrics_address);
+        options.metrics_port = static_cast<std::uint16_t>(m_args.get_uint("metrics-port", 0));
+        options.read_timeout = std::chrono::seconds(m_args.get_uint("read-timeout", options.read_timeout.count()));
+        options.write_timeout = std::chrono::seconds(m_args.get_uint("write-timeout", options.write_timeout.count()));
+        options.no_delay = m_args.has("no-delay");
+        options.direct = !m_args.has("no-direct");
+        options.session_grace = std::chrono::seconds(m_args.get_uint("session-grace", options.session_grace.count()));
+        options.history_directory = m_args.get("history", options.history_directory);
+        options.history_segment_bytes = static_cast<std::size_t>(m_args.get_uint("history-segment", options.history_segment_bytes));
+        options.history_max_bytes = m_args.get_uint("history-bytes", options.history_max_bytes);
+        options.history_max_age = std::chrono::seconds(m_args.get_uint("history-age", options.history_max_age.count()));
+        options.spill_threshold = m_args.get_uint("spill-threshold", options.spill_threshold);
+        options.memory_budget = m_args.get_uint("memory-budget", options.memory_budget);
+        options.max_text = m_args.get_uint("max-text", options.max_text);
+        options.max_file = m_args.get_uint("max-file", options.max_file);
+        options.member_ingress = m_args.get_uint("member-ingress", options.member_ingress);
+        options.member_egress = m_args.get_uint("member-egress", options.member_egress);
+        options.room_ingress = m_args.get_uint("room-ingress", options.room_ingress);
+        options.room_egress = m_args.get_uint("room-egress", options.room_egress);
+        options.egress_quantum = m_args.get_uint("egress-quantum", options.egress_quantum);
+        options.multicast_group = m_args.get("multicast", options.multicast_group);
+        options.multicast_interface = m_args.get("multicast-interface", options.multicast_interface);
+        options.multicast_ttl = static_cast<int>(m_args.get_uint("multicast-ttl", options.multicast_ttl));
+        options.multicast_rate = m_args.get_uint("multicast-rate", options.multicast_rate);
+        try
+        {
+            if (m_args.has("checksums"))
+                options.checksums = scft::checksum::parse_names(m_args.get("checksums"));
+            m_server = std::make_unique<scft::server::server>(m_io_ctx, options, m_log);
+        }
+        catch (std::exception& e)
+        {
+            m_log.append_log(std::string("Cannot start server: ") + e.what() + '\n');
+            m_log.set_sink(nullptr);
+            return 1;
+        }
+
+        boost::asio::signal_set signals(m_io_ctx, SIGINT, SIGTERM);
+        signals.async_wait(
+            [this](boost::system::error_code ec, int signal_number)
+            {
+                if (!ec)
+                    m_log.append_log("Received signal " + std::to_string(signal_number) + ", stopping\n");
+                m_server->stop();
+            });
+
+        m_log.append_log("Started server\n");
+        m_io_ctx.run();
+        m_server.reset();
+        m_log.append_log("Stopped server\n");
+        m_log.set_sink(nullptr);
+        return 0;
+    }
+
+    private: const scft::command_line::arguments& m_args;
+    private: scft::basic_shell::scrolling_log m_log;
+    private: std::unique_ptr<scft::server::server> m_server;
+    private: boost::asio::io_context m_io_ctx;
+};
+
+static void print_usage()
+{
+    std::cout <<
+        "Usage: scft-srv [--headless --port PORT [OPTIONS]]\n"
+        "Without --headless, starts the interactive shell\n"
+        "\t--headless: Run without terminal interface until SIGINT/SIGTERM\n"
+        "\t--address IP: Address to listen on (default 0.0.0.0)\n"
+        "\t--port PORT: Port to listen on\n"
+        "\t--unix PATH: Listen on a Unix domain socket as well, for members on this host\n"
+        "\t--shm PATH: Listen on a Unix domain socket for members on this host exchanging frames through shared memory\n"
+        "\t--log-file PATH: Append log to file instead of stdout\n"
+        "\t--metrics-port PORT: Serve Prometheus metrics on this port\n"
+        "\t--metrics-address IP: Metrics address (default 127.0.0.1)\n"
+        "\t--read-timeout S: Drop members silent for S seconds, 0 disables (default 60)\n"
+        "\t--write-timeout S: Drop members not draining their queue for S seconds, 0 disables (default 60)\n"
+        "\t--no-delay: Disable Nagle's algorithm on member sockets\n"
+        "\t--checksums LIST: Checksums members may negotiate (default crc32,crc32c,xxh3-64), add none to allow unchecked frames\n"
+        "\t--history DIR: Keep broadcast history in DIR for joiners to replay, disabled by default\n"
+        "\t--history-segment BYTES: History segment file size (default 16777216)\n"
+        "\t--history-bytes BYTES: Delete oldest history beyond BYTES (default 268435456)\n"
+        "\t--history-age S: Delete history older than S seconds, 0 disables (default 86400)\n"
+        "\t--spill-threshold BYTES: Spool relayed file contents above BYTES to disk instead of memory, 0 disables (default 1048576)\n"
+        "\t--memory-budget BYTES: Defer reading frames while receive buffers and send queues hold BYTES (default 268435456)\n"
+        "\t--max-text BYTES: Drop members sending longer texts (default 1048576)\n"
+        "\t--max-file BYTES: Drop members sending larger files, 0 for no limit but the protocol's (default 0)\n"
+        "\t--member-ingress BYTES: Read at most BYTES per second from each member, 0 for unlimited (default 0)\n"
+        "\t--member-egress BYTES: Write at most BYTES per second to each member, 0 for unlimited (default 0)\n"
+        "\t--room-ingress BYTES: Read at most BYTES per second from all members together, 0 for unlimited (default 0)\n"
+        "\t--room-egress BYTES: Write at most BYTES per second to all members together, members take turns, 0 for unlimited (default 0)\n"
+        "\t--egress-quantum BYTES: Bytes per member turn when the room egress is contended (default 65536)\n"
+        "\t--multicast GROUP:PORT: Multicast spooled files to members that ask for it, repairs go over TCP, disabled by default\n"
+        "\t--multicast-interface IP: Interface to multicast on (default the system's choice)\n"
+        "\t--multicast-ttl N: Router hops of multicast datagrams (default 1)\n"
+        "\t--multicast-rate BYTES: Multicast at most BYTES per second (default 50000000)\n"
+        "\t--no-direct: Relay every file instead of letting members fetch offered files from their sender\n"
+        "\t--session-grace S: Keep the session of a disconnected member S seconds for it to resume, 0 disables (default 30)\n"
+        "\t--help: Prints this\n";
+}
+
 int main(int argc, char* argv[])
 {
+#if defined(SIGPIPE)
+    // sendfile() to a peer that reset the connection raises it, the returned error is enough
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    if (argc > 1)
+    {
+        try
+        {
+            scft::command_line::arguments args(argc, argv, {"headless", "help", "no-delay", "no-direct"});
+            std::vector<std::string> unknown = args.unknown(
+                {"headless", "help", "no-delay", "no-direct", "address", "port", "unix", "shm", "log-file", "metrics-port", "metrics-address",
+                 "read-timeout", "write-timeout", "checksums", "history", "history-segment", "history-bytes", "history-age",
+                 "spill-threshold", "memory-budget", "max-text", "max-file", "member-ingress", "member-egress", "room-ingress",
+                 "room-egress", "egress-quantum", "multicast", "multicast-interface", "multicast-ttl", "multicast-rate",
+                 "session-grace"});
+            if (!unknown.empty())
+                throw std::runtime_error("Unknown flag --" + unknown.front());
+            if (args.has("help") || !args.has("headless") || !args.has("port"))
+            {
+                print_usage();
+                return args.has("help") ? 0 : 1;
+            }
+            server_daemon daemon(args);
+            return daemon.run();
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            print_usage();
+            return 1;
+        }
+    }
     server_shell _shell;
     _shell.run();
     return 0;
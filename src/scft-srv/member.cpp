@@ -1,96 +1,1146 @@
 #include "member.hpp"
+#include "file_transfer.hpp"
 
-using boost::asio::ip::tcp;
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
 
 namespace scft
 {
     namespace server
     {
-    member::member(tcp::socket _socket, room& group)
+    /**
+     * @brief Names spool files uniquely within the process
+    */
+    static std::atomic<std::uint64_t> spool_count{0};
+
+    /**
+     * @brief Stands in for the port of Unix domain members, which have none, to tell them apart
+    */
+    static std::atomic<std::uint16_t> local_count{0};
+
+    /**
+     * @brief Make a session token
+     * @return 128 random bits in hexadecimal
+    */
+    static std::string make_token()
+    {
+        static std::mt19937_64 generator{(static_cast<std::uint64_t>(std::random_device{}()) << 32) | std::random_device{}()};
+        char token[33];
+        std::snprintf(token, sizeof(token), "%016llx%016llx",
+            static_cast<unsigned long long>(generator()), static_cast<unsigned long long>(generator()));
+        return token;
+    }
+
+    member::member(transport::stream _socket, room& group)
     :
     m_socket(std::move(_socket)),
+    m_port(0),
     m_message(),
+    m_writing(false),
+    m_queued(0),
+    m_multicast(false),
+    m_repairs(group.get_log(), group.get_metrics()),
+    m_direct(false),
+    m_checksums(checksum::bit(checksum::CRC32)),
+    m_spooled(),
+    m_memory(group.get_budget()),
+    m_deferred(false),
+    m_pacer(m_socket.get_executor(), group.get_bandwidth(), group.get_metrics()),
+    m_announced(group.get_session_grace().count() == 0),
+    m_lingering(false),
+    m_expired(false),
+    m_window(),
+    m_stalled(false),
+    m_piggybacked(false),
     m_group(group)
     {
+        boost::system::error_code ec;
+        transport::endpoint remote = m_socket.remote_endpoint(ec);
+        if (!ec)
+        {
+            m_address = transport::get_address(remote);
+            m_port = transport::is_local(remote) ? ++local_count : transport::get_port(remote);
+        }
+
+        server_metrics& _metrics = m_group.get_metrics();
+        std::string labels = metrics::label("member", m_address + ':' + std::to_string(m_port));
+        m_bytes_in = _metrics.registry.make_local_counter("scft_member_bytes_in_total", "Bytes received from a member", labels);
+        m_frames_in = _metrics.registry.make_local_counter("scft_member_frames_in_total", "Frames received from a member", labels);
+        m_bytes_out = _metrics.registry.make_local_counter("scft_member_bytes_out_total", "Bytes sent to a member", labels);
+        m_frames_out = _metrics.registry.make_local_counter("scft_member_frames_out_total", "Frames sent to a member", labels);
+        m_queue_depth = _metrics.registry.make_gauge("scft_member_queue_depth", "Frames waiting in a member send queue", labels);
+    }
+
+    void member::start()
+    {
+        m_last_read = std::chrono::steady_clock::now();
+        m_last_write = m_last_read;
+        schedule_idle_check();
+        // Without a session to resume, the first frame can only be a new member's
+        if (!m_announced && !m_group.has_sessions())
+            announce();
+        else if (!m_announced)
+        {
+            std::weak_ptr<member> weak_self = shared_from_this();
+            m_group.get_timer_wheel().schedule(HELLO_WINDOW,
+                [weak_self]()
+                {
+                    std::shared_ptr<member> self = weak_self.lock();
+                    if (self && !self->m_announced && self->m_socket.is_open())
+                        self->announce();
+                });
+        }
         header_reader();
     }
 
+    bool member::linger()
+    {
+        if (m_lingering)
+            return !m_expired;
+        std::chrono::seconds grace = m_group.get_session_grace();
+        if (m_session.empty() || grace.count() == 0)
+            return false;
+        // Broadcasts keep queueing, the member gets them if it resumes in time
+        m_lingering = true;
+        close();
+        m_group.get_log().append_log("Lingering: " + m_address + ':' + std::to_string(m_port) + ", session kept for " + std::to_string(grace.count()) + "s\n");
+        std::weak_ptr<member> weak_self = shared_from_this();
+        m_group.get_timer_wheel().schedule(grace,
+            [weak_self]()
+            {
+                std::shared_ptr<member> self = weak_self.lock();
+                if (!self)
+                    return;
+                self->m_expired = true;
+                self->m_group.remove_member(self);
+            });
+        return true;
+    }
+
+    void member::schedule_idle_check()
+    {
+        std::chrono::seconds read_timeout = m_group.get_read_timeout();
+        std::chrono::seconds write_timeout = m_group.get_write_timeout();
+        if (read_timeout.count() == 0 && write_timeout.count() == 0)
+            return;
+
+        // Fire at the earliest possible expiry, activity since then only pushes it back
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::time_point::max();
+        if (read_timeout.count() != 0)
+            next = std::min(next, m_last_read + read_timeout);
+        if (write_timeout.count() != 0)
+            next = std::min(next, (m_queued == 0 ? now : m_last_write) + write_timeout);
+        std::weak_ptr<member> weak_self = shared_from_this();
+        m_group.get_timer_wheel().schedule(std::max(next - now, std::chrono::steady_clock::duration::zero()),
+            [weak_self]()
+            {
+                std::shared_ptr<member> self = weak_self.lock();
+                if (self)
+                    self->check_idle();
+            });
+    }
+
+    void member::check_idle()
+    {
+        if (!m_socket.is_open())
+            return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::seconds read_timeout = m_group.get_read_timeout();
+        std::chrono::seconds write_timeout = m_group.get_write_timeout();
+        std::string reason;
+        if (read_timeout.count() != 0 && !m_deferred && !m_pacer.is_throttled() && now - m_last_read >= read_timeout)
+            reason = "nothing read for " + std::to_string(read_timeout.count()) + "s";
+        else if (write_timeout.count() != 0 && m_queued != 0 && now - m_last_write >= write_timeout)
+            reason = std::to_string(m_queued) + " frames not written for " + std::to_string(write_timeout.count()) + "s";
+        if (reason.empty())
+        {
+            schedule_idle_check();
+            return;
+        }
+        m_group.get_metrics().timeouts->add();
+        m_group.get_log().append_log("Timed out: " + m_address + ':' + std::to_string(m_port) + ", " + reason + '\n');
+        m_group.remove_member(shared_from_this());
+    }
+
+    void member::close()
+    {
+        boost::system::error_code ec;
+        m_socket.close(ec);
+        // A deferred frame will never be read, let the frames behind it go
+        m_memory.cancel_wait();
+        m_deferred = false;
+    }
+
     member::~member()
     {
+        m_group.get_metrics().queued_frames->add(-static_cast<std::int64_t>(m_queued));
     }
 
     void member::header_reader()
     {
         boost::asio::async_read(m_socket, boost::asio::buffer(m_message.get_raw_message(), message::HEADER_SIZE),
-            [this](boost::system::error_code ec, std::size_t)
+            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec)
+                {
+                    m_last_read = std::chrono::steady_clock::now();
+                    header_extension_reader();
+                }
+                else
+                {
+                    m_group.remove_member(self);
+                }
+            });
+    }
+
+    void member::header_extension_reader()
+    {
+        std::size_t missing = m_message.extend_header();
+        boost::asio::async_read(m_socket, boost::asio::buffer(m_message.get_raw_message().data() + message::HEADER_SIZE, missing),
+            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (ec || m_message.bad_header())
+                {
+                    m_group.remove_member(self);
+                    return;
+                }
+                // Refused before reading the data, a streamed body could be large
+                checksum::ALGORITHM algorithm = m_message.get_checksum_algorithm();
+                if ((m_message.get_message_type() == message::MESSAGE_TYPE::TEXT || m_message.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE)
+                    && (m_group.get_checksums() & checksum::bit(algorithm)) == 0)
+                {
+                    m_group.get_log().append_log("Refused checksum: " + m_address + ':' + std::to_string(m_port) + ", " + checksum::get_name(algorithm) + '\n');
+                    refuse();
+                    return;
+                }
+                std::uint64_t spill_threshold = m_group.get_spill_threshold();
+                admit_frame(spill_threshold != 0 && m_message.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE
+                    && !m_message.has_streamed_body() && !m_message.is_chunked() && m_message.get_stringdata_len() > spill_threshold);
+            });
+    }
+
+    void member::admit_frame(bool spill)
+    {
+        // The buffer as adjust() or spill_reader() will size it, plus the chunk buffer of spooled contents
+        std::uint64_t buffered = m_message.get_header_size();
+        if (spill)
+            buffered += m_message.get_origin_len() + SPILL_NAME_PREFIX + transfer::CHUNK_SIZE;
+        else if (m_message.has_streamed_body())
+            buffered += m_message.get_buffered_data_len() + transfer::CHUNK_SIZE;
+        else
+            buffered += m_message.get_buffered_data_len();
+        memory_budget& budget = m_group.get_budget();
+        ADMISSION admission = budget.admit(m_message.get_message_type(), m_message.get_stringdata_len(), buffered);
+        if (admission == REFUSED)
+        {
+            m_group.get_log().append_log("Refused frame: " + m_address + ':' + std::to_string(m_port) + ", " +
+                std::to_string(m_message.get_stringdata_len()) + " bytes of type " + std::to_string(m_message.get_message_type()) + '\n');
+            refuse();
+            return;
+        }
+        if (admission == DEFERRED)
+        {
+            // Not reading leaves the rest of the frame in the socket buffers, TCP then slows the sender down
+            m_deferred = true;
+            std::weak_ptr<member> weak_self = shared_from_this();
+            m_memory.wait(buffered,
+                [weak_self, buffered, spill]()
+                {
+                    std::shared_ptr<member> self = weak_self.lock();
+                    if (!self || !self->m_socket.is_open())
+                        return false;
+                    self->m_deferred = false;
+                    self->m_memory.hold_frame(buffered);
+                    self->m_last_read = std::chrono::steady_clock::now();
+                    self->read_frame(spill);
+                    return true;
+                });
+            return;
+        }
+        m_memory.hold_frame(buffered);
+        read_frame(spill);
+    }
+
+    void member::read_frame(bool spill)
+    {
+        // The header is charged with the data read next, spooled contents are charged by the chunk
+        std::uint64_t bytes = m_message.get_header_size() + (spill ? m_message.get_origin_len() : m_message.get_buffered_data_len());
+        pace_read(bytes,
+            [this, spill]()
+            {
+                if (spill)
+                {
+                    spill_reader();
+                    return;
+                }
+                m_message.adjust();
+                data_buffer_reader(0);
+            });
+    }
+
+    void member::release_frame()
+    {
+        if (m_message.get_raw_message().capacity() > RECEIVE_BUFFER_KEEP)
+            m_message = message::message();
+        m_memory.release_frame();
+    }
+
+    void member::data_buffer_reader(std::size_t done)
+    {
+        boost::asio::async_read(m_socket, boost::asio::buffer(m_message.get_data() + done, m_message.get_buffered_data_len() - done),
+            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (!ec && m_view.parse(m_message.get_raw_message().data(), m_message.get_raw_message().size()))
+                {
+                    m_last_read = std::chrono::steady_clock::now();
+                    if (m_view.has_streamed_body())
+                        body_reader();
+                    else
+                        on_frame();
+                }
+                else
+                {
+                    m_group.remove_member(self);
+                }
+            });
+    }
+
+    void member::spill_reader()
+    {
+        // Version 2 headers carry the file name length, version 1 names are looked for in a prefix
+        std::size_t prefix = m_message.get_origin_len() + (m_message.is_v2() ? m_message.get_string_len() + 1 :
+            static_cast<std::size_t>(std::min<std::uint64_t>(m_message.get_stringdata_len(), SPILL_NAME_PREFIX)));
+        m_message.set_payload_file(nullptr);
+        m_message.get_raw_message().resize(m_message.get_header_size() + prefix);
+        boost::asio::async_read(m_socket, boost::asio::buffer(m_message.get_data(), prefix),
+            [this, self = shared_from_this(), prefix](boost::system::error_code ec, std::size_t)
             {
-                if (!ec && !m_message.bad_header())
+                if (ec)
                 {
+                    m_group.remove_member(self);
+                    return;
+                }
+                m_last_read = std::chrono::steady_clock::now();
+                if (m_view.parse(m_message.get_raw_message().data(), m_message.get_raw_message().size(), true))
+                {
+                    body_reader();
+                }
+                else if (!m_message.is_v2() && prefix < m_message.get_data_len())
+                {
+                    // Name longer than the prefix, read the frame into memory after all
+                    m_memory.grow_frame(m_message.get_data_len() - prefix);
                     m_message.adjust();
-                    data_buffer_reader();
+                    data_buffer_reader(prefix);
                 }
                 else
                 {
-                    m_group.remove_member(shared_from_this());
+                    m_group.remove_member(self);
                 }
             });
     }
 
-    void member::data_buffer_reader()
+    void member::body_reader()
     {
-        boost::asio::async_read(m_socket, boost::asio::buffer(m_message.get_data(), m_message.get_data_len()),
-            [this](boost::system::error_code ec, std::size_t)
+        // Spool to disk, every recipient then streams from the same file
+        std::string spool_path = (std::filesystem::temp_directory_path() / ("scft-spool-" + std::to_string(spool_count++) + ".part")).string();
+        std::shared_ptr<message::payload_file> spool = std::make_shared<message::payload_file>(spool_path, m_view.get_file_buffer_len(), true);
+        // Contents read with a version 1 file name start the spool file, the buffer then ends with the name
+        std::size_t stored = m_message.get_raw_message().size() - m_view.get_header_size() - m_view.get_buffered_data().size;
+        m_spooled = start_checksums(stored);
+        if (stored != 0)
+        {
+            std::ofstream spool_file{spool_path, std::ios::out | std::ios::binary | std::ios::trunc};
+            spool_file.write(reinterpret_cast<const char*>(m_view.get_buffered_data().data + m_view.get_buffered_data().size), stored);
+            if (!spool_file)
+            {
+                m_group.remove_member(shared_from_this());
+                return;
+            }
+            m_message.get_raw_message().resize(m_message.get_raw_message().size() - stored);
+            m_view.parse(m_message.get_raw_message().data(), m_message.get_raw_message().size(), true);
+        }
+        std::shared_ptr<transfer::file_receiver> receiver = std::make_shared<transfer::file_receiver>(
+            m_socket, spool_path, spool->get_length() - stored, false, checksum::hasher(),
+            [this, self = shared_from_this(), spool](boost::system::error_code ec, std::uint64_t)
             {
                 if (!ec)
                 {
-                    m_group.broadcast(m_message);
-                    header_reader();
+                    m_message.set_payload_file(spool);
+                    on_frame();
                 }
                 else
                 {
-                    m_group.remove_member(shared_from_this());
+                    m_group.remove_member(self);
                 }
             });
+        receiver->set_progress_handler([this](std::size_t) { m_last_read = std::chrono::steady_clock::now(); });
+        receiver->set_pace_handler([this](std::size_t length, std::function<void()> resume) { pace_read(length, std::move(resume)); });
+        receiver->set_data_handler([this](const std::uint8_t* data, std::size_t length) { update_checksums(m_spooled, data, length); });
+        receiver->resume_at(stored);
+        receiver->start();
+    }
+
+    spool_checksums member::start_checksums(std::size_t stored)
+    {
+        // Contents are not verified here, a CRC32 is only needed for members that can't check the sender's algorithm
+        spool_checksums checksums;
+        message::byte_span buffered{m_view.get_buffered_data().data, m_view.get_buffered_data().size + stored};
+        checksums.fallback = !m_group.accepted_by_all(m_view.get_checksum_algorithm());
+        // Frames of local members get their name in relay(), verified and checksummed again as the contents go by
+        std::string origin = m_address + ':' + std::to_string(m_port);
+        checksums.stamp = m_address == transport::LOCAL_ADDRESS && m_view.get_origin() != origin;
+        std::size_t origin_string_len = m_view.get_origin().size() + 1;
+        if (checksums.stamp)
+        {
+            checksums.verified = checksum::hasher(m_view.get_checksum_algorithm());
+            checksums.stamped = checksum::hasher(m_view.get_checksum_algorithm());
+            checksums.verified.update(buffered.data, buffered.size);
+            checksums.stamped.update(origin.c_str(), origin.size() + 1);
+            checksums.stamped.update(buffered.data + origin_string_len, buffered.size - origin_string_len);
+        }
+        // The CRC32 copy is relayed with the new origin too
+        if (checksums.fallback && checksums.stamp)
+        {
+            checksums.fallback_hasher.update(origin.c_str(), origin.size() + 1);
+            checksums.fallback_hasher.update(buffered.data + origin_string_len, buffered.size - origin_string_len);
+        }
+        else if (checksums.fallback)
+            checksums.fallback_hasher.update(buffered.data, buffered.size);
+        return checksums;
+    }
+
+    void member::update_checksums(spool_checksums& checksums, const std::uint8_t* data, std::size_t size)
+    {
+        if (checksums.fallback)
+            checksums.fallback_hasher.update(data, size);
+        if (checksums.stamp)
+        {
+            checksums.verified.update(data, size);
+            checksums.stamped.update(data, size);
+        }
+    }
+
+    void member::on_frame()
+    {
+        // Read just before a resume closed this connection, the client sends it again
+        if (!m_socket.is_open())
+        {
+            m_group.remove_member(shared_from_this());
+            return;
+        }
+        server_metrics& _metrics = m_group.get_metrics();
+        m_frames_in->add();
+        m_bytes_in->add(m_view.get_frame_len());
+        _metrics.frames_in->add();
+        _metrics.bytes_in->add(m_view.get_frame_len());
+        m_window.receive(m_view.get_message_type(), m_view.get_flags());
+        if (!m_announced && m_view.get_message_type() != message::MESSAGE_TYPE::SESSION)
+            announce();
+        if (m_view.get_message_type() == message::MESSAGE_TYPE::HEARTBEAT)
+        {
+            // Let the member see the server is alive too
+            send_message(m_message);
+            if (m_window.has_ack())
+                send_ack();
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::SESSION && m_announced && m_view.get_string().empty())
+        {
+            // The member is leaving, its disconnect is not held for a resume
+            m_group.get_log().append_log("Session ended: " + m_address + ':' + std::to_string(m_port) + ", member leaving\n");
+            end_session();
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::SESSION)
+        {
+            if (!resume())
+            {
+                m_group.get_log().append_log("Bad session: " + m_address + ':' + std::to_string(m_port) + '\n');
+                refuse();
+                return;
+            }
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::ACK)
+        {
+            std::uint64_t received;
+            try
+            {
+                received = std::stoull(std::string(m_view.get_string()));
+            }
+            catch (std::exception&)
+            {
+                m_group.get_log().append_log("Bad ACK: " + m_address + ':' + std::to_string(m_port) + '\n');
+                refuse();
+                return;
+            }
+            acknowledge(received);
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::PING)
+        {
+            // Answer through the send queue so the round trip includes queueing behind broadcasts
+            _metrics.pings->add();
+            message::message pong = m_message;
+            pong.set_message_type(message::MESSAGE_TYPE::PONG);
+            send_message(pong);
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::NEGOTIATE)
+        {
+            negotiate();
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::HISTORY)
+        {
+            request_history();
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::OFFER || m_view.get_message_type() == message::MESSAGE_TYPE::FETCH)
+        {
+            if (!(m_view.get_message_type() == message::MESSAGE_TYPE::OFFER ? offer() : fetch()))
+            {
+                m_group.get_log().append_log("Bad offer: " + m_address + ':' + std::to_string(m_port) + ", " + std::string(m_view.get_string()) + '\n');
+                refuse();
+                return;
+            }
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::NACK)
+        {
+            if (!request_repair())
+            {
+                m_group.get_log().append_log("Bad NACK: " + m_address + ':' + std::to_string(m_port) + '\n');
+                refuse();
+                return;
+            }
+        }
+        else if (m_view.is_chunked() || m_view.get_message_type() == message::MESSAGE_TYPE::CHUNK)
+        {
+            if (!(m_view.is_chunked() ? open_stream() : append_stream()))
+            {
+                m_group.get_log().append_log("Bad stream: " + m_address + ':' + std::to_string(m_port) + ", " + std::to_string(m_view.get_stream_id()) + '\n');
+                refuse();
+                return;
+            }
+        }
+        else if (m_view.get_message_type() == message::MESSAGE_TYPE::TEXT || m_view.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE)
+        {
+            relay(m_message);
+        }
+        if (m_window.is_ack_due())
+            send_ack();
+        // Recipients hold their own reference, the spool file goes once they are done
+        m_message.set_payload_file(nullptr);
+        release_frame();
+        header_reader();
+    }
+
+    void member::refuse()
+    {
+        end_session();
+        m_group.remove_member(shared_from_this());
+    }
+
+    void member::announce()
+    {
+        m_announced = true;
+        m_group.announce(shared_from_this());
+        if (!m_writing && !m_replay.is_active() && !m_scheduler.empty())
+            flush_messages();
+    }
+
+    bool member::resume()
+    {
+        // "TOKEN RECEIVED", only the first frame of a connection resumes
+        std::string_view text = m_view.get_string();
+        std::size_t space = text.find(' ');
+        std::shared_ptr<member> previous;
+        std::uint64_t received = 0;
+        if (!m_announced && space != std::string_view::npos)
+        {
+            try
+            {
+                received = std::stoull(std::string(text.substr(space + 1)));
+            }
+            catch (std::exception&)
+            {
+                return false;
+            }
+            previous = m_group.find_session(std::string(text.substr(0, space)));
+        }
+        if (!previous || previous.get() == this || !previous->m_window.can_resume(received))
+        {
+            // An empty answer tells the client to start anew, it renegotiates
+            m_group.get_log().append_log("Session not resumed: " + m_address + ':' + std::to_string(m_port) + '\n');
+            send_message(message::message{message::MESSAGE_TYPE::SESSION, m_address, m_port, ""});
+            if (!m_announced)
+                announce();
+            return true;
+        }
+        m_group.replace_member(previous, shared_from_this());
+        adopt(*previous, received);
+        m_group.add_session(m_session, shared_from_this());
+        // Answered ahead of the frames sent again, the client then sends its own again
+        m_current = mux::scheduled_frame();
+        m_current.frame = message::message{message::MESSAGE_TYPE::SESSION, m_address, m_port, m_session + ' ' + std::to_string(m_window.get_received())};
+        m_writing = true;
+        m_last_write = std::chrono::steady_clock::now();
+        pace_write(m_current.frame.get_raw_message().size(), [this]() { write_current(); });
+        return true;
+    }
+
+    void member::adopt(member& previous, std::uint64_t received)
+    {
+        // Whatever was queued here while the resume was pending was queued for the previous connection too
+        m_queue_depth->add(-static_cast<std::int64_t>(m_queued));
+        m_group.get_metrics().queued_frames->add(-static_cast<std::int64_t>(m_queued));
+        // The frame the previous connection was writing is sent again, its message counts as written
+        if (previous.m_writing)
+        {
+            if (previous.m_current.last)
+            {
+                previous.m_queue_depth->add(-1);
+                m_group.get_metrics().queued_frames->add(-1);
+                previous.m_queued--;
+                previous.m_memory.dequeue(previous.m_current.queued_len);
+            }
+            previous.retain(std::move(previous.m_current));
+            previous.m_current = mux::scheduled_frame();
+            previous.m_writing = false;
+        }
+        m_address = previous.m_address;
+        m_port = previous.m_port;
+        m_bytes_in = previous.m_bytes_in;
+        m_frames_in = previous.m_frames_in;
+        m_bytes_out = previous.m_bytes_out;
+        m_frames_out = previous.m_frames_out;
+        m_queue_depth = previous.m_queue_depth;
+        m_scheduler = std::move(previous.m_scheduler);
+        m_queued = previous.m_queued;
+        m_memory.take_queue(previous.m_memory);
+        previous.m_queued = 0;
+        m_incoming = std::move(previous.m_incoming);
+        m_multicast = previous.m_multicast;
+        m_direct = previous.m_direct;
+        m_offers.take_over(previous.m_offers);
+        m_repairs.take_over(previous.m_repairs);
+        m_checksums = previous.m_checksums;
+        m_replay.set_joined_sequence(previous.m_replay.get_joined_sequence());
+        m_session = std::move(previous.m_session);
+        previous.m_session.clear();
+        m_window = std::move(previous.m_window);
+        previous.m_window = session_window();
+        m_group.get_metrics().resent_frames->add(m_window.resume_from(received));
+        m_announced = true;
+    }
+
+    void member::acknowledge(std::uint64_t received)
+    {
+        m_window.acknowledge(received);
+        // Credit came back, frames held for it go now
+        if (m_stalled && m_window.has_credit())
+        {
+            m_stalled = false;
+            if (!m_writing && !m_replay.is_active() && !m_scheduler.empty())
+                flush_messages();
+        }
+    }
+
+    void member::send_ack()
+    {
+        send_message(message::message{message::MESSAGE_TYPE::ACK, m_address, m_port, std::to_string(m_window.take_ack())});
+    }
+
+    void member::retain(mux::scheduled_frame frame)
+    {
+        if (m_window.retain(std::move(frame)))
+            return;
+        m_group.get_log().append_log("Session ended: " + m_address + ':' + std::to_string(m_port) + ", " +
+            std::to_string(m_window.get_retained()) + " frames not acknowledged\n");
+        end_session();
+    }
+
+    void member::end_session()
+    {
+        if (m_session.empty())
+            return;
+        m_group.remove_session(m_session);
+        m_session.clear();
+        m_window.stop_retaining();
+    }
+
+    void member::relay(message::message& _message)
+    {
+        // Unix domain and shared memory clients only see "local:0" from their end, frames get the name the server gave them
+        std::string origin = m_address + ':' + std::to_string(m_port);
+        if (m_address == transport::LOCAL_ADDRESS && std::string_view(_message.get_origin()) != origin)
+        {
+            // Spooled contents were checksummed while received, reading them back here would stall the io thread
+            bool verified = true;
+            if (!_message.has_streamed_body())
+                verified = _message.set_origin(origin);
+            else if (m_spooled.stamp && m_spooled.verified.digest() == _message.get_checksum())
+                _message.set_origin(origin, m_spooled.stamped.digest());
+            else
+                verified = false;
+            if (!verified)
+            {
+                m_group.get_log().append_log("Bad checksum: " + origin + ", frame dropped\n");
+                return;
+            }
+        }
+        message::message fallback = _message;
+        if (_message.get_checksum_algorithm() != checksum::CRC32)
+        {
+            // Computed while spooling, with the stamped origin, the file is never read back
+            if (fallback.has_streamed_body())
+                fallback.set_checksum_algorithm(checksum::CRC32, m_spooled.fallback ? m_spooled.fallback_hasher.digest() : _message.get_checksum());
+            else
+                fallback.set_checksum_algorithm(checksum::CRC32);
+        }
+        if ((_message.get_flags() & message::FLAG_DIRECT) != 0)
+            relay_fetched(_message, fallback);
+        else
+            m_group.broadcast(_message, fallback, this);
+    }
+
+    void member::relay_fetched(message::message& _message, const message::message& fallback)
+    {
+        // A file nobody waits for anymore is dropped, its recipients left
+        std::vector<std::weak_ptr<member>> recipients = m_offers.take(_message.get_stream_id());
+        if (recipients.empty())
+            return;
+        message::message fetched = _message;
+        message::message fetched_fallback = fallback;
+        for (message::message* copy : {&fetched, &fetched_fallback})
+        {
+            copy->set_flags(copy->get_flags() & ~message::FLAG_DIRECT);
+            copy->set_stream_id(0);
+        }
+        m_group.get_log().append_log("Relaying offer: " + std::to_string(_message.get_stream_id()) + " from " + m_address + ':' + std::to_string(m_port) + '\n');
+        for (const std::weak_ptr<member>& weak_recipient : recipients)
+        {
+            std::shared_ptr<member> recipient = weak_recipient.lock();
+            if (!recipient)
+                continue;
+            recipient->send_message(recipient->accepts_checksum(_message.get_checksum_algorithm()) ? fetched : fetched_fallback);
+            m_group.get_metrics().direct_relays->add();
+        }
+    }
+
+    bool member::offer()
+    {
+        // "ID PORT", the address is the one the server sees
+        std::string_view text = m_view.get_string();
+        std::size_t space = text.find(' ');
+        if (!m_direct || space == std::string_view::npos)
+            return false;
+        unsigned long long offer_id;
+        unsigned long port;
+        try
+        {
+            offer_id = std::stoull(std::string(text.substr(0, space)));
+            port = std::stoul(std::string(text.substr(space + 1)));
+        }
+        catch (std::exception&)
+        {
+            return false;
+        }
+        if (offer_id == 0 || offer_id > UINT32_MAX || port == 0 || port > UINT16_MAX)
+            return false;
+        m_offers.add(static_cast<std::uint32_t>(offer_id));
+        m_group.offer(shared_from_this(), static_cast<std::uint32_t>(offer_id), static_cast<std::uint16_t>(port));
+        return true;
+    }
+
+    bool member::fetch()
+    {
+        // "ID ORIGIN" of an OFFER the member could not fetch directly, its sender may have left meanwhile
+        std::string_view text = m_view.get_string();
+        std::size_t space = text.find(' ');
+        if (space == std::string_view::npos)
+            return false;
+        unsigned long long offer_id;
+        try
+        {
+            offer_id = std::stoull(std::string(text.substr(0, space)));
+        }
+        catch (std::exception&)
+        {
+            return false;
+        }
+        if (offer_id == 0 || offer_id > UINT32_MAX)
+            return false;
+        std::shared_ptr<member> sender = m_group.find_member(text.substr(space + 1));
+        if (sender && sender.get() != this)
+            sender->request_fetch(static_cast<std::uint32_t>(offer_id), shared_from_this());
+        return true;
+    }
+
+    void member::request_fetch(std::uint32_t offer_id, std::shared_ptr<member> recipient)
+    {
+        if (m_offers.wait(offer_id, recipient))
+            send_message(message::message{message::MESSAGE_TYPE::FETCH, m_address, m_port, std::to_string(offer_id)});
+    }
+
+    bool member::open_stream()
+    {
+        std::uint32_t stream_id = m_view.get_stream_id();
+        if (m_view.is_multicast() || m_incoming.size() >= mux::MAX_STREAMS || m_incoming.count(stream_id) != 0)
+            return false;
+        // Spooled like a streamed body, chunks of other streams and other frames come in between
+        incoming_stream& stream = m_incoming[stream_id];
+        std::string spool_path = (std::filesystem::temp_directory_path() / ("scft-spool-" + std::to_string(spool_count++) + ".part")).string();
+        stream.announce = m_message;
+        stream.spool = std::make_shared<message::payload_file>(spool_path, m_view.get_file_buffer_len(), true);
+        stream.out.open(spool_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        stream.checksums = start_checksums(0);
+        return static_cast<bool>(stream.out);
+    }
+
+    bool member::append_stream()
+    {
+        std::map<std::uint32_t, incoming_stream>::iterator found = m_incoming.find(m_view.get_stream_id());
+        if (found == m_incoming.end())
+            return false;
+        incoming_stream& stream = found->second;
+        message::byte_span contents = m_view.get_file_buffer();
+        if (stream.received + contents.size > stream.spool->get_length())
+            return false;
+        stream.out.write(reinterpret_cast<const char*>(contents.data), contents.size);
+        if (!stream.out)
+            return false;
+        update_checksums(stream.checksums, contents.data, contents.size);
+        stream.received += contents.size;
+        if (stream.received < stream.spool->get_length())
+            return true;
+
+        stream.out.close();
+        message::message complete = stream.announce;
+        complete.set_flags(complete.get_flags() & ~message::FLAG_CHUNKED);
+        complete.set_stream_id(0);
+        complete.set_payload_file(stream.spool);
+        m_spooled = std::move(stream.checksums);
+        m_incoming.erase(found);
+        relay(complete);
+        return true;
+    }
+
+    bool member::request_repair()
+    {
+        if (!m_repairs.request(m_view.get_string()))
+            return false;
+        queue_repair();
+        return true;
+    }
+
+    void member::queue_repair()
+    {
+        message::message frame;
+        if (m_repairs.take(frame))
+            send_message(std::move(frame));
+    }
+
+    void member::negotiate()
+    {
+        // Names are the client's in order of preference, unknown ones come from newer clients
+        std::uint32_t offered = 0;
+        bool found = false;
+        checksum::ALGORITHM chosen = checksum::CRC32;
+        bool streams = false;
+        bool joined = false;
+        bool direct = false;
+        bool session = false;
+        std::uint64_t window = 0;
+        std::string_view names = m_view.get_string();
+        std::size_t begin = 0;
+        while (begin <= names.size())
+        {
+            std::size_t end = std::min(names.find(',', begin), names.size());
+            checksum::ALGORITHM algorithm;
+            if (names.substr(begin, end - begin) == "streams")
+                streams = true;
+            else if (names.substr(begin, end - begin) == "multicast")
+                joined = m_group.get_multicast() != nullptr;
+            else if (names.substr(begin, end - begin) == "direct")
+                direct = m_group.get_direct();
+            else if (names.substr(begin, end - begin) == "session")
+                session = m_group.get_session_grace().count() != 0;
+            else if (names.substr(begin, 7) == "window=" && end > begin + 7)
+            {
+                try
+                {
+                    window = std::max<std::uint64_t>(std::stoull(std::string(names.substr(begin + 7, end - begin - 7))), message::MIN_RECEIVE_WINDOW);
+                }
+                catch (std::exception&)
+                {
+                }
+            }
+            else if (checksum::parse_name(std::string(names.substr(begin, end - begin)), algorithm))
+            {
+                if (!found && (m_group.get_checksums() & checksum::bit(algorithm)) != 0)
+                {
+                    found = true;
+                    chosen = algorithm;
+                }
+                offered |= checksum::bit(algorithm);
+            }
+            begin = end + 1;
+        }
+        m_checksums = offered | checksum::bit(checksum::CRC32);
+        // Files queued from now on are chunked, the answer goes out on the control lane ahead of them
+        m_scheduler.set_chunking(streams);
+        // Files broadcast from now on are announced only, the answer tells the member which group to join
+        m_multicast = joined;
+        m_direct = direct;
+        if (session && m_session.empty())
+        {
+            m_session = make_token();
+            m_window.start_retaining();
+            m_group.add_session(m_session, shared_from_this());
+        }
+        // Credit is counted from the frames taken after the answer
+        m_window.set_window(window);
+        m_group.get_log().append_log("Checksum: " + m_address + ':' + std::to_string(m_port) + ", " + checksum::get_name(chosen) +
+            (streams ? ", streams" : "") + (joined ? ", multicast" : "") + (direct ? ", direct" : "") + (session ? ", session" : "")
+            + (window != 0 ? ", window " + std::to_string(window) + '\n' : "\n"));
+        send_message(message::message{message::MESSAGE_TYPE::NEGOTIATE, m_address, m_port,
+            std::string(checksum::get_name(chosen)) + (streams ? ",streams" : "")
+            + (joined ? ",multicast=" + m_group.get_multicast()->get_group() : "") + (direct ? ",direct" : "")
+            + (session ? ",session=" + m_session : "") + (window != 0 ? ",window" : "")});
+        if (m_stalled)
+        {
+            m_stalled = false;
+            if (!m_writing && !m_replay.is_active() && !m_scheduler.empty())
+                flush_messages();
+        }
+    }
+
+    void member::request_history()
+    {
+        history* _history = m_group.get_history();
+        if (_history == nullptr || m_replay.is_active())
+            return;
+        std::size_t count = m_replay.request(*_history, m_view.get_string());
+        if (count == 0)
+            return;
+        m_group.get_log().append_log("Replaying: " + m_address + ':' + std::to_string(m_port) + ", " + std::to_string(count) + " frames\n");
+        if (!m_writing)
+            write_replay();
+    }
+
+    void member::write_replay()
+    {
+        // A gathered write per batch, straight from the mapped segments
+        std::vector<boost::asio::const_buffer> batch = m_replay.take_batch();
+        std::size_t count = batch.size();
+        pace_write(boost::asio::buffer_size(batch),
+            [this, batch = std::move(batch), count]()
+            {
+                boost::asio::async_write(m_socket, batch,
+                    [this, self = shared_from_this(), count](boost::system::error_code ec, std::size_t length)
+                    {
+                        if (ec)
+                        {
+                            m_group.remove_member(self);
+                            return;
+                        }
+                        server_metrics& _metrics = m_group.get_metrics();
+                        m_frames_out->add(count);
+                        m_bytes_out->add(length);
+                        _metrics.frames_out->add(count);
+                        _metrics.bytes_out->add(length);
+                        m_last_write = std::chrono::steady_clock::now();
+                        if (!m_replay.is_done())
+                        {
+                            write_replay();
+                            return;
+                        }
+                        m_replay.finish();
+                        if (!m_scheduler.empty())
+                            flush_messages();
+                    });
+            });
+    }
+
+    void member::pace_read(std::uint64_t bytes, std::function<void()> resume)
+    {
+        // The pacer goes with the member, a pending wakeup never outlives it
+        m_pacer.read(bytes,
+            [this, resume = std::move(resume)]()
+            {
+                if (!m_socket.is_open())
+                    return;
+                m_last_read = std::chrono::steady_clock::now();
+                resume();
+            });
+    }
+
+    void member::pace_write(std::uint64_t bytes, std::function<void()> resume)
+    {
+        m_pacer.write(bytes,
+            [this, resume = std::move(resume)]()
+            {
+                if (!m_socket.is_open())
+                    return false;
+                resume();
+                return true;
+            });
     }
 
     void member::send_message(message::message _message)
     {
-        bool send_in_progress = !m_messages.empty();
-        m_messages.push_back(_message);
+        bool send_in_progress = m_writing || m_replay.is_active();
+        if (!send_in_progress)
+            m_last_write = std::chrono::steady_clock::now();
+        std::uint64_t buffered = _message.get_raw_message().size();
+        m_scheduler.push(std::move(_message));
+        m_queued++;
+        m_memory.queue(buffered);
+        m_queue_depth->add(1);
+        m_group.get_metrics().queued_frames->add(1);
         if (!send_in_progress)
         {
             flush_messages();
         }
     }
 
+    void member::send_multicast(message::message announce, std::uint32_t transfer_id, std::shared_ptr<message::payload_file> contents)
+    {
+        m_repairs.keep(transfer_id, std::move(contents));
+        send_message(std::move(announce));
+    }
+
+    void member::end_multicast(std::uint32_t transfer_id)
+    {
+        send_message(message::message{message::MESSAGE_TYPE::MULTICAST_END, m_address, m_port, std::to_string(transfer_id)});
+    }
+
     void member::flush_messages()
     {
-        boost::asio::async_write(m_socket,  boost::asio::buffer(m_messages.front().get_raw_message(), m_messages.front().get_raw_message().size()),
-            [this](boost::system::error_code ec, std::size_t)
+        // Held until the member is known not to resume a session, or while it lingers
+        if (!m_announced || !m_socket.is_open())
+            return;
+        try
+        {
+            // Unacknowledged frames of a resumed session go first, in sequence
+            if (!m_window.take_resend(m_current))
             {
-                if (!ec)
+                if (m_scheduler.empty())
+                    return;
+                // The client takes no more than its window, the queue waits for its ACK
+                if (!m_window.has_credit())
                 {
-                    m_messages.pop_front();
-                    if (!m_messages.empty())
-                    {
-                        flush_messages();
-                    }
+                    if (!m_stalled)
+                        m_group.get_metrics().credit_stalls->add();
+                    m_stalled = true;
+                    return;
+                }
+                m_current = m_scheduler.take();
+                m_window.number(m_current);
+            }
+            // Frames received since the last ACK are acknowledged in the same write
+            if (m_window.has_ack())
+            {
+                m_piggyback = message::message{message::MESSAGE_TYPE::ACK, m_address, m_port, std::to_string(m_window.take_ack())};
+                m_piggybacked = true;
+            }
+        }
+        catch (std::exception& e)
+        {
+            m_group.get_log().append_log("Send failed: " + m_address + ':' + std::to_string(m_port) + ", " + e.what());
+            refuse();
+            return;
+        }
+        m_writing = true;
+        if (m_current.first)
+        {
+            m_write_started = std::chrono::steady_clock::now();
+            m_group.get_metrics().queue_wait->record(std::chrono::duration_cast<std::chrono::nanoseconds>(m_write_started - m_current.queued_at).count());
+        }
+        pace_write(m_current.frame.get_raw_message().size() + (m_piggybacked ? m_piggyback.get_raw_message().size() : 0), [this]() { write_current(); });
+    }
+
+    void member::write_current()
+    {
+        std::array<boost::asio::const_buffer, 2> buffers{
+            boost::asio::buffer(m_piggyback.get_raw_message(), m_piggybacked ? m_piggyback.get_raw_message().size() : 0),
+            boost::asio::buffer(m_current.frame.get_raw_message(), m_current.frame.get_raw_message().size())};
+        boost::asio::async_write(m_socket, buffers,
+            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (ec)
+                {
+                    m_group.remove_member(self);
+                }
+                else if (m_current.frame.get_payload_file())
+                {
+                    std::shared_ptr<transfer::file_sender> sender = std::make_shared<transfer::file_sender>(
+                        m_socket, m_current.frame.get_payload_file(),
+                        [this, self](boost::system::error_code ec)
+                        {
+                            if (!ec)
+                                message_flushed();
+                            else
+                                m_group.remove_member(self);
+                        });
+                    sender->set_progress_handler([this](std::size_t) { m_last_write = std::chrono::steady_clock::now(); });
+                    sender->set_pace_handler([this](std::size_t length, std::function<void()> resume) { pace_write(length, std::move(resume)); });
+                    sender->start();
                 }
                 else
                 {
-                    m_group.remove_member(shared_from_this());
+                    message_flushed();
                 }
             });
     }
 
+    void member::message_flushed()
+    {
+        server_metrics& _metrics = m_group.get_metrics();
+        std::uint64_t length = m_current.frame.get_raw_message().size();
+        if (m_current.frame.get_payload_file())
+            length += m_current.frame.get_payload_file()->get_length();
+        m_frames_out->add();
+        m_bytes_out->add(length);
+        _metrics.frames_out->add();
+        _metrics.bytes_out->add(length);
+        if (m_current.last)
+        {
+            _metrics.write->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_write_started).count());
+            m_queue_depth->add(-1);
+            _metrics.queued_frames->add(-1);
+            m_queued--;
+            m_memory.dequeue(m_current.queued_len);
+        }
+        bool repaired = m_current.frame.get_message_type() == message::MESSAGE_TYPE::REPAIR;
+        m_piggybacked = false;
+        retain(std::move(m_current));
+        m_current = mux::scheduled_frame();
+        m_writing = false;
+        m_last_write = std::chrono::steady_clock::now();
+        if (repaired)
+        {
+            m_repairs.written();
+            queue_repair();
+        }
+        if (m_replay.is_active())
+        {
+            write_replay();
+        }
+        else if (!m_writing && (!m_scheduler.empty() || m_window.has_resend()))
+        {
+            flush_messages();
+        }
+    }
+
     std::string member::get_address()
     {
-        return m_socket.remote_endpoint().address().to_string();
+        return m_address;
     }
 
     std::uint16_t member::get_port()
     {
-        return m_socket.remote_endpoint().port();
+        return m_port;
     }
     }
 }
\ No newline at end of file
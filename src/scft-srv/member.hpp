@@ -6,11 +6,26 @@
  * @brief Defines member class, contained in the room
 */
 
+#include "bandwidth.hpp"
+#include "frame_scheduler.hpp"
+#include "history.hpp"
+#include "memory_budget.hpp"
+#include "message_view.hpp"
+#include "metrics.hpp"
+#include "multicast.hpp"
+#include "offer_book.hpp"
 #include "scft_message.hpp"
+#include "repair_queue.hpp"
 #include "room.hpp"
+#include "session_window.hpp"
+#include "transport.hpp"
 
 #include <boost/asio.hpp>
+#include <chrono>
 #include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
 
 namespace scft
 {
@@ -18,17 +33,94 @@ namespace scft
     {
         class room;
 
+        /**
+         * @brief Bytes read with a spilled version 1 file, its name has to end within them
+        */
+        constexpr std::size_t SPILL_NAME_PREFIX = 4096;
+
+        /**
+         * @brief Receive buffers above this are freed after their frame instead of reused
+        */
+        constexpr std::size_t RECEIVE_BUFFER_KEEP = 65536;
+
+        /**
+         * @brief While sessions exist, frames for a new member wait this long for a SESSION resuming one, or any other first frame
+        */
+        constexpr std::chrono::milliseconds HELLO_WINDOW{250};
+
+        /**
+         * @brief Checksums a spooled frame is relayed with, computed while receiving so its file is never read back
+        */
+        struct spool_checksums
+        {
+            bool stamp = false;                                 //!< The origin is replaced by the member's name
+            checksum::hasher verified;                          //!< Sender's algorithm over the frame as sent, when stamping
+            checksum::hasher stamped;                           //!< Sender's algorithm over the frame with the new origin, when stamping
+            bool fallback = false;                              //!< A CRC32 copy is needed
+            checksum::hasher fallback_hasher;                   //!< CRC32 of the frame as relayed, when a copy is needed
+        };
+
+        /**
+         * @brief Chunked file being received, spooled until complete
+        */
+        struct incoming_stream
+        {
+            message::message announce;                          //!< WRITE_FILE flagged FLAG_CHUNKED
+            std::shared_ptr<message::payload_file> spool;       //!< Spool file
+            std::ofstream out;                                  //!< Spool file being written
+            spool_checksums checksums;                          //!< Checksums of the data
+            std::uint64_t received = 0;                         //!< Contents received
+        };
+
         /**
          * @brief Room member
         */
         class member : public std::enable_shared_from_this<member>
         {
             /**
-             * @brief Starts checking for message
+             * @brief Remember remote endpoint
              * @param _socket Member socket
              * @param group Room in which the member belongs
             */
-            public: member(boost::asio::ip::tcp::socket _socket, room& group);
+            public: member(transport::stream _socket, room& group);
+
+            /**
+             * @brief Starts checking for message, call once owned by a shared_ptr
+            */
+            public: void start();
+
+            /**
+             * @brief Close socket, pending operations complete with an error
+            */
+            public: void close();
+
+            /**
+             * @brief Keep the member, its queue and session for the grace period instead of removing it
+             * @return True while it lingers, false to remove it now
+            */
+            public: bool linger();
+
+            /**
+             * @brief Session token
+             * @return Token, empty without a session
+            */
+            public: const std::string& get_session() const { return m_session; }
+
+            /**
+             * @brief Check if the room was told the member joined
+             * @return False during the hello window of a member that may resume a session
+            */
+            public: bool is_announced() const { return m_announced; }
+
+            /**
+             * @brief Arm the timer wheel for the earliest possible idle expiry
+            */
+            private: void schedule_idle_check();
+
+            /**
+             * @brief Reap the member if idle, otherwise check again later
+            */
+            private: void check_idle();
 
             /**
              * @brief Default destructor
@@ -40,10 +132,170 @@ namespace scft
             */
             private: void header_reader();
 
+            /**
+             * @brief Check for the rest of a version 2 header
+            */
+            private: void header_extension_reader();
+
+            /**
+             * @brief Reserve memory for the frame whose header was read, or wait for it
+             * @param spill Spool the file contents
+            */
+            private: void admit_frame(bool spill);
+
+            /**
+             * @brief Read the admitted frame
+             * @param spill Spool the file contents
+            */
+            private: void read_frame(bool spill);
+
+            /**
+             * @brief Give back the memory of the frame just handled
+            */
+            private: void release_frame();
+
             /**
              * @brief Read message reader from client
+             * @param done Bytes of the buffered data already read
+            */
+            private: void data_buffer_reader(std::size_t done);
+
+            /**
+             * @brief Read the origin and file name of a file above the spill threshold, its contents go to disk
+            */
+            private: void spill_reader();
+
+            /**
+             * @brief Spool streamed or spilled file contents to a temporary file
+            */
+            private: void body_reader();
+
+            /**
+             * @brief Start the checksums of a spooled frame, with its buffered data
+             * @param stored Contents already read after the buffered data
+             * @return Checksums
+            */
+            private: spool_checksums start_checksums(std::size_t stored);
+
+            /**
+             * @brief Add spooled contents to the checksums
+             * @param checksums Checksums
+             * @param data Contents
+             * @param size Contents size
             */
-            private: void data_buffer_reader();
+            private: static void update_checksums(spool_checksums& checksums, const std::uint8_t* data, std::size_t size);
+
+            /**
+             * @brief Answer or broadcast a completely read message
+            */
+            private: void on_frame();
+
+            /**
+             * @brief Remove the member for a protocol error, its session ends, a resume would repeat the error
+            */
+            private: void refuse();
+
+            /**
+             * @brief Let the room know the member joined, frames then flow
+            */
+            private: void announce();
+
+            /**
+             * @brief Take over the session a SESSION names, or start anew if it is gone
+             * @return False on a protocol error
+            */
+            private: bool resume();
+
+            /**
+             * @brief Take the queue, streams, offers and unacknowledged frames of the previous connection of a session
+             * @param previous Member that held the session
+             * @param received Sequence number of the last frame the client got
+            */
+            private: void adopt(member& previous, std::uint64_t received);
+
+            /**
+             * @brief Forget frames the client acknowledged, frames held for credit then go
+             * @param received Sequence number of the last frame the client got
+            */
+            private: void acknowledge(std::uint64_t received);
+
+            /**
+             * @brief Queue an ACK for the frames received so far
+            */
+            private: void send_ack();
+
+            /**
+             * @brief Keep a written frame until the client acknowledges it, the session ends if too much is kept
+             * @param frame Frame, ignored unless sequenced and new
+            */
+            private: void retain(mux::scheduled_frame frame);
+
+            /**
+             * @brief Stop keeping frames and forget the session, a reconnection starts anew
+            */
+            private: void end_session();
+
+            /**
+             * @brief Broadcast a TEXT or complete WRITE_FILE, with a CRC32 fallback if needed
+             * @param _message Message, streamed contents in its payload_file
+            */
+            private: void relay(message::message& _message);
+
+            /**
+             * @brief Start spooling a chunked WRITE_FILE
+             * @return False on a protocol error
+            */
+            private: bool open_stream();
+
+            /**
+             * @brief Spool a CHUNK, broadcast its file once complete
+             * @return False on a protocol error
+            */
+            private: bool append_stream();
+
+            /**
+             * @brief Send a WRITE_FILE flagged FLAG_DIRECT to the members that fetched its offer through the server
+             * @param _message Message
+             * @param fallback Same message checksummed with CRC32
+            */
+            private: void relay_fetched(message::message& _message, const message::message& fallback);
+
+            /**
+             * @brief Broker an OFFER
+             * @return False on a protocol error
+            */
+            private: bool offer();
+
+            /**
+             * @brief Forward a FETCH to the sender of its offer
+             * @return False on a protocol error
+            */
+            private: bool fetch();
+
+            /**
+             * @brief Queue the contents a NACK asks for
+             * @return False on a protocol error
+            */
+            private: bool request_repair();
+
+            /**
+             * @brief Queue the next REPAIR frame unless one is queued
+            */
+            private: void queue_repair();
+
+            /**
+             * @brief Charge read bytes to the member and room ingress, then continue reading once their debt is paid
+             * @param bytes Bytes read or about to be read
+             * @param resume Continues reading
+            */
+            private: void pace_read(std::uint64_t bytes, std::function<void()> resume);
+
+            /**
+             * @brief Charge bytes about to be written to the member egress, then wait for a turn at the room egress
+             * @param bytes Bytes written or about to be written
+             * @param resume Continues writing
+            */
+            private: void pace_write(std::uint64_t bytes, std::function<void()> resume);
 
             /**
              * @brief Send message to client
@@ -51,11 +303,54 @@ namespace scft
             */
             public: void send_message(message::message _message);
 
+            /**
+             * @brief Send the announce of a multicast file, its contents are kept for repairs until the member's NACK
+             * @param announce WRITE_FILE flagged FLAG_MULTICAST
+             * @param transfer_id Multicast transfer
+             * @param contents File contents
+            */
+            public: void send_multicast(message::message announce, std::uint32_t transfer_id, std::shared_ptr<message::payload_file> contents);
+
+            /**
+             * @brief Tell the member every datagram of a transfer was sent
+             * @param transfer_id Multicast transfer
+            */
+            public: void end_multicast(std::uint32_t transfer_id);
+
+            /**
+             * @brief Check if the member receives multicast files
+             * @return True once negotiated
+            */
+            public: bool takes_multicast() const { return m_multicast; }
+
+            /**
+             * @brief Check if the member fetches offered files from their sender
+             * @return True once negotiated
+            */
+            public: bool takes_direct() const { return m_direct; }
+
+            /**
+             * @brief Have an offered file relayed to a member, the first one waiting asks the member for it
+             * @param offer_id Offer of this member, unknown ones are ignored
+             * @param recipient Member to relay it to
+            */
+            public: void request_fetch(std::uint32_t offer_id, std::shared_ptr<member> recipient);
+
             /**
              * @brief Flush message to client
             */
             private: void flush_messages();
 
+            /**
+             * @brief Write m_current once paced, then its payload file
+            */
+            private: void write_current();
+
+            /**
+             * @brief Account for the written front message and flush the next one
+            */
+            private: void message_flushed();
+
             /**
              * @brief Get remote address
              * @return Remote IPV4 String
@@ -69,9 +364,47 @@ namespace scft
             public: std::uint16_t get_port();
 
             /**
-             * @brief boost tcp socket
+             * @brief Check if the member verifies an algorithm
+             * @param algorithm Algorithm
+             * @return True for CRC32 and algorithms listed in its NEGOTIATE
+            */
+            public: bool accepts_checksum(checksum::ALGORITHM algorithm) const { return (m_checksums & checksum::bit(algorithm)) != 0; }
+
+            /**
+             * @brief Choose the checksum the member sends and remember those it verifies, whether it takes streams, multicast and offers
+            */
+            private: void negotiate();
+
+            /**
+             * @brief Remember where the history stood when the member joined, replays stop there
+             * @param sequence Sequence number of the first frame broadcast after joining
+            */
+            public: void set_joined_sequence(std::uint64_t sequence) { m_replay.set_joined_sequence(sequence); }
+
+            /**
+             * @brief Answer a HISTORY request, replayed frames go out at the next frame boundary
+            */
+            private: void request_history();
+
+            /**
+             * @brief Write the next batch of replayed frames
+            */
+            private: void write_replay();
+
+            /**
+             * @brief Connection, a socket or shared memory rings
+            */
+            transport::stream m_socket;
+
+            /**
+             * @brief Remote address, kept since remote_endpoint() fails once disconnected
             */
-            boost::asio::ip::tcp::socket m_socket;
+            std::string m_address;
+
+            /**
+             * @brief Remote port
+            */
+            std::uint16_t m_port;
 
             /**
              * @brief Current reading message
@@ -79,14 +412,169 @@ namespace scft
             message::message m_message;
 
             /**
-             * @brief Message queue
+             * @brief Segments of m_message, parsed once its buffered data is read
+            */
+            message::message_view m_view;
+
+            /**
+             * @brief Message queue, files are chunked once the member negotiated streams
+            */
+            mux::frame_scheduler m_scheduler;
+
+            /**
+             * @brief Frame being written
+            */
+            mux::scheduled_frame m_current;
+
+            /**
+             * @brief m_current is being written
+            */
+            bool m_writing;
+
+            /**
+             * @brief Messages queued and not completely written
+            */
+            std::size_t m_queued;
+
+            /**
+             * @brief Time the write of the first frame of the current message started
+            */
+            std::chrono::steady_clock::time_point m_write_started;
+
+            /**
+             * @brief Chunked files being received, by stream identifier
+            */
+            std::map<std::uint32_t, incoming_stream> m_incoming;
+
+            /**
+             * @brief Member joined the multicast group
+            */
+            bool m_multicast;
+
+            /**
+             * @brief Announced multicast files until the member's NACK, then the contents it missed
+            */
+            repair_queue m_repairs;
+
+            /**
+             * @brief Member offers files and fetches offered ones
+            */
+            bool m_direct;
+
+            /**
+             * @brief Offers of the member, and who waits for them to be relayed
+            */
+            offer_book m_offers;
+
+            /**
+             * @brief Last time bytes were read
+            */
+            std::chrono::steady_clock::time_point m_last_read;
+
+            /**
+             * @brief Last time bytes were written, or the queue became non empty
+            */
+            std::chrono::steady_clock::time_point m_last_write;
+
+            /**
+             * @brief Checksum algorithms the member verifies
+            */
+            std::uint32_t m_checksums;
+
+            /**
+             * @brief Checksums of the current streamed frame, computed while spooling
+            */
+            spool_checksums m_spooled;
+
+            /**
+             * @brief Memory reserved for the frame being read and queued messages
+            */
+            memory_share m_memory;
+
+            /**
+             * @brief Reading waits for memory, the read timeout does not apply
+            */
+            bool m_deferred;
+
+            /**
+             * @brief Member and room rates, reading waits for the ingress ones without the read timeout applying
+            */
+            pacer m_pacer;
+
+            /**
+             * @brief History frames the member asked for, active while waiting for the current message or being written, messages wait for it
+            */
+            history_cursor m_replay;
+
+            /**
+             * @brief The room was told the member joined, frames are written from then on
+            */
+            bool m_announced;
+
+            /**
+             * @brief Disconnected, kept for the grace period
+            */
+            bool m_lingering;
+
+            /**
+             * @brief Grace period over, removed for good
+            */
+            bool m_expired;
+
+            /**
+             * @brief Session token, empty without a session
+            */
+            std::string m_session;
+
+            /**
+             * @brief Sequence numbers, frames kept for the session and credit of the receive window
+            */
+            session_window m_window;
+
+            /**
+             * @brief Frames wait for an ACK, out of credit
+            */
+            bool m_stalled;
+
+            /**
+             * @brief ACK written ahead of m_current
+            */
+            message::message m_piggyback;
+
+            /**
+             * @brief m_piggyback goes with m_current
             */
-            std::deque<message::message> m_messages;
+            bool m_piggybacked;
 
             /**
              * @brief Room in which it is contained
             */
             room& m_group;
+
+            /**
+             * @brief Bytes received from this member
+            */
+            std::shared_ptr<metrics::local_counter> m_bytes_in;
+
+            /**
+             * @brief Frames received from this member
+            */
+            std::shared_ptr<metrics::local_counter> m_frames_in;
+
+            /**
+             * @brief Bytes sent to this member
+            */
+            std::shared_ptr<metrics::local_counter> m_bytes_out;
+
+            /**
+             * @brief Frames sent to this member
+            */
+            std::shared_ptr<metrics::local_counter> m_frames_out;
+
+            /**
+             * @brief Queued messages, readable from other threads
+            */
+            std::shared_ptr<metrics::gauge> m_queue_depth;
         };
     }
 }
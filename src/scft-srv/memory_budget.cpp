@@ -0,0 +1,150 @@
+#include "memory_budget.hpp"
+
+#include <algorithm>
+
+namespace scft
+{
+    namespace server
+    {
+    memory_budget::memory_budget(std::uint64_t limit, std::uint64_t text_limit, std::uint64_t file_limit, server_metrics& _metrics)
+    :
+    m_limit(limit),
+    m_text_limit(text_limit),
+    m_file_limit(file_limit == 0 ? message::MAX_STREAM_LENGTH : file_limit),
+    m_used(0),
+    m_metrics(_metrics)
+    {
+        m_metrics.memory_limit->set(static_cast<std::int64_t>(m_limit));
+    }
+
+    memory_budget::~memory_budget()
+    {
+    }
+
+    ADMISSION memory_budget::admit(message::MESSAGE_TYPE message_type, std::uint64_t data_len, std::uint64_t buffered)
+    {
+        std::uint64_t type_limit = CONTROL_LIMIT;
+        if (message_type == message::MESSAGE_TYPE::TEXT)
+            type_limit = m_text_limit;
+        else if (message_type == message::MESSAGE_TYPE::WRITE_FILE)
+            type_limit = m_file_limit;
+        else if (message_type == message::MESSAGE_TYPE::CHUNK)
+            type_limit = message::MAX_CHUNK_LENGTH + 1;
+        if (data_len > type_limit || buffered > m_limit)
+        {
+            m_metrics.frames_refused->add();
+            return REFUSED;
+        }
+        // Frames already waiting go first, a stream of small ones would otherwise starve a large one
+        if (!m_waiters.empty() || m_used + buffered > m_limit)
+        {
+            m_metrics.frames_deferred->add();
+            return DEFERRED;
+        }
+        reserve(buffered);
+        return ADMITTED;
+    }
+
+    void memory_budget::wait(std::uint64_t buffered, const memory_share* owner, waiter resume)
+    {
+        m_waiters.push_back(deferred{buffered, owner, std::move(resume)});
+        m_metrics.deferred_frames->add(1);
+    }
+
+    void memory_budget::cancel(const memory_share* owner)
+    {
+        std::size_t before = m_waiters.size();
+        m_waiters.erase(std::remove_if(m_waiters.begin(), m_waiters.end(), [owner](const deferred& waiting) { return waiting.owner == owner; }),
+            m_waiters.end());
+        if (m_waiters.size() == before)
+            return;
+        m_metrics.deferred_frames->add(-static_cast<std::int64_t>(before - m_waiters.size()));
+        wake();
+    }
+
+    void memory_budget::reserve(std::uint64_t bytes)
+    {
+        m_used += bytes;
+        m_metrics.memory_used->add(static_cast<std::int64_t>(bytes));
+    }
+
+    void memory_budget::release(std::uint64_t bytes)
+    {
+        m_used -= bytes;
+        m_metrics.memory_used->add(-static_cast<std::int64_t>(bytes));
+        wake();
+    }
+
+    void memory_budget::wake()
+    {
+        while (!m_waiters.empty() && m_used + m_waiters.front().buffered <= m_limit)
+        {
+            deferred next = std::move(m_waiters.front());
+            m_waiters.pop_front();
+            m_metrics.deferred_frames->add(-1);
+            reserve(next.buffered);
+            // Resuming only starts a read, it does not release memory before returning
+            if (!next.resume())
+            {
+                m_used -= next.buffered;
+                m_metrics.memory_used->add(-static_cast<std::int64_t>(next.buffered));
+            }
+        }
+    }
+
+    memory_share::memory_share(memory_budget& budget)
+    :
+    m_budget(budget),
+    m_frame(0),
+    m_queued(0)
+    {
+    }
+
+    memory_share::~memory_share()
+    {
+        m_budget.cancel(this);
+        m_budget.release(m_frame + m_queued);
+    }
+
+    void memory_share::wait(std::uint64_t bytes, memory_budget::waiter resume)
+    {
+        m_budget.wait(bytes, this, std::move(resume));
+    }
+
+    void memory_share::cancel_wait()
+    {
+        m_budget.cancel(this);
+    }
+
+    void memory_share::grow_frame(std::uint64_t bytes)
+    {
+        m_budget.reserve(bytes);
+        m_frame += bytes;
+    }
+
+    void memory_share::release_frame()
+    {
+        m_budget.release(m_frame);
+        m_frame = 0;
+    }
+
+    void memory_share::queue(std::uint64_t bytes)
+    {
+        m_budget.reserve(bytes);
+        m_queued += bytes;
+    }
+
+    void memory_share::dequeue(std::uint64_t bytes)
+    {
+        m_budget.release(bytes);
+        m_queued -= bytes;
+    }
+
+    void memory_share::take_queue(memory_share& previous)
+    {
+        m_budget.release(m_queued);
+        m_queued = previous.m_queued;
+        previous.m_queued = 0;
+    }
+    }
+}
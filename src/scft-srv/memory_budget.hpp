@@ -0,0 +1,236 @@
+#ifndef MEMORY_BUDGET_HPP
+#define MEMORY_BUDGET_HPP
+
+/**
+ * @file src/scft-srv/memory_budget.hpp
+ * @brief Defines memory_budget and memory_share classes, admitting received frames against the memory every member holds
+*/
+
+#include "scft_message.hpp"
+#include "server_metrics.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace scft
+{
+    namespace server
+    {
+        class memory_share;
+
+        /**
+         * @brief Data length limit of PING, HEARTBEAT, NEGOTIATE and HISTORY frames
+        */
+        constexpr std::uint64_t CONTROL_LIMIT = 4096;
+
+        /**
+         * @brief What to do with a received header
+        */
+        typedef enum _ADMISSION : std::uint8_t
+        {
+            ADMITTED = 0,   //!< Memory reserved, read the frame
+            DEFERRED = 1,   //!< Does not fit now, stop reading until memory is released
+            REFUSED = 2     //!< Above its type limit or the whole budget, drop the member
+        }ADMISSION;
+
+        /**
+         * @brief Server wide accountant of receive buffers and send queues, not thread safe, use it from the io thread
+        */
+        class memory_budget
+        {
+            /**
+             * @brief Resumes a deferred frame once its memory is reserved
+             * @return False if nobody wants it anymore, the reservation is then released
+            */
+            public: typedef std::function<bool()> waiter;
+
+            /**
+             * @brief Set limits
+             * @param limit Bytes members may hold together
+             * @param text_limit Data length limit of TEXT frames
+             * @param file_limit Data length limit of WRITE_FILE frames, 0 for the protocol limits
+             * @param _metrics Server wide metrics
+            */
+            public: memory_budget(std::uint64_t limit, std::uint64_t text_limit, std::uint64_t file_limit, server_metrics& _metrics);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~memory_budget();
+
+            /**
+             * @brief Check a received header, reserving its buffers if admitted
+             * @param message_type Frame type
+             * @param data_len Data length announced by the header
+             * @param buffered Bytes held while the frame is read and relayed
+             * @return Admission, DEFERRED frames go through wait()
+            */
+            public: ADMISSION admit(message::MESSAGE_TYPE message_type, std::uint64_t data_len, std::uint64_t buffered);
+
+            /**
+             * @brief Queue a deferred frame, resumed in order once its bytes fit
+             * @param buffered Bytes to reserve
+             * @param owner Share the frame is read for
+             * @param resume Called with the bytes reserved
+            */
+            public: void wait(std::uint64_t buffered, const memory_share* owner, waiter resume);
+
+            /**
+             * @brief Forget the deferred frames of a share, so a gone member does not hold up those behind it
+             * @param owner Share
+            */
+            public: void cancel(const memory_share* owner);
+
+            /**
+             * @brief Account for memory that can not be deferred, like send queues
+             * @param bytes Bytes
+            */
+            public: void reserve(std::uint64_t bytes);
+
+            /**
+             * @brief Give back reserved memory and resume deferred frames that fit
+             * @param bytes Bytes
+            */
+            public: void release(std::uint64_t bytes);
+
+            /**
+             * @brief Bytes reserved
+             * @return Bytes
+            */
+            public: std::uint64_t get_used() const { return m_used; }
+
+            /**
+             * @brief Budget
+             * @return Bytes
+            */
+            public: std::uint64_t get_limit() const { return m_limit; }
+
+            /**
+             * @brief Deferred frame
+            */
+            private: struct deferred
+            {
+                std::uint64_t buffered;     //!< Bytes to reserve
+                const memory_share* owner;  //!< Share the frame is read for
+                waiter resume;              //!< Resume reading
+            };
+
+            /**
+             * @brief Resume deferred frames in order while they fit
+            */
+            private: void wake();
+
+            /**
+             * @brief Bytes members may hold together
+            */
+            private: std::uint64_t m_limit;
+
+            /**
+             * @brief TEXT data length limit
+            */
+            private: std::uint64_t m_text_limit;
+
+            /**
+             * @brief WRITE_FILE data length limit
+            */
+            private: std::uint64_t m_file_limit;
+
+            /**
+             * @brief Bytes reserved
+            */
+            private: std::uint64_t m_used;
+
+            /**
+             * @brief Deferred frames, oldest first
+            */
+            private: std::deque<deferred> m_waiters;
+
+            /**
+             * @brief Server wide metrics
+            */
+            private: server_metrics& m_metrics;
+        };
+
+        /**
+         * @brief Memory one member holds in a memory_budget, given back when destroyed
+        */
+        class memory_share
+        {
+            /**
+             * @brief Hold nothing
+             * @param budget Server wide budget
+            */
+            public: memory_share(memory_budget& budget);
+
+            /**
+             * @brief Release everything held
+            */
+            public: ~memory_share();
+
+            /**
+             * @brief Account for the bytes the budget admitted for the frame being read
+             * @param bytes Bytes already reserved by admit() or wait()
+            */
+            public: void hold_frame(std::uint64_t bytes) { m_frame += bytes; }
+
+            /**
+             * @brief Wait until the budget fits a deferred frame
+             * @param bytes Bytes to reserve
+             * @param resume Called with the bytes reserved, hold_frame() them
+            */
+            public: void wait(std::uint64_t bytes, memory_budget::waiter resume);
+
+            /**
+             * @brief Give up waiting, when the member goes
+            */
+            public: void cancel_wait();
+
+            /**
+             * @brief Reserve more for the frame being read
+             * @param bytes Bytes
+            */
+            public: void grow_frame(std::uint64_t bytes);
+
+            /**
+             * @brief Release the frame just handled
+            */
+            public: void release_frame();
+
+            /**
+             * @brief Reserve a queued message
+             * @param bytes Its buffer length
+            */
+            public: void queue(std::uint64_t bytes);
+
+            /**
+             * @brief Release a written message
+             * @param bytes Its buffer length
+            */
+            public: void dequeue(std::uint64_t bytes);
+
+            /**
+             * @brief Take over the queue of another share, releasing this one's
+             * @param previous Share whose queue is taken, left without one
+            */
+            public: void take_queue(memory_share& previous);
+
+            /**
+             * @brief Server wide budget
+            */
+            private: memory_budget& m_budget;
+
+            /**
+             * @brief Bytes reserved for the frame being read
+            */
+            private: std::uint64_t m_frame;
+
+            /**
+             * @brief Bytes reserved for queued messages
+            */
+            private: std::uint64_t m_queued;
+        };
+    }
+}
+
+#endif /* MEMORY_BUDGET_HPP */
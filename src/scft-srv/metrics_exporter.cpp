@@ -0,0 +1,109 @@
+#include "metrics_exporter.hpp"
+
+#include <istream>
+
+using boost::asio::ip::tcp;
+
+namespace scft
+{
+    namespace server
+    {
+    metrics_exporter::metrics_exporter(
+        boost::asio::io_context& io_ctx,
+        const std::string& address,
+        std::uint16_t port,
+        metrics::registry& _registry,
+        basic_shell::scrolling_log& _log)
+    :
+    m_acceptor(io_ctx, tcp::endpoint(boost::asio::ip::make_address(address), port)),
+    m_registry(_registry),
+    m_log(_log)
+    {
+        m_log.append_log("Metrics on " + address + ':' + std::to_string(m_acceptor.local_endpoint().port()) + "/metrics\n");
+        accepter();
+    }
+
+    metrics_exporter::~metrics_exporter()
+    {
+    }
+
+    void metrics_exporter::stop()
+    {
+        boost::system::error_code ec;
+        m_acceptor.close(ec);
+    }
+
+    void metrics_exporter::accepter()
+    {
+        m_acceptor.async_accept(
+            [this](boost::system::error_code ec, tcp::socket _socket)
+            {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+                if (!ec)
+                    std::make_shared<metrics_session>(std::move(_socket), m_registry)->start();
+                accepter();
+            });
+    }
+
+    metrics_session::metrics_session(tcp::socket _socket, metrics::registry& _registry)
+    :
+    m_socket(std::move(_socket)),
+    m_request(MAX_HTTP_REQUEST_SIZE),
+    m_registry(_registry)
+    {
+    }
+
+    metrics_session::~metrics_session()
+    {
+    }
+
+    void metrics_session::start()
+    {
+        boost::asio::async_read_until(m_socket, m_request, "\r\n\r\n",
+            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t)
+            {
+                if (ec)
+                    return;
+                respond();
+                boost::asio::async_write(m_socket, boost::asio::buffer(m_response),
+                    [this, self](boost::system::error_code, std::size_t)
+                    {
+                        boost::system::error_code close_ec;
+                        m_socket.shutdown(tcp::socket::shutdown_both, close_ec);
+                        m_socket.close(close_ec);
+                    });
+            });
+    }
+
+    void metrics_session::respond()
+    {
+        std::istream request(&m_request);
+        std::string method;
+        std::string target;
+        request >> method >> target;
+
+        std::string status = "200 OK";
+        std::string body;
+        if (method != "GET")
+        {
+            status = "405 Method Not Allowed";
+            body = "Only GET is supported\n";
+        }
+        else if (target != "/metrics" && target != "/")
+        {
+            status = "404 Not Found";
+            body = "Metrics are served on /metrics\n";
+        }
+        else
+            body = m_registry.render_prometheus();
+
+        m_response =
+            "HTTP/1.0 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n"
+            "\r\n" + body;
+    }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef METRICS_EXPORTER_HPP
+#define METRICS_EXPORTER_HPP
+
+/**
+ * @file src/scft-srv/metrics_exporter.hpp
+ * @brief Defines metrics_exporter, serving the registry in Prometheus text format over HTTP
+*/
+
+#include "metrics.hpp"
+#include "scrolling_log.hpp"
+
+#include <boost/asio.hpp>
+
+#include <memory>
+#include <string>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Maximum size of an HTTP request head
+        */
+        constexpr std::size_t MAX_HTTP_REQUEST_SIZE = 8192;
+
+        /**
+         * @brief Minimal HTTP/1.0 server answering GET /metrics
+        */
+        class metrics_exporter
+        {
+            /**
+             * @brief Listen on address and port
+             * @param io_ctx boost io context
+             * @param address Address to listen on, usually 127.0.0.1
+             * @param port Port to listen on
+             * @param _registry Registry to serve
+             * @param _log Log
+            */
+            public: metrics_exporter(
+                boost::asio::io_context& io_ctx,
+                const std::string& address,
+                std::uint16_t port,
+                metrics::registry& _registry,
+                basic_shell::scrolling_log& _log);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~metrics_exporter();
+
+            /**
+             * @brief Stop accepting
+            */
+            public: void stop();
+
+            /**
+             * @brief Accept scrapers
+            */
+            private: void accepter();
+
+            /**
+             * @brief TCP Accept socket
+            */
+            private: boost::asio::ip::tcp::acceptor m_acceptor;
+
+            /**
+             * @brief Registry to serve
+            */
+            private: metrics::registry& m_registry;
+
+            /**
+             * @brief Log
+            */
+            private: basic_shell::scrolling_log& m_log;
+        };
+
+        /**
+         * @brief One scrape: read request head, write response, close
+        */
+        class metrics_session : public std::enable_shared_from_this<metrics_session>
+        {
+            /**
+             * @brief Take connected socket
+             * @param _socket Scraper connection
+             * @param _registry Registry to serve
+            */
+            public: metrics_session(boost::asio::ip::tcp::socket _socket, metrics::registry& _registry);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~metrics_session();
+
+            /**
+             * @brief Read request, call once owned by a shared_ptr
+            */
+            public: void start();
+
+            /**
+             * @brief Build response from request line
+            */
+            private: void respond();
+
+            /**
+             * @brief Scraper connection
+            */
+            private: boost::asio::ip::tcp::socket m_socket;
+
+            /**
+             * @brief Request buffer
+            */
+            private: boost::asio::streambuf m_request;
+
+            /**
+             * @brief Response kept alive during the write
+            */
+            private: std::string m_response;
+
+            /**
+             * @brief Registry to serve
+            */
+            private: metrics::registry& m_registry;
+        };
+    }
+}
+
+#endif /* METRICS_EXPORTER_HPP */
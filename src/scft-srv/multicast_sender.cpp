@@ -0,0 +1,137 @@
+#include "multicast_sender.hpp"
+
+#include <algorithm>
+
+using boost::asio::ip::udp;
+
+namespace scft
+{
+    namespace server
+    {
+    multicast_sender::multicast_sender(
+        boost::asio::io_context& io_ctx,
+        const udp::endpoint& group,
+        const std::string& interface_address,
+        int ttl,
+        std::uint64_t rate,
+        server_metrics& _metrics,
+        basic_shell::scrolling_log& _log)
+    :
+    m_socket(io_ctx, udp::v4()),
+    m_group(group),
+    m_rate(rate, MULTICAST_BURST),
+    m_timer(io_ctx),
+    m_offset(0),
+    m_datagram(multicast::DATAGRAM_HEADER_SIZE + multicast::DATAGRAM_PAYLOAD),
+    m_next_id(1),
+    m_metrics(_metrics),
+    m_log(_log)
+    {
+        m_socket.set_option(boost::asio::ip::multicast::hops(ttl));
+        m_socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+        if (!interface_address.empty())
+            m_socket.set_option(boost::asio::ip::multicast::outbound_interface(boost::asio::ip::make_address_v4(interface_address)));
+        m_log.append_log("Multicasting files to " + get_group() + '\n');
+    }
+
+    multicast_sender::~multicast_sender()
+    {
+        boost::system::error_code ec;
+        m_timer.cancel();
+        m_socket.close(ec);
+    }
+
+    std::string multicast_sender::get_group() const
+    {
+        return m_group.address().to_string() + ':' + std::to_string(m_group.port());
+    }
+
+    std::uint32_t multicast_sender::send(std::shared_ptr<message::payload_file> contents, done_handler done)
+    {
+        std::uint32_t id = m_next_id;
+        m_next_id = m_next_id == UINT32_MAX ? 1 : m_next_id + 1;
+        m_transfers.push_back(transfer{id, std::move(contents), std::move(done)});
+        m_metrics.multicast_transfers->add();
+        if (m_transfers.size() == 1)
+            start_transfer();
+        return id;
+    }
+
+    void multicast_sender::start_transfer()
+    {
+        // Never completes within send(), announces are queued before the end of their transfer
+        m_timer.expires_after(MULTICAST_START_DELAY);
+        m_timer.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                if (ec)
+                    return;
+                m_offset = 0;
+                m_file = std::ifstream(m_transfers.front().contents->get_path(), std::ios::in | std::ios::binary);
+                if (!m_file)
+                {
+                    // Receivers then ask for every packet, repairs fail the same way
+                    m_log.append_log("Multicast failed: could not open " + m_transfers.front().contents->get_path() + '\n');
+                    finish_transfer();
+                    return;
+                }
+                send_datagram();
+            });
+    }
+
+    void multicast_sender::send_datagram()
+    {
+        std::uint64_t length = m_transfers.front().contents->get_length();
+        if (m_offset >= length)
+        {
+            finish_transfer();
+            return;
+        }
+        std::chrono::steady_clock::duration delay = m_rate.get_delay();
+        if (delay > std::chrono::steady_clock::duration::zero())
+        {
+            m_timer.expires_after(delay);
+            m_timer.async_wait(
+                [this](boost::system::error_code ec)
+                {
+                    if (!ec)
+                        send_datagram();
+                });
+            return;
+        }
+        std::size_t size = static_cast<std::size_t>(std::min<std::uint64_t>(multicast::DATAGRAM_PAYLOAD, length - m_offset));
+        multicast::write_header(m_datagram.data(), m_transfers.front().id, m_offset);
+        if (!m_file.read(reinterpret_cast<char*>(m_datagram.data() + multicast::DATAGRAM_HEADER_SIZE), size))
+        {
+            m_log.append_log("Multicast failed: " + m_transfers.front().contents->get_path() + " shrank\n");
+            finish_transfer();
+            return;
+        }
+        m_socket.async_send_to(boost::asio::buffer(m_datagram.data(), multicast::DATAGRAM_HEADER_SIZE + size), m_group,
+            [this, size](boost::system::error_code ec, std::size_t sent)
+            {
+                // A datagram the kernel dropped is one more packet to repair
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+                if (!ec)
+                {
+                    m_metrics.multicast_datagrams->add();
+                    m_metrics.multicast_bytes->add(sent);
+                }
+                m_rate.consume(multicast::DATAGRAM_HEADER_SIZE + size);
+                m_offset += size;
+                send_datagram();
+            });
+    }
+
+    void multicast_sender::finish_transfer()
+    {
+        m_file.close();
+        transfer finished = std::move(m_transfers.front());
+        m_transfers.pop_front();
+        finished.done(finished.id);
+        if (!m_transfers.empty())
+            start_transfer();
+    }
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef MULTICAST_SENDER_HPP
+#define MULTICAST_SENDER_HPP
+
+/**
+ * @file src/scft-srv/multicast_sender.hpp
+ * @brief Defines multicast_sender class, sending spooled files once to a multicast group
+*/
+
+#include "bandwidth.hpp"
+#include "multicast.hpp"
+#include "scft_message.hpp"
+#include "scrolling_log.hpp"
+#include "server_metrics.hpp"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Time between queueing the announces of a transfer and its first datagram, so receivers expect it
+        */
+        constexpr std::chrono::milliseconds MULTICAST_START_DELAY{200};
+
+        /**
+         * @brief Members that negotiated multicast a file needs before it is multicast rather than unicast
+        */
+        constexpr std::size_t MULTICAST_MIN_RECIPIENTS = 2;
+
+        /**
+         * @brief Datagram bytes sent back to back, small enough for the receive buffers of the members
+        */
+        constexpr std::uint64_t MULTICAST_BURST = 65536;
+
+        /**
+         * @brief Sends files to a multicast group one after the other at a fixed rate, not thread safe, use it from the io thread
+         * @note Paced with its own timer, the timer wheel is too coarse for bursts that fit socket buffers
+        */
+        class multicast_sender
+        {
+            /**
+             * @brief Called once every datagram of a transfer was sent, with its identifier
+            */
+            public: typedef std::function<void(std::uint32_t transfer_id)> done_handler;
+
+            /**
+             * @brief Open the socket
+             * @param io_ctx boost io context
+             * @param group Multicast group
+             * @param interface_address IPV4 of the interface to send on, empty for the system's choice
+             * @param ttl Router hops, 1 stays on the LAN
+             * @param rate Bytes per second, datagram headers included
+             * @param _metrics Server wide metrics
+             * @param _log Log
+             * @note Throws boost::system::system_error if the socket can not be set up
+            */
+            public: multicast_sender(
+                boost::asio::io_context& io_ctx,
+                const boost::asio::ip::udp::endpoint& group,
+                const std::string& interface_address,
+                int ttl,
+                std::uint64_t rate,
+                server_metrics& _metrics,
+                basic_shell::scrolling_log& _log);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~multicast_sender();
+
+            /**
+             * @brief Group as told to members in NEGOTIATE answers
+             * @return "IPV4:PORT"
+            */
+            public: std::string get_group() const;
+
+            /**
+             * @brief Queue a file
+             * @param contents File contents
+             * @param done Called once sent, never before returning
+             * @return Transfer identifier, never 0
+            */
+            public: std::uint32_t send(std::shared_ptr<message::payload_file> contents, done_handler done);
+
+            /**
+             * @brief Start the front transfer after MULTICAST_START_DELAY
+            */
+            private: void start_transfer();
+
+            /**
+             * @brief Send the next datagram of the front transfer once the rate allows it
+            */
+            private: void send_datagram();
+
+            /**
+             * @brief Complete the front transfer and start the next one
+            */
+            private: void finish_transfer();
+
+            /**
+             * @brief Queued file
+            */
+            private: struct transfer
+            {
+                std::uint32_t id;                                   //!< Transfer identifier
+                std::shared_ptr<message::payload_file> contents;    //!< File contents
+                done_handler done;                                  //!< Completion handler
+            };
+
+            /**
+             * @brief UDP socket
+            */
+            private: boost::asio::ip::udp::socket m_socket;
+
+            /**
+             * @brief Multicast group
+            */
+            private: boost::asio::ip::udp::endpoint m_group;
+
+            /**
+             * @brief Sending rate
+            */
+            private: token_bucket m_rate;
+
+            /**
+             * @brief Start delay and pacing timer
+            */
+            private: boost::asio::steady_timer m_timer;
+
+            /**
+             * @brief Transfers, the front one is being sent
+            */
+            private: std::deque<transfer> m_transfers;
+
+            /**
+             * @brief Contents of the front transfer
+            */
+            private: std::ifstream m_file;
+
+            /**
+             * @brief Offset of the next datagram
+            */
+            private: std::uint64_t m_offset;
+
+            /**
+             * @brief Datagram being sent
+            */
+            private: std::vector<std::uint8_t> m_datagram;
+
+            /**
+             * @brief Identifier of the next transfer
+            */
+            private: std::uint32_t m_next_id;
+
+            /**
+             * @brief Server wide metrics
+            */
+            private: server_metrics& m_metrics;
+
+            /**
+             * @brief Log
+            */
+            private: basic_shell::scrolling_log& m_log;
+        };
+    }
+}
+
+#endif /* MULTICAST_SENDER_HPP */
@@ -0,0 +1,54 @@
+#include "offer_book.hpp"
+
+#include <algorithm>
+
+namespace scft
+{
+    namespace server
+    {
+    offer_book::offer_book()
+    {
+    }
+
+    offer_book::~offer_book()
+    {
+    }
+
+    void offer_book::add(std::uint32_t offer_id)
+    {
+        m_offers.push_back(offer_id);
+        if (m_offers.size() > MAX_OFFERS)
+        {
+            m_fetches.erase(m_offers.front());
+            m_offers.pop_front();
+        }
+    }
+
+    bool offer_book::wait(std::uint32_t offer_id, std::weak_ptr<member> recipient)
+    {
+        if (std::find(m_offers.begin(), m_offers.end(), offer_id) == m_offers.end())
+            return false;
+        std::vector<std::weak_ptr<member>>& waiting = m_fetches[offer_id];
+        waiting.push_back(std::move(recipient));
+        return waiting.size() == 1;
+    }
+
+    std::vector<std::weak_ptr<member>> offer_book::take(std::uint32_t offer_id)
+    {
+        std::map<std::uint32_t, std::vector<std::weak_ptr<member>>>::iterator found = m_fetches.find(offer_id);
+        if (found == m_fetches.end())
+            return std::vector<std::weak_ptr<member>>();
+        std::vector<std::weak_ptr<member>> recipients = std::move(found->second);
+        m_fetches.erase(found);
+        return recipients;
+    }
+
+    void offer_book::take_over(offer_book& previous)
+    {
+        m_offers = std::move(previous.m_offers);
+        m_fetches = std::move(previous.m_fetches);
+        previous.m_offers.clear();
+        previous.m_fetches.clear();
+    }
+    }
+}
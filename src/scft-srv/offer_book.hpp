@@ -0,0 +1,81 @@
+#ifndef OFFER_BOOK_HPP
+#define OFFER_BOOK_HPP
+
+/**
+ * @file src/scft-srv/offer_book.hpp
+ * @brief Defines offer_book class, the offers of one member and who waits for them to be relayed
+*/
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace scft
+{
+    namespace server
+    {
+        class member;
+
+        /**
+         * @brief Offers of a member other members may fetch through the server, older ones are forgotten
+        */
+        constexpr std::size_t MAX_OFFERS = 64;
+
+        /**
+         * @brief Offers of one member, and the members waiting for the server to relay them
+        */
+        class offer_book
+        {
+            /**
+             * @brief No offers
+            */
+            public: offer_book();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~offer_book();
+
+            /**
+             * @brief Remember an offer, forgetting the oldest one and its recipients beyond MAX_OFFERS
+             * @param offer_id Offer
+            */
+            public: void add(std::uint32_t offer_id);
+
+            /**
+             * @brief Have a member wait for an offer relayed through the server
+             * @param offer_id Offer, unknown ones are ignored
+             * @param recipient Member to relay it to
+             * @return True for the first recipient, the sender is then asked for the file
+            */
+            public: bool wait(std::uint32_t offer_id, std::weak_ptr<member> recipient);
+
+            /**
+             * @brief Take the members waiting for an offer
+             * @param offer_id Offer
+             * @return Recipients, empty if nobody waits
+            */
+            public: std::vector<std::weak_ptr<member>> take(std::uint32_t offer_id);
+
+            /**
+             * @brief Take the offers of a previous connection
+             * @param previous Book left empty
+            */
+            public: void take_over(offer_book& previous);
+
+            /**
+             * @brief Offers, oldest first
+            */
+            private: std::deque<std::uint32_t> m_offers;
+
+            /**
+             * @brief Members waiting for offers, by offer identifier
+            */
+            private: std::map<std::uint32_t, std::vector<std::weak_ptr<member>>> m_fetches;
+        };
+    }
+}
+
+#endif /* OFFER_BOOK_HPP */
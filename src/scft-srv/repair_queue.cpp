@@ -0,0 +1,85 @@
+#include "repair_queue.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+namespace scft
+{
+    namespace server
+    {
+    repair_queue::repair_queue(basic_shell::scrolling_log& _log, server_metrics& _metrics)
+    :
+    m_log(_log),
+    m_metrics(_metrics),
+    m_busy(false)
+    {
+    }
+
+    repair_queue::~repair_queue()
+    {
+    }
+
+    void repair_queue::keep(std::uint32_t transfer_id, std::shared_ptr<message::payload_file> contents)
+    {
+        m_files[transfer_id] = std::move(contents);
+    }
+
+    bool repair_queue::request(std::string_view nack)
+    {
+        std::uint32_t transfer_id;
+        std::vector<multicast::range> ranges;
+        if (!multicast::parse_nack(nack, transfer_id, ranges))
+            return false;
+        // One NACK per transfer
+        std::map<std::uint32_t, std::shared_ptr<message::payload_file>>::iterator found = m_files.find(transfer_id);
+        if (found == m_files.end())
+            return true;
+        std::shared_ptr<message::payload_file> contents = found->second;
+        m_files.erase(found);
+        for (const multicast::range& _range : ranges)
+        {
+            std::uint64_t offset = _range.first * multicast::DATAGRAM_PAYLOAD;
+            std::uint64_t end = std::min((_range.last + 1) * multicast::DATAGRAM_PAYLOAD, contents->get_length());
+            if (_range.last >= multicast::packet_count(contents->get_length()))
+                return false;
+            m_pending.push_back(pending{transfer_id, contents, offset, end});
+        }
+        return true;
+    }
+
+    bool repair_queue::take(message::message& frame)
+    {
+        if (m_busy || m_pending.empty())
+            return false;
+        pending& repair = m_pending.front();
+        std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(multicast::REPAIR_PIECE, repair.end - repair.offset));
+        std::vector<std::uint8_t> contents(length);
+        std::ifstream file(repair.contents->get_path(), std::ios::in | std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(repair.offset));
+        if (!file.read(reinterpret_cast<char*>(contents.data()), length))
+        {
+            m_log.append_log("Repair failed: could not read " + repair.contents->get_path() + '\n');
+            m_pending.clear();
+            return false;
+        }
+        frame = message::message{repair.transfer_id, repair.offset, contents.data(), length};
+        repair.offset += length;
+        if (repair.offset >= repair.end)
+            m_pending.pop_front();
+        m_busy = true;
+        m_metrics.multicast_repair_bytes->add(length);
+        return true;
+    }
+
+    void repair_queue::take_over(repair_queue& previous)
+    {
+        m_files = std::move(previous.m_files);
+        m_pending = std::move(previous.m_pending);
+        m_busy = previous.m_busy;
+        previous.m_files.clear();
+        previous.m_pending.clear();
+        previous.m_busy = false;
+    }
+    }
+}
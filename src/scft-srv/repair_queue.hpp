@@ -0,0 +1,113 @@
+#ifndef REPAIR_QUEUE_HPP
+#define REPAIR_QUEUE_HPP
+
+/**
+ * @file src/scft-srv/repair_queue.hpp
+ * @brief Defines repair_queue class, the multicast contents one member asks for again
+*/
+
+#include "multicast.hpp"
+#include "scft_message.hpp"
+#include "scrolling_log.hpp"
+#include "server_metrics.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string_view>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Multicast files announced to one member, kept until its NACK, then the ranges it missed as REPAIR frames
+         * @note One REPAIR frame is read at a time, as the previous one is written, so a large repair never sits in memory
+        */
+        class repair_queue
+        {
+            /**
+             * @brief Nothing kept
+             * @param _log Log
+             * @param _metrics Server wide metrics
+            */
+            public: repair_queue(basic_shell::scrolling_log& _log, server_metrics& _metrics);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~repair_queue();
+
+            /**
+             * @brief Keep the contents of an announced multicast file until the member's NACK
+             * @param transfer_id Multicast transfer
+             * @param contents File contents
+            */
+            public: void keep(std::uint32_t transfer_id, std::shared_ptr<message::payload_file> contents);
+
+            /**
+             * @brief Queue the ranges a NACK asks for, a late or repeated one has nothing left to repair
+             * @param nack NACK string
+             * @return False on a protocol error
+            */
+            public: bool request(std::string_view nack);
+
+            /**
+             * @brief Read the next REPAIR frame unless the previous one is not written yet
+             * @param frame Filled
+             * @return False if there is nothing to send now
+            */
+            public: bool take(message::message& frame);
+
+            /**
+             * @brief The REPAIR frame taken last was written
+            */
+            public: void written() { m_busy = false; }
+
+            /**
+             * @brief Take the files and repairs of a previous connection
+             * @param previous Queue left empty
+            */
+            public: void take_over(repair_queue& previous);
+
+            /**
+             * @brief Contents of a multicast file a member asked for again
+            */
+            private: struct pending
+            {
+                std::uint32_t transfer_id;                          //!< Multicast transfer
+                std::shared_ptr<message::payload_file> contents;    //!< File contents
+                std::uint64_t offset;                               //!< Next byte to send
+                std::uint64_t end;                                  //!< End of the missing range
+            };
+
+            /**
+             * @brief Log
+            */
+            private: basic_shell::scrolling_log& m_log;
+
+            /**
+             * @brief Server wide metrics
+            */
+            private: server_metrics& m_metrics;
+
+            /**
+             * @brief Contents of announced multicast files, by transfer identifier, until the member's NACK
+            */
+            private: std::map<std::uint32_t, std::shared_ptr<message::payload_file>> m_files;
+
+            /**
+             * @brief Contents to send again, in order
+            */
+            private: std::deque<pending> m_pending;
+
+            /**
+             * @brief A REPAIR frame is not written yet, the next one waits for it
+            */
+            private: bool m_busy;
+        };
+    }
+}
+
+#endif /* REPAIR_QUEUE_HPP */
@@ -1,14 +1,56 @@
 #include "room.hpp"
 
-using boost::asio::ip::tcp;
+#include <algorithm>
+#include <chrono>
 
 namespace scft
 {
     namespace server
     {
-    room::room(basic_shell::scrolling_log& _log)
+    /**
+     * @brief Announce of a multicast file, its contents follow in datagrams
+     * @param _message Spooled WRITE_FILE
+     * @param transfer_id Multicast transfer
+     * @return Header, origin and file name flagged FLAG_MULTICAST
+    */
+    static message::message make_announce(message::message _message, std::uint32_t transfer_id)
+    {
+        message::message announce;
+        std::size_t prefix = _message.get_header_size() + _message.get_origin_len() + _message.get_string_len() + 1;
+        announce.get_raw_message().assign(_message.get_raw_message().begin(), _message.get_raw_message().begin() + prefix);
+        announce.set_flags(announce.get_flags() | message::FLAG_MULTICAST);
+        announce.set_stream_id(transfer_id);
+        return announce;
+    }
+
+    room::room(
+        basic_shell::scrolling_log& _log,
+        server_metrics& _metrics,
+        timer::timer_wheel& wheel,
+        std::chrono::seconds read_timeout,
+        std::chrono::seconds write_timeout,
+        std::uint32_t checksums,
+        history* _history,
+        std::uint64_t spill_threshold,
+        memory_budget& budget,
+        bandwidth& _bandwidth,
+        multicast_sender* _multicast,
+        bool direct,
+        std::chrono::seconds session_grace)
     :
-    m_log(_log)
+    m_log(_log),
+    m_metrics(_metrics),
+    m_wheel(wheel),
+    m_read_timeout(read_timeout),
+    m_write_timeout(write_timeout),
+    m_checksums(checksums),
+    m_history(_history),
+    m_spill_threshold(spill_threshold),
+    m_budget(budget),
+    m_bandwidth(_bandwidth),
+    m_multicast(_multicast),
+    m_direct(direct),
+    m_session_grace(session_grace)
     {
     }
 
@@ -16,46 +58,206 @@ namespace scft
     {
     }
 
-    void room::add_member(tcp::socket _socket)
+    void room::add_member(transport::stream _socket)
     {
-        m_log.append_log(
-            "Adding: " + _socket.remote_endpoint().address().to_string() + ':' +
-            std::to_string(_socket.remote_endpoint().port()) +  '\n');
-        broadcast(
-            message::message(
-                message::MESSAGE_TYPE::TEXT, _socket.remote_endpoint().address().to_string(), _socket.remote_endpoint().port(), " HAS JOINED"));
+        std::shared_ptr<member> _member = std::make_shared<member>(std::move(_socket), *this);
+        m_log.append_log("Adding: " + _member->get_address() + ':' + std::to_string(_member->get_port()) +  '\n');
+        if (m_history)
+            _member->set_joined_sequence(m_history->get_next_sequence());
+        // With sessions, the member announces itself once it is not a reconnection
+        if (m_session_grace.count() == 0)
+            announce(_member);
 
         m_members_mutex.lock();
-        m_members.push_back(std::make_shared<member>(std::move(_socket), *this));
+        m_members.push_back(_member);
         m_members_mutex.unlock();
+        m_metrics.members->add(1);
+        _member->start();
+    }
+
+    void room::announce(std::shared_ptr<member> _member)
+    {
+        broadcast(message::message(message::MESSAGE_TYPE::TEXT, _member->get_address(), _member->get_port(), " HAS JOINED"), _member.get());
     }
 
     void room::remove_member(std::shared_ptr<member> _member)
     {
+        // Reading and writing both fail on a dead connection, only the first one removes
+        m_members_mutex.lock();
+        std::vector<std::shared_ptr<member>>::iterator found = std::find(m_members.begin(), m_members.end(), _member);
+        if (found == m_members.end() || _member->linger())
+        {
+            m_members_mutex.unlock();
+            return;
+        }
+        m_members.erase(found);
+        m_members_mutex.unlock();
+        m_metrics.members->add(-1);
+        _member->close();
+        if (!_member->get_session().empty())
+            remove_session(_member->get_session());
+
         m_log.append_log("Removing: " + _member->get_address() + ':' + std::to_string(_member->get_port()) +  '\n');
-        broadcast(message::message(message::MESSAGE_TYPE::TEXT, _member->get_address(), _member->get_port(), " HAS LEFT"));
+        if (_member->is_announced())
+            broadcast(message::message(message::MESSAGE_TYPE::TEXT, _member->get_address(), _member->get_port(), " HAS LEFT"), _member.get());
+    }
+
+    void room::replace_member(std::shared_ptr<member> previous, std::shared_ptr<member> _member)
+    {
         m_members_mutex.lock();
-        for (std::size_t index = 0; index < m_members.size(); index++)
+        std::vector<std::shared_ptr<member>>::iterator found = std::find(m_members.begin(), m_members.end(), previous);
+        bool removed = found != m_members.end();
+        if (removed)
+            m_members.erase(found);
+        m_members_mutex.unlock();
+        if (removed)
+            m_metrics.members->add(-1);
+        previous->close();
+        m_log.append_log("Resuming: " + previous->get_address() + ':' + std::to_string(previous->get_port()) +
+            " from " + _member->get_address() + ':' + std::to_string(_member->get_port()) + '\n');
+        m_metrics.resumed_sessions->add();
+    }
+
+    void room::add_session(const std::string& token, std::shared_ptr<member> _member)
+    {
+        m_sessions[token] = _member;
+    }
+
+    void room::remove_session(const std::string& token)
+    {
+        m_sessions.erase(token);
+    }
+
+    std::shared_ptr<member> room::find_session(const std::string& token)
+    {
+        std::map<std::string, std::weak_ptr<member>>::iterator found = m_sessions.find(token);
+        return found != m_sessions.end() ? found->second.lock() : nullptr;
+    }
+
+    bool room::accepted_by_all(checksum::ALGORITHM algorithm)
+    {
+        m_members_mutex.lock();
+        bool accepted = std::all_of(m_members.begin(), m_members.end(),
+            [algorithm](const std::shared_ptr<member>& _member) { return _member->accepts_checksum(algorithm); });
+        m_members_mutex.unlock();
+        return accepted;
+    }
+
+    void room::offer(std::shared_ptr<member> sender, std::uint32_t offer_id, std::uint16_t port)
+    {
+        std::string origin = sender->get_address() + ':' + std::to_string(sender->get_port());
+        m_log.append_log("Offering: " + std::to_string(offer_id) + " from " + origin + '\n');
+        // Members that did not negotiate direct get the file through the server, as soon as the sender can send it
+        // Senders on a Unix domain socket are only reachable over loopback, by members on the same host
+        bool local = sender->get_address() == transport::LOCAL_ADDRESS;
+        message::message _offer{message::MESSAGE_TYPE::OFFER, sender->get_address(), sender->get_port(),
+            std::to_string(offer_id) + ' ' + (local ? std::string("127.0.0.1") : sender->get_address()) + ':' + std::to_string(port)};
+        for (std::shared_ptr<member>& _member : m_members)
         {
-            if (m_members[index].get() == _member.get())
-            {
-                m_members.erase(m_members.begin() + index);
-                m_members_mutex.unlock();
-                return;
-            }
+            if (_member == sender)
+                continue;
+            if (_member->takes_direct() && (!local || _member->get_address() == transport::LOCAL_ADDRESS))
+                _member->send_message(_offer);
+            else
+                sender->request_fetch(offer_id, _member);
+        }
+        m_metrics.direct_offers->add();
+    }
+
+    std::shared_ptr<member> room::find_member(std::string_view origin)
+    {
+        for (std::shared_ptr<member>& _member : m_members)
+        {
+            if (_member->get_address() + ':' + std::to_string(_member->get_port()) == origin)
+                return _member;
         }
-        throw std::logic_error("Double self-destruction");
+        return nullptr;
+    }
+
+    void room::close_all()
+    {
+        m_members_mutex.lock();
+        std::vector<std::shared_ptr<member>> members;
+        members.swap(m_members);
+        m_members_mutex.unlock();
+        m_metrics.members->add(-static_cast<std::int64_t>(members.size()));
+        for (std::shared_ptr<member>& _member : members)
+            _member->close();
+    }
+
+    void room::broadcast(message::message _message, const member* sender)
+    {
+        broadcast(_message, _message, sender);
     }
 
-    void room::broadcast(message::message _message)
+    void room::broadcast(message::message _message, const message::message& fallback, const member* sender)
     {
-        m_log.append_log("Broadcasting: " + std::string(_message.get_string()) + '\n');
+        message::message_view view;
+        view.parse(_message.get_raw_message().data(), _message.get_raw_message().size(), _message.get_payload_file() != nullptr);
+        m_log.append_log("Broadcasting: " + std::string(view.get_string()) + '\n');
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<member>> recipients;
         for (std::shared_ptr<member>& _member : m_members)
         {
-            std::string origin = _member->get_address() + ":" + std::to_string(_member->get_port());
-            if (origin != _message.get_origin())
-                _member->send_message(_message);
+            if (_member.get() != sender)
+                recipients.push_back(_member);
+        }
+        // Spooled files are sent once to the group, members that negotiated multicast only get an announce
+        std::vector<std::weak_ptr<member>> multicast_members;
+        if (m_multicast && view.get_message_type() == message::MESSAGE_TYPE::WRITE_FILE && _message.get_payload_file())
+        {
+            for (std::shared_ptr<member>& _member : recipients)
+            {
+                if (_member->takes_multicast())
+                    multicast_members.push_back(_member);
+            }
+            if (multicast_members.size() < MULTICAST_MIN_RECIPIENTS)
+                multicast_members.clear();
+        }
+        if (!multicast_members.empty())
+        {
+            std::uint32_t transfer_id = m_multicast->send(_message.get_payload_file(),
+                [multicast_members](std::uint32_t finished_id)
+                {
+                    for (const std::weak_ptr<member>& weak_member : multicast_members)
+                    {
+                        std::shared_ptr<member> _member = weak_member.lock();
+                        if (_member)
+                            _member->end_multicast(finished_id);
+                    }
+                });
+            message::message announce = make_announce(_message, transfer_id);
+            message::message fallback_announce = make_announce(fallback, transfer_id);
+            for (std::shared_ptr<member>& _member : recipients)
+            {
+                bool accepted = _member->accepts_checksum(view.get_checksum_algorithm());
+                if (_member->takes_multicast())
+                    _member->send_multicast(accepted ? announce : fallback_announce, transfer_id, _message.get_payload_file());
+                else
+                    _member->send_message(accepted ? _message : fallback);
+            }
+        }
+        else
+        {
+            for (std::shared_ptr<member>& _member : recipients)
+                _member->send_message(_member->accepts_checksum(view.get_checksum_algorithm()) ? _message : fallback);
+        }
+        // Stored checksummed with CRC32 so any member can verify a replay, streamed and spooled contents are not kept
+        if (m_history && !view.has_streamed_body())
+        {
+            message::message stored = fallback;
+            stored.set_flags(stored.get_flags() | message::FLAG_REPLAYED);
+            try
+            {
+                m_history->append(stored.get_raw_message().data(), stored.get_raw_message().size());
+            }
+            catch (std::exception& e)
+            {
+                m_log.append_log(std::string("History append failed: ") + e.what() + '\n');
+            }
         }
+        m_metrics.broadcasts->add();
+        m_metrics.fanout->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
     }
     }
 }
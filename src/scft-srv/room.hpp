@@ -6,11 +6,21 @@
  * @brief Defines room class, used by server
 */
 
+#include "bandwidth.hpp"
+#include "history.hpp"
 #include "member.hpp"
+#include "memory_budget.hpp"
+#include "multicast_sender.hpp"
 #include "scrolling_log.hpp"
+#include "server_metrics.hpp"
+#include "timer_wheel.hpp"
+#include "transport.hpp"
 #include <boost/asio.hpp>
+#include <chrono>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 
 namespace scft
 {
@@ -26,8 +36,33 @@ namespace scft
             /**
              * @brief Specify the log
              * @param _log Log
+             * @param _metrics Server wide metrics
+             * @param wheel Timer wheel of the io thread
+             * @param read_timeout Reap members silent for this long, 0 to disable
+             * @param write_timeout Reap members not draining their queue for this long, 0 to disable
+             * @param checksums Set of checksum::bit() members may send
+             * @param _history Broadcast history, nullptr to disable
+             * @param spill_threshold File contents above this are spooled to disk while received, 0 to disable
+             * @param budget Memory members may hold
+             * @param _bandwidth Rate limits
+             * @param _multicast Multicast of spooled files, nullptr to disable
+             * @param direct Let members offer files for others to fetch from them
+             * @param session_grace Keep the session of a departed member this long for it to resume, 0 to disable
             */
-            public: room(basic_shell::scrolling_log& _log);
+            public: room(
+                basic_shell::scrolling_log& _log,
+                server_metrics& _metrics,
+                timer::timer_wheel& wheel,
+                std::chrono::seconds read_timeout,
+                std::chrono::seconds write_timeout,
+                std::uint32_t checksums,
+                history* _history,
+                std::uint64_t spill_threshold,
+                memory_budget& budget,
+                bandwidth& _bandwidth,
+                multicast_sender* _multicast,
+                bool direct,
+                std::chrono::seconds session_grace);
 
             /**
              * @brief Default destructor
@@ -36,21 +71,174 @@ namespace scft
 
             /**
              * @brief Add client connection
-             * @param _socket Connected socket
+             * @param _socket Connected stream
             */
-            public: void add_member(boost::asio::ip::tcp::socket _socket);
+            public: void add_member(transport::stream _socket);
 
             /**
-             * @brief Remove client connection
+             * @brief Tell members someone joined, once the member is known not to resume a session
+             * @param _member Joined member
+            */
+            public: void announce(std::shared_ptr<member> _member);
+
+            /**
+             * @brief Remove client connection, a member with a session lingers for the grace period instead
              * @param _member Member to remove
             */
             public: void remove_member(std::shared_ptr<member> _member);
 
             /**
-             * @brief Send message to every member except message origin
+             * @brief Let a new connection take over the session of a previous one, without announcing either
+             * @param previous Member whose session is resumed, closed and removed
+             * @param _member New connection
+            */
+            public: void replace_member(std::shared_ptr<member> previous, std::shared_ptr<member> _member);
+
+            /**
+             * @brief Remember a session
+             * @param token Session token
+             * @param _member Member holding it
+            */
+            public: void add_session(const std::string& token, std::shared_ptr<member> _member);
+
+            /**
+             * @brief Forget a session
+             * @param token Session token
+            */
+            public: void remove_session(const std::string& token);
+
+            /**
+             * @brief Find the member holding a session, connected or lingering
+             * @param token Session token
+             * @return nullptr if unknown or expired
+            */
+            public: std::shared_ptr<member> find_session(const std::string& token);
+
+            /**
+             * @brief Check if any session could be resumed
+             * @return True while a member, connected or lingering, holds a session
+            */
+            public: bool has_sessions() const { return !m_sessions.empty(); }
+
+            /**
+             * @brief Close every member without announcing departures, for shutdown
+            */
+            public: void close_all();
+
+            /**
+             * @brief Send message to every member except its sender
              * @param _message Initialized message to broadcast
+             * @param sender Member left out
+            */
+            public: void broadcast(message::message _message, const member* sender);
+
+            /**
+             * @brief Send message to every member but its sender, spooled files are multicast once enough members take it
+             * @param _message Message
+             * @param fallback Same message checksummed with CRC32, for members that did not negotiate its algorithm
+             * @param sender Member left out, members on Unix domain sockets can't tell the origin they are known by
+            */
+            public: void broadcast(message::message _message, const message::message& fallback, const member* sender);
+
+            /**
+             * @brief Tell members that negotiated direct where to fetch a file, ask its sender to relay it to the others
+             * @param sender Member offering the file
+             * @param offer_id Offer identifier, chosen by the sender
+             * @param port Port the sender serves it on, at its address as seen by the server
+            */
+            public: void offer(std::shared_ptr<member> sender, std::uint32_t offer_id, std::uint16_t port);
+
+            /**
+             * @brief Find a member by origin
+             * @param origin "IPV4:PORT"
+             * @return nullptr if not in the room
+            */
+            public: std::shared_ptr<member> find_member(std::string_view origin);
+
+            /**
+             * @brief Check if every member verifies an algorithm
+             * @param algorithm Algorithm
+             * @return False if a broadcast would need a CRC32 fallback
+            */
+            public: bool accepted_by_all(checksum::ALGORITHM algorithm);
+
+            /**
+             * @brief Server wide metrics
+             * @return Metrics shared with members
+            */
+            public: server_metrics& get_metrics() { return m_metrics; }
+
+            /**
+             * @brief Timer wheel of the io thread
+             * @return Wheel shared by members
+            */
+            public: timer::timer_wheel& get_timer_wheel() { return m_wheel; }
+
+            /**
+             * @brief Read idle timeout
+             * @return 0 if disabled
+            */
+            public: std::chrono::seconds get_read_timeout() const { return m_read_timeout; }
+
+            /**
+             * @brief Write idle timeout
+             * @return 0 if disabled
+            */
+            public: std::chrono::seconds get_write_timeout() const { return m_write_timeout; }
+
+            /**
+             * @brief Checksum algorithms members may send
+             * @return Set of checksum::bit()
+            */
+            public: std::uint32_t get_checksums() const { return m_checksums; }
+
+            /**
+             * @brief Broadcast history
+             * @return nullptr if disabled
+            */
+            public: history* get_history() { return m_history; }
+
+            /**
+             * @brief File contents above this are spooled to disk while received
+             * @return Bytes, 0 if disabled
+            */
+            public: std::uint64_t get_spill_threshold() const { return m_spill_threshold; }
+
+            /**
+             * @brief Memory members may hold
+             * @return Budget
+            */
+            public: memory_budget& get_budget() { return m_budget; }
+
+            /**
+             * @brief Rate limits
+             * @return Room and member rates
+            */
+            public: bandwidth& get_bandwidth() { return m_bandwidth; }
+
+            /**
+             * @brief Multicast of spooled files
+             * @return nullptr if disabled
+            */
+            public: multicast_sender* get_multicast() { return m_multicast; }
+
+            /**
+             * @brief Direct transfers
+             * @return True if members may offer files
+            */
+            public: bool get_direct() const { return m_direct; }
+
+            /**
+             * @brief Time sessions of departed members are kept
+             * @return Grace period, 0 if sessions are disabled
+            */
+            public: std::chrono::seconds get_session_grace() const { return m_session_grace; }
+
+            /**
+             * @brief Log
+             * @return Log shared by members
             */
-            public: void broadcast(message::message _message);
+            public: basic_shell::scrolling_log& get_log() { return m_log; }
 
             /**
              * @brief Member list
@@ -66,6 +254,71 @@ namespace scft
              * @brief Log
             */
             private: basic_shell::scrolling_log& m_log;
+
+            /**
+             * @brief Server wide metrics
+            */
+            private: server_metrics& m_metrics;
+
+            /**
+             * @brief Timer wheel of the io thread
+            */
+            private: timer::timer_wheel& m_wheel;
+
+            /**
+             * @brief Read idle timeout
+            */
+            private: std::chrono::seconds m_read_timeout;
+
+            /**
+             * @brief Write idle timeout
+            */
+            private: std::chrono::seconds m_write_timeout;
+
+            /**
+             * @brief Checksum algorithms members may send
+            */
+            private: std::uint32_t m_checksums;
+
+            /**
+             * @brief Broadcast history
+            */
+            private: history* m_history;
+
+            /**
+             * @brief Spool file contents above this
+            */
+            private: std::uint64_t m_spill_threshold;
+
+            /**
+             * @brief Memory members may hold
+            */
+            private: memory_budget& m_budget;
+
+            /**
+             * @brief Rate limits
+            */
+            private: bandwidth& m_bandwidth;
+
+            /**
+             * @brief Multicast of spooled files
+            */
+            private: multicast_sender* m_multicast;
+
+            /**
+             * @brief Members may offer files
+            */
+            private: bool m_direct;
+
+            /**
+             * @brief Session grace period
+            */
+            private: std::chrono::seconds m_session_grace;
+
+            /**
+             * @brief Members by session token, only used on the io thread
+            */
+            private: std::map<std::string, std::weak_ptr<member>> m_sessions;
         };
     }
 }
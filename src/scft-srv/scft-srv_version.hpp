@@ -0,0 +1,3 @@
+#define SCFT_SRV_VERSION_MAJOR 0
+#define SCFT_SRV_VERSION_MINOR 4
+#define SCFT_SRV_VERSION_PATCH 0
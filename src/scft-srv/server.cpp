@@ -1,40 +1,174 @@
 #include "server.hpp"
 
+#include <filesystem>
+
 using boost::asio::ip::tcp;
 
 namespace scft
 {
     namespace server
     {
+    /**
+     * @brief Open the multicast sender if a group is set
+     * @param io_ctx boost io context
+     * @param options Server settings
+     * @param _metrics Server wide metrics
+     * @param _log Log
+     * @return nullptr if disabled
+    */
+    static std::unique_ptr<multicast_sender> make_multicast(
+        boost::asio::io_context& io_ctx,
+        const server_options& options,
+        server_metrics& _metrics,
+        basic_shell::scrolling_log& _log)
+    {
+        if (options.multicast_group.empty())
+            return nullptr;
+        boost::asio::ip::udp::endpoint group;
+        if (!multicast::parse_group(options.multicast_group, group))
+            throw std::runtime_error("invalid multicast group " + options.multicast_group);
+        return std::make_unique<multicast_sender>(io_ctx, group, options.multicast_interface, options.multicast_ttl,
+            options.multicast_rate, _metrics, _log);
+    }
+
+    /**
+     * @brief Listen on a Unix domain socket if a path is set
+     * @param io_ctx boost io context
+     * @param path Socket path, a socket left there by a previous run is replaced
+     * @return nullptr if disabled
+    */
+    static std::unique_ptr<transport::acceptor> make_local_acceptor(boost::asio::io_context& io_ctx, const std::string& path)
+    {
+        if (path.empty())
+            return nullptr;
+        std::error_code ec;
+        if (std::filesystem::is_socket(path, ec))
+            std::filesystem::remove(path, ec);
+        return std::make_unique<transport::acceptor>(io_ctx, transport::make_local_endpoint(path));
+    }
+
     server::server(
         boost::asio::io_context& io_ctx,
-        const std::string& address,
-        std::uint16_t port,
+        const server_options& options,
         basic_shell::scrolling_log& _log)
     :
-    m_acceptor(io_ctx, tcp::endpoint(boost::asio::ip::make_address_v4(address), port)),
-    m_room(_log),
+    m_metrics(m_registry),
+    m_acceptor(io_ctx, transport::endpoint(tcp::endpoint(boost::asio::ip::make_address_v4(options.address), options.port))),
+    m_port(transport::get_port(m_acceptor.local_endpoint())),
+    m_local_acceptor(make_local_acceptor(io_ctx, options.local_path)),
+    m_local_path(options.local_path),
+    m_shm_acceptor(make_local_acceptor(io_ctx, options.shm_path)),
+    m_shm_path(options.shm_path),
+    m_no_delay(options.no_delay),
+    m_wheel(io_ctx, IDLE_CHECK_TICK),
+    m_budget(options.memory_budget, options.max_text, options.max_file, m_metrics),
+    m_bandwidth(options.member_ingress, options.member_egress, options.room_ingress, options.room_egress, options.egress_quantum, io_ctx, m_metrics),
+    m_history(options.history_directory.empty() ? nullptr : std::make_unique<history>(options.history_directory,
+        options.history_segment_bytes, options.history_max_bytes, options.history_max_age, _log)),
+    m_multicast(make_multicast(io_ctx, options, m_metrics, _log)),
+    m_room(_log, m_metrics, m_wheel, options.read_timeout, options.write_timeout, options.checksums | checksum::bit(checksum::CRC32),
+        m_history.get(), options.spill_threshold, m_budget, m_bandwidth, m_multicast.get(), options.direct,
+        options.session_grace),
     m_log(_log)
     {
-        m_log.append_log("Listening on " + std::to_string(m_acceptor.local_endpoint().port()) + '\n');
-        accepter();
+        m_log.append_log("Listening on " + std::to_string(m_port) + '\n');
+        if (m_local_acceptor)
+            m_log.append_log("Listening on " + m_local_path + '\n');
+        if (m_shm_acceptor)
+            m_log.append_log("Listening for shared memory on " + m_shm_path + '\n');
+        if (options.metrics_port != 0)
+            m_exporter = std::make_unique<metrics_exporter>(io_ctx, options.metrics_address, options.metrics_port, m_registry, m_log);
+        accepter(m_acceptor);
+        if (m_local_acceptor)
+            accepter(*m_local_acceptor);
+        if (m_shm_acceptor)
+            shm_accepter();
+    }
+
+    void server::stop()
+    {
+        boost::asio::post(m_acceptor.get_executor(),
+            [this]()
+            {
+                boost::system::error_code ec;
+                m_acceptor.close(ec);
+                if (m_local_acceptor && m_local_acceptor->is_open())
+                {
+                    m_local_acceptor->close(ec);
+                    std::error_code remove_ec;
+                    std::filesystem::remove(m_local_path, remove_ec);
+                }
+                if (m_shm_acceptor && m_shm_acceptor->is_open())
+                {
+                    m_shm_acceptor->close(ec);
+                    std::error_code remove_ec;
+                    std::filesystem::remove(m_shm_path, remove_ec);
+                }
+                if (m_exporter)
+                    m_exporter->stop();
+                m_wheel.stop();
+                m_room.close_all();
+            });
     }
 
     server::~server()
     {
-        m_log.append_log("Stopped listening on " + std::to_string(m_acceptor.local_endpoint().port()) + '\n');
+        m_log.append_log("Stopped listening on " + std::to_string(m_port) + '\n');
     }
 
-    void server::accepter()
+    void server::accepter(transport::acceptor& _acceptor)
     {
-        m_acceptor.async_accept(
-            [&](boost::system::error_code ec, tcp::socket _socket)
+        _acceptor.async_accept(
+            [this, &_acceptor](boost::system::error_code ec, transport::socket _socket)
             {
+                if (!_acceptor.is_open())
+                    return;
                 if (!ec)
                 {
-                    m_room.add_member(std::move(_socket));
+                    m_metrics.accepts->add();
+                    if (m_no_delay)
+                        transport::set_no_delay(_socket, true);
+                    m_room.add_member(transport::stream(std::move(_socket)));
+                }
+                accepter(_acceptor);
+            });
+    }
+
+    void server::shm_accepter()
+    {
+        m_shm_acceptor->async_accept(
+            [this](boost::system::error_code ec, transport::socket _socket)
+            {
+                if (!m_shm_acceptor->is_open())
+                    return;
+                if (!ec)
+                {
+                    m_metrics.accepts->add();
+                    attach_shm(std::make_shared<transport::socket>(std::move(_socket)));
+                }
+                shm_accepter();
+            });
+    }
+
+    void server::attach_shm(std::shared_ptr<transport::socket> _socket)
+    {
+        // The client sends its segment right after connecting, one without is dropped when it disconnects
+        _socket->async_wait(transport::socket::wait_read,
+            [this, _socket](boost::system::error_code ec)
+            {
+                if (ec || !m_shm_acceptor->is_open())
+                    return;
+                try
+                {
+                    std::shared_ptr<transport::shm_channel> channel = transport::shm_channel::accept(*_socket);
+                    transport::stream _stream(std::move(*_socket));
+                    _stream.attach(std::move(channel));
+                    m_room.add_member(std::move(_stream));
+                }
+                catch (std::exception& e)
+                {
+                    m_log.append_log("Shared memory handshake failed: " + std::string(e.what()) + '\n');
                 }
-                accepter();
             });
     }
     }
@@ -7,9 +7,17 @@
 */
 
 #include "scft-srv_version.hpp"
+#include "metrics.hpp"
+#include "metrics_exporter.hpp"
+#include "multicast_sender.hpp"
 #include "scrolling_log.hpp"
+#include "server_metrics.hpp"
 #include "room.hpp"
+#include "timer_wheel.hpp"
+#include "transport.hpp"
 #include <boost/asio.hpp>
+#include <chrono>
+#include <memory>
 
 namespace scft
 {
@@ -18,6 +26,48 @@ namespace scft
     */
     namespace server
     {
+        /**
+         * @brief Resolution of idle timeouts
+        */
+        constexpr std::chrono::milliseconds IDLE_CHECK_TICK{100};
+
+        /**
+         * @brief Server settings
+        */
+        struct server_options
+        {
+            std::string address = "0.0.0.0";               //!< IPV4 to listen on
+            std::uint16_t port = 0;                         //!< Port to listen on
+            std::string local_path;                         //!< Unix domain socket to listen on as well, empty to disable
+            std::string shm_path;                           //!< Unix domain socket shared memory clients hand their segment over, empty to disable
+            std::string metrics_address = "127.0.0.1";     //!< Prometheus exporter address
+            std::uint16_t metrics_port = 0;                 //!< Prometheus exporter port, 0 to disable
+            std::chrono::seconds read_timeout{60};          //!< Reap members silent for this long, 0 to disable
+            std::chrono::seconds write_timeout{60};         //!< Reap members not draining their queue for this long, 0 to disable
+            bool no_delay = false;                          //!< Set TCP_NODELAY on member sockets
+            std::uint32_t checksums = checksum::bit(checksum::CRC32) | checksum::bit(checksum::CRC32C)
+                | checksum::bit(checksum::XXH3_64);        //!< Checksum algorithms members may send, CRC32 is always allowed
+            std::string history_directory;                  //!< Broadcast history segments, empty to disable
+            std::size_t history_segment_bytes = 16 << 20;   //!< Size of a history segment file
+            std::uint64_t history_max_bytes = 256 << 20;    //!< Delete oldest segments beyond this size
+            std::chrono::seconds history_max_age{86400};    //!< Delete segments older than this, 0 to disable
+            std::uint64_t spill_threshold = 1 << 20;        //!< Spool received file contents above this to disk, 0 to disable
+            std::uint64_t memory_budget = 256 << 20;        //!< Bytes receive buffers and send queues may hold together
+            std::uint64_t max_text = 1 << 20;               //!< Refuse TEXT frames with more data
+            std::uint64_t max_file = 0;                     //!< Refuse WRITE_FILE frames with more data, 0 for the protocol limits
+            std::uint64_t member_ingress = 0;               //!< Bytes per second read from each member, 0 for unlimited
+            std::uint64_t member_egress = 0;                //!< Bytes per second written to each member, 0 for unlimited
+            std::uint64_t room_ingress = 0;                 //!< Bytes per second read from every member together, 0 for unlimited
+            std::uint64_t room_egress = 0;                  //!< Bytes per second written to every member together, 0 for unlimited
+            std::uint64_t egress_quantum = DEFAULT_QUANTUM; //!< Bytes per member turn when the room egress is contended
+            std::string multicast_group;                    //!< "IPV4:PORT" spooled files are multicast to, empty to disable
+            std::string multicast_interface;                //!< IPV4 of the interface to multicast on, empty for the system's choice
+            int multicast_ttl = 1;                          //!< Router hops of multicast datagrams
+            std::uint64_t multicast_rate = 50000000;        //!< Bytes per second sent to the multicast group
+            bool direct = true;                             //!< Let members offer files for others to fetch from them
+            std::chrono::seconds session_grace{30};         //!< Keep the session of a departed member this long, 0 to disable
+        };
+
         /**
          * @brief SCFT Server
         */
@@ -26,14 +76,12 @@ namespace scft
             /**
              * @brief Listen to specified address and port
              * @param io_ctx boost io context
-             * @param address IPV4 to listen on
-             * @param port to listen on
+             * @param options Addresses and ports
              * @param _log Log
             */
             public: server(
                 boost::asio::io_context& io_ctx,
-                const std::string& address,
-                std::uint16_t port,
+                const server_options& options,
                 basic_shell::scrolling_log& _log);
 
             /**
@@ -41,15 +89,109 @@ namespace scft
             */
             public: ~server();
 
+            /**
+             * @brief Close acceptors and members, io context runs out of work once their handlers complete
+            */
+            public: void stop();
+
+            /**
+             * @brief Metrics registry, safe to read from any thread
+             * @return Registry
+            */
+            public: metrics::registry& get_registry() { return m_registry; }
+
+            /**
+             * @brief Server wide metrics
+             * @return Metrics
+            */
+            public: server_metrics& get_metrics() { return m_metrics; }
+
             /**
              * @brief Listen
+             * @param _acceptor TCP or Unix domain acceptor
             */
-            private: void accepter();
+            private: void accepter(transport::acceptor& _acceptor);
+
+            /**
+             * @brief Listen for shared memory clients
+            */
+            private: void shm_accepter();
+
+            /**
+             * @brief Map the segment a shared memory client sends, then add it to the room
+             * @param _socket Accepted socket
+            */
+            private: void attach_shm(std::shared_ptr<transport::socket> _socket);
+
+            /**
+             * @brief Metrics registry
+            */
+            metrics::registry m_registry;
+
+            /**
+             * @brief Server wide metrics, outlive room and members
+            */
+            server_metrics m_metrics;
 
             /**
              * @brief TCP Accept socket
             */
-            boost::asio::ip::tcp::acceptor m_acceptor;
+            transport::acceptor m_acceptor;
+
+            /**
+             * @brief Listening port, kept for logging once closed
+            */
+            std::uint16_t m_port;
+
+            /**
+             * @brief Unix domain accept socket, null if disabled
+            */
+            std::unique_ptr<transport::acceptor> m_local_acceptor;
+
+            /**
+             * @brief Unix domain socket path, removed once closed
+            */
+            std::string m_local_path;
+
+            /**
+             * @brief Shared memory handshake accept socket, null if disabled
+            */
+            std::unique_ptr<transport::acceptor> m_shm_acceptor;
+
+            /**
+             * @brief Shared memory handshake socket path, removed once closed
+            */
+            std::string m_shm_path;
+
+            /**
+             * @brief Set TCP_NODELAY on accepted sockets
+            */
+            bool m_no_delay;
+
+            /**
+             * @brief Idle timeouts of every member
+            */
+            timer::timer_wheel m_wheel;
+
+            /**
+             * @brief Memory members may hold, outlives the room
+            */
+            memory_budget m_budget;
+
+            /**
+             * @brief Rate limits, outlives the room
+            */
+            bandwidth m_bandwidth;
+
+            /**
+             * @brief Broadcast history, null if disabled, outlives the room
+            */
+            std::unique_ptr<history> m_history;
+
+            /**
+             * @brief Multicast of spooled files, null if disabled, outlives the room
+            */
+            std::unique_ptr<multicast_sender> m_multicast;
 
             /**
              * @brief Server room
@@ -60,6 +202,11 @@ namespace scft
              * @brief Log to write to
             */
             basic_shell::scrolling_log& m_log;
+
+            /**
+             * @brief Prometheus exporter, null if disabled
+            */
+            std::unique_ptr<metrics_exporter> m_exporter;
         };
     }
 }
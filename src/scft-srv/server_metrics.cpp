@@ -0,0 +1,44 @@
+#include "server_metrics.hpp"
+
+namespace scft
+{
+    namespace server
+    {
+    server_metrics::server_metrics(metrics::registry& _registry)
+    :
+    registry(_registry),
+    accepts(_registry.make_counter("scft_accepts_total", "Accepted connections")),
+    members(_registry.make_gauge("scft_members", "Connected members")),
+    frames_in(_registry.make_counter("scft_frames_in_total", "Frames received from members")),
+    bytes_in(_registry.make_counter("scft_bytes_in_total", "Bytes received from members")),
+    frames_out(_registry.make_counter("scft_frames_out_total", "Frames sent to members")),
+    bytes_out(_registry.make_counter("scft_bytes_out_total", "Bytes sent to members")),
+    queued_frames(_registry.make_gauge("scft_queued_frames", "Frames waiting in member send queues")),
+    broadcasts(_registry.make_counter("scft_broadcasts_total", "Broadcasted frames")),
+    fanout(_registry.make_histogram("scft_broadcast_fanout_seconds", "Time to queue a broadcast to every member", metrics::latency_bounds())),
+    queue_wait(_registry.make_histogram("scft_frame_queue_wait_seconds", "Time a frame waited in a member send queue", metrics::latency_bounds())),
+    write(_registry.make_histogram("scft_frame_write_seconds", "Time to write a frame to a member", metrics::latency_bounds())),
+    pings(_registry.make_counter("scft_pings_total", "PING frames answered")),
+    timeouts(_registry.make_counter("scft_idle_timeouts_total", "Members reaped by a read or write idle timeout")),
+    memory_used(_registry.make_gauge("scft_memory_bytes", "Bytes held by receive buffers and send queues")),
+    memory_limit(_registry.make_gauge("scft_memory_budget_bytes", "Memory budget of receive buffers and send queues")),
+    deferred_frames(_registry.make_gauge("scft_deferred_frames", "Received headers waiting for memory")),
+    frames_deferred(_registry.make_counter("scft_frames_deferred_total", "Received headers that waited for memory")),
+    frames_refused(_registry.make_counter("scft_frames_refused_total", "Frames refused for their size")),
+    throttled_reads(_registry.make_counter("scft_throttled_reads_total", "Reads delayed by a member or room ingress rate")),
+    throttled_writes(_registry.make_counter("scft_throttled_writes_total", "Writes delayed by a member or room egress rate")),
+    throttle_delay(_registry.make_histogram("scft_throttle_delay_seconds", "Time a read or write was delayed by a rate", metrics::latency_bounds())),
+    egress_waiting(_registry.make_gauge("scft_egress_waiting", "Members waiting for their turn at the room egress rate")),
+    multicast_transfers(_registry.make_counter("scft_multicast_transfers_total", "Files multicast to members")),
+    multicast_datagrams(_registry.make_counter("scft_multicast_datagrams_total", "Datagrams sent to the multicast group")),
+    multicast_bytes(_registry.make_counter("scft_multicast_bytes_total", "Datagram bytes sent to the multicast group")),
+    multicast_repair_bytes(_registry.make_counter("scft_multicast_repair_bytes_total", "File bytes resent over TCP to members that missed datagrams")),
+    direct_offers(_registry.make_counter("scft_direct_offers_total", "Files offered for members to fetch from their sender directly")),
+    direct_relays(_registry.make_counter("scft_direct_relays_total", "Offered files relayed through the server to members that could not fetch them")),
+    resumed_sessions(_registry.make_counter("scft_resumed_sessions_total", "Reconnected members that resumed their session")),
+    resent_frames(_registry.make_counter("scft_resent_frames_total", "Unacknowledged frames sent again to resumed members")),
+    credit_stalls(_registry.make_counter("scft_credit_stalls_total", "Times a member's queue waited for its receive window to open"))
+    {
+    }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef SERVER_METRICS_HPP
+#define SERVER_METRICS_HPP
+
+/**
+ * @file src/scft-srv/server_metrics.hpp
+ * @brief Defines server_metrics, the server wide metrics shared by room and members
+*/
+
+#include "metrics.hpp"
+
+#include <memory>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Server wide metrics, per member ones are owned by each member
+        */
+        struct server_metrics
+        {
+            /**
+             * @brief Register every server wide metric
+             * @param _registry Registry to register in
+            */
+            server_metrics(metrics::registry& _registry);
+
+            metrics::registry& registry;                        //!< Registry, for per member metrics
+            std::shared_ptr<metrics::counter> accepts;          //!< Accepted connections
+            std::shared_ptr<metrics::gauge> members;            //!< Current members
+            std::shared_ptr<metrics::counter> frames_in;        //!< Frames read from members
+            std::shared_ptr<metrics::counter> bytes_in;         //!< Bytes read from members
+            std::shared_ptr<metrics::counter> frames_out;       //!< Frames written to members
+            std::shared_ptr<metrics::counter> bytes_out;        //!< Bytes written to members
+            std::shared_ptr<metrics::gauge> queued_frames;      //!< Messages waiting in every member send queue
+            std::shared_ptr<metrics::counter> broadcasts;       //!< room::broadcast calls
+            std::shared_ptr<metrics::histogram> fanout;         //!< Time spent queueing a broadcast to every member
+            std::shared_ptr<metrics::histogram> queue_wait;     //!< Time a frame waited in a recipient queue
+            std::shared_ptr<metrics::histogram> write;          //!< Time spent writing a frame to a recipient
+            std::shared_ptr<metrics::counter> pings;            //!< PING frames answered
+            std::shared_ptr<metrics::counter> timeouts;         //!< Members reaped by an idle timeout
+            std::shared_ptr<metrics::gauge> memory_used;        //!< Bytes reserved in memory_budget
+            std::shared_ptr<metrics::gauge> memory_limit;       //!< memory_budget limit
+            std::shared_ptr<metrics::gauge> deferred_frames;    //!< Frames waiting for memory
+            std::shared_ptr<metrics::counter> frames_deferred;  //!< Frames that had to wait for memory
+            std::shared_ptr<metrics::counter> frames_refused;   //!< Frames above a type limit or the whole budget
+            std::shared_ptr<metrics::counter> throttled_reads;  //!< Reads delayed by an ingress rate
+            std::shared_ptr<metrics::counter> throttled_writes; //!< Writes delayed by an egress rate
+            std::shared_ptr<metrics::histogram> throttle_delay; //!< Time a read or write was delayed by a rate
+            std::shared_ptr<metrics::gauge> egress_waiting;     //!< Writes waiting for their turn at the room egress
+            std::shared_ptr<metrics::counter> multicast_transfers;      //!< Files multicast
+            std::shared_ptr<metrics::counter> multicast_datagrams;      //!< Datagrams sent to the multicast group
+            std::shared_ptr<metrics::counter> multicast_bytes;          //!< Datagram bytes sent to the multicast group
+            std::shared_ptr<metrics::counter> multicast_repair_bytes;   //!< File bytes resent to members that missed datagrams
+            std::shared_ptr<metrics::counter> direct_offers;    //!< Files offered for members to fetch from their sender
+            std::shared_ptr<metrics::counter> direct_relays;    //!< Offered files relayed to members that could not fetch them
+            std::shared_ptr<metrics::counter> resumed_sessions; //!< Reconnections that resumed a session
+            std::shared_ptr<metrics::counter> resent_frames;    //!< Unacknowledged frames sent again after a resume
+            std::shared_ptr<metrics::counter> credit_stalls;    //!< Times a member's queue waited for its receive window
+        };
+    }
+}
+
+#endif /* SERVER_METRICS_HPP */
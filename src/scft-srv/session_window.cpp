@@ -0,0 +1,137 @@
+#include "session_window.hpp"
+
+#include <algorithm>
+
+namespace scft
+{
+    namespace server
+    {
+    session_window::session_window()
+    :
+    m_retaining(false),
+    m_received(0),
+    m_acknowledged(0),
+    m_sequence(0),
+    m_acked(0),
+    m_resend(1),
+    m_unacked_bytes(0),
+    m_window(0),
+    m_sent_bytes(0),
+    m_acked_bytes(0)
+    {
+    }
+
+    session_window::~session_window()
+    {
+    }
+
+    void session_window::receive(message::MESSAGE_TYPE message_type, std::uint32_t flags)
+    {
+        if (message::is_sequenced(message_type, flags))
+            m_received++;
+    }
+
+    std::uint64_t session_window::take_ack()
+    {
+        m_acknowledged = m_received;
+        return m_received;
+    }
+
+    void session_window::start_retaining()
+    {
+        // Frames written before are not kept, the client got them before the answer
+        m_retaining = true;
+        m_acked = m_sequence;
+    }
+
+    void session_window::stop_retaining()
+    {
+        m_retaining = false;
+        m_unacked.clear();
+        m_unacked_bytes = 0;
+    }
+
+    void session_window::set_window(std::uint64_t window)
+    {
+        m_window = window;
+        m_acked_bytes = m_sent_bytes;
+        m_credit.clear();
+    }
+
+    bool session_window::can_resume(std::uint64_t received) const
+    {
+        return m_retaining && received >= m_acked && received <= m_sequence;
+    }
+
+    std::uint64_t session_window::resume_from(std::uint64_t received)
+    {
+        acknowledge(received);
+        m_resend = received + 1;
+        return m_sequence - received;
+    }
+
+    void session_window::acknowledge(std::uint64_t received)
+    {
+        received = std::min(received, m_sequence);
+        while (!m_unacked.empty() && m_unacked.front().sequence <= received)
+        {
+            m_unacked_bytes -= m_unacked.front().frame.get_raw_message().size();
+            m_unacked.pop_front();
+        }
+        m_acked = std::max(m_acked, received);
+        while (!m_credit.empty() && m_credit.front().first <= received)
+        {
+            m_acked_bytes = m_credit.front().second;
+            m_credit.pop_front();
+        }
+    }
+
+    bool session_window::has_credit() const
+    {
+        // One frame always goes, however large, so a window below a frame does not stop the member for good
+        return m_window == 0 || m_sent_bytes == m_acked_bytes || m_sent_bytes - m_acked_bytes < m_window;
+    }
+
+    bool session_window::take_resend(mux::scheduled_frame& frame)
+    {
+        m_resend = std::max(m_resend, m_acked + 1);
+        if (m_resend <= m_sequence && m_resend - m_acked - 1 < m_unacked.size())
+        {
+            frame = m_unacked[m_resend - m_acked - 1];
+            frame.first = false;
+            frame.last = false;
+            frame.queued_len = 0;
+            m_resend++;
+            return true;
+        }
+        // Frames the session stopped keeping are lost
+        m_resend = m_sequence + 1;
+        return false;
+    }
+
+    void session_window::number(mux::scheduled_frame& frame)
+    {
+        if (!message::is_sequenced(frame.frame.get_message_type(), frame.frame.get_flags()))
+            return;
+        frame.sequence = ++m_sequence;
+        m_resend = m_sequence + 1;
+        if (m_window != 0)
+        {
+            m_sent_bytes += frame.frame.get_raw_message().size();
+            if (frame.frame.get_payload_file())
+                m_sent_bytes += frame.frame.get_payload_file()->get_length();
+            m_credit.emplace_back(m_sequence, m_sent_bytes);
+        }
+    }
+
+    bool session_window::retain(mux::scheduled_frame frame)
+    {
+        // Frames sent again are kept already
+        if (!m_retaining || frame.sequence <= m_acked || (!m_unacked.empty() && frame.sequence <= m_unacked.back().sequence))
+            return true;
+        m_unacked_bytes += frame.frame.get_raw_message().size();
+        m_unacked.push_back(std::move(frame));
+        return m_unacked_bytes <= SESSION_RETAINED_BYTES;
+    }
+    }
+}
@@ -0,0 +1,215 @@
+#ifndef SESSION_WINDOW_HPP
+#define SESSION_WINDOW_HPP
+
+/**
+ * @file src/scft-srv/session_window.hpp
+ * @brief Defines session_window class, sequence numbers, acknowledgements and receive window of one connection
+*/
+
+#include "frame_scheduler.hpp"
+#include "scft_message.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+namespace scft
+{
+    namespace server
+    {
+        /**
+         * @brief Unacknowledged frames kept for a session beyond this end it 16M, file contents on disk do not count
+        */
+        constexpr std::uint64_t SESSION_RETAINED_BYTES = 16777216;
+
+        /**
+         * @brief Frames numbered both ways on a connection, those kept until the client acknowledges them and the credit its window leaves
+         * @note Sequence numbers are implicit, each side counts the sequenced frames it sends and receives
+        */
+        class session_window
+        {
+            /**
+             * @brief Nothing sent or received, no window
+            */
+            public: session_window();
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~session_window();
+
+            /**
+             * @brief Count a received frame
+             * @param message_type Its type
+             * @param flags Its version 2 flags
+            */
+            public: void receive(message::MESSAGE_TYPE message_type, std::uint32_t flags);
+
+            /**
+             * @brief Sequence number of the last frame received
+             * @return Sequence number
+            */
+            public: std::uint64_t get_received() const { return m_received; }
+
+            /**
+             * @brief Check if the client counts on ACKs, for a session or a receive window
+             * @return True if frames are acknowledged
+            */
+            public: bool is_acknowledging() const { return m_retaining || m_window != 0; }
+
+            /**
+             * @brief Check if frames were received since the last ACK
+             * @return True if an ACK would tell the client something
+            */
+            public: bool has_ack() const { return is_acknowledging() && m_received != m_acknowledged; }
+
+            /**
+             * @brief Check if ACK_INTERVAL frames were received since the last ACK
+             * @return True if an ACK is due even without frames to send
+            */
+            public: bool is_ack_due() const { return is_acknowledging() && m_received - m_acknowledged >= message::ACK_INTERVAL; }
+
+            /**
+             * @brief Acknowledge the frames received so far
+             * @return Sequence number to send in the ACK
+            */
+            public: std::uint64_t take_ack();
+
+            /**
+             * @brief Keep written frames until acknowledged, from the next one taken from the queue on
+            */
+            public: void start_retaining();
+
+            /**
+             * @brief Forget kept frames and stop keeping them
+            */
+            public: void stop_retaining();
+
+            /**
+             * @brief Set the receive window, counted from the next frame taken from the queue
+             * @param window Bytes, 0 for none
+            */
+            public: void set_window(std::uint64_t window);
+
+            /**
+             * @brief Check if the client can resume from where it stopped receiving
+             * @param received Sequence number of the last frame the client got
+             * @return True if every frame after it is kept
+            */
+            public: bool can_resume(std::uint64_t received) const;
+
+            /**
+             * @brief Send again every kept frame after the last one the client got
+             * @param received Sequence number of the last frame the client got, checked by can_resume()
+             * @return Frames to send again
+            */
+            public: std::uint64_t resume_from(std::uint64_t received);
+
+            /**
+             * @brief Forget frames the client acknowledged and give their credit back
+             * @param received Sequence number of the last frame the client got
+            */
+            public: void acknowledge(std::uint64_t received);
+
+            /**
+             * @brief Check the receive window of the client against what it did not acknowledge yet
+             * @return True if another frame may be taken from the queue
+            */
+            public: bool has_credit() const;
+
+            /**
+             * @brief Check if kept frames wait to be sent again
+             * @return True until caught up
+            */
+            public: bool has_resend() const { return m_resend <= m_sequence; }
+
+            /**
+             * @brief Take the next kept frame to send again
+             * @param frame Filled, its message counts as written already
+             * @return False once caught up
+            */
+            public: bool take_resend(mux::scheduled_frame& frame);
+
+            /**
+             * @brief Number a frame taken from the queue and charge it to the window
+             * @param frame Frame, left unnumbered unless sequenced
+            */
+            public: void number(mux::scheduled_frame& frame);
+
+            /**
+             * @brief Keep a written frame until the client acknowledges it
+             * @param frame Frame, ignored unless retaining, sequenced and new
+             * @return False once the kept frames exceed SESSION_RETAINED_BYTES
+            */
+            public: bool retain(mux::scheduled_frame frame);
+
+            /**
+             * @brief Frames kept
+             * @return Frame count
+            */
+            public: std::size_t get_retained() const { return m_unacked.size(); }
+
+            /**
+             * @brief Written frames are kept until acknowledged
+            */
+            private: bool m_retaining;
+
+            /**
+             * @brief Sequence number of the last frame received
+            */
+            private: std::uint64_t m_received;
+
+            /**
+             * @brief Sequence number in the last ACK sent
+            */
+            private: std::uint64_t m_acknowledged;
+
+            /**
+             * @brief Sequence number of the last frame taken from the queue
+            */
+            private: std::uint64_t m_sequence;
+
+            /**
+             * @brief Sequence number the client last acknowledged
+            */
+            private: std::uint64_t m_acked;
+
+            /**
+             * @brief Sequence number of the next frame to send again, past m_sequence when caught up
+            */
+            private: std::uint64_t m_resend;
+
+            /**
+             * @brief Written frames not acknowledged yet, in sequence
+            */
+            private: std::deque<mux::scheduled_frame> m_unacked;
+
+            /**
+             * @brief Buffer bytes of m_unacked
+            */
+            private: std::uint64_t m_unacked_bytes;
+
+            /**
+             * @brief Receive window the client advertised, 0 if it did not
+            */
+            private: std::uint64_t m_window;
+
+            /**
+             * @brief Bytes of sequenced frames taken from the queue, contents included
+            */
+            private: std::uint64_t m_sent_bytes;
+
+            /**
+             * @brief m_sent_bytes up to the frame the client last acknowledged
+            */
+            private: std::uint64_t m_acked_bytes;
+
+            /**
+             * @brief Sequence number and m_sent_bytes after each frame not acknowledged yet
+            */
+            private: std::deque<std::pair<std::uint64_t, std::uint64_t>> m_credit;
+        };
+    }
+}
+
+#endif /* SESSION_WINDOW_HPP */
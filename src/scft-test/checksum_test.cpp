@@ -0,0 +1,136 @@
+#include "checksum.hpp"
+#include "crc32.hpp"
+#include "temp_file.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace scft;
+
+/**
+ * @brief Check value input of the CRC catalogue
+*/
+constexpr const char* CHECK_INPUT = "123456789";
+
+/**
+ * @brief Seed of the generated inputs
+*/
+constexpr std::uint64_t SEED = 0x5CF7;
+
+/**
+ * @brief Bit at a time reflected CRC, unfinalized like the library's
+ * @param buffer Buffer
+ * @param size Buffer size
+ * @param polynomial Reflected polynomial
+ * @return State
+*/
+static std::uint32_t bitwise_crc(const std::uint8_t* buffer, std::size_t size, std::uint32_t polynomial)
+{
+    std::uint32_t crc = ~0U;
+    for (std::size_t index = 0; index < size; index++)
+    {
+        crc ^= buffer[index];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (polynomial & (0U - (crc & 1)));
+    }
+    return crc;
+}
+
+/**
+ * @brief Hash a buffer through a hasher, fed in pieces of a given size
+ * @param algorithm Algorithm
+ * @param buffer Buffer
+ * @param piece Bytes per update
+ * @return Digest
+*/
+static std::uint64_t hash_in_pieces(checksum::ALGORITHM algorithm, const std::vector<std::uint8_t>& buffer, std::size_t piece)
+{
+    checksum::hasher _hasher(algorithm);
+    for (std::size_t offset = 0; offset < buffer.size(); offset += piece)
+        _hasher.update(buffer.data() + offset, std::min(piece, buffer.size() - offset));
+    return _hasher.digest();
+}
+
+TEST(checksum, crc32_check_value)
+{
+    EXPECT_EQ(crc32::get_crc32(CHECK_INPUT, std::strlen(CHECK_INPUT)), ~0xCBF43926U);
+}
+
+TEST(checksum, crc32c_check_value)
+{
+    EXPECT_EQ(~checksum::get_crc32c(CHECK_INPUT, std::strlen(CHECK_INPUT)), 0xE3069283U);
+    checksum::hasher _hasher(checksum::CRC32C);
+    _hasher.update(CHECK_INPUT, std::strlen(CHECK_INPUT));
+    EXPECT_EQ(_hasher.digest(), 0xE3069283U);
+}
+
+TEST(checksum, crc_matches_bitwise_reference)
+{
+    // Lengths around the word and unrolled block sizes of the table and instruction paths
+    std::vector<std::uint8_t> buffer = make_buffer(4099, SEED);
+    for (std::size_t size : {0, 1, 3, 7, 8, 9, 63, 64, 65, 255, 1024, 4099})
+    {
+        EXPECT_EQ(crc32::get_crc32(buffer.data(), size), bitwise_crc(buffer.data(), size, 0xEDB88320U)) << size;
+        EXPECT_EQ(checksum::get_crc32c(buffer.data(), size), bitwise_crc(buffer.data(), size, 0x82F63B78U)) << size;
+        // Unaligned start
+        EXPECT_EQ(checksum::get_crc32c(buffer.data() + 1, size - (size != 0)), bitwise_crc(buffer.data() + 1, size - (size != 0), 0x82F63B78U)) << size;
+    }
+}
+
+TEST(checksum, xxh3_empty)
+{
+    EXPECT_EQ(checksum::get_xxh3_64(nullptr, 0), 0x2D06800538D394C2ULL);
+    EXPECT_EQ(checksum::hasher(checksum::XXH3_64).digest(), 0x2D06800538D394C2ULL);
+}
+
+TEST(checksum, hasher_matches_one_shot)
+{
+    // Every short and mid size path, then several 1K blocks and a partial one
+    std::vector<std::uint8_t> source = make_buffer(5000, SEED);
+    for (std::size_t size = 0; size <= source.size(); size += size < 300 ? 1 : 61)
+    {
+        std::vector<std::uint8_t> buffer(source.begin(), source.begin() + size);
+        std::uint64_t xxh3 = checksum::get_xxh3_64(buffer.data(), buffer.size());
+        std::uint32_t crc32c = ~checksum::get_crc32c(buffer.data(), buffer.size());
+        std::uint32_t crc32 = crc32::get_crc32(buffer.data(), buffer.size());
+        for (std::size_t piece : {1, 7, 64, 100, 256, 1000, 5000})
+        {
+            EXPECT_EQ(hash_in_pieces(checksum::XXH3_64, buffer, piece), xxh3) << size << " " << piece;
+            EXPECT_EQ(hash_in_pieces(checksum::CRC32C, buffer, piece), crc32c) << size << " " << piece;
+            EXPECT_EQ(hash_in_pieces(checksum::CRC32, buffer, piece), crc32) << size << " " << piece;
+            EXPECT_EQ(hash_in_pieces(checksum::NONE, buffer, piece), 0u);
+        }
+    }
+}
+
+TEST(checksum, xxh3_detects_changes)
+{
+    std::vector<std::uint8_t> buffer = make_buffer(3000, SEED);
+    for (std::size_t size : {1, 16, 17, 128, 129, 240, 241, 3000})
+    {
+        std::uint64_t original = checksum::get_xxh3_64(buffer.data(), size);
+        buffer[size - 1] ^= 1;
+        EXPECT_NE(checksum::get_xxh3_64(buffer.data(), size), original) << size;
+        buffer[size - 1] ^= 1;
+    }
+}
+
+TEST(checksum, names)
+{
+    for (std::uint8_t index = 0; index <= checksum::LAST_ALGORITHM; index++)
+    {
+        checksum::ALGORITHM algorithm = static_cast<checksum::ALGORITHM>(index);
+        checksum::ALGORITHM parsed;
+        ASSERT_TRUE(checksum::parse_name(checksum::get_name(algorithm), parsed));
+        EXPECT_EQ(parsed, algorithm);
+    }
+    checksum::ALGORITHM parsed;
+    EXPECT_FALSE(checksum::parse_name("md5", parsed));
+    EXPECT_EQ(checksum::parse_names("crc32c,xxh3-64"), checksum::bit(checksum::CRC32C) | checksum::bit(checksum::XXH3_64));
+    EXPECT_EQ(checksum::parse_names(""), 0u);
+    EXPECT_THROW(checksum::parse_names("crc32,md5"), std::runtime_error);
+}
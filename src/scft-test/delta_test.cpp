@@ -0,0 +1,213 @@
+#include "delta.hpp"
+#include "temp_file.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace scft;
+
+/**
+ * @brief Frame size used to serialize operations, smaller than a block so literals span frames
+*/
+constexpr std::size_t FRAME_SIZE = 1000;
+
+/**
+ * @brief Result of rebuilding a copy
+*/
+struct rebuilt
+{
+    std::vector<std::uint8_t> contents;     //!< Copy once patched
+    std::uint64_t literal_bytes = 0;        //!< Bytes sent as literals
+    std::uint64_t copied_bytes = 0;         //!< Bytes copied within the copy
+};
+
+/**
+ * @brief Run a transfer the way peers do, signatures of the copy sent over, operations encoded and applied to it in place
+ * @param copy Receiver's copy
+ * @param contents New contents
+ * @return Patched copy
+*/
+static rebuilt transfer(const temp_file& copy, const std::vector<std::uint8_t>& contents)
+{
+    rebuilt result;
+    std::vector<std::uint8_t> wire = delta::write_signatures(delta::compute_signatures(copy.get_path()));
+    delta::signatures _signatures;
+    EXPECT_TRUE(delta::read_signatures_header(wire.data(), _signatures));
+    EXPECT_EQ(wire.size(), delta::SIGNATURES_HEADER_SIZE + delta::get_blocks_size(_signatures));
+    delta::read_blocks(wire.data() + delta::SIGNATURES_HEADER_SIZE, _signatures);
+
+    delta::source _source{"", contents.data(), contents.size()};
+    std::vector<delta::op> ops;
+    EXPECT_TRUE(delta::encode(_source, _signatures, ops));
+    delta::op_writer writer(_source, std::move(ops));
+    delta::patcher _patcher(copy.get_path(), _signatures.length, contents.size());
+    EXPECT_TRUE(_patcher.is_open());
+    std::vector<std::uint8_t> frame;
+    while (!writer.done())
+    {
+        EXPECT_TRUE(writer.next(frame, FRAME_SIZE));
+        EXPECT_LE(frame.size(), FRAME_SIZE);
+        EXPECT_TRUE(_patcher.apply(frame.data(), frame.size()));
+    }
+    EXPECT_TRUE(_patcher.complete());
+    EXPECT_TRUE(_patcher.finish());
+
+    std::ifstream in_file{copy.get_path(), std::ios::in | std::ios::binary};
+    result.contents.assign(std::istreambuf_iterator<char>(in_file), std::istreambuf_iterator<char>());
+    result.literal_bytes = writer.get_literal_bytes();
+    result.copied_bytes = _patcher.get_copied_bytes();
+    return result;
+}
+
+TEST(delta, block_size)
+{
+    EXPECT_EQ(delta::choose_block_size(0), delta::MIN_BLOCK_SIZE);
+    EXPECT_EQ(delta::choose_block_size(1000000), delta::MIN_BLOCK_SIZE);
+    EXPECT_EQ(delta::choose_block_size(std::uint64_t(1) << 40), delta::MAX_BLOCK_SIZE);
+    std::uint32_t previous = 0;
+    for (std::uint64_t length = 1; length < (std::uint64_t(1) << 42); length *= 3)
+    {
+        std::uint32_t block_size = delta::choose_block_size(length);
+        EXPECT_EQ(block_size & (block_size - 1), 0u);
+        EXPECT_GE(block_size, previous);
+        previous = block_size;
+    }
+}
+
+TEST(delta, weak_checksum_rolls)
+{
+    const std::size_t block_size = 64;
+    std::vector<std::uint8_t> buffer = make_buffer(1000, 1);
+    std::uint32_t a;
+    std::uint32_t b;
+    delta::weak_checksum(buffer.data(), block_size, a, b);
+    for (std::size_t position = 0; position + block_size < buffer.size(); position++)
+    {
+        std::uint32_t out = buffer[position];
+        a += buffer[position + block_size] - out;
+        b += a - static_cast<std::uint32_t>(block_size) * out;
+        std::uint32_t expected_a;
+        std::uint32_t expected_b;
+        std::uint32_t expected = delta::weak_checksum(buffer.data() + position + 1, block_size, expected_a, expected_b);
+        ASSERT_EQ((a & 0xffff) | (b << 16), expected) << position;
+    }
+}
+
+TEST(delta, signatures_round_trip)
+{
+    temp_file copy("signatures", 5 * delta::MIN_BLOCK_SIZE + 100);
+    delta::signatures computed = delta::compute_signatures(copy.get_path());
+    EXPECT_EQ(computed.block_size, delta::MIN_BLOCK_SIZE);
+    EXPECT_EQ(computed.length, copy.get_contents().size());
+    ASSERT_EQ(computed.blocks.size(), 5u);
+
+    std::vector<std::uint8_t> wire = delta::write_signatures(computed);
+    delta::signatures parsed;
+    ASSERT_TRUE(delta::read_signatures_header(wire.data(), parsed));
+    ASSERT_EQ(delta::get_blocks_size(parsed), 5 * delta::SIGNATURE_SIZE);
+    delta::read_blocks(wire.data() + delta::SIGNATURES_HEADER_SIZE, parsed);
+    ASSERT_EQ(parsed.blocks.size(), computed.blocks.size());
+    for (std::size_t block = 0; block < parsed.blocks.size(); block++)
+    {
+        EXPECT_EQ(parsed.blocks[block].weak, computed.blocks[block].weak);
+        EXPECT_EQ(parsed.blocks[block].strong, computed.blocks[block].strong);
+    }
+
+    // Missing copies have no block size, bad block sizes are refused
+    EXPECT_EQ(delta::compute_signatures("scft-test-missing.bin").block_size, 0u);
+    delta::signatures bad;
+    bad.block_size = delta::MIN_BLOCK_SIZE + 1;
+    EXPECT_FALSE(delta::read_signatures_header(delta::write_signatures(bad).data(), parsed));
+}
+
+TEST(delta, unchanged_copy_sends_no_literals)
+{
+    temp_file copy("unchanged", 40 * delta::MIN_BLOCK_SIZE + 123);
+    std::vector<std::uint8_t> contents = copy.get_contents();
+    rebuilt result = transfer(copy, contents);
+    EXPECT_EQ(result.contents, contents);
+    // Only the tail shorter than a block
+    EXPECT_EQ(result.literal_bytes, 123u);
+}
+
+TEST(delta, edited_copy_sends_changes)
+{
+    temp_file copy("edited", 100 * delta::MIN_BLOCK_SIZE);
+    std::vector<std::uint8_t> contents = copy.get_contents();
+    for (std::size_t index = 0; index < 300; index++)
+        contents[30 * delta::MIN_BLOCK_SIZE + 5 + index] ^= 0x5A;
+    contents.erase(contents.begin() + 60 * delta::MIN_BLOCK_SIZE, contents.begin() + 65 * delta::MIN_BLOCK_SIZE + 17);
+
+    rebuilt result = transfer(copy, contents);
+    EXPECT_EQ(result.contents, contents);
+    EXPECT_LT(result.literal_bytes, 3 * delta::MIN_BLOCK_SIZE);
+    EXPECT_EQ(result.literal_bytes + result.copied_bytes, contents.size());
+}
+
+TEST(delta, inserted_bytes_are_rebuilt_in_place)
+{
+    // Blocks after an insertion are behind the rebuilt position, so they go as literals
+    temp_file copy("inserted", 20 * delta::MIN_BLOCK_SIZE);
+    std::vector<std::uint8_t> contents = copy.get_contents();
+    std::vector<std::uint8_t> inserted = make_buffer(777, 2);
+    contents.insert(contents.begin() + 10 * delta::MIN_BLOCK_SIZE + 5, inserted.begin(), inserted.end());
+    rebuilt result = transfer(copy, contents);
+    EXPECT_EQ(result.contents, contents);
+    EXPECT_EQ(result.copied_bytes, 10 * delta::MIN_BLOCK_SIZE);
+}
+
+TEST(delta, moved_blocks_are_rebuilt_in_place)
+{
+    // The second half moves to the front, copies can not read what was already rebuilt over
+    temp_file copy("moved", 20 * delta::MIN_BLOCK_SIZE);
+    std::vector<std::uint8_t> contents(copy.get_contents().begin() + 10 * delta::MIN_BLOCK_SIZE, copy.get_contents().end());
+    contents.insert(contents.end(), copy.get_contents().begin(), copy.get_contents().begin() + 10 * delta::MIN_BLOCK_SIZE);
+    rebuilt result = transfer(copy, contents);
+    EXPECT_EQ(result.contents, contents);
+    EXPECT_GT(result.copied_bytes, 0u);
+}
+
+TEST(delta, missing_copy_sends_everything)
+{
+    std::vector<std::uint8_t> contents = make_buffer(10000, 3);
+    rebuilt result;
+    {
+        temp_file copy("grown", std::vector<std::uint8_t>());
+        std::remove(copy.get_path().c_str());
+        result = transfer(copy, contents);
+    }
+    EXPECT_EQ(result.contents, contents);
+    EXPECT_EQ(result.literal_bytes, contents.size());
+    EXPECT_EQ(result.copied_bytes, 0u);
+}
+
+TEST(delta, patcher_refuses_bad_operations)
+{
+    temp_file copy("refused", 4 * delta::MIN_BLOCK_SIZE);
+    std::vector<std::uint8_t> data(delta::COPY_OP_SIZE);
+    std::uint64_t offset = 3 * delta::MIN_BLOCK_SIZE;
+    std::uint64_t count = 2 * delta::MIN_BLOCK_SIZE;
+    data[0] = delta::OP_COPY;
+    std::memcpy(data.data() + 1, &offset, 8);
+    std::memcpy(data.data() + 9, &count, 8);
+    {
+        // Past the end of the copy
+        delta::patcher _patcher(copy.get_path(), copy.get_contents().size(), copy.get_contents().size());
+        EXPECT_FALSE(_patcher.apply(data.data(), data.size()));
+    }
+    {
+        // Unknown operation, and a literal longer than its data
+        delta::patcher _patcher(copy.get_path(), copy.get_contents().size(), copy.get_contents().size());
+        std::uint8_t unknown[] = {0, 0, 0, 0, 0};
+        EXPECT_FALSE(_patcher.apply(unknown, sizeof(unknown)));
+        std::uint8_t literal[] = {delta::OP_LITERAL, 10, 0, 0, 0, 1, 2};
+        delta::patcher other(copy.get_path(), copy.get_contents().size(), copy.get_contents().size());
+        EXPECT_FALSE(other.apply(literal, sizeof(literal)));
+    }
+}
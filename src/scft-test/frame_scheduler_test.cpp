@@ -0,0 +1,185 @@
+#include "frame_scheduler.hpp"
+#include "temp_file.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace scft;
+
+/**
+ * @brief Take the next frame, checking next_size() announced its size
+ * @param scheduler Non empty scheduler
+ * @return Frame
+*/
+static mux::scheduled_frame take(mux::frame_scheduler& scheduler)
+{
+    std::size_t expected = scheduler.next_size();
+    mux::scheduled_frame next = scheduler.take();
+    EXPECT_EQ(next.frame.get_raw_message().size(), expected);
+    return next;
+}
+
+TEST(frame_scheduler, lanes)
+{
+    EXPECT_EQ(mux::get_lane(message::PING), mux::CONTROL);
+    EXPECT_EQ(mux::get_lane(message::NACK), mux::CONTROL);
+    EXPECT_EQ(mux::get_lane(message::TEXT), mux::CHAT);
+    EXPECT_EQ(mux::get_lane(message::WRITE_FILE), mux::BULK);
+    EXPECT_EQ(mux::get_lane(message::MULTICAST_END), mux::BULK);
+    EXPECT_EQ(mux::get_lane(message::REPAIR), mux::BULK);
+}
+
+TEST(frame_scheduler, control_before_chat_before_bulk)
+{
+    temp_file file("lanes", 1000);
+    mux::frame_scheduler scheduler;
+    scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, file.get_path()));
+    scheduler.push(message::message(message::TEXT, "127.0.0.1", 7200, "first"));
+    scheduler.push(message::message(message::TEXT, "127.0.0.1", 7200, "second"));
+    scheduler.push(message::message(message::PING, "127.0.0.1", 7200, "1"));
+    EXPECT_EQ(scheduler.size(), 4u);
+
+    std::vector<message::MESSAGE_TYPE> order;
+    std::vector<std::string> texts;
+    while (!scheduler.empty())
+    {
+        std::uint64_t queued = scheduler.next_size();
+        mux::scheduled_frame next = take(scheduler);
+        EXPECT_TRUE(next.first);
+        EXPECT_TRUE(next.last);
+        EXPECT_EQ(next.queued_len, queued);
+        order.push_back(next.frame.get_message_type());
+        if (next.frame.get_message_type() == message::TEXT)
+            texts.push_back(next.frame.get_string());
+    }
+    EXPECT_EQ(order, (std::vector<message::MESSAGE_TYPE>{message::PING, message::TEXT, message::TEXT, message::WRITE_FILE}));
+    EXPECT_EQ(texts, (std::vector<std::string>{"first", "second"}));
+}
+
+TEST(frame_scheduler, texts_keep_sender_order)
+{
+    // Texts of any size, between files, control frames and another sender's texts
+    temp_file file("ordered", 3 * message::STREAM_CHUNK_SIZE);
+    mux::frame_scheduler scheduler;
+    scheduler.set_chunking(true);
+    std::vector<std::string> sent{"hello", std::string(4 * message::STREAM_CHUNK_SIZE, 'b'), std::string(message::STREAM_CHUNK_SIZE + 1, 'm'), "bye"};
+    scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, file.get_path()));
+    for (const std::string& text : sent)
+    {
+        scheduler.push(message::message(message::TEXT, "127.0.0.1", 7200, text));
+        scheduler.push(message::message(message::TEXT, "127.0.0.1", 7201, "other"));
+        scheduler.push(message::message(message::PING, "127.0.0.1", 7200, "1"));
+    }
+
+    std::vector<std::string> received;
+    while (!scheduler.empty())
+    {
+        mux::scheduled_frame next = take(scheduler);
+        if (next.frame.get_message_type() == message::TEXT && std::string(next.frame.get_origin()) == "127.0.0.1:7200")
+            received.push_back(next.frame.get_string());
+    }
+    EXPECT_EQ(received, sent);
+}
+
+TEST(frame_scheduler, files_sent_whole_without_chunking)
+{
+    temp_file file("whole", 3 * message::STREAM_CHUNK_SIZE);
+    mux::frame_scheduler scheduler;
+    scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, file.get_path()));
+    mux::scheduled_frame next = take(scheduler);
+    EXPECT_FALSE(next.frame.is_chunked());
+    EXPECT_EQ(next.frame.get_file_buffer_len(), file.get_contents().size());
+    EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(frame_scheduler, chunks_large_files)
+{
+    temp_file file("chunked", 3 * message::STREAM_CHUNK_SIZE + 100);
+    mux::frame_scheduler scheduler;
+    scheduler.set_chunking(true);
+    message::message source(message::WRITE_FILE, "127.0.0.1", 7200, file.get_path());
+    std::uint64_t source_checksum = source.get_checksum();
+    scheduler.push(std::move(source));
+
+    mux::scheduled_frame announce = take(scheduler);
+    EXPECT_EQ(announce.frame.get_message_type(), message::WRITE_FILE);
+    EXPECT_TRUE(announce.frame.is_chunked());
+    EXPECT_EQ(announce.frame.get_stream_id(), 1u);
+    EXPECT_EQ(announce.frame.get_checksum(), source_checksum);
+    EXPECT_EQ(announce.frame.get_file_buffer_len(), file.get_contents().size());
+    EXPECT_TRUE(announce.first);
+    EXPECT_FALSE(announce.last);
+
+    std::vector<std::uint8_t> received;
+    bool last = false;
+    while (!last)
+    {
+        ASSERT_FALSE(scheduler.empty());
+        mux::scheduled_frame chunk = take(scheduler);
+        EXPECT_EQ(chunk.frame.get_message_type(), message::CHUNK);
+        EXPECT_EQ(chunk.frame.get_stream_id(), 1u);
+        EXPECT_FALSE(chunk.first);
+        received.insert(received.end(), chunk.frame.get_file_buffer(), chunk.frame.get_file_buffer() + chunk.frame.get_file_buffer_len());
+        last = chunk.last;
+    }
+    EXPECT_EQ(received, file.get_contents());
+    EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(frame_scheduler, streams_take_turns)
+{
+    temp_file first("first", 2 * message::STREAM_CHUNK_SIZE);
+    temp_file second("second", 2 * message::STREAM_CHUNK_SIZE);
+    mux::frame_scheduler scheduler;
+    scheduler.set_chunking(true);
+    scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, first.get_path()));
+    scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, second.get_path()));
+
+    std::vector<std::uint32_t> streams;
+    for (int index = 0; index < 3; index++)
+        streams.push_back(take(scheduler).frame.get_stream_id());
+    // A text queued mid-transfer goes before the next chunk
+    scheduler.push(message::message(message::TEXT, "127.0.0.1", 7200, "between"));
+    EXPECT_EQ(take(scheduler).frame.get_message_type(), message::TEXT);
+    while (!scheduler.empty())
+        streams.push_back(take(scheduler).frame.get_stream_id());
+    EXPECT_EQ(streams, (std::vector<std::uint32_t>{1, 2, 1, 2, 1, 2}));
+}
+
+TEST(frame_scheduler, limits_active_streams)
+{
+    std::vector<std::unique_ptr<temp_file>> files;
+    mux::frame_scheduler scheduler;
+    scheduler.set_chunking(true);
+    for (std::size_t index = 0; index <= mux::MAX_STREAMS; index++)
+    {
+        files.push_back(std::make_unique<temp_file>("stream" + std::to_string(index), message::STREAM_CHUNK_SIZE + 1));
+        scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, files.back()->get_path()));
+    }
+    for (std::size_t index = 0; index < mux::MAX_STREAMS; index++)
+        EXPECT_EQ(take(scheduler).frame.get_message_type(), message::WRITE_FILE);
+    // The last file waits for a stream to finish
+    EXPECT_EQ(take(scheduler).frame.get_message_type(), message::CHUNK);
+    EXPECT_EQ(scheduler.size(), mux::MAX_STREAMS + 1);
+}
+
+TEST(frame_scheduler, rewind_restarts_streams)
+{
+    temp_file file("rewind", 2 * message::STREAM_CHUNK_SIZE);
+    mux::frame_scheduler scheduler;
+    scheduler.set_chunking(true);
+    scheduler.push(message::message(message::WRITE_FILE, "127.0.0.1", 7200, file.get_path()));
+    take(scheduler);
+    mux::scheduled_frame chunk = take(scheduler);
+    EXPECT_EQ(chunk.frame.get_message_type(), message::CHUNK);
+
+    scheduler.rewind();
+    mux::scheduled_frame announce = take(scheduler);
+    EXPECT_EQ(announce.frame.get_message_type(), message::WRITE_FILE);
+    EXPECT_TRUE(announce.first);
+    mux::scheduled_frame again = take(scheduler);
+    EXPECT_EQ(again.frame.get_raw_message(), chunk.frame.get_raw_message());
+}
@@ -0,0 +1,87 @@
+#include "memory_budget.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+using namespace scft;
+
+/**
+ * @brief Budget of the tests, with metrics
+*/
+class memory_budget_test : public ::testing::Test
+{
+    protected: metrics::registry m_registry;
+
+    protected: server::server_metrics m_metrics{m_registry};
+
+    protected: server::memory_budget m_budget{100, 1000, 1000, m_metrics};
+};
+
+TEST_F(memory_budget_test, defers_what_does_not_fit)
+{
+    EXPECT_EQ(m_budget.admit(message::TEXT, 80, 80), server::ADMITTED);
+    EXPECT_EQ(m_budget.admit(message::TEXT, 2000, 10), server::REFUSED);
+    EXPECT_EQ(m_budget.admit(message::TEXT, 50, 200), server::REFUSED);
+    EXPECT_EQ(m_budget.admit(message::TEXT, 50, 50), server::DEFERRED);
+
+    server::memory_share share(m_budget);
+    bool resumed = false;
+    share.wait(50, [&]() { resumed = true; share.hold_frame(50); return true; });
+    // Waiting frames go first, even if a smaller one would fit
+    EXPECT_EQ(m_budget.admit(message::TEXT, 10, 10), server::DEFERRED);
+    m_budget.release(40);
+    EXPECT_TRUE(resumed);
+    EXPECT_EQ(m_budget.get_used(), 90u);
+    share.release_frame();
+    m_budget.release(40);
+    EXPECT_EQ(m_budget.get_used(), 0u);
+}
+
+TEST_F(memory_budget_test, gone_waiters_do_not_block_others)
+{
+    m_budget.reserve(90);
+    std::vector<int> resumed;
+    server::memory_share kept(m_budget);
+    {
+        server::memory_share gone(m_budget);
+        gone.wait(50, [&]() { resumed.push_back(1); return true; });
+        kept.wait(10, [&]() { resumed.push_back(2); kept.hold_frame(10); return true; });
+        m_budget.release(10);
+        EXPECT_TRUE(resumed.empty());
+    }
+    // The share of the gone member cancelled its wait, the next one fits
+    EXPECT_EQ(resumed, std::vector<int>{2});
+    EXPECT_EQ(m_budget.get_used(), 90u);
+    EXPECT_EQ(m_metrics.deferred_frames->get(), 0);
+}
+
+TEST_F(memory_budget_test, cancel_wait_lets_others_go)
+{
+    m_budget.reserve(95);
+    server::memory_share closed(m_budget);
+    server::memory_share open(m_budget);
+    bool closed_resumed = false;
+    bool open_resumed = false;
+    closed.wait(60, [&]() { closed_resumed = true; return true; });
+    open.wait(5, [&]() { open_resumed = true; open.hold_frame(5); return true; });
+    closed.cancel_wait();
+    EXPECT_FALSE(closed_resumed);
+    EXPECT_TRUE(open_resumed);
+    m_budget.release(95);
+    EXPECT_FALSE(closed_resumed);
+}
+
+TEST_F(memory_budget_test, share_releases_what_it_holds)
+{
+    {
+        server::memory_share share(m_budget);
+        share.queue(30);
+        share.grow_frame(20);
+        EXPECT_EQ(m_budget.get_used(), 50u);
+        share.dequeue(10);
+        EXPECT_EQ(m_budget.get_used(), 40u);
+    }
+    EXPECT_EQ(m_budget.get_used(), 0u);
+}
@@ -0,0 +1,195 @@
+#include "checksum.hpp"
+#include "message_view.hpp"
+#include "scft_message.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace scft;
+
+/**
+ * @brief Read a frame the way clients and the server do, prefix, rest of the header, then the buffered data
+ * @param wire Frame as sent
+ * @param received Message read into
+ * @return False if the header is rejected
+*/
+static bool receive(const std::vector<std::uint8_t>& wire, message::message& received)
+{
+    std::vector<std::uint8_t>& raw = received.get_raw_message();
+    raw.assign(wire.begin(), wire.begin() + message::HEADER_SIZE);
+    if (received.is_v2())
+    {
+        std::size_t rest = received.extend_header();
+        if (rest == 0)
+            return false;
+        std::copy(wire.begin() + message::HEADER_SIZE, wire.begin() + message::HEADER_SIZE + rest, raw.begin() + message::HEADER_SIZE);
+    }
+    if (received.bad_header())
+        return false;
+    std::size_t header_size = received.get_header_size();
+    received.adjust();
+    std::copy(wire.begin() + header_size, wire.begin() + header_size + received.get_buffered_data_len(), raw.begin() + header_size);
+    return true;
+}
+
+/**
+ * @brief Checksum of the origin and stringdata as a receiver computes it
+ * @param _message Complete message
+ * @return Digest with the message's algorithm
+*/
+static std::uint64_t compute_checksum(message::message& _message)
+{
+    checksum::hasher _hasher(_message.get_checksum_algorithm());
+    _hasher.update(_message.get_data(), _message.get_buffered_data_len());
+    return _hasher.digest();
+}
+
+TEST(scft_message, text_v1_round_trip)
+{
+    message::message sent(message::TEXT, "127.0.0.1", 7200, "hello");
+    ASSERT_FALSE(sent.is_v2());
+    EXPECT_EQ(sent.get_header_size(), message::HEADER_SIZE);
+    EXPECT_EQ(sent.get_raw_message().size(), sent.get_frame_len());
+
+    message::message received;
+    ASSERT_TRUE(receive(sent.get_raw_message(), received));
+    EXPECT_FALSE(received.is_v2());
+    EXPECT_EQ(received.get_message_type(), message::TEXT);
+    EXPECT_STREQ(received.get_origin(), "127.0.0.1:7200");
+    EXPECT_STREQ(received.get_string(), "hello");
+    EXPECT_EQ(received.get_string_len(), 5u);
+    EXPECT_EQ(received.get_flags(), 0u);
+    EXPECT_EQ(received.get_checksum_algorithm(), checksum::CRC32);
+    EXPECT_EQ(received.get_checksum(), compute_checksum(received));
+    EXPECT_EQ(received.get_raw_message(), sent.get_raw_message());
+}
+
+TEST(scft_message, text_v2_round_trip)
+{
+    message::message sent(message::TEXT, "127.0.0.1", 7200, "hello", checksum::XXH3_64);
+    ASSERT_TRUE(sent.is_v2());
+    EXPECT_EQ(sent.get_header_size(), message::V2_HEADER_SIZE);
+
+    message::message received;
+    ASSERT_TRUE(receive(sent.get_raw_message(), received));
+    EXPECT_TRUE(received.is_v2());
+    EXPECT_EQ(received.get_message_type(), message::TEXT);
+    EXPECT_STREQ(received.get_origin(), "127.0.0.1:7200");
+    EXPECT_STREQ(received.get_string(), "hello");
+    EXPECT_EQ(received.get_string_len(), 5u);
+    EXPECT_EQ(received.get_checksum_algorithm(), checksum::XXH3_64);
+    EXPECT_EQ(received.get_checksum(), compute_checksum(received));
+    EXPECT_GT(received.get_checksum() >> 32, 0u);
+}
+
+TEST(scft_message, flags_upgrade_to_v2)
+{
+    message::message sent(message::TEXT, "127.0.0.1", 7200, "replayed");
+    std::uint64_t crc = sent.get_checksum();
+    sent.set_flags(message::FLAG_REPLAYED);
+    ASSERT_TRUE(sent.is_v2());
+    EXPECT_EQ(sent.get_checksum_algorithm(), checksum::CRC32);
+    EXPECT_EQ(sent.get_checksum(), crc);
+
+    message::message received;
+    ASSERT_TRUE(receive(sent.get_raw_message(), received));
+    EXPECT_EQ(received.get_flags(), message::FLAG_REPLAYED);
+    EXPECT_STREQ(received.get_string(), "replayed");
+    EXPECT_EQ(received.get_checksum(), compute_checksum(received));
+}
+
+TEST(scft_message, stream_id_extends_header)
+{
+    std::vector<std::uint8_t> contents(1000, 0xAB);
+    message::message sent(7, contents.data(), contents.size());
+    ASSERT_TRUE(sent.is_v2());
+    EXPECT_EQ(sent.get_header_size(), message::V2_STREAM_HEADER_SIZE);
+
+    message::message received;
+    ASSERT_TRUE(receive(sent.get_raw_message(), received));
+    EXPECT_EQ(received.get_message_type(), message::CHUNK);
+    EXPECT_EQ(received.get_stream_id(), 7u);
+    EXPECT_EQ(received.get_file_buffer_len(), contents.size());
+    EXPECT_EQ(std::vector<std::uint8_t>(received.get_file_buffer(), received.get_file_buffer() + contents.size()), contents);
+}
+
+TEST(scft_message, trace_and_origin)
+{
+    message::message sent(message::TEXT, "127.0.0.1", 7200, "traced");
+    sent.set_trace(123456789, 42);
+    ASSERT_TRUE(sent.has_trace());
+    ASSERT_TRUE(sent.set_origin("10.0.0.1:9000"));
+    EXPECT_EQ(sent.get_checksum(), compute_checksum(sent));
+
+    message::message received;
+    ASSERT_TRUE(receive(sent.get_raw_message(), received));
+    EXPECT_STREQ(received.get_origin(), "10.0.0.1:9000");
+    EXPECT_STREQ(received.get_string(), "traced");
+    EXPECT_TRUE(received.has_trace());
+    EXPECT_EQ(received.get_send_time(), 123456789u);
+    EXPECT_EQ(received.get_trace_id(), 42u);
+}
+
+TEST(scft_message, set_origin_rejects_corrupted)
+{
+    message::message sent(message::TEXT, "127.0.0.1", 7200, "hello");
+    sent.get_string()[0] = 'j';
+    EXPECT_FALSE(sent.set_origin("10.0.0.1:9000"));
+}
+
+TEST(scft_message, set_origin_keeps_given_checksum)
+{
+    // The server computes the stamped checksum of spooled contents while receiving them
+    message::message verified(message::TEXT, "local", 0, "stamped");
+    verified.set_checksum_algorithm(checksum::XXH3_64);
+    message::message given = verified;
+    ASSERT_TRUE(verified.set_origin("local:1"));
+    given.set_origin("local:1", verified.get_checksum());
+    EXPECT_EQ(given.get_raw_message(), verified.get_raw_message());
+    EXPECT_EQ(given.get_checksum(), compute_checksum(given));
+}
+
+TEST(scft_message, bad_headers)
+{
+    message::message sent(message::TEXT, "127.0.0.1", 7200, "hello", checksum::CRC32C);
+    message::message received;
+
+    std::vector<std::uint8_t> wire = sent.get_raw_message();
+    wire[message::V2_VERSION_OFFSET] = message::V2_VERSION + 1;
+    EXPECT_FALSE(receive(wire, received));
+
+    wire = sent.get_raw_message();
+    wire[message::MESSAGE_TYPE_OFFSET] = message::V2_TYPE_FLAG | message::RESERVED;
+    EXPECT_FALSE(receive(wire, received));
+
+    wire = sent.get_raw_message();
+    wire[message::V2_CHECKSUM_ALGORITHM_OFFSET] = checksum::LAST_ALGORITHM + 1;
+    EXPECT_FALSE(receive(wire, received));
+
+    message::message v1(message::TEXT, "127.0.0.1", 7200, "hello");
+    wire = v1.get_raw_message();
+    wire[message::MESSAGE_TYPE_OFFSET] = message::LAST_MESSAGE_TYPE + 1;
+    EXPECT_FALSE(receive(wire, received));
+}
+
+TEST(scft_message, view_matches_message)
+{
+    for (checksum::ALGORITHM algorithm : {checksum::CRC32, checksum::XXH3_64})
+    {
+        message::message sent(message::TEXT, "127.0.0.1", 7200, "viewed", algorithm);
+        message::message_view view;
+        const std::vector<std::uint8_t>& wire = sent.get_raw_message();
+        ASSERT_TRUE(view.parse(wire.data(), wire.size()));
+        EXPECT_EQ(view.is_v2(), sent.is_v2());
+        EXPECT_EQ(view.get_message_type(), message::TEXT);
+        EXPECT_EQ(view.get_header_size(), sent.get_header_size());
+        EXPECT_EQ(view.get_origin(), "127.0.0.1:7200");
+        EXPECT_EQ(view.get_string(), "viewed");
+        EXPECT_EQ(view.get_checksum(), sent.get_checksum());
+        EXPECT_EQ(view.get_checksum_algorithm(), algorithm);
+        EXPECT_EQ(view.get_frame_len(), wire.size());
+        EXPECT_FALSE(view.parse(wire.data(), wire.size() - 1));
+    }
+}
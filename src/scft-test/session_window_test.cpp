@@ -0,0 +1,137 @@
+#include "session_window.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace scft;
+
+/**
+ * @brief Take a text frame from a queue the way a member does
+ * @param window Window numbering it
+ * @param text Text
+ * @return Numbered frame
+*/
+static mux::scheduled_frame take_text(server::session_window& window, const std::string& text)
+{
+    mux::scheduled_frame frame;
+    frame.frame = message::message(message::TEXT, "127.0.0.1", 7200, text);
+    frame.first = true;
+    frame.last = true;
+    window.number(frame);
+    return frame;
+}
+
+TEST(session_window, counts_sequenced_frames)
+{
+    server::session_window window;
+    window.receive(message::TEXT, 0);
+    window.receive(message::WRITE_FILE, 0);
+    window.receive(message::ACK, 0);
+    window.receive(message::SESSION, 0);
+    window.receive(message::TEXT, message::FLAG_REPLAYED);
+    EXPECT_EQ(window.get_received(), 2u);
+
+    // No ACKs until the client asks for a session or a window
+    EXPECT_FALSE(window.is_acknowledging());
+    EXPECT_FALSE(window.has_ack());
+    window.start_retaining();
+    EXPECT_TRUE(window.has_ack());
+    EXPECT_FALSE(window.is_ack_due());
+    EXPECT_EQ(window.take_ack(), 2u);
+    EXPECT_FALSE(window.has_ack());
+    for (std::uint64_t index = 0; index < message::ACK_INTERVAL; index++)
+        window.receive(message::TEXT, 0);
+    EXPECT_TRUE(window.is_ack_due());
+}
+
+TEST(session_window, numbers_sequenced_frames)
+{
+    server::session_window window;
+    EXPECT_EQ(take_text(window, "one").sequence, 1u);
+    EXPECT_EQ(take_text(window, "two").sequence, 2u);
+    mux::scheduled_frame ack;
+    ack.frame = message::message(message::ACK, "127.0.0.1", 7200, "2");
+    window.number(ack);
+    EXPECT_EQ(ack.sequence, 0u);
+    EXPECT_EQ(take_text(window, "three").sequence, 3u);
+}
+
+TEST(session_window, resumes_after_last_received)
+{
+    server::session_window window;
+    // Frames before retaining started were received before the session answer
+    take_text(window, "before");
+    window.start_retaining();
+    for (int index = 1; index <= 5; index++)
+        EXPECT_TRUE(window.retain(take_text(window, "text " + std::to_string(index))));
+    EXPECT_EQ(window.get_retained(), 5u);
+
+    window.acknowledge(3);
+    EXPECT_EQ(window.get_retained(), 3u);
+    EXPECT_FALSE(window.can_resume(2));
+    EXPECT_TRUE(window.can_resume(3));
+    EXPECT_TRUE(window.can_resume(6));
+    EXPECT_FALSE(window.can_resume(7));
+
+    EXPECT_EQ(window.resume_from(4), 2u);
+    EXPECT_EQ(window.get_retained(), 2u);
+    ASSERT_TRUE(window.has_resend());
+    mux::scheduled_frame frame;
+    ASSERT_TRUE(window.take_resend(frame));
+    EXPECT_EQ(frame.sequence, 5u);
+    EXPECT_STREQ(frame.frame.get_string(), "text 4");
+    EXPECT_FALSE(frame.last);
+    // Frames sent again are not kept twice
+    EXPECT_TRUE(window.retain(frame));
+    ASSERT_TRUE(window.take_resend(frame));
+    EXPECT_EQ(frame.sequence, 6u);
+    EXPECT_FALSE(window.take_resend(frame));
+    EXPECT_FALSE(window.has_resend());
+    EXPECT_EQ(window.get_retained(), 2u);
+
+    window.stop_retaining();
+    EXPECT_EQ(window.get_retained(), 0u);
+    EXPECT_FALSE(window.can_resume(6));
+}
+
+TEST(session_window, retained_bytes_are_limited)
+{
+    server::session_window window;
+    window.start_retaining();
+    std::string text(1048576, 'x');
+    bool kept = true;
+    std::uint64_t frames = 0;
+    while (kept && frames <= server::SESSION_RETAINED_BYTES / text.size() + 1)
+    {
+        kept = window.retain(take_text(window, text));
+        frames++;
+    }
+    EXPECT_FALSE(kept);
+    EXPECT_EQ(frames, server::SESSION_RETAINED_BYTES / text.size());
+}
+
+TEST(session_window, window_limits_unacknowledged_bytes)
+{
+    server::session_window window;
+    EXPECT_TRUE(window.has_credit());
+    window.set_window(message::MIN_RECEIVE_WINDOW);
+    EXPECT_TRUE(window.is_acknowledging());
+
+    // One frame always goes, whatever its size
+    std::string text(message::MIN_RECEIVE_WINDOW, 'x');
+    take_text(window, text);
+    EXPECT_FALSE(window.has_credit());
+    window.acknowledge(1);
+    EXPECT_TRUE(window.has_credit());
+
+    take_text(window, "small");
+    take_text(window, "small");
+    EXPECT_TRUE(window.has_credit());
+    take_text(window, text);
+    EXPECT_FALSE(window.has_credit());
+    window.acknowledge(3);
+    EXPECT_FALSE(window.has_credit());
+    window.acknowledge(4);
+    EXPECT_TRUE(window.has_credit());
+}
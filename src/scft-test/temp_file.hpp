@@ -0,0 +1,100 @@
+#ifndef TEMP_FILE_HPP
+#define TEMP_FILE_HPP
+
+/**
+ * @file src/scft-test/temp_file.hpp
+ * @brief Defines make_buffer and temp_file, inputs the tests generate
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Deterministic pseudo random bytes
+ * @param size Number of bytes
+ * @param seed Seed, the same one gives the same bytes
+ * @return Buffer
+*/
+inline std::vector<std::uint8_t> make_buffer(std::size_t size, std::uint64_t seed)
+{
+    std::mt19937_64 random(seed);
+    std::vector<std::uint8_t> buffer(size);
+    for (std::uint8_t& byte : buffer)
+        byte = static_cast<std::uint8_t>(random());
+    return buffer;
+}
+
+/**
+ * @brief File with deterministic contents, removed when destroyed
+*/
+class temp_file
+{
+    /**
+     * @brief Write the file
+     * @param name Unique part of the file name
+     * @param size Number of pseudo random bytes, seeded by size
+    */
+    public: temp_file(const std::string& name, std::size_t size)
+    :
+    m_path("scft-test-" + name + ".bin"),
+    m_contents(make_buffer(size, size))
+    {
+        write();
+    }
+
+    /**
+     * @brief Write the file
+     * @param name Unique part of the file name
+     * @param contents Contents
+    */
+    public: temp_file(const std::string& name, std::vector<std::uint8_t> contents)
+    :
+    m_path("scft-test-" + name + ".bin"),
+    m_contents(std::move(contents))
+    {
+        write();
+    }
+
+    /**
+     * @brief Remove the file
+    */
+    public: ~temp_file() { std::remove(m_path.c_str()); }
+
+    /**
+     * @brief Get file path
+     * @return Path, relative to the working directory
+    */
+    public: const std::string& get_path() const { return m_path; }
+
+    /**
+     * @brief Get contents as written
+     * @return Contents
+    */
+    public: const std::vector<std::uint8_t>& get_contents() const { return m_contents; }
+
+    /**
+     * @brief Write contents to the path
+    */
+    private: void write()
+    {
+        std::ofstream out_file{m_path, std::ios::out | std::ios::binary | std::ios::trunc};
+        out_file.write(reinterpret_cast<const char*>(m_contents.data()), m_contents.size());
+    }
+
+    /**
+     * @brief File path
+    */
+    private: std::string m_path;
+
+    /**
+     * @brief Contents
+    */
+    private: std::vector<std::uint8_t> m_contents;
+};
+
+#endif /* TEMP_FILE_HPP */
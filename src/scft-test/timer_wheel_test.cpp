@@ -0,0 +1,103 @@
+#include "timer_wheel.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace scft;
+
+/**
+ * @brief Tick used by the tests, short so they run fast
+*/
+constexpr std::chrono::milliseconds TICK(1);
+
+/**
+ * @brief Longest a test runs its io context
+*/
+constexpr std::chrono::seconds TIMEOUT(5);
+
+TEST(timer_wheel, fires_after_delay)
+{
+    boost::asio::io_context io_ctx;
+    timer::timer_wheel wheel(io_ctx, TICK);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration elapsed{};
+    wheel.schedule(std::chrono::milliseconds(20),
+        [&]()
+        {
+            elapsed = std::chrono::steady_clock::now() - start;
+            io_ctx.stop();
+        });
+    EXPECT_EQ(wheel.size(), 1u);
+    io_ctx.run_for(TIMEOUT);
+    EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+    EXPECT_LT(elapsed, TIMEOUT);
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(timer_wheel, fires_in_deadline_order)
+{
+    boost::asio::io_context io_ctx;
+    timer::timer_wheel wheel(io_ctx, TICK);
+    std::vector<int> fired;
+    wheel.schedule(std::chrono::milliseconds(30), [&]() { fired.push_back(30); io_ctx.stop(); });
+    wheel.schedule(std::chrono::milliseconds(10), [&]() { fired.push_back(10); });
+    wheel.schedule(std::chrono::milliseconds(0), [&]() { fired.push_back(0); });
+    wheel.schedule(std::chrono::milliseconds(20), [&]() { fired.push_back(20); });
+    io_ctx.run_for(TIMEOUT);
+    EXPECT_EQ(fired, (std::vector<int>{0, 10, 20, 30}));
+}
+
+TEST(timer_wheel, cascades_from_coarser_levels)
+{
+    boost::asio::io_context io_ctx;
+    timer::timer_wheel wheel(io_ctx, TICK);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::chrono::steady_clock::duration> elapsed;
+    // Past the WHEEL_SIZE ticks of level 0, the second one past a level 1 slot boundary
+    for (int delay : {100, 200})
+    {
+        wheel.schedule(std::chrono::milliseconds(delay),
+            [&, delay]()
+            {
+                elapsed.push_back(std::chrono::steady_clock::now() - start);
+                EXPECT_GE(elapsed.back(), std::chrono::milliseconds(delay));
+                if (elapsed.size() == 2)
+                    io_ctx.stop();
+            });
+    }
+    io_ctx.run_for(TIMEOUT);
+    ASSERT_EQ(elapsed.size(), 2u);
+    EXPECT_LE(elapsed[0], elapsed[1]);
+}
+
+TEST(timer_wheel, reschedules_from_callback)
+{
+    boost::asio::io_context io_ctx;
+    timer::timer_wheel wheel(io_ctx, TICK);
+    int count = 0;
+    std::function<void()> repeat = [&]()
+    {
+        if (++count == 5)
+            io_ctx.stop();
+        else
+            wheel.schedule(std::chrono::milliseconds(2), repeat);
+    };
+    wheel.schedule(std::chrono::milliseconds(2), repeat);
+    io_ctx.run_for(TIMEOUT);
+    EXPECT_EQ(count, 5);
+}
+
+TEST(timer_wheel, stop_drops_pending)
+{
+    boost::asio::io_context io_ctx;
+    timer::timer_wheel wheel(io_ctx, TICK);
+    bool fired = false;
+    wheel.schedule(std::chrono::milliseconds(5), [&]() { fired = true; });
+    wheel.schedule(std::chrono::seconds(60), [&]() { fired = true; });
+    EXPECT_EQ(wheel.size(), 2u);
+    wheel.stop();
+    EXPECT_EQ(wheel.size(), 0u);
+    io_ctx.run_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(fired);
+}
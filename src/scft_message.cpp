@@ -1,73 +1,220 @@
 #include "scft_message.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
 namespace scft
 {
     namespace message
     {
+        std::uint64_t get_monotonic_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        bool is_sequenced(MESSAGE_TYPE message_type, std::uint32_t flags)
+        {
+            return message_type != SESSION && message_type != ACK && (flags & FLAG_REPLAYED) == 0;
+        }
+
+        payload_file::payload_file(const std::string& path, std::uint64_t length, bool temporary)
+        :
+        m_path(path),
+        m_length(length),
+        m_temporary(temporary)
+        {
+        }
+
+        payload_file::~payload_file()
+        {
+            if (m_temporary)
+                std::remove(m_path.c_str());
+        }
+
         message::message()
         {
             m_raw_message.resize(HEADER_SIZE);
         }
 
-        message::message(MESSAGE_TYPE message_type, const std::string& address, std::uint16_t port, const std::string& _str)
+        message::message(MESSAGE_TYPE message_type, const std::string& address, std::uint16_t port, const std::string& _str,
+            checksum::ALGORITHM algorithm, const file_progress& progress, const std::string& name)
         {
             if (message_type == TEXT)
             {
                 std::string origin = address + ":" + std::to_string(port);
-                init_as_text(origin, _str);
+                init_as_text(origin, _str, algorithm);
             }
             else if (message_type == WRITE_FILE)
             {
                 std::string origin = address + ":" + std::to_string(port);
-                init_as_file(origin, _str);
+                init_as_file(origin, _str, algorithm, progress, name);
+            }
+            else if (message_type == PING || message_type == HEARTBEAT || message_type == NEGOTIATE || message_type == HISTORY
+                || message_type == MULTICAST_END || message_type == NACK || message_type == OFFER || message_type == FETCH
+                || message_type == SESSION || message_type == ACK)
+            {
+                std::string origin = address + ":" + std::to_string(port);
+                init_as_text(origin, _str, algorithm);
+                set_message_type(message_type);
             }
             else
                 throw std::runtime_error("Unrecognized message type\n");
         }
 
-        void message::init_as_text(const std::string& origin, const std::string& text)
+        message::message(std::uint32_t stream_id, const std::uint8_t* data, std::size_t length)
         {
-            m_raw_message.resize(HEADER_SIZE + origin.size() + 1 + text.size() + 1);
+            if (length > MAX_CHUNK_LENGTH)
+                throw std::logic_error("Chunk too long\n");
+            // Empty origin and string, receivers know the sender from the stream
+            write_header(MESSAGE_TYPE::CHUNK, 1, 1 + length, 1, true, checksum::NONE);
+            set_stream_id(stream_id);
+            adjust();
+            *get_origin() = '\0';
+            *get_string() = '\0';
+            if (length != 0)
+                std::memcpy(get_string() + 1, data, length);
+        }
 
-            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET) = static_cast<std::uint8_t>(MESSAGE_TYPE::TEXT);
-            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + ORIGIN_LEN_OFFSET) = static_cast<std::uint8_t>(origin.size() + 1);
-            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + STRINGDATA_LEN_OFFSET) = static_cast<std::uint32_t>(text.size() + 1);
-            std::memcpy(m_raw_message.data() + DATA_OFFSET, origin.data(), origin.size() + 1);
-            std::memcpy(m_raw_message.data() + DATA_OFFSET + origin.size() + 1, text.data(), text.size() + 1);
-            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + CHECKSUM_OFFSET) =
-                crc32::get_crc32(reinterpret_cast<const std::uint8_t*>(m_raw_message.data() + DATA_OFFSET), origin.size() + 1 + text.size() + 1);
+        message::message(std::uint32_t transfer_id, std::uint64_t offset, const std::uint8_t* data, std::size_t length)
+        {
+            if (length > MAX_CHUNK_LENGTH)
+                throw std::logic_error("Repair too long\n");
+            std::string position = std::to_string(offset);
+            write_header(MESSAGE_TYPE::REPAIR, 1, position.size() + 1 + length, position.size() + 1, true, checksum::NONE);
+            set_stream_id(transfer_id);
+            adjust();
+            *get_origin() = '\0';
+            std::memcpy(get_string(), position.c_str(), position.size() + 1);
+            if (length != 0)
+                std::memcpy(get_string() + position.size() + 1, data, length);
+        }
+
+        void message::init_as_text(const std::string& origin, const std::string& text, checksum::ALGORITHM algorithm)
+        {
+            write_header(MESSAGE_TYPE::TEXT, origin.size() + 1, text.size() + 1, text.size() + 1, false, algorithm);
+            adjust();
+            std::memcpy(get_origin(), origin.data(), origin.size() + 1);
+            std::memcpy(get_string(), text.data(), text.size() + 1);
+            update_checksum();
         }
 
-        void message::init_as_file(const std::string& origin, const std::string& filepath)
+        void message::init_as_file(const std::string& origin, const std::string& filepath, checksum::ALGORITHM algorithm,
+            const file_progress& progress, const std::string& name)
         {
             std::ifstream in_file{filepath, std::ios::in | std::ios::binary | std::ios::ate};
-            std::size_t file_size = in_file.tellg();
+            if (!in_file)
+                throw std::runtime_error("Could not open file\n");
+            std::uint64_t file_size = in_file.tellg();
             in_file.seekg(0, std::ios::beg);
             in_file.clear();
 
-            std::string out_filepath = filepath.substr(filepath.find_last_of("/\\") + 1);
+            std::string out_filepath = name.empty() ? filepath.substr(filepath.find_last_of("/\\") + 1) : name;
 
-            m_raw_message.resize(HEADER_SIZE + origin.size() + 1 + out_filepath.size() + 1 + file_size);
-
-            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET) = static_cast<std::uint8_t>(MESSAGE_TYPE::WRITE_FILE);
-            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + ORIGIN_LEN_OFFSET) = static_cast<std::uint8_t>(origin.size() + 1);
-            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + STRINGDATA_LEN_OFFSET) = static_cast<std::uint32_t>(out_filepath.size() + 1 + file_size);
-            std::memcpy(m_raw_message.data() + DATA_OFFSET, origin.data(), origin.size() + 1);
-            std::memcpy(m_raw_message.data() + DATA_OFFSET + origin.size() + 1, out_filepath.data(), out_filepath.size() + 1);
-            in_file.read(reinterpret_cast<char*>(m_raw_message.data() + DATA_OFFSET + origin.size() + 1 + out_filepath.size() + 1), file_size);
+            bool streamed = file_size > STREAM_THRESHOLD;
+            write_header(MESSAGE_TYPE::WRITE_FILE, origin.size() + 1, out_filepath.size() + 1 + file_size, out_filepath.size() + 1, streamed, algorithm);
+            adjust();
+            std::memcpy(get_origin(), origin.data(), origin.size() + 1);
+            std::memcpy(get_string(), out_filepath.data(), out_filepath.size() + 1);
+            // Checksum each chunk right after reading it, while it is still in cache
+            checksum::hasher _hasher(algorithm);
+            _hasher.update(get_data(), get_buffered_data_len() - (streamed ? 0 : file_size));
+            std::vector<std::uint8_t> buffer(streamed ? FILE_READ_CHUNK : 0);
+            std::uint8_t* contents = reinterpret_cast<std::uint8_t*>(get_string() + out_filepath.size() + 1);
+            for (std::uint64_t done = 0; done < file_size;)
+            {
+                std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(FILE_READ_CHUNK, file_size - done));
+                std::uint8_t* chunk_data = streamed ? buffer.data() : contents + done;
+                if (!in_file.read(reinterpret_cast<char*>(chunk_data), chunk))
+                    throw std::runtime_error("File shrank while reading\n");
+                _hasher.update(chunk_data, chunk);
+                done += chunk;
+                if (progress && !progress(done, file_size))
+                    throw std::runtime_error("Stopped reading file\n");
+            }
             in_file.close();
-            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + CHECKSUM_OFFSET) =
-                crc32::get_crc32(reinterpret_cast<const std::uint8_t*>(m_raw_message.data() + DATA_OFFSET), origin.size() + 1 + out_filepath.size() + 1 + file_size);
+            set_checksum(_hasher.digest());
+            if (!streamed)
+                return;
+            m_payload_file = std::make_shared<payload_file>(filepath, file_size, false);
+        }
+
+        void message::write_header(
+            MESSAGE_TYPE message_type,
+            std::size_t origin_len,
+            std::uint64_t stringdata_len,
+            std::size_t string_len,
+            bool force_v2,
+            checksum::ALGORITHM algorithm)
+        {
+            if (!force_v2 && algorithm == checksum::CRC32 && origin_len <= UINT8_MAX && stringdata_len <= MAX_DATA_LENGTH)
+            {
+                if (m_raw_message.size() < HEADER_SIZE)
+                    m_raw_message.resize(HEADER_SIZE);
+                *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET) = static_cast<std::uint8_t>(message_type);
+                *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + ORIGIN_LEN_OFFSET) = static_cast<std::uint8_t>(origin_len);
+                *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + STRINGDATA_LEN_OFFSET) = static_cast<std::uint32_t>(stringdata_len);
+                return;
+            }
+
+            if (origin_len > UINT16_MAX || string_len > MAX_DATA_LENGTH)
+                throw std::logic_error("Message fields too long\n");
+            if (m_raw_message.size() < V2_HEADER_SIZE)
+                m_raw_message.resize(V2_HEADER_SIZE);
+            std::memset(m_raw_message.data(), 0, V2_HEADER_SIZE);
+            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET) = static_cast<std::uint8_t>(message_type | V2_TYPE_FLAG);
+            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + V2_VERSION_OFFSET) = V2_VERSION;
+            *reinterpret_cast<std::uint16_t*>(m_raw_message.data() + V2_HEADER_SIZE_OFFSET) = static_cast<std::uint16_t>(V2_HEADER_SIZE);
+            *reinterpret_cast<std::uint64_t*>(m_raw_message.data() + V2_STRINGDATA_LEN_OFFSET) = stringdata_len;
+            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_STRING_LEN_OFFSET) = static_cast<std::uint32_t>(string_len);
+            *reinterpret_cast<std::uint16_t*>(m_raw_message.data() + V2_ORIGIN_LEN_OFFSET) = static_cast<std::uint16_t>(origin_len);
+            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + V2_CHECKSUM_ALGORITHM_OFFSET) = algorithm;
         }
 
         message::~message()
         {
         }
 
+        std::size_t message::extend_header()
+        {
+            if (!is_v2())
+                return 0;
+            std::size_t header_size = get_header_size();
+            if (m_raw_message[V2_VERSION_OFFSET] != V2_VERSION || header_size < V2_HEADER_SIZE || header_size > MAX_HEADER_SIZE)
+                return 0;
+            m_raw_message.resize(header_size);
+            return header_size - HEADER_SIZE;
+        }
+
         bool message::bad_header()
         {
-            if (get_message_type() != TEXT && get_message_type() != WRITE_FILE)
+            if (is_v2())
+            {
+                std::size_t header_size = get_header_size();
+                if (m_raw_message[V2_VERSION_OFFSET] != V2_VERSION || header_size < V2_HEADER_SIZE || header_size > MAX_HEADER_SIZE)
+                    return true;
+                if (m_raw_message.size() < header_size)
+                    return true;
+                std::uint32_t string_len = *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_STRING_LEN_OFFSET);
+                if (string_len == 0 || string_len > get_stringdata_len())
+                    return true;
+                if (get_checksum_algorithm() > checksum::LAST_ALGORITHM)
+                    return true;
+            }
+            MESSAGE_TYPE message_type = get_message_type();
+            if (message_type == RESERVED || message_type > LAST_MESSAGE_TYPE)
+                return true;
+            if (get_origin_len() == 0)
                 return true;
+            if (message_type == CHUNK)
+                return !is_v2() || get_stream_id() == 0 || get_stringdata_len() > MAX_CHUNK_LENGTH + 1;
+            if (message_type == REPAIR)
+                return !is_v2() || get_stream_id() == 0 || get_stringdata_len() > MAX_REPAIR_LENGTH;
+            if (is_chunked())
+                return get_stream_id() == 0 || get_stringdata_len() > MAX_STREAM_LENGTH || get_buffered_data_len() > MAX_DATA_LENGTH;
+            if (has_streamed_body())
+                return get_stringdata_len() > MAX_STREAM_LENGTH || get_buffered_data_len() > MAX_DATA_LENGTH;
             if (get_stringdata_len() > MAX_DATA_LENGTH)
                 return true;
             return false;
@@ -75,15 +222,187 @@ namespace scft
 
         void message::adjust()
         {
-            m_raw_message.resize(HEADER_SIZE + get_data_len());
+            m_payload_file.reset();
+            m_raw_message.resize(get_header_size() + get_buffered_data_len());
+        }
+
+        bool message::is_v2()
+        {
+            return (m_raw_message[MESSAGE_TYPE_OFFSET] & V2_TYPE_FLAG) != 0;
+        }
+
+        std::size_t message::get_header_size()
+        {
+            if (!is_v2())
+                return HEADER_SIZE;
+            return *reinterpret_cast<std::uint16_t*>(m_raw_message.data() + V2_HEADER_SIZE_OFFSET);
         }
 
         MESSAGE_TYPE message::get_message_type()
         {
-            MESSAGE_TYPE message_type = static_cast<MESSAGE_TYPE>(*reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET));
+            MESSAGE_TYPE message_type = static_cast<MESSAGE_TYPE>(*reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET) & ~V2_TYPE_FLAG);
             return message_type;
         }
 
+        void message::set_message_type(MESSAGE_TYPE message_type)
+        {
+            std::uint8_t version_flag = m_raw_message[MESSAGE_TYPE_OFFSET] & V2_TYPE_FLAG;
+            *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + MESSAGE_TYPE_OFFSET) = static_cast<std::uint8_t>(message_type | version_flag);
+        }
+
+        std::uint32_t message::get_flags()
+        {
+            if (!is_v2())
+                return 0;
+            return *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_FLAGS_OFFSET);
+        }
+
+        void message::set_flags(std::uint32_t flags)
+        {
+            if (!is_v2())
+            {
+                if (flags == 0)
+                    return;
+                to_v2();
+            }
+            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_FLAGS_OFFSET) = flags;
+        }
+
+        void message::to_v2()
+        {
+            if (is_v2())
+                return;
+            MESSAGE_TYPE message_type = get_message_type();
+            std::size_t origin_len = get_origin_len();
+            std::uint64_t stringdata_len = get_stringdata_len();
+            std::size_t string_len = message_type == WRITE_FILE ? get_string_len() + 1 : stringdata_len;
+            std::uint64_t old_checksum = get_checksum();
+            m_raw_message.insert(m_raw_message.begin() + HEADER_SIZE, V2_HEADER_SIZE - HEADER_SIZE, 0);
+            write_header(message_type, origin_len, stringdata_len, string_len, true, checksum::CRC32);
+            set_checksum(old_checksum);
+        }
+
+        bool message::set_origin(const std::string& origin)
+        {
+            // Whatever follows the string, a trace, is kept after the new one
+            const char* origin_end = static_cast<const char*>(std::memchr(get_origin(), '\0', get_origin_len()));
+            std::size_t origin_string_len = origin_end == nullptr ? get_origin_len() : origin_end - get_origin() + 1;
+            checksum::hasher verified(get_checksum_algorithm());
+            checksum::hasher stamped(get_checksum_algorithm());
+            verified.update(get_data(), get_buffered_data_len());
+            stamped.update(origin.c_str(), origin.size() + 1);
+            stamped.update(get_data() + origin_string_len, get_buffered_data_len() - origin_string_len);
+            if (has_streamed_body())
+            {
+                if (!m_payload_file)
+                    throw std::logic_error("Streamed contents are not attached\n");
+                std::ifstream in_file{m_payload_file->get_path(), std::ios::in | std::ios::binary};
+                std::vector<std::uint8_t> buffer(FILE_READ_CHUNK);
+                for (std::uint64_t done = 0; done < m_payload_file->get_length();)
+                {
+                    std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(FILE_READ_CHUNK, m_payload_file->get_length() - done));
+                    if (!in_file.read(reinterpret_cast<char*>(buffer.data()), chunk))
+                        throw std::runtime_error("File shrank while reading\n");
+                    verified.update(buffer.data(), chunk);
+                    stamped.update(buffer.data(), chunk);
+                    done += chunk;
+                }
+            }
+            if (verified.digest() != get_checksum())
+                return false;
+            set_origin(origin, stamped.digest());
+            return true;
+        }
+
+        void message::set_origin(const std::string& origin, std::uint64_t _checksum)
+        {
+            const char* origin_end = static_cast<const char*>(std::memchr(get_origin(), '\0', get_origin_len()));
+            std::size_t origin_string_len = origin_end == nullptr ? get_origin_len() : origin_end - get_origin() + 1;
+            std::size_t origin_len = origin.size() + 1 + get_origin_len() - origin_string_len;
+            std::vector<std::uint8_t> data(origin.begin(), origin.end());
+            data.push_back(0);
+            data.insert(data.end(), get_data() + origin_string_len, get_data() + get_buffered_data_len());
+            if (!is_v2() && origin_len > UINT8_MAX)
+                to_v2();
+            m_raw_message.resize(get_header_size());
+            m_raw_message.insert(m_raw_message.end(), data.begin(), data.end());
+            set_origin_len(origin_len);
+            set_checksum(_checksum);
+        }
+
+        void message::set_trace(std::uint64_t send_time_ns, std::uint64_t trace_id)
+        {
+            if (has_streamed_body())
+                throw std::logic_error("Streamed messages can not carry a trace\n");
+            std::size_t origin_string_len = std::strlen(get_origin()) + 1;
+            if (!has_trace())
+            {
+                if (!is_v2() && origin_string_len + TRACE_SIZE > UINT8_MAX)
+                    to_v2();
+                m_raw_message.insert(m_raw_message.begin() + get_header_size() + origin_string_len, TRACE_SIZE, 0);
+                set_origin_len(origin_string_len + TRACE_SIZE);
+            }
+            *reinterpret_cast<std::uint64_t*>(get_origin() + origin_string_len) = send_time_ns;
+            *reinterpret_cast<std::uint64_t*>(get_origin() + origin_string_len + sizeof(std::uint64_t)) = trace_id;
+            update_checksum();
+        }
+
+        bool message::has_trace()
+        {
+            const char* origin_end = static_cast<const char*>(std::memchr(get_origin(), '\0', get_origin_len()));
+            if (origin_end == nullptr)
+                return false;
+            return get_origin_len() == origin_end - get_origin() + 1 + TRACE_SIZE;
+        }
+
+        std::uint64_t message::get_send_time()
+        {
+            if (!has_trace())
+                return 0;
+            return *reinterpret_cast<std::uint64_t*>(get_origin() + get_origin_len() - TRACE_SIZE);
+        }
+
+        std::uint64_t message::get_trace_id()
+        {
+            if (!has_trace())
+                return 0;
+            return *reinterpret_cast<std::uint64_t*>(get_origin() + get_origin_len() - sizeof(std::uint64_t));
+        }
+
+        std::uint32_t message::get_stream_id()
+        {
+            if (!is_v2() || get_header_size() < V2_STREAM_HEADER_SIZE)
+                return 0;
+            return *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_STREAM_ID_OFFSET);
+        }
+
+        void message::set_stream_id(std::uint32_t stream_id)
+        {
+            to_v2();
+            std::size_t header_size = get_header_size();
+            if (header_size < V2_STREAM_HEADER_SIZE)
+            {
+                m_raw_message.insert(m_raw_message.begin() + header_size, V2_STREAM_HEADER_SIZE - header_size, 0);
+                *reinterpret_cast<std::uint16_t*>(m_raw_message.data() + V2_HEADER_SIZE_OFFSET) = static_cast<std::uint16_t>(V2_STREAM_HEADER_SIZE);
+            }
+            *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_STREAM_ID_OFFSET) = stream_id;
+        }
+
+        bool message::is_chunked()
+        {
+            return get_message_type() == WRITE_FILE && (get_flags() & (FLAG_CHUNKED | FLAG_MULTICAST)) != 0;
+        }
+
+        bool message::is_multicast()
+        {
+            return get_message_type() == WRITE_FILE && (get_flags() & FLAG_MULTICAST) != 0;
+        }
+
+        bool message::has_streamed_body()
+        {
+            return get_message_type() == WRITE_FILE && !is_chunked() && (m_payload_file || (is_v2() && get_file_buffer_len() > STREAM_THRESHOLD));
+        }
+
         std::vector<std::uint8_t>& message::get_raw_message()
         {
             return m_raw_message;
@@ -91,59 +410,154 @@ namespace scft
 
         char* message::get_origin()
         {
-            return reinterpret_cast<char*>(m_raw_message.data() + DATA_OFFSET);
+            return reinterpret_cast<char*>(m_raw_message.data() + get_header_size());
         }
 
         char* message::get_string()
         {
-            return reinterpret_cast<char*>(m_raw_message.data() + DATA_OFFSET + get_origin_len());
+            return reinterpret_cast<char*>(m_raw_message.data() + get_header_size() + get_origin_len());
         }
 
         char* message::get_data()
         {
-            return reinterpret_cast<char*>(m_raw_message.data() + DATA_OFFSET);
+            return reinterpret_cast<char*>(m_raw_message.data() + get_header_size());
         }
 
         const std::uint8_t* message::get_file_buffer()
         {
-            if (get_message_type() != WRITE_FILE)
+            if (get_message_type() == CHUNK)
+                return reinterpret_cast<const std::uint8_t*>(get_string()) + 1;
+            if (get_message_type() == REPAIR)
+                return reinterpret_cast<const std::uint8_t*>(get_string()) + get_string_len() + 1;
+            if (get_message_type() != WRITE_FILE || has_streamed_body() || is_chunked())
                 return nullptr;
-            return m_raw_message.data() + DATA_OFFSET + get_origin_len() + std::strlen(get_string()) + 1;
+            return reinterpret_cast<const std::uint8_t*>(get_string()) + get_string_len() + 1;
         }
 
-        std::uint8_t message::get_origin_len()
+        std::uint16_t message::get_origin_len()
         {
+            if (is_v2())
+                return *reinterpret_cast<std::uint16_t*>(m_raw_message.data() + V2_ORIGIN_LEN_OFFSET);
             std::uint8_t origin_len = *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + ORIGIN_LEN_OFFSET);
             return origin_len;
         }
 
         std::uint32_t message::get_string_len()
         {
+            if (is_v2())
+                return *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_STRING_LEN_OFFSET) - 1;
             return std::strlen(get_string());
         }
 
-        std::uint32_t message::get_stringdata_len()
+        std::uint64_t message::get_stringdata_len()
         {
+            if (is_v2())
+                return *reinterpret_cast<std::uint64_t*>(m_raw_message.data() + V2_STRINGDATA_LEN_OFFSET);
             std::uint32_t stringdata_len = *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + STRINGDATA_LEN_OFFSET);
             return stringdata_len;
         }
 
-        std::uint32_t message::get_data_len()
+        std::uint64_t message::get_data_len()
         {
             return get_origin_len() + get_stringdata_len();
         }
 
-        std::uint32_t message::get_checksum()
+        std::size_t message::get_buffered_data_len()
+        {
+            if (has_streamed_body() || is_chunked())
+                return get_origin_len() + get_string_len() + 1;
+            return get_data_len();
+        }
+
+        std::uint64_t message::get_frame_len()
+        {
+            return get_header_size() + get_data_len();
+        }
+
+        std::uint64_t message::get_checksum()
         {
+            if (is_v2())
+                return *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_CHECKSUM_OFFSET)
+                    | static_cast<std::uint64_t>(*reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_CHECKSUM_HIGH_OFFSET)) << 32;
             std::uint32_t checksum = *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + CHECKSUM_OFFSET);
             return checksum;
         }
 
-        std::uint32_t message::get_file_buffer_len()
+        checksum::ALGORITHM message::get_checksum_algorithm()
+        {
+            if (!is_v2())
+                return checksum::CRC32;
+            return static_cast<checksum::ALGORITHM>(m_raw_message[V2_CHECKSUM_ALGORITHM_OFFSET]);
+        }
+
+        void message::set_checksum_algorithm(checksum::ALGORITHM algorithm)
+        {
+            if (algorithm != checksum::CRC32)
+                to_v2();
+            if (is_v2())
+                *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + V2_CHECKSUM_ALGORITHM_OFFSET) = algorithm;
+            update_checksum();
+        }
+
+        void message::set_checksum_algorithm(checksum::ALGORITHM algorithm, std::uint64_t _checksum)
+        {
+            if (algorithm != checksum::CRC32)
+                to_v2();
+            if (is_v2())
+                *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + V2_CHECKSUM_ALGORITHM_OFFSET) = algorithm;
+            set_checksum(_checksum);
+        }
+
+        void message::update_checksum()
+        {
+            checksum::hasher _hasher(get_checksum_algorithm());
+            _hasher.update(get_data(), get_buffered_data_len());
+            if (has_streamed_body())
+            {
+                if (!m_payload_file)
+                    throw std::logic_error("Streamed contents are not attached\n");
+                std::ifstream in_file{m_payload_file->get_path(), std::ios::in | std::ios::binary};
+                std::vector<std::uint8_t> buffer(FILE_READ_CHUNK);
+                for (std::uint64_t done = 0; done < m_payload_file->get_length();)
+                {
+                    std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(FILE_READ_CHUNK, m_payload_file->get_length() - done));
+                    if (!in_file.read(reinterpret_cast<char*>(buffer.data()), chunk))
+                        throw std::runtime_error("File shrank while reading\n");
+                    _hasher.update(buffer.data(), chunk);
+                    done += chunk;
+                }
+            }
+            set_checksum(_hasher.digest());
+        }
+
+        std::uint64_t message::get_file_buffer_len()
         {
-            if (get_message_type() != WRITE_FILE)
+            if (get_message_type() == CHUNK)
+                return get_stringdata_len() - 1;
+            if (get_message_type() != WRITE_FILE && get_message_type() != REPAIR)
                 return 0;
+            if (is_v2())
+                return get_stringdata_len() - *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_STRING_LEN_OFFSET);
             return get_stringdata_len() - std::strlen(get_string()) - 1;
         }
+
+        void message::set_origin_len(std::size_t origin_len)
+        {
+            if (is_v2())
+                *reinterpret_cast<std::uint16_t*>(m_raw_message.data() + V2_ORIGIN_LEN_OFFSET) = static_cast<std::uint16_t>(origin_len);
+            else
+                *reinterpret_cast<std::uint8_t*>(m_raw_message.data() + ORIGIN_LEN_OFFSET) = static_cast<std::uint8_t>(origin_len);
+        }
+
+        void message::set_checksum(std::uint64_t checksum)
+        {
+            if (is_v2())
+            {
+                *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_CHECKSUM_OFFSET) = static_cast<std::uint32_t>(checksum);
+                *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + V2_CHECKSUM_HIGH_OFFSET) = static_cast<std::uint32_t>(checksum >> 32);
+            }
+            else
+                *reinterpret_cast<std::uint32_t*>(m_raw_message.data() + CHECKSUM_OFFSET) = static_cast<std::uint32_t>(checksum);
+        }
     }
-}
\ No newline at end of file
+}
@@ -6,22 +6,50 @@
  * @brief Defines class message, to send structured information
 */
 
+#include "checksum.hpp"
 #include "crc32.hpp"
 
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <memory>
 
 /**
  * @brief SCFT General namespace
  * @verbatim
+ * Version 1, when the first byte has its high bit clear:
  * [1][2][0003][0004][ORIGIN...][STRINGDATA...]
  * 1: Identifier (MESSAGE_TYPE) 1 byte
  * 2: Origin length 1 byte
  * 3: Stringdata length 4 bytes
  * 4: CRC32 checksum 4 bytes
+ * Version 2, when the first byte has its high bit set, every field naturally aligned:
+ * [1][2][33][4444][55555555][6666][7777][88][9][0][AAAA][ORIGIN...][STRINGDATA...]
+ * 1: Identifier (MESSAGE_TYPE) | V2_TYPE_FLAG 1 byte
+ * 2: Version 1 byte
+ * 3: Header size 2 bytes, receivers skip header bytes they do not know
+ * 4: Flags 4 bytes
+ * 5: Stringdata length 8 bytes
+ * 6: String length (text or file name, with terminator) 4 bytes
+ * 7: Checksum, low half for 64 bit algorithms 4 bytes
+ * 8: Origin length 2 bytes
+ * 9: Checksum algorithm (checksum::ALGORITHM) 1 byte
+ * 0: Reserved 1 byte
+ * A: Checksum high half 4 bytes
+ * Headers of V2_STREAM_HEADER_SIZE and more extend it with:
+ * [BBBB][0000]
+ * B: Stream identifier, 0 for none 4 bytes
+ * 0: Reserved 4 bytes
+ * The checksum covers ORIGIN and STRINGDATA, version 1 headers always use CRC32
+ * ORIGIN is a null terminated string, optionally followed by a trace:
+ * [ORIGIN...\0][0005][0006]
+ * 5: Monotonic send time in nanoseconds 8 bytes
+ * 6: Trace identifier 8 bytes
+ * Origin length covers the trace, receivers reading ORIGIN as a string ignore it
  * @endverbatim
+ * How the message types are exchanged is described in README.md, section "Wire format"
 */
 namespace scft
 {
@@ -37,14 +65,97 @@ namespace scft
         {
             RESERVED = 0,   //!< No use
             TEXT = 1,       //!< Plain text
-            WRITE_FILE = 2  //!< File
+            WRITE_FILE = 2, //!< File
+            PING = 3,       //!< Round trip probe, answered to its sender only
+            PONG = 4,       //!< Answer to PING
+            HEARTBEAT = 5,  //!< Keeps an idle connection alive
+            NEGOTIATE = 6,  //!< Comma separated features and checksums, answered with those accepted
+            HISTORY = 7,    //!< Asks for the frames broadcast before its sender joined
+            CHUNK = 8,      //!< Next contents of a chunked WRITE_FILE
+            MULTICAST_END = 9,  //!< Every datagram of a multicast WRITE_FILE was sent
+            NACK = 10,      //!< Missing datagram ranges of a multicast WRITE_FILE
+            REPAIR = 11,    //!< Missing contents of a multicast WRITE_FILE
+            OFFER = 12,     //!< File its sender serves directly
+            FETCH = 13,     //!< Asks for an offered file
+            SESSION = 14,   //!< Resumes a session
+            ACK = 15        //!< Highest sequence number received
         }MESSAGE_TYPE;
 
         /**
-         * @brief Maximum message length 1G
+         * @brief Highest known message type
+        */
+        constexpr MESSAGE_TYPE LAST_MESSAGE_TYPE = ACK;
+
+        /**
+         * @brief Version 2 flag of frames replayed from the server history
+        */
+        constexpr std::uint32_t FLAG_REPLAYED = 0x1;
+
+        /**
+         * @brief Version 2 flag of a WRITE_FILE whose contents follow in CHUNK frames
+        */
+        constexpr std::uint32_t FLAG_CHUNKED = 0x2;
+
+        /**
+         * @brief Version 2 flag of a WRITE_FILE whose contents follow in multicast datagrams
+        */
+        constexpr std::uint32_t FLAG_MULTICAST = 0x4;
+
+        /**
+         * @brief Version 2 flag of a WRITE_FILE answering a FETCH
+        */
+        constexpr std::uint32_t FLAG_DIRECT = 0x8;
+
+        /**
+         * @brief Version 2 flag of a chunked WRITE_FILE whose CHUNK frames carry delta operations
+        */
+        constexpr std::uint32_t FLAG_DELTA = 0x10;
+
+        /**
+         * @brief Contents carried by one CHUNK frame when sending 64K
+        */
+        constexpr std::size_t STREAM_CHUNK_SIZE = 65536;
+
+        /**
+         * @brief Largest CHUNK contents accepted 1M
+        */
+        constexpr std::uint32_t MAX_CHUNK_LENGTH = 1048576;
+
+        /**
+         * @brief Largest REPAIR stringdata accepted, MAX_CHUNK_LENGTH and a 20 digit offset
+        */
+        constexpr std::uint32_t MAX_REPAIR_LENGTH = MAX_CHUNK_LENGTH + 21;
+
+        /**
+         * @brief Maximum length of the data kept in memory 1G
         */
         constexpr std::uint32_t MAX_DATA_LENGTH = 1073741824;
 
+        /**
+         * @brief Maximum stringdata length of a version 2 file 1T
+        */
+        constexpr std::uint64_t MAX_STREAM_LENGTH = 1099511627776ULL;
+
+        /**
+         * @brief File contents above this are streamed from and to disk instead of kept in memory 64M
+        */
+        constexpr std::uint64_t STREAM_THRESHOLD = 67108864;
+
+        /**
+         * @brief File contents are read and checksummed in chunks of this 256K
+        */
+        constexpr std::size_t FILE_READ_CHUNK = 262144;
+
+        /**
+         * @brief Set in the first byte of a version 2 header
+        */
+        constexpr std::uint8_t V2_TYPE_FLAG = 0x80;
+
+        /**
+         * @brief Version written in version 2 headers
+        */
+        constexpr std::uint8_t V2_VERSION = 2;
+
         /**
          * @brief Offset of identifier in a message
         */
@@ -71,10 +182,162 @@ namespace scft
         const std::uint32_t DATA_OFFSET = sizeof(std::uint8_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t) + sizeof(std::uint32_t);
 
         /**
-         * @brief Size of the header
+         * @brief Size of the header, and of the prefix read before knowing the version
         */
         const std::size_t HEADER_SIZE = sizeof(std::uint8_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t) + sizeof(std::uint32_t);
 
+        /**
+         * @brief Offset of the version 2 version
+        */
+        const std::uint32_t V2_VERSION_OFFSET = 1;
+
+        /**
+         * @brief Offset of the version 2 header size
+        */
+        const std::uint32_t V2_HEADER_SIZE_OFFSET = 2;
+
+        /**
+         * @brief Offset of the version 2 flags
+        */
+        const std::uint32_t V2_FLAGS_OFFSET = 4;
+
+        /**
+         * @brief Offset of the version 2 stringdata length
+        */
+        const std::uint32_t V2_STRINGDATA_LEN_OFFSET = 8;
+
+        /**
+         * @brief Offset of the version 2 string length
+        */
+        const std::uint32_t V2_STRING_LEN_OFFSET = 16;
+
+        /**
+         * @brief Offset of the version 2 CRC32 checksum
+        */
+        const std::uint32_t V2_CHECKSUM_OFFSET = 20;
+
+        /**
+         * @brief Offset of the version 2 origin length
+        */
+        const std::uint32_t V2_ORIGIN_LEN_OFFSET = 24;
+
+        /**
+         * @brief Offset of the version 2 checksum algorithm
+        */
+        const std::uint32_t V2_CHECKSUM_ALGORITHM_OFFSET = 26;
+
+        /**
+         * @brief Offset of the version 2 checksum high half
+        */
+        const std::uint32_t V2_CHECKSUM_HIGH_OFFSET = 28;
+
+        /**
+         * @brief Size of the version 2 header written by this version
+        */
+        const std::size_t V2_HEADER_SIZE = 32;
+
+        /**
+         * @brief Offset of the stream identifier in extended version 2 headers
+        */
+        const std::uint32_t V2_STREAM_ID_OFFSET = 32;
+
+        /**
+         * @brief Size of a version 2 header carrying a stream identifier
+        */
+        const std::size_t V2_STREAM_HEADER_SIZE = 40;
+
+        /**
+         * @brief Largest version 2 header accepted
+        */
+        const std::size_t MAX_HEADER_SIZE = 256;
+
+        /**
+         * @brief Size of the optional trace after the origin string
+        */
+        const std::size_t TRACE_SIZE = sizeof(std::uint64_t) + sizeof(std::uint64_t);
+
+        /**
+         * @brief Monotonic clock used for trace send times
+         * @return Nanoseconds since an unspecified epoch, comparable only on the same host
+        */
+        std::uint64_t get_monotonic_ns();
+
+        /**
+         * @brief Check if a frame is numbered, kept by its sender until acknowledged and sent again after a reconnect
+         * @param message_type Message type
+         * @param flags Version 2 flags
+         * @return False for SESSION, ACK and frames flagged FLAG_REPLAYED
+        */
+        bool is_sequenced(MESSAGE_TYPE message_type, std::uint32_t flags);
+
+        /**
+         * @brief Sequenced frames a receiver gets before sending an ACK, which bounds what its peer keeps
+        */
+        constexpr std::uint64_t ACK_INTERVAL = 32;
+
+        /**
+         * @brief Receive window a client advertises by default 4M
+        */
+        constexpr std::uint64_t DEFAULT_RECEIVE_WINDOW = 4194304;
+
+        /**
+         * @brief Smallest receive window honoured, smaller ones are raised to it 64K
+        */
+        constexpr std::uint64_t MIN_RECEIVE_WINDOW = 65536;
+
+        /**
+         * @brief Called while a file is read and checksummed
+         * @param done Bytes processed
+         * @param total File length
+         * @return False to stop, the constructor then throws std::runtime_error
+        */
+        typedef std::function<bool(std::uint64_t done, std::uint64_t total)> file_progress;
+
+        /**
+         * @brief File holding the contents of a streamed WRITE_FILE message
+        */
+        class payload_file
+        {
+            /**
+             * @brief Describe file range
+             * @param path File path
+             * @param length Contents length
+             * @param temporary Remove file once the last message referencing it is gone
+            */
+            public: payload_file(const std::string& path, std::uint64_t length, bool temporary);
+
+            /**
+             * @brief Removes the file if temporary
+            */
+            public: ~payload_file();
+
+            /**
+             * @brief Get file path
+             * @return File path
+            */
+            public: const std::string& get_path() const { return m_path; }
+
+            /**
+             * @brief Get contents length
+             * @return Length in bytes
+            */
+            public: std::uint64_t get_length() const { return m_length; }
+
+            /**
+             * @brief File path
+            */
+            private: std::string m_path;
+
+            /**
+             * @brief Contents length
+            */
+            private: std::uint64_t m_length;
+
+            /**
+             * @brief Remove on destruction
+            */
+            private: bool m_temporary;
+        };
 
         /**
          * @brief Message wrapper
@@ -89,26 +352,71 @@ namespace scft
 
             /**
              * @brief Creates message ready to send
-             * @param message_type Throw std::logic_error if it isn't TEXT or WRITE_FILE
+             * @param message_type Throw std::logic_error if it isn't TEXT, WRITE_FILE, PING, HEARTBEAT, NEGOTIATE, HISTORY, MULTICAST_END, NACK,
+             * OFFER or FETCH
              * @param address Sender address
              * @param port Sender port
              * @param _str Text or file name
+             * @param algorithm Checksum algorithm, anything but CRC32 needs a version 2 header
+             * @param progress Called after every read chunk of a WRITE_FILE, may be empty
+             * @param name File name receivers write to, a relative path with '/' separators, empty for the base name of _str
+            */
+            public: message(MESSAGE_TYPE message_type, const std::string& address, std::uint16_t port, const std::string& _str,
+                checksum::ALGORITHM algorithm = checksum::CRC32, const file_progress& progress = nullptr, const std::string& name = "");
+
+            /**
+             * @brief Creates a CHUNK frame, unchecked, its WRITE_FILE checksum covers the contents
+             * @param stream_id Stream of the chunked WRITE_FILE
+             * @param data Contents
+             * @param length Contents length, at most MAX_CHUNK_LENGTH
+            */
+            public: message(std::uint32_t stream_id, const std::uint8_t* data, std::size_t length);
+
+            /**
+             * @brief Creates a REPAIR frame, unchecked, its WRITE_FILE checksum covers the contents
+             * @param transfer_id Transfer of the multicast WRITE_FILE
+             * @param offset Offset of the contents in the file
+             * @param data Contents
+             * @param length Contents length, at most MAX_CHUNK_LENGTH
             */
-            public: message(MESSAGE_TYPE message_type, const std::string& address, std::uint16_t port, const std::string& _str);
+            public: message(std::uint32_t transfer_id, std::uint64_t offset, const std::uint8_t* data, std::size_t length);
 
             /**
              * @brief Intialize message as plain text
              * @param origin Sender string
              * @param text Plain text, accepts u8
+             * @param algorithm Checksum algorithm
             */
-            private: void init_as_text(const std::string& origin, const std::string& text);
+            private: void init_as_text(const std::string& origin, const std::string& text, checksum::ALGORITHM algorithm);
 
             /**
-             * @brief Initialize message as file
+             * @brief Initialize message as file, contents above STREAM_THRESHOLD stay on disk
+             * @note Reads and checksums the whole file with blocking reads, clients call it on their preparation threads
              * @param origin Sender string
              * @param filepath Path to file
+             * @param algorithm Checksum algorithm
+             * @param progress Chunk callback, may be empty
+             * @param name File name sent, empty for the base name of filepath
             */
-            private: void init_as_file(const std::string& origin, const std::string& filepath);
+            private: void init_as_file(const std::string& origin, const std::string& filepath, checksum::ALGORITHM algorithm,
+                const file_progress& progress, const std::string& name);
+
+            /**
+             * @brief Write header fields, version 1 if they fit in it, grows the buffer up to the header size
+             * @param message_type Message type
+             * @param origin_len Origin length
+             * @param stringdata_len Stringdata length
+             * @param string_len Text or file name length, with terminator
+             * @param force_v2 Use version 2 even if fields fit in version 1
+             * @param algorithm Checksum algorithm, version 2 unless CRC32
+            */
+            private: void write_header(
+                MESSAGE_TYPE message_type,
+                std::size_t origin_len,
+                std::uint64_t stringdata_len,
+                std::size_t string_len,
+                bool force_v2,
+                checksum::ALGORITHM algorithm);
 
             /**
              * @brief Default destructor
@@ -116,22 +424,139 @@ namespace scft
             public: ~message();
 
             /**
-             * @brief Check if header is valid
+             * @brief Size the buffer for the rest of the header, call once HEADER_SIZE bytes were read
+             * @return Header bytes left to read after HEADER_SIZE, 0 for version 1
+            */
+            public: std::size_t extend_header();
+
+            /**
+             * @brief Check if header is valid, call once the whole header was read
              * @return True if bad header, false if ok
             */
             public: bool bad_header();
 
             /**
-             * @brief Resizes buffer according to header
+             * @brief Resizes buffer according to header, streamed contents are not included
             */
             public: void adjust();
 
+            /**
+             * @brief Check header version
+             * @return True for version 2
+            */
+            public: bool is_v2();
+
+            /**
+             * @brief Returns header size
+             * @return HEADER_SIZE for version 1
+            */
+            public: std::size_t get_header_size();
+
             /**
              * @brief Returns message type
              * @return Message type
             */
             public: MESSAGE_TYPE get_message_type();
 
+            /**
+             * @brief Change message type, checksum does not cover it
+             * @param message_type New type
+            */
+            public: void set_message_type(MESSAGE_TYPE message_type);
+
+            /**
+             * @brief Returns header flags
+             * @return 0 for version 1
+            */
+            public: std::uint32_t get_flags();
+
+            /**
+             * @brief Set header flags, converts to version 2 if needed
+             * @param flags New flags
+            */
+            public: void set_flags(std::uint32_t flags);
+
+            /**
+             * @brief Returns stream identifier
+             * @return 0 if the header does not carry one
+            */
+            public: std::uint32_t get_stream_id();
+
+            /**
+             * @brief Set stream identifier, converts to version 2 and extends the header if needed
+             * @param stream_id New identifier
+            */
+            public: void set_stream_id(std::uint32_t stream_id);
+
+            /**
+             * @brief Check if file contents follow in other frames
+             * @return True for a WRITE_FILE flagged FLAG_CHUNKED or FLAG_MULTICAST
+            */
+            public: bool is_chunked();
+
+            /**
+             * @brief Check if file contents follow in multicast datagrams
+             * @return True for a WRITE_FILE flagged FLAG_MULTICAST
+            */
+            public: bool is_multicast();
+
+            /**
+             * @brief Replace the origin string, keeping a trace, after checking the checksum, which is then recomputed
+             * @param origin New origin
+             * @return False, leaving the message unchanged, if the checksum does not match the contents
+            */
+            public: bool set_origin(const std::string& origin);
+
+            /**
+             * @brief Replace the origin string, keeping a trace, and a checksum computed elsewhere
+             * @param origin New origin
+             * @param _checksum Checksum of the data with the new origin, e.g. computed while receiving streamed contents
+            */
+            public: void set_origin(const std::string& origin, std::uint64_t _checksum);
+
+            /**
+             * @brief Add or replace trace after origin, recomputes checksum
+             * @param send_time_ns Send time from get_monotonic_ns()
+             * @param trace_id Trace identifier
+            */
+            public: void set_trace(std::uint64_t send_time_ns, std::uint64_t trace_id);
+
+            /**
+             * @brief Check for a trace after origin
+             * @return True if origin carries a trace
+            */
+            public: bool has_trace();
+
+            /**
+             * @brief Returns trace send time
+             * @return 0 if there's no trace
+            */
+            public: std::uint64_t get_send_time();
+
+            /**
+             * @brief Returns trace identifier
+             * @return 0 if there's no trace
+            */
+            public: std::uint64_t get_trace_id();
+
+            /**
+             * @brief Check if file contents are streamed instead of kept in the buffer
+             * @return True for version 2 files above STREAM_THRESHOLD and files with an attached payload_file, false if chunked
+            */
+            public: bool has_streamed_body();
+
+            /**
+             * @brief File holding streamed contents
+             * @return nullptr if not set
+            */
+            public: std::shared_ptr<payload_file> get_payload_file() { return m_payload_file; }
+
+            /**
+             * @brief Attach file holding streamed contents
+             * @param _payload_file File, its length must be get_file_buffer_len(), the buffer then ends with the file name
+            */
+            public: void set_payload_file(std::shared_ptr<payload_file> _payload_file) { m_payload_file = _payload_file; }
+
             /**
              * @brief Return reference to internal buffer
              * @return Access to this class internal vector
@@ -157,8 +582,8 @@ namespace scft
             public: char* get_data();
 
             /**
-             * @brief Returns file buffer
-             * @return nullptr if there's no file buffer
+             * @brief Returns file buffer, or the contents of a CHUNK or REPAIR
+             * @return nullptr if there's no file buffer or if it is streamed or chunked
             */
             public: const std::uint8_t* get_file_buffer();
 
@@ -166,7 +591,7 @@ namespace scft
              * @brief Returns sender string
              * @return Length of origin
             */
-            public: std::uint8_t get_origin_len();
+            public: std::uint16_t get_origin_len();
 
             /**
              * @brief Returns file name or text length
@@ -178,32 +603,91 @@ namespace scft
              * @brief Returns length of text or (file name length + 1 + file size)
              * @return Stringdata length
             */
-            public: std::uint32_t get_stringdata_len();
+            public: std::uint64_t get_stringdata_len();
 
             /**
              * @brief Same as get_origin_len() + get_stringdata_len()
              * @return Length of the data (origin + stringdata)
             */
-            public: std::uint32_t get_data_len();
+            public: std::uint64_t get_data_len();
+
+            /**
+             * @brief Length of the data held in the buffer
+             * @return get_data_len() without streamed or chunked contents
+            */
+            public: std::size_t get_buffered_data_len();
+
+            /**
+             * @brief Whole frame length on the wire
+             * @return Header size + get_data_len()
+            */
+            public: std::uint64_t get_frame_len();
 
             /**
              * @brief Returns checksum
-             * @return CRC32 Checksum
+             * @return Checksum, 32 bit algorithms use the low half
+            */
+            public: std::uint64_t get_checksum();
+
+            /**
+             * @brief Returns checksum algorithm
+             * @return CRC32 for version 1, unknown identifiers are returned as is
+            */
+            public: checksum::ALGORITHM get_checksum_algorithm();
+
+            /**
+             * @brief Switch checksum algorithm and recompute the checksum, converts to version 2 unless CRC32
+             * @param algorithm New algorithm
+             * @note Streamed contents are read back from the payload file
             */
-            public: std::uint32_t get_checksum();
+            public: void set_checksum_algorithm(checksum::ALGORITHM algorithm);
+
+            /**
+             * @brief Switch checksum algorithm, keeping a checksum computed elsewhere
+             * @param algorithm New algorithm
+             * @param _checksum Checksum of the data with that algorithm, e.g. computed while receiving streamed contents
+            */
+            public: void set_checksum_algorithm(checksum::ALGORITHM algorithm, std::uint64_t _checksum);
 
             /**
              * @brief Get file length
-             * @return 0, if it does not contain a file
+             * @return 0, if it does not contain a file, chunk or repair
             */
-            public: std::uint32_t get_file_buffer_len();
+            public: std::uint64_t get_file_buffer_len();
+
+            /**
+             * @brief Rewrite a version 1 header as version 2, keeping data
+            */
+            private: void to_v2();
+
+            /**
+             * @brief Store origin length in the header
+             * @param origin_len New origin length
+            */
+            private: void set_origin_len(std::size_t origin_len);
+
+            /**
+             * @brief Store checksum in the header
+             * @param checksum Checksum, only the low half fits in version 1
+            */
+            private: void set_checksum(std::uint64_t checksum);
+
+            /**
+             * @brief Recompute checksum over data with the current algorithm
+            */
+            private: void update_checksum();
 
             /**
              * @brief Underlying buffer
             */
             private: std::vector<std::uint8_t> m_raw_message;
+
+            /**
+             * @brief Streamed contents, if any
+            */
+            private: std::shared_ptr<payload_file> m_payload_file;
         };
     }
 }
 
-#endif /* SCFT_MESSAGE_HPP */
\ No newline at end of file
+#endif /* SCFT_MESSAGE_HPP */
@@ -10,7 +10,8 @@ namespace scft
         :
         m_width(width),
         m_height(height),
-        recorded_lines_count(0)
+        recorded_lines_count(0),
+        m_sink(nullptr)
         {
             if (m_width < 1 || m_height < 1)
                 throw std::logic_error("Width and/or height cannot be lower than 1");
@@ -23,6 +24,12 @@ namespace scft
         void scrolling_log::append_log(const std::string& str)
         {
             lines_mutex.lock();
+            if (m_sink)
+            {
+                *m_sink << str;
+                if (!str.empty() && str.back() == '\n')
+                    m_sink->flush();
+            }
             for (const char& ch : str)
             {
                 if (cur_line.size() > m_width)
@@ -40,6 +47,13 @@ namespace scft
             lines_mutex.unlock();
         }
 
+        void scrolling_log::set_sink(std::ostream* sink)
+        {
+            lines_mutex.lock();
+            m_sink = sink;
+            lines_mutex.unlock();
+        }
+
         void scrolling_log::add_line(const std::string& str)
         {
             ++recorded_lines_count;
@@ -2,6 +2,7 @@
 #define SCROLLING_LOG_HPP
 
 #include <deque>
+#include <ostream>
 #include <string>
 #include <mutex>
 
@@ -37,6 +38,12 @@ namespace scft
             */
             public: void append_log(const std::string& str);
 
+            /**
+             * @brief Also write every entry, unwrapped, to a stream (headless mode)
+             * @param sink Stream to write to, nullptr to disable
+            */
+            public: void set_sink(std::ostream* sink);
+
             /**
              * @brief Add line
              * @param str String
@@ -96,6 +103,11 @@ namespace scft
              * @brief Prevent concurrent append_log() calls
             */
             private: std::mutex lines_mutex;
+
+            /**
+             * @brief Optional stream receiving unwrapped entries
+            */
+            private: std::ostream* m_sink;
         };
     }
 }
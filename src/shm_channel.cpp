@@ -0,0 +1,435 @@
+#include "shm_channel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(SCFT_SHM)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace scft
+{
+    namespace transport
+    {
+    #if defined(SCFT_SHM)
+        /**
+         * @brief Throw the last system error
+         * @param what Failed call
+        */
+        [[noreturn]] static void throw_errno(const std::string& what)
+        {
+            throw std::runtime_error(what + ": " + std::strerror(errno));
+        }
+
+        /**
+         * @brief Close descriptors that are open
+         * @param fds Descriptors, -1 for none
+        */
+        static void close_all(std::initializer_list<int> fds)
+        {
+            for (int fd : fds)
+                if (fd >= 0)
+                    ::close(fd);
+        }
+    #endif
+
+        shm_channel::shm_channel(const boost::asio::any_io_executor& executor, int memory_fd, std::uint64_t ring_size, int bell_fd, int peer_bell_fd, bool client)
+        :
+        m_executor(executor),
+        m_header(nullptr),
+        m_length(SHM_DATA_OFFSET + 2 * ring_size),
+        m_ring_size(ring_size),
+    #if defined(SCFT_SHM)
+        m_bell(executor, bell_fd),
+    #endif
+        m_peer_bell(peer_bell_fd),
+        m_sleeping(false),
+        m_open(true),
+        m_read_max(0),
+        m_read_done(0),
+        m_write_max(0),
+        m_write_done(0)
+        {
+        #if defined(SCFT_SHM)
+            void* mapping = ::mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+            ::close(memory_fd);
+            if (mapping == MAP_FAILED)
+            {
+                ::close(m_peer_bell);
+                throw_errno("mmap");
+            }
+            m_header = static_cast<shm_header*>(mapping);
+            std::uint8_t* data = static_cast<std::uint8_t*>(mapping) + SHM_DATA_OFFSET;
+            m_in = &m_header->rings[client ? 1 : 0];
+            m_in_data = data + (client ? m_ring_size : 0);
+            m_out = &m_header->rings[client ? 0 : 1];
+            m_out_data = data + (client ? 0 : m_ring_size);
+        #else
+            (void)memory_fd;
+            (void)bell_fd;
+            (void)client;
+            throw std::runtime_error("no shared memory transport on this platform");
+        #endif
+        }
+
+        shm_channel::~shm_channel()
+        {
+        #if defined(SCFT_SHM)
+            if (m_header)
+                ::munmap(m_header, m_length);
+            if (m_peer_bell >= 0)
+                ::close(m_peer_bell);
+        #endif
+        }
+
+        std::shared_ptr<shm_channel> shm_channel::offer(const boost::asio::any_io_executor& executor, int socket_fd, std::size_t ring_size)
+        {
+        #if defined(SCFT_SHM)
+            std::uint64_t size = SHM_MIN_RING_SIZE;
+            while (size < ring_size && size < SHM_MAX_RING_SIZE)
+                size <<= 1;
+            std::size_t length = SHM_DATA_OFFSET + 2 * size;
+
+            int memory_fd = ::memfd_create("scft-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (memory_fd < 0)
+                throw_errno("memfd_create");
+            if (::ftruncate(memory_fd, static_cast<off_t>(length)) != 0)
+            {
+                close_all({memory_fd});
+                throw_errno("ftruncate");
+            }
+            // A segment shrinking under the server's mapping would fault it, the server checks the seal
+            if (::fcntl(memory_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+            {
+                close_all({memory_fd});
+                throw_errno("fcntl F_ADD_SEALS");
+            }
+            void* mapping = ::mmap(nullptr, SHM_DATA_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close_all({memory_fd});
+                throw_errno("mmap");
+            }
+            shm_header* header = new (mapping) shm_header();
+            header->magic = SHM_MAGIC;
+            header->version = SHM_VERSION;
+            header->ring_size = size;
+            ::munmap(mapping, SHM_DATA_OFFSET);
+
+            // The first one wakes the server, the second one the client
+            int server_bell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            int client_bell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (server_bell < 0 || client_bell < 0)
+            {
+                close_all({memory_fd, server_bell, client_bell});
+                throw_errno("eventfd");
+            }
+
+            int fds[3] = {memory_fd, server_bell, client_bell};
+            char version = static_cast<char>(SHM_VERSION);
+            iovec data{&version, 1};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+            std::memset(control, 0, sizeof(control));
+            msghdr msg{};
+            msg.msg_iov = &data;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+            std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+            if (::sendmsg(socket_fd, &msg, MSG_NOSIGNAL) != 1)
+            {
+                close_all({memory_fd, server_bell, client_bell});
+                throw_errno("sendmsg");
+            }
+            return std::shared_ptr<shm_channel>(new shm_channel(executor, memory_fd, size, client_bell, server_bell, true));
+        #else
+            (void)executor;
+            (void)socket_fd;
+            (void)ring_size;
+            throw std::runtime_error("no shared memory transport on this platform");
+        #endif
+        }
+
+        std::shared_ptr<shm_channel> shm_channel::accept(const boost::asio::any_io_executor& executor, int socket_fd)
+        {
+        #if defined(SCFT_SHM)
+            std::vector<int> fds;
+            char version = 0;
+            iovec data{&version, 1};
+            alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))];
+            msghdr msg{};
+            msg.msg_iov = &data;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            ssize_t length = ::recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+            if (length < 0)
+                throw_errno("recvmsg");
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                    continue;
+                std::size_t offset = fds.size();
+                fds.resize(offset + (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                std::memcpy(fds.data() + offset, CMSG_DATA(cmsg), (fds.size() - offset) * sizeof(int));
+            }
+            if (length != 1 || version != static_cast<char>(SHM_VERSION) || fds.size() != 3 || (msg.msg_flags & MSG_CTRUNC))
+            {
+                for (int fd : fds)
+                    ::close(fd);
+                throw std::runtime_error("bad shared memory handshake");
+            }
+
+            // The client keeps writing to the segment, only trust what is checked here and copied
+            std::uint8_t prefix[16];
+            std::uint32_t magic = 0;
+            std::uint32_t segment_version = 0;
+            std::uint64_t ring_size = 0;
+            struct stat status;
+            int seals = ::fcntl(fds[0], F_GET_SEALS);
+            if (::pread(fds[0], prefix, sizeof(prefix), 0) == static_cast<ssize_t>(sizeof(prefix)))
+            {
+                std::memcpy(&magic, prefix, sizeof(magic));
+                std::memcpy(&segment_version, prefix + 4, sizeof(segment_version));
+                std::memcpy(&ring_size, prefix + 8, sizeof(ring_size));
+            }
+            if (magic != SHM_MAGIC || segment_version != SHM_VERSION
+                || ring_size < SHM_MIN_RING_SIZE || ring_size > SHM_MAX_RING_SIZE || (ring_size & (ring_size - 1)) != 0
+                || ::fstat(fds[0], &status) != 0 || static_cast<std::uint64_t>(status.st_size) != SHM_DATA_OFFSET + 2 * ring_size
+                || seals < 0 || (seals & F_SEAL_SHRINK) == 0)
+            {
+                close_all({fds[0], fds[1], fds[2]});
+                throw std::runtime_error("bad shared memory segment");
+            }
+            return std::shared_ptr<shm_channel>(new shm_channel(executor, fds[0], ring_size, fds[1], fds[2], false));
+        #else
+            (void)executor;
+            (void)socket_fd;
+            throw std::runtime_error("no shared memory transport on this platform");
+        #endif
+        }
+
+        void shm_channel::close(boost::system::error_code ec)
+        {
+            if (!m_open)
+                return;
+            m_open = false;
+        #if defined(SCFT_SHM)
+            boost::system::error_code ignored;
+            m_bell.close(ignored);
+        #endif
+            if (m_read_handler)
+                complete(m_read_handler, ec, 0);
+            if (m_write_handler)
+                complete(m_write_handler, ec == boost::asio::error::eof ? boost::asio::error::broken_pipe : ec, 0);
+            m_consumer = nullptr;
+            m_producer = nullptr;
+        }
+
+        void shm_channel::pump()
+        {
+            if (!m_open)
+            {
+                if (m_read_handler)
+                    complete(m_read_handler, boost::asio::error::bad_descriptor, 0);
+                if (m_write_handler)
+                    complete(m_write_handler, boost::asio::error::bad_descriptor, 0);
+                m_consumer = nullptr;
+                m_producer = nullptr;
+                return;
+            }
+            for (;;)
+            {
+                if (m_read_handler)
+                {
+                    std::uint64_t tail = m_in->tail.load(std::memory_order_relaxed);
+                    std::uint64_t available = m_in->head.load(std::memory_order_acquire) - tail;
+                    if (available > m_ring_size)
+                    {
+                        close(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                        return;
+                    }
+                    if (m_read_max == 0)
+                        complete(m_read_handler, boost::system::error_code(), 0);
+                    else if (available > 0)
+                    {
+                        std::uint64_t length = std::min<std::uint64_t>(available, m_read_max);
+                        std::uint64_t at = tail & (m_ring_size - 1);
+                        std::uint64_t first = std::min(length, m_ring_size - at);
+                        m_consumer(m_in_data + at, first);
+                        if (length > first)
+                            m_consumer(m_in_data, length - first);
+                        m_consumer = nullptr;
+                        m_in->tail.store(tail + length, std::memory_order_release);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        if (m_in->writer_idle.load(std::memory_order_relaxed) && m_in->writer_idle.exchange(0))
+                            ring_peer();
+                        complete(m_read_handler, boost::system::error_code(), length);
+                    }
+                }
+                if (m_write_handler)
+                {
+                    std::uint64_t head = m_out->head.load(std::memory_order_relaxed);
+                    std::uint64_t used = head - m_out->tail.load(std::memory_order_acquire);
+                    if (used > m_ring_size)
+                    {
+                        close(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                        return;
+                    }
+                    if (m_write_max == 0)
+                        complete(m_write_handler, boost::system::error_code(), 0);
+                    else if (used < m_ring_size)
+                    {
+                        std::uint64_t space = std::min<std::uint64_t>(m_ring_size - used, m_write_max);
+                        std::uint64_t at = head & (m_ring_size - 1);
+                        std::uint64_t first = std::min(space, m_ring_size - at);
+                        std::uint64_t length = m_producer(m_out_data + at, first);
+                        if (length == first && space > first)
+                            length += m_producer(m_out_data, space - first);
+                        m_producer = nullptr;
+                        if (length == 0)
+                        {
+                            complete(m_write_handler, boost::system::errc::make_error_code(boost::system::errc::io_error), 0);
+                            continue;
+                        }
+                        m_out->head.store(head + length, std::memory_order_release);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        if (m_out->reader_idle.load(std::memory_order_relaxed) && m_out->reader_idle.exchange(0))
+                            ring_peer();
+                        complete(m_write_handler, boost::system::error_code(), length);
+                    }
+                }
+                if (!m_read_handler && !m_write_handler)
+                    return;
+
+                // Announce the idle side, then look again so a peer that moved meanwhile is not missed
+                if (m_read_handler)
+                    m_in->reader_idle.store(1);
+                if (m_write_handler)
+                    m_out->writer_idle.store(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool readable = m_read_handler && m_in->head.load() != m_in->tail.load(std::memory_order_relaxed);
+                bool writable = m_write_handler && m_out->head.load(std::memory_order_relaxed) - m_out->tail.load() < m_ring_size;
+                if (!readable && !writable)
+                {
+                    sleep();
+                    return;
+                }
+            }
+        }
+
+        void shm_channel::async_consume(std::size_t max, consumer _consumer, io_handler handler)
+        {
+            m_read_max = max;
+            m_consumer = std::move(_consumer);
+            m_read_handler = std::move(handler);
+            pump();
+        }
+
+        void shm_channel::async_produce(std::size_t max, producer _producer, io_handler handler)
+        {
+            m_write_max = max;
+            m_producer = std::move(_producer);
+            m_write_handler = std::move(handler);
+            pump();
+        }
+
+        void shm_channel::copy_out(const std::uint8_t* data, std::size_t length)
+        {
+            std::size_t skip = m_read_done;
+            m_read_done += length;
+            for (const boost::asio::mutable_buffer& buffer : m_read_buffers)
+            {
+                if (skip >= buffer.size())
+                {
+                    skip -= buffer.size();
+                    continue;
+                }
+                std::size_t size = std::min(buffer.size() - skip, length);
+                std::memcpy(static_cast<std::uint8_t*>(buffer.data()) + skip, data, size);
+                data += size;
+                length -= size;
+                skip = 0;
+                if (length == 0)
+                    break;
+            }
+        }
+
+        std::size_t shm_channel::copy_in(std::uint8_t* data, std::size_t length)
+        {
+            std::size_t skip = m_write_done;
+            std::size_t copied = length;
+            m_write_done += length;
+            for (const boost::asio::const_buffer& buffer : m_write_buffers)
+            {
+                if (skip >= buffer.size())
+                {
+                    skip -= buffer.size();
+                    continue;
+                }
+                std::size_t size = std::min(buffer.size() - skip, length);
+                std::memcpy(data, static_cast<const std::uint8_t*>(buffer.data()) + skip, size);
+                data += size;
+                length -= size;
+                skip = 0;
+                if (length == 0)
+                    break;
+            }
+            return copied;
+        }
+
+        void shm_channel::complete(io_handler& handler, boost::system::error_code ec, std::size_t length)
+        {
+            boost::asio::post(m_executor,
+                [handler = std::move(handler), ec, length]()
+                {
+                    handler(ec, length);
+                });
+            handler = nullptr;
+        }
+
+        void shm_channel::ring_peer()
+        {
+        #if defined(SCFT_SHM)
+            std::uint64_t one = 1;
+            // A full counter means a wakeup is already pending
+            ssize_t written = ::write(m_peer_bell, &one, sizeof(one));
+            (void)written;
+        #endif
+        }
+
+        void shm_channel::sleep()
+        {
+        #if defined(SCFT_SHM)
+            if (m_sleeping)
+                return;
+            m_sleeping = true;
+            m_bell.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                [self = shared_from_this()](boost::system::error_code ec)
+                {
+                    self->m_sleeping = false;
+                    if (ec || !self->m_open)
+                        return;
+                    std::uint64_t count;
+                    ssize_t length = ::read(self->m_bell.native_handle(), &count, sizeof(count));
+                    (void)length;
+                    self->pump();
+                });
+        #endif
+        }
+    }
+}
@@ -0,0 +1,371 @@
+#ifndef SHM_CHANNEL_HPP
+#define SHM_CHANNEL_HPP
+
+/**
+ * @file src/shm_channel.hpp
+ * @brief Defines shm_channel, frames between a client and the server on the same host through shared memory rings
+*/
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__) && defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+#define SCFT_SHM 1
+#endif
+
+namespace scft
+{
+    namespace transport
+    {
+        /**
+         * @brief Default capacity of each ring 4M
+        */
+        constexpr std::size_t SHM_RING_SIZE = 4194304;
+
+        /**
+         * @brief Smallest ring capacity the server maps 64K
+        */
+        constexpr std::size_t SHM_MIN_RING_SIZE = 65536;
+
+        /**
+         * @brief Largest ring capacity the server maps 64M
+        */
+        constexpr std::size_t SHM_MAX_RING_SIZE = 67108864;
+
+        /**
+         * @brief First word of a segment
+        */
+        constexpr std::uint32_t SHM_MAGIC = 0x53434654;
+
+        /**
+         * @brief Layout version of a segment
+        */
+        constexpr std::uint32_t SHM_VERSION = 1;
+
+        /**
+         * @brief One direction of a segment, a single producer and a single consumer
+         * @verbatim
+         * head and tail count bytes since the segment was created, the data is at (count % ring_size).
+         * The consumer sets reader_idle before sleeping on its eventfd, the producer only signals it then,
+         * likewise writer_idle when the ring was full. Busy sides never make a system call.
+         * @endverbatim
+        */
+        struct shm_ring
+        {
+            alignas(64) std::atomic<std::uint64_t> head;        //!< Bytes written, advanced by the producer
+            alignas(64) std::atomic<std::uint64_t> tail;        //!< Bytes read, advanced by the consumer
+            alignas(64) std::atomic<std::uint32_t> reader_idle; //!< The consumer sleeps until signaled
+            alignas(64) std::atomic<std::uint32_t> writer_idle; //!< The producer waits for space until signaled
+        };
+
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory rings need lock free 64 bit atomics");
+
+        /**
+         * @brief Start of a segment, the ring data follows at SHM_DATA_OFFSET
+        */
+        struct shm_header
+        {
+            std::uint32_t magic;                                //!< SHM_MAGIC
+            std::uint32_t version;                              //!< SHM_VERSION
+            std::uint64_t ring_size;                            //!< Capacity of each ring, a power of two
+            shm_ring rings[2];                                  //!< Client to server, then server to client
+        };
+
+        /**
+         * @brief Offset of the first ring data in a segment
+        */
+        constexpr std::size_t SHM_DATA_OFFSET = 4096;
+
+        static_assert(sizeof(shm_header) <= SHM_DATA_OFFSET, "shared memory header overlaps the ring data");
+
+        /**
+         * @brief Byte stream over a pair of shared memory rings, not thread safe, use it from the io thread
+         * @note One read and one write may be pending at once, like on a socket
+        */
+        class shm_channel : public std::enable_shared_from_this<shm_channel>
+        {
+            /**
+             * @brief Completion handler of a read or write
+            */
+            public: typedef std::function<void(boost::system::error_code ec, std::size_t length)> io_handler;
+
+            /**
+             * @brief Create a segment and hand it to the server over a connected Unix domain socket
+             * @param _socket Socket connected to the server's shared memory listener
+             * @param ring_size Capacity of each ring, rounded up to a power of two
+             * @return Client end
+             * @note Throws std::runtime_error on failure, or if the platform has no shared memory transport
+            */
+            public: template <typename Socket>
+            static std::shared_ptr<shm_channel> offer(Socket& _socket, std::size_t ring_size)
+            {
+                return offer(_socket.get_executor(), _socket.native_handle(), ring_size);
+            }
+
+            /**
+             * @brief Map the segment a client handed over a Unix domain socket, once the socket is readable
+             * @param _socket Accepted socket
+             * @return Server end
+             * @note Throws std::runtime_error on failure, or if the platform has no shared memory transport
+            */
+            public: template <typename Socket>
+            static std::shared_ptr<shm_channel> accept(Socket& _socket)
+            {
+                return accept(_socket.get_executor(), _socket.native_handle());
+            }
+
+            /**
+             * @brief Unmap the segment
+            */
+            public: ~shm_channel();
+
+            /**
+             * @brief Check if the channel is usable
+             * @return False once closed
+            */
+            public: bool is_open() const { return m_open; }
+
+            /**
+             * @brief Fail pending operations, the peer notices once the socket the segment came over closes
+             * @param ec Error pending operations complete with
+            */
+            public: void close(boost::system::error_code ec = boost::asio::error::operation_aborted);
+
+            /**
+             * @brief Reads bytes in place, from ring memory, before their space is handed back to the producer
+            */
+            public: typedef std::function<void(const std::uint8_t* data, std::size_t length)> consumer;
+
+            /**
+             * @brief Writes bytes in place, into ring memory, before they are published
+             * @return Bytes written, fewer than length ends the operation, none fails it
+            */
+            public: typedef std::function<std::size_t(std::uint8_t* data, std::size_t length)> producer;
+
+            /**
+             * @brief Read at least one byte, handler runs on the executor
+             * @param buffers Destination
+             * @param handler Completion handler
+            */
+            public: template <typename MutableBufferSequence>
+            void async_read_some(const MutableBufferSequence& buffers, io_handler handler)
+            {
+                m_read_buffers.assign(boost::asio::buffer_sequence_begin(buffers), boost::asio::buffer_sequence_end(buffers));
+                m_read_done = 0;
+                async_consume(boost::asio::buffer_size(m_read_buffers),
+                    [this](const std::uint8_t* data, std::size_t length) { copy_out(data, length); },
+                    std::move(handler));
+            }
+
+            /**
+             * @brief Write at least one byte, handler runs on the executor
+             * @param buffers Source
+             * @param handler Completion handler
+            */
+            public: template <typename ConstBufferSequence>
+            void async_write_some(const ConstBufferSequence& buffers, io_handler handler)
+            {
+                m_write_buffers.assign(boost::asio::buffer_sequence_begin(buffers), boost::asio::buffer_sequence_end(buffers));
+                m_write_done = 0;
+                async_produce(boost::asio::buffer_size(m_write_buffers),
+                    [this](std::uint8_t* data, std::size_t length) { return copy_in(data, length); },
+                    std::move(handler));
+            }
+
+            /**
+             * @brief Read at least one byte in place, so large contents go from the ring to their file without a copy
+             * @param max Bytes to read at most
+             * @param _consumer Called with one or two ring segments, from the io thread
+             * @param handler Completion handler, runs on the executor
+            */
+            public: void async_consume(std::size_t max, consumer _consumer, io_handler handler);
+
+            /**
+             * @brief Write at least one byte in place, so large contents go from their file to the ring without a copy
+             * @param max Bytes to write at most
+             * @param _producer Called with one or two ring segments, from the io thread
+             * @param handler Completion handler, runs on the executor, io_error if the producer wrote nothing
+            */
+            public: void async_produce(std::size_t max, producer _producer, io_handler handler);
+
+            /**
+             * @brief Map a segment
+             * @param executor Executor of the owning socket
+             * @param memory_fd Segment, closed once mapped
+             * @param ring_size Capacity of each ring
+             * @param bell_fd Eventfd this end sleeps on, owned from now on
+             * @param peer_bell_fd Eventfd waking the peer, owned from now on
+             * @param client True for the client end
+             * @note Throws std::runtime_error if mapping fails
+            */
+            private: shm_channel(const boost::asio::any_io_executor& executor, int memory_fd, std::uint64_t ring_size, int bell_fd, int peer_bell_fd, bool client);
+
+            /**
+             * @brief See offer()
+            */
+            private: static std::shared_ptr<shm_channel> offer(const boost::asio::any_io_executor& executor, int socket_fd, std::size_t ring_size);
+
+            /**
+             * @brief See accept()
+            */
+            private: static std::shared_ptr<shm_channel> accept(const boost::asio::any_io_executor& executor, int socket_fd);
+
+            /**
+             * @brief Move bytes for the pending operations, sleep on the eventfd for those that can not progress
+            */
+            private: void pump();
+
+            /**
+             * @brief Post the completion of an operation
+             * @param handler Handler, empty afterwards
+             * @param ec Result
+             * @param length Bytes transferred
+            */
+            private: void complete(io_handler& handler, boost::system::error_code ec, std::size_t length);
+
+            /**
+             * @brief Copy ring bytes to the pending read buffers
+             * @param data Ring segment
+             * @param length Segment length
+            */
+            private: void copy_out(const std::uint8_t* data, std::size_t length);
+
+            /**
+             * @brief Copy the pending write buffers to the ring
+             * @param data Ring segment
+             * @param length Segment length
+             * @return length
+            */
+            private: std::size_t copy_in(std::uint8_t* data, std::size_t length);
+
+            /**
+             * @brief Wake the peer
+            */
+            private: void ring_peer();
+
+            /**
+             * @brief Wait for the peer to ring, then pump
+            */
+            private: void sleep();
+
+            /**
+             * @brief Executor handlers run on
+            */
+            private: boost::asio::any_io_executor m_executor;
+
+            /**
+             * @brief Mapped segment
+            */
+            private: shm_header* m_header;
+
+            /**
+             * @brief Mapped length
+            */
+            private: std::size_t m_length;
+
+            /**
+             * @brief Ring read from
+            */
+            private: shm_ring* m_in;
+
+            /**
+             * @brief Data of m_in
+            */
+            private: const std::uint8_t* m_in_data;
+
+            /**
+             * @brief Ring written to
+            */
+            private: shm_ring* m_out;
+
+            /**
+             * @brief Data of m_out
+            */
+            private: std::uint8_t* m_out_data;
+
+            /**
+             * @brief Capacity of each ring
+            */
+            private: std::uint64_t m_ring_size;
+
+#if defined(SCFT_SHM)
+            /**
+             * @brief Eventfd this end sleeps on
+            */
+            private: boost::asio::posix::stream_descriptor m_bell;
+#endif
+
+            /**
+             * @brief Eventfd waking the peer
+            */
+            private: int m_peer_bell;
+
+            /**
+             * @brief Waiting on m_bell
+            */
+            private: bool m_sleeping;
+
+            /**
+             * @brief Not closed
+            */
+            private: bool m_open;
+
+            /**
+             * @brief Bytes the pending read takes at most
+            */
+            private: std::size_t m_read_max;
+
+            /**
+             * @brief Consumer of the pending read
+            */
+            private: consumer m_consumer;
+
+            /**
+             * @brief Handler of the pending read, empty if none
+            */
+            private: io_handler m_read_handler;
+
+            /**
+             * @brief Destination of async_read_some
+            */
+            private: std::vector<boost::asio::mutable_buffer> m_read_buffers;
+
+            /**
+             * @brief Bytes of m_read_buffers filled
+            */
+            private: std::size_t m_read_done;
+
+            /**
+             * @brief Bytes the pending write gives at most
+            */
+            private: std::size_t m_write_max;
+
+            /**
+             * @brief Producer of the pending write
+            */
+            private: producer m_producer;
+
+            /**
+             * @brief Handler of the pending write, empty if none
+            */
+            private: io_handler m_write_handler;
+
+            /**
+             * @brief Source of async_write_some
+            */
+            private: std::vector<boost::asio::const_buffer> m_write_buffers;
+
+            /**
+             * @brief Bytes of m_write_buffers taken
+            */
+            private: std::size_t m_write_done;
+        };
+    }
+}
+
+#endif /* SHM_CHANNEL_HPP */
@@ -0,0 +1,99 @@
+#include "timer_wheel.hpp"
+
+namespace scft
+{
+    namespace timer
+    {
+        timer_wheel::timer_wheel(boost::asio::io_context& io_ctx, std::chrono::milliseconds tick)
+        :
+        m_timer(io_ctx),
+        m_tick(tick),
+        m_tick_time(std::chrono::steady_clock::now()),
+        m_now(0),
+        m_size(0)
+        {
+            arm();
+        }
+
+        timer_wheel::~timer_wheel()
+        {
+        }
+
+        void timer_wheel::schedule(std::chrono::steady_clock::duration delay, callback fn)
+        {
+            // Round up from the current tick, the wheel may be up to one tick behind the clock
+            std::chrono::steady_clock::duration ahead = delay + (std::chrono::steady_clock::now() - m_tick_time);
+            std::uint64_t ticks = (ahead.count() + m_tick.count() - 1) / m_tick.count();
+            m_size++;
+            place(entry{m_now + (ticks == 0 ? 1 : ticks), std::move(fn)});
+        }
+
+        void timer_wheel::stop()
+        {
+            m_timer.cancel();
+            for (std::array<std::vector<entry>, WHEEL_SIZE>& level : m_slots)
+                for (std::vector<entry>& slot : level)
+                    slot.clear();
+            m_size = 0;
+        }
+
+        void timer_wheel::place(entry _entry)
+        {
+            // Entries due now only come from cascading, which runs before the current slot fires
+            if (_entry.deadline < m_now)
+                _entry.deadline = m_now;
+            std::uint64_t delta = _entry.deadline - m_now;
+            for (std::size_t level = 0; level < WHEEL_LEVELS; level++)
+            {
+                if (delta < (std::uint64_t(1) << (WHEEL_BITS * (level + 1))))
+                {
+                    m_slots[level][(_entry.deadline >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)].push_back(std::move(_entry));
+                    return;
+                }
+            }
+            _entry.deadline = m_now + (std::uint64_t(1) << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+            m_slots[WHEEL_LEVELS - 1][(_entry.deadline >> (WHEEL_BITS * (WHEEL_LEVELS - 1))) & (WHEEL_SIZE - 1)].push_back(std::move(_entry));
+        }
+
+        void timer_wheel::arm()
+        {
+            m_timer.expires_at(m_tick_time + m_tick);
+            m_timer.async_wait(
+                [this](boost::system::error_code ec)
+                {
+                    if (ec)
+                        return;
+                    // Catch up if the io thread was busy for several ticks
+                    while (m_tick_time + m_tick <= std::chrono::steady_clock::now())
+                    {
+                        m_tick_time += m_tick;
+                        advance();
+                    }
+                    arm();
+                });
+        }
+
+        void timer_wheel::advance()
+        {
+            m_now++;
+
+            // Redistribute coarser slots reaching their turn, highest level first so entries can fall through
+            std::size_t top = 0;
+            while (top + 1 < WHEEL_LEVELS && (m_now & ((std::uint64_t(1) << (WHEEL_BITS * (top + 1))) - 1)) == 0)
+                top++;
+            for (std::size_t level = top; level > 0; level--)
+            {
+                std::vector<entry> cascaded;
+                cascaded.swap(m_slots[level][(m_now >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)]);
+                for (entry& cur_entry : cascaded)
+                    place(std::move(cur_entry));
+            }
+
+            std::vector<entry> due;
+            due.swap(m_slots[0][m_now & (WHEEL_SIZE - 1)]);
+            m_size -= due.size();
+            for (entry& cur_entry : due)
+                cur_entry.fn();
+        }
+    }
+}
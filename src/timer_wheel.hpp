@@ -0,0 +1,143 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+/**
+ * @file src/timer_wheel.hpp
+ * @brief Defines timer_wheel, many coarse timers driven by one steady_timer
+*/
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace scft
+{
+    /**
+     * @brief Timers
+    */
+    namespace timer
+    {
+        /**
+         * @brief log2 of the slot count of a level
+        */
+        constexpr unsigned int WHEEL_BITS = 6;
+
+        /**
+         * @brief Slots per level
+        */
+        constexpr std::size_t WHEEL_SIZE = std::size_t(1) << WHEEL_BITS;
+
+        /**
+         * @brief Levels, each one WHEEL_SIZE times coarser than the previous
+        */
+        constexpr std::size_t WHEEL_LEVELS = 4;
+
+        /**
+         * @brief Hierarchical timer wheel, not thread safe, use it from the thread running its io context
+         * @verbatim
+         * Level 0 holds timers due in the next WHEEL_SIZE ticks, one slot per tick.
+         * Level N holds timers due within WHEEL_SIZE^(N+1) ticks, one slot per WHEEL_SIZE^N ticks,
+         * its slots are redistributed to lower levels when level N-1 wraps around.
+         * Timers further than the last level are clamped to it.
+         * @endverbatim
+        */
+        class timer_wheel
+        {
+            /**
+             * @brief Called once the delay elapsed
+            */
+            public: typedef std::function<void()> callback;
+
+            /**
+             * @brief Start ticking
+             * @param io_ctx boost io context
+             * @param tick Resolution, timers fire up to one tick late
+            */
+            public: timer_wheel(boost::asio::io_context& io_ctx, std::chrono::milliseconds tick);
+
+            /**
+             * @brief Default destructor
+            */
+            public: ~timer_wheel();
+
+            /**
+             * @brief Call fn after delay, there is no cancellation, callbacks check if they are still wanted
+             * @param delay Delay, rounded up to the tick
+             * @param fn Callback
+            */
+            public: void schedule(std::chrono::steady_clock::duration delay, callback fn);
+
+            /**
+             * @brief Stop ticking, pending callbacks are dropped
+            */
+            public: void stop();
+
+            /**
+             * @brief Pending timers
+             * @return Count
+            */
+            public: std::size_t size() const { return m_size; }
+
+            /**
+             * @brief Pending timer
+            */
+            private: struct entry
+            {
+                std::uint64_t deadline;     //!< Tick at which to fire
+                callback fn;                //!< Callback
+            };
+
+            /**
+             * @brief Put entry in the slot matching its distance to now
+             * @param _entry Entry
+            */
+            private: void place(entry _entry);
+
+            /**
+             * @brief Arm steady_timer for next tick
+            */
+            private: void arm();
+
+            /**
+             * @brief Advance one tick, cascade and fire due slot
+            */
+            private: void advance();
+
+            /**
+             * @brief Drives the wheel
+            */
+            private: boost::asio::steady_timer m_timer;
+
+            /**
+             * @brief Resolution
+            */
+            private: std::chrono::steady_clock::duration m_tick;
+
+            /**
+             * @brief Time of the current tick
+            */
+            private: std::chrono::steady_clock::time_point m_tick_time;
+
+            /**
+             * @brief Current tick
+            */
+            private: std::uint64_t m_now;
+
+            /**
+             * @brief Pending timers
+            */
+            private: std::size_t m_size;
+
+            /**
+             * @brief Slots by level
+            */
+            private: std::array<std::array<std::vector<entry>, WHEEL_SIZE>, WHEEL_LEVELS> m_slots;
+        };
+    }
+}
+
+#endif /* TIMER_WHEEL_HPP */
@@ -0,0 +1,128 @@
+#include "transport.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace scft
+{
+    namespace transport
+    {
+        /**
+         * @brief Copy a TCP endpoint out of a generic one
+         * @param _endpoint AF_INET or AF_INET6 endpoint
+         * @return TCP endpoint
+        */
+        static boost::asio::ip::tcp::endpoint to_tcp(const endpoint& _endpoint)
+        {
+            boost::asio::ip::tcp::endpoint tcp_endpoint;
+            std::memcpy(tcp_endpoint.data(), _endpoint.data(), std::min(_endpoint.size(), tcp_endpoint.capacity()));
+            return tcp_endpoint;
+        }
+
+        bool is_local(const endpoint& _endpoint)
+        {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+            return _endpoint.protocol().family() == AF_UNIX;
+#else
+            return false;
+#endif
+        }
+
+        std::string get_address(const endpoint& _endpoint)
+        {
+            if (is_local(_endpoint))
+                return LOCAL_ADDRESS;
+            return to_tcp(_endpoint).address().to_string();
+        }
+
+        std::uint16_t get_port(const endpoint& _endpoint)
+        {
+            if (is_local(_endpoint))
+                return 0;
+            return to_tcp(_endpoint).port();
+        }
+
+        std::string describe(const endpoint& _endpoint)
+        {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+            if (is_local(_endpoint))
+            {
+                boost::asio::local::stream_protocol::endpoint local_endpoint;
+                std::memcpy(local_endpoint.data(), _endpoint.data(), std::min(_endpoint.size(), local_endpoint.capacity()));
+                local_endpoint.resize(_endpoint.size());
+                return local_endpoint.path().empty() ? std::string(LOCAL_ADDRESS) : local_endpoint.path();
+            }
+#endif
+            return get_address(_endpoint) + ':' + std::to_string(get_port(_endpoint));
+        }
+
+        endpoint make_local_endpoint(const std::string& path)
+        {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+            return endpoint(boost::asio::local::stream_protocol::endpoint(path));
+#else
+            throw std::runtime_error("no Unix domain sockets on this platform");
+#endif
+        }
+
+        void set_no_delay(socket& _socket, bool enabled)
+        {
+            boost::system::error_code ec;
+            endpoint local = _socket.local_endpoint(ec);
+            if (!ec && !is_local(local))
+                _socket.set_option(boost::asio::ip::tcp::no_delay(enabled), ec);
+        }
+
+        stream::stream(const executor_type& executor)
+        :
+        m_socket(executor)
+        {
+        }
+
+        stream::stream(socket _socket)
+        :
+        m_socket(std::move(_socket))
+        {
+        }
+
+        stream::~stream()
+        {
+            if (m_shm)
+                m_shm->close();
+        }
+
+        void stream::attach(std::shared_ptr<shm_channel> channel)
+        {
+            m_shm = std::move(channel);
+            // Nothing else is sent over the socket, it becomes readable when the peer closes it
+            m_socket.async_wait(socket::wait_read,
+                [channel = m_shm](boost::system::error_code ec)
+                {
+                    if (ec != boost::asio::error::operation_aborted)
+                        channel->close(boost::asio::error::eof);
+                });
+        }
+
+        void stream::close(boost::system::error_code& ec)
+        {
+            if (m_shm)
+                m_shm->close();
+            m_socket.close(ec);
+        }
+
+        void stream::close()
+        {
+            if (m_shm)
+                m_shm->close();
+            m_socket.close();
+        }
+
+        void stream::reset()
+        {
+            boost::system::error_code ec;
+            close(ec);
+            m_shm.reset();
+        }
+    }
+}
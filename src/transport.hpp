@@ -0,0 +1,233 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+/**
+ * @file src/transport.hpp
+ * @brief Defines the stream socket shared by TCP and Unix domain connections, shared by server and client
+*/
+
+#include "shm_channel.hpp"
+
+#include <boost/asio.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace scft
+{
+    /**
+     * @brief Stream sockets, TCP or AF_UNIX, frames are the same on both
+    */
+    namespace transport
+    {
+        /**
+         * @brief Connected socket of either family
+        */
+        typedef boost::asio::generic::stream_protocol::socket socket;
+
+        /**
+         * @brief Endpoint of either family
+        */
+        typedef boost::asio::generic::stream_protocol::endpoint endpoint;
+
+        /**
+         * @brief Listening socket of either family
+        */
+        typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> acceptor;
+
+        /**
+         * @brief Address of Unix domain peers in logs, origins and metric labels
+        */
+        constexpr const char* LOCAL_ADDRESS = "local";
+
+        /**
+         * @brief Check the family of an endpoint
+         * @param _endpoint Endpoint
+         * @return True for AF_UNIX
+        */
+        bool is_local(const endpoint& _endpoint);
+
+        /**
+         * @brief Address of an endpoint
+         * @param _endpoint Endpoint
+         * @return IP of a TCP endpoint, LOCAL_ADDRESS for AF_UNIX
+        */
+        std::string get_address(const endpoint& _endpoint);
+
+        /**
+         * @brief Port of an endpoint
+         * @param _endpoint Endpoint
+         * @return Port of a TCP endpoint, 0 for AF_UNIX
+        */
+        std::uint16_t get_port(const endpoint& _endpoint);
+
+        /**
+         * @brief Describe an endpoint for logs
+         * @param _endpoint Endpoint
+         * @return "IP:PORT", or the socket path
+        */
+        std::string describe(const endpoint& _endpoint);
+
+        /**
+         * @brief Endpoint of a Unix domain socket
+         * @param path Socket path
+         * @return Endpoint
+         * @note Throws std::runtime_error if the platform has no Unix domain sockets
+        */
+        endpoint make_local_endpoint(const std::string& path);
+
+        /**
+         * @brief Set TCP_NODELAY, nothing for AF_UNIX which does not batch
+         * @param _socket Connected socket
+         * @param enabled True to disable Nagle's algorithm
+        */
+        void set_no_delay(socket& _socket, bool enabled);
+
+        /**
+         * @brief Connection carrying frames over its socket, or over shared memory rings once attached
+         * @note Models asio's AsyncReadStream and AsyncWriteStream for callback handlers
+        */
+        class stream
+        {
+            /**
+             * @brief Executor of the socket
+            */
+            public: typedef socket::executor_type executor_type;
+
+            /**
+             * @brief Unconnected stream
+             * @param executor Executor handlers run on
+            */
+            public: explicit stream(const executor_type& executor);
+
+            /**
+             * @brief Stream over a connected socket
+             * @param _socket Socket
+            */
+            public: explicit stream(socket _socket);
+
+            /**
+             * @brief Move constructor
+            */
+            public: stream(stream&&) = default;
+
+            /**
+             * @brief Close the shared memory channel, whose wakeup wait would keep it alive
+            */
+            public: ~stream();
+
+            /**
+             * @brief Carry frames over shared memory from now on, the socket only tells when the peer is gone
+             * @param channel Channel whose segment came over the socket
+            */
+            public: void attach(std::shared_ptr<shm_channel> channel);
+
+            /**
+             * @brief Check if frames go over shared memory
+             * @return True once attached
+            */
+            public: bool is_shm() const { return static_cast<bool>(m_shm); }
+
+            /**
+             * @brief Shared memory rings, to read or write large contents in place
+             * @return Channel, null over the socket
+            */
+            public: shm_channel* get_shm() { return m_shm.get(); }
+
+            /**
+             * @brief Socket, to connect, set options or read endpoints
+             * @return Socket
+            */
+            public: socket& get_socket() { return m_socket; }
+
+            /**
+             * @brief Executor handlers run on
+             * @return Executor
+            */
+            public: executor_type get_executor() { return m_socket.get_executor(); }
+
+            /**
+             * @brief Check if the stream is usable
+             * @return False once closed or, over shared memory, once the peer is gone
+            */
+            public: bool is_open() const { return m_socket.is_open() && (!m_shm || m_shm->is_open()); }
+
+            /**
+             * @brief Close, pending operations complete with an error
+             * @param ec Error closing the socket
+            */
+            public: void close(boost::system::error_code& ec);
+
+            /**
+             * @brief Close, pending operations complete with an error, throws boost::system::system_error
+            */
+            public: void close();
+
+            /**
+             * @brief Close and detach the shared memory channel, the socket may then connect again
+            */
+            public: void reset();
+
+            /**
+             * @brief Remote endpoint of the socket
+             * @param ec Error
+             * @return Endpoint
+            */
+            public: endpoint remote_endpoint(boost::system::error_code& ec) const { return m_socket.remote_endpoint(ec); }
+
+            /**
+             * @brief Read at least one byte
+             * @param buffers Destination
+             * @param handler Completion handler
+            */
+            public: template <typename MutableBufferSequence, typename ReadHandler>
+            void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+            {
+                if (m_shm)
+                    m_shm->async_read_some(buffers, erase(std::forward<ReadHandler>(handler)));
+                else
+                    m_socket.async_read_some(buffers, std::forward<ReadHandler>(handler));
+            }
+
+            /**
+             * @brief Write at least one byte
+             * @param buffers Source
+             * @param handler Completion handler
+            */
+            public: template <typename ConstBufferSequence, typename WriteHandler>
+            void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+            {
+                if (m_shm)
+                    m_shm->async_write_some(buffers, erase(std::forward<WriteHandler>(handler)));
+                else
+                    m_socket.async_write_some(buffers, std::forward<WriteHandler>(handler));
+            }
+
+            /**
+             * @brief Type erase a handler, asio's composed operations are move only
+             * @param handler Handler
+             * @return Copyable handler
+            */
+            private: template <typename Handler>
+            static shm_channel::io_handler erase(Handler&& handler)
+            {
+                std::shared_ptr<std::decay_t<Handler>> held = std::make_shared<std::decay_t<Handler>>(std::forward<Handler>(handler));
+                return [held](boost::system::error_code ec, std::size_t length) { (*held)(ec, length); };
+            }
+
+            /**
+             * @brief Socket, the shared memory handshake one once attached
+            */
+            private: socket m_socket;
+
+            /**
+             * @brief Shared memory rings, null over the socket
+            */
+            private: std::shared_ptr<shm_channel> m_shm;
+        };
+    }
+}
+
+#endif /* TRANSPORT_HPP */